@@ -17,6 +17,8 @@ wio_status_t wio_buf_init(
     //Initialize cursors
     self->pos_a = 0;
     self->pos_b = 0;
+    //Reset high-water mark
+    self->used_max = 0;
 
     return WIO_OK;
 }
@@ -160,16 +162,29 @@ wio_status_t wio_alloc(
 ) {
     void** ptr = (void**)_ptr;
 
-    //Move to begin of the buffer
-    if (self->pos_b+size>=self->size)
-        self->pos_b = 0;
-    //Try to allocate buffer
-    //TODO: Out of memory check
+    //Empty buffer; restart from the beginning
+    //(Otherwise an allocation bigger than both free ends fails)
+    if (self->pos_a==self->pos_b)
+        self->pos_a = self->pos_b = 0;
+    //Allocated memory must end before the read cursor,
+    //or a full buffer can't be told apart from an empty one
+    if (self->pos_b>=self->pos_a) {
+        //Move to begin of the buffer
+        //(Must match the wrap around condition of "wio_free()")
+        if (self->pos_b+size>self->size) {
+            if (size>=self->pos_a)
+                return WIO_ERR_NO_MEMORY;
+            self->pos_b = 0;
+        }
+    } else if (self->pos_b+size>=self->pos_a)
+        return WIO_ERR_NO_MEMORY;
 
     //Set pointer
     *ptr = self->buffer+self->pos_b;
     //Update cursor
     self->pos_b += size;
+    //Update high-water mark
+    wio_update_used_max(self);
 
     return WIO_OK;
 }
@@ -181,11 +196,36 @@ wio_status_t wio_free(
     wio_buf_t* self,
     uint16_t size
 ) {
+    //Memory freed, with unused space skipped at the end of the buffer
+    //(Must match the wrap around condition of "wio_alloc()")
+    bool wrap = self->size-self->pos_a<size;
+    uint16_t freed = wrap?self->size-self->pos_a+size:size;
+    if (freed>wio_used(self))
+        return WIO_ERR_OUT_OF_RANGE;
+
     //Move to begin of the buffer
-    if (self->size-self->pos_a<size)
+    if (wrap)
         self->pos_a = 0;
     //Update cursor
     self->pos_a += size;
 
     return WIO_OK;
 }
+
+/**
+ * {@inheritDoc}
+ */
+uint16_t wio_alloc_max(
+    const wio_buf_t* self
+) {
+    //Empty buffer restarts from the beginning
+    if (self->pos_a==self->pos_b)
+        return self->size;
+    //Free space is at the end of the buffer, and before the read cursor after wrapping around
+    //(Allocated memory must end before the read cursor; see "wio_alloc()")
+    if (self->pos_b>=self->pos_a) {
+        uint16_t tail_size = self->size-self->pos_b;
+        return (self->pos_a>tail_size+1)?self->pos_a-1:tail_size;
+    }
+    return self->pos_a-self->pos_b-1;
+}
@@ -13,6 +13,9 @@ typedef struct wio_buf {
     uint16_t pos_a;
     /// Cursor B (Write cursor)
     uint16_t pos_b;
+
+    /// Most memory in use so far (High-water mark; see "wio_used()")
+    uint16_t used_max;
 } wio_buf_t;
 
 /**
@@ -69,6 +72,94 @@ extern wio_status_t wio_write(
     uint16_t size
 );
 
+/**
+ * @brief Check that data can be read from WIO buffer.
+ *
+ * One check covers all the fields of a packet, which are then read
+ * with the unchecked functions below.
+ *
+ * @param self WIO buffer instance.
+ * @param size Size of data to read.
+ * @return WIO_ERR_OUT_OF_RANGE if read beyond buffer range, otherwise WIO_OK.
+ */
+static inline wio_status_t wio_ensure(
+    const wio_buf_t* self,
+    uint16_t size
+) {
+    return (self->pos_a+size>self->size)?WIO_ERR_OUT_OF_RANGE:WIO_OK;
+}
+
+/**
+ * @brief Check that data can be written to WIO buffer.
+ *
+ * @param self WIO buffer instance.
+ * @param size Size of data to write.
+ * @return WIO_ERR_OUT_OF_RANGE if write beyond buffer range, otherwise WIO_OK.
+ */
+static inline wio_status_t wio_ensure_write(
+    const wio_buf_t* self,
+    uint16_t size
+) {
+    return (self->pos_b+size>self->size)?WIO_ERR_OUT_OF_RANGE:WIO_OK;
+}
+
+/**
+ * @brief Read a byte from WIO buffer without bounds check.
+ *
+ * @param self WIO buffer instance (Checked with "wio_ensure()").
+ * @return Byte read.
+ */
+static inline uint8_t wio_read_u8(
+    wio_buf_t* self
+) {
+    return self->buffer[self->pos_a++];
+}
+
+/**
+ * @brief Read a little endian 16-bit integer from WIO buffer without bounds check.
+ *
+ * @param self WIO buffer instance (Checked with "wio_ensure()").
+ * @return Integer read.
+ */
+static inline uint16_t wio_read_u16(
+    wio_buf_t* self
+) {
+    const uint8_t* src = self->buffer+self->pos_a;
+    self->pos_a += 2;
+
+    return src[0]|((uint16_t)src[1]<<8);
+}
+
+/**
+ * @brief Write a byte to WIO buffer without bounds check.
+ *
+ * @param self WIO buffer instance (Checked with "wio_ensure_write()").
+ * @param value Byte to write.
+ */
+static inline void wio_write_u8(
+    wio_buf_t* self,
+    uint8_t value
+) {
+    self->buffer[self->pos_b++] = value;
+}
+
+/**
+ * @brief Write a little endian 16-bit integer to WIO buffer without bounds check.
+ *
+ * @param self WIO buffer instance (Checked with "wio_ensure_write()").
+ * @param value Integer to write.
+ */
+static inline void wio_write_u16(
+    wio_buf_t* self,
+    uint16_t value
+) {
+    uint8_t* dst = self->buffer+self->pos_b;
+    self->pos_b += 2;
+
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value>>8);
+}
+
 /**
  * @brief Copy data from one WIO buffer to another.
  *
@@ -83,9 +174,46 @@ extern wio_status_t wio_copy(
     uint16_t size
 );
 
+/**
+ * @brief Get size of memory in use in WIO buffer.
+ *
+ * For a buffer used as a ring arena, this is the memory from the read cursor to the write cursor,
+ * including unused space skipped at the end of the buffer when an allocation wraps around.
+ *
+ * @param self WIO buffer instance.
+ * @return Size of memory in use.
+ */
+static inline uint16_t wio_used(
+    const wio_buf_t* self
+) {
+    return (self->pos_b>=self->pos_a)?self->pos_b-self->pos_a:self->size-self->pos_a+self->pos_b;
+}
+
+/**
+ * @brief Update high-water mark of WIO buffer after writing to it.
+ *
+ * (Called by "wio_alloc()"; buffers filled with "wio_write()" call it on their own)
+ *
+ * @param self WIO buffer instance.
+ */
+static inline void wio_update_used_max(
+    wio_buf_t* self
+) {
+    uint16_t used = wio_used(self);
+
+    if (used>self->used_max)
+        self->used_max = used;
+}
+
 /**
  * @brief Allocate memory from WIO buffer in a circlular manner.
  *
+ * The buffer works as a ring arena: memory is allocated at the write cursor and freed
+ * at the read cursor in the same order. An allocation that doesn't fit at the end
+ * of the buffer wraps around to its beginning, and the space skipped stays in use until
+ * the read cursor passes it. Allocated memory ends before the read cursor, so both cursors
+ * meet only when the buffer is empty; an empty buffer restarts from its beginning.
+ *
  * @param self WIO buffer instance.
  * @param size Size of the memory to allocate.
  * @param _ptr Pointer to memory for holding pointer to allocated memory.
@@ -100,11 +228,24 @@ extern wio_status_t wio_alloc(
 /**
  * @brief Free memory from WIO buffer in a circular manner.
  *
+ * Memory must be freed in allocation order with the sizes it was allocated with,
+ * so that the read cursor skips the same unused space at the end of the buffer.
+ *
  * @param self WIO buffer instance.
  * @param size Size of the memory to free.
- * @return WIO_OK.
+ * @return WIO_ERR_OUT_OF_RANGE if more memory is freed than in use, otherwise WIO_OK.
  */
 extern wio_status_t wio_free(
     wio_buf_t* self,
     uint16_t size
 );
+
+/**
+ * @brief Get size of the largest memory that can be allocated from WIO buffer.
+ *
+ * @param self WIO buffer instance.
+ * @return Size of the largest allocation that succeeds.
+ */
+extern uint16_t wio_alloc_max(
+    const wio_buf_t* self
+);
@@ -54,14 +54,18 @@ wio_status_t wio_set_timeout(
     timer->cb_data = cb_data;
 
     //Find place to insert
-    while (next_timer&&(next_timer->_time<current_time))
+    //(Timers are ordered by trigger time)
+    while (next_timer&&(next_timer->_time<=timer->_time))
         next_timer = next_timer->_next;
     //Insert timer to linked list
     if (next_timer) {
         timer->_prev = next_timer->_prev;
         timer->_next = next_timer;
 
-        next_timer->_prev->_next = timer;
+        if (next_timer->_prev)
+            next_timer->_prev->_next = timer;
+        else
+            timer_begin = timer;
         next_timer->_prev = timer;
     } else {
         timer->_prev = timer_end;
@@ -116,6 +120,10 @@ wio_status_t wio_clear_timeout(
         next->_prev = prev;
     else
         timer_end = prev;
+    //Reset timer
+    timer->flag = false;
+    timer->_prev = NULL;
+    timer->_next = NULL;
 
     return WIO_OK;
 }
@@ -145,15 +153,18 @@ void wio_timer_callback() {
     current_time++;
 
     //Activate timers
-    while (timer_begin&&(timer_begin->_time==current_time)) {
+    while (timer_begin&&(timer_begin->_time<=current_time)) {
         wio_timer_t* timer = timer_begin;
 
         //Update linked list begin and end item
         timer_begin = timer->_next;
-        if (!timer_begin)
+        if (timer_begin)
+            timer_begin->_prev = NULL;
+        else
             timer_end = NULL;
         //Reset timer
         timer->flag = false;
+        timer->_next = NULL;
 
         //Invoke timer callback
         if (timer->cb)
@@ -24,10 +24,17 @@ typedef wio_status_t ert_status_t;
 static const uint8_t ERT_BW_SIZE = _ERT_BW_SIZE;
 /// EPC size
 static const uint8_t ERT_EPC_SIZE = 12;
+/// RFID operations without ACK callback after which EPC content is taken as observed
+/// (EPC was refreshed this often before the ACK callback drove refreshes)
+static const uint8_t ERT_EPC_FALLBACK_ROUNDS = 16;
 /// WISP class
 static const uint8_t ERT_WISP_CLASS = 0x10;
 /// ERT user stack size
 static const uint16_t ERT_USER_STACK_SIZE = 200;
+/// Maximum number of symbols in compression trees
+static const uint8_t ERT_FGK_N_SYMBOLS = 32;
+/// Compression buffer size (Largest u-RPC message and compression header)
+static const uint16_t ERT_FGK_BUF_SIZE = 97;
 
 //=== ERT error codes ===
 /// Error code for failed remote system call
@@ -38,6 +45,8 @@ static const uint8_t ERT_ERR_SYS_FAILED = 0x30;
 extern wtp_t* ert_wtp_ep;
 /// ERT u-RPC endpoint
 extern urpc_t* ert_rpc_ep;
+/// Compress u-RPC messages (Set in "ert_pre_init()"; the server runtime must compress as well)
+extern bool ert_compress;
 
 //=== ERT runtime APIs ===
 /**
@@ -13,11 +13,30 @@ wtp_t* ert_wtp_ep = WIO_INST_PTR(wtp_t);
 /// u-RPC endpoint
 urpc_t* ert_rpc_ep = WIO_INST_PTR(urpc_t);
 
+/// Compress u-RPC messages
+bool ert_compress = false;
+
+/// WTP session (Kept in FRAM information memory, so the connection is resumed after power loss)
+static wtp_session_t* const ert_wtp_session = (wtp_session_t*)INFO_WISP_USR;
+
 /// Blockwrite data buffer
 static uint8_t blockwrite_buffer[_ERT_BW_SIZE] = {0};
 /// WISP data
 static WISP_dataStructInterface_t wisp_data;
 
+/// Uplink compression codec
+static wtp_fgk_t ert_fgk_tx;
+/// Downlink compression codec
+static wtp_fgk_t ert_fgk_rx;
+/// Compressed uplink message buffer
+static uint8_t* ert_fgk_tx_buf;
+/// Decompressed downlink message buffer
+static uint8_t* ert_fgk_rx_buf;
+
+/// RFID ACK flag
+static bool ack_flag = false;
+/// RFID operations since the last ACK callback
+static uint8_t epc_unobserved_rounds = 0;
 /// RFID Read flag
 static bool read_flag = false;
 /// RFID BlockWrite flag
@@ -35,8 +54,12 @@ static void* user_result_var;
 /// User context result size
 static uint16_t user_result_size;
 
-/// EPC update counter
-static uint8_t epc_update_counter = 0;
+/**
+ * @brief WISP RFID ACK callback.
+ */
+static void ert_ack_callback(void) {
+    ack_flag = true;
+}
 
 /**
  * @brief WISP RFID Read callback.
@@ -81,22 +104,111 @@ static WIO_CALLBACK(ert_enter_main) {
     return WIO_OK;
 }
 
+/**
+ * ERT u-RPC send function, compressing messages when enabled.
+ */
+static wtp_status_t ert_send(
+    wtp_t* wtp,
+    uint8_t* data,
+    uint16_t size,
+    void* cb_data,
+    wio_callback_t cb
+) {
+    if (ert_compress) {
+        if (size+WTP_FGK_HEADER_SIZE>ERT_FGK_BUF_SIZE)
+            return WIO_ERR_OUT_OF_RANGE;
+        WIO_TRY(wtp_fgk_encode(&ert_fgk_tx, data, size, ert_fgk_tx_buf, &size))
+        data = ert_fgk_tx_buf;
+    }
+
+    wtp_status_t status = wtp_send(wtp, data, size, cb_data, cb);
+    //The server never sees the message; begin a new stream
+    if (ert_compress&&(status!=WIO_OK))
+        wtp_fgk_reset(&ert_fgk_tx);
+
+    return status;
+}
+
 /**
  * ERT WTP data received callback.
  */
 static WIO_CALLBACK(ert_on_recv) {
     //Keep receiving data from WTP endpoint
     WIO_TRY(wtp_recv(ert_wtp_ep, NULL, ert_on_recv))
+    //Decompress message
+    wio_buf_t msg_buf;
+    if (ert_compress&&(status==WIO_OK)) {
+        wio_buf_t* compressed_buf = (wio_buf_t*)result;
+        uint16_t size;
+
+        //Drop messages out of stream (The server begins a new stream when the connection resumes)
+        WIO_TRY(wtp_fgk_decode(
+            &ert_fgk_rx,
+            compressed_buf->buffer,
+            compressed_buf->size,
+            ert_fgk_rx_buf,
+            ERT_FGK_BUF_SIZE,
+            &size
+        ))
+        WIO_TRY(wio_buf_init(&msg_buf, ert_fgk_rx_buf, size))
+        result = &msg_buf;
+    }
     //Call u-RPC data received callback
     WIO_TRY(urpc_on_recv(ert_rpc_ep, status, result))
 
     return WIO_OK;
 }
 
+/**
+ * @brief Initialize compression codecs and buffers.
+ *
+ * @return Error code if initialization fails (Nothing is kept), otherwise WIO_OK.
+ */
+static wtp_status_t ert_init_compression(void) {
+    wtp_status_t status = wtp_fgk_init(&ert_fgk_tx, ERT_FGK_N_SYMBOLS);
+    if (status==WIO_OK)
+        status = wtp_fgk_init(&ert_fgk_rx, ERT_FGK_N_SYMBOLS);
+    ert_fgk_tx_buf = malloc(ERT_FGK_BUF_SIZE);
+    ert_fgk_rx_buf = malloc(ERT_FGK_BUF_SIZE);
+
+    if ((status!=WIO_OK)||!ert_fgk_tx_buf||!ert_fgk_rx_buf) {
+        wtp_fgk_fini(&ert_fgk_tx);
+        wtp_fgk_fini(&ert_fgk_rx);
+        free(ert_fgk_tx_buf);
+        free(ert_fgk_rx_buf);
+        ert_fgk_tx_buf = ert_fgk_rx_buf = NULL;
+        return (status!=WIO_OK)?status:WIO_ERR_NO_MEMORY;
+    }
+    return WIO_OK;
+}
+
+/**
+ * @brief Begin new compression streams in both directions.
+ */
+static void ert_reset_compression(void) {
+    if (ert_compress) {
+        wtp_fgk_reset(&ert_fgk_tx);
+        wtp_fgk_reset(&ert_fgk_rx);
+    }
+}
+
+/**
+ * ERT WTP connection restarted callback.
+ */
+static WIO_CALLBACK(ert_on_restart) {
+    //The server opened a new connection with new decoders; messages out of stream are dropped
+    //until the next one begins a stream
+    ert_reset_compression();
+
+    return WIO_OK;
+}
+
 /**
  * ERT WTP connected callback.
  */
 static WIO_CALLBACK(ert_on_connect) {
+    //New or resumed connection; the server begins a new downlink stream as well
+    ert_reset_compression();
     //Keep receiving data from WTP endpoint
     WIO_TRY(wtp_recv(ert_wtp_ep, NULL, ert_on_recv))
     //Load ERT constants
@@ -157,6 +269,7 @@ void main(void) {
     WISP_init();
 
     //Register RFID callback functions
+    WISP_registerCallback_ACK(ert_ack_callback);
     WISP_registerCallback_READ(ert_read_callback);
     WISP_registerCallback_BLOCKWRITE(ert_blockwrite_callback);
 
@@ -188,7 +301,7 @@ void main(void) {
         //Send function closure data
         ert_wtp_ep,
         //Send function
-        (urpc_send_func_t)wtp_send,
+        (urpc_send_func_t)ert_send,
         //Capacity of callback table
         8
     );
@@ -220,58 +333,41 @@ void main(void) {
         5
     );
 
+    //Initialize compression codecs (Memory is only taken when compression is enabled)
+    //(The server runtime can't decode messages without them; stay off the air)
+    if (ert_compress&&(ert_init_compression()!=WIO_OK))
+        while (true);
+
     //WTP connected event handler
     wtp_on_event(ert_wtp_ep, WTP_EVENT_OPEN, NULL, ert_on_connect);
+    //WTP connection restarted event handler
+    wtp_on_event(ert_wtp_ep, WTP_EVENT_RESTART, NULL, ert_on_restart);
+    //Resume session of previous power cycle
+    //(Information memory is not erased on reprogramming; "wtp_connect()" only resumes a session
+    //that passes "wtp_session_valid()", and opens a new connection otherwise)
+    wtp_set_session(ert_wtp_ep, ert_wtp_session);
     //Connect to WTP server
     wtp_connect(ert_wtp_ep);
 
     //RFID loop
     while (true) {
-        //TODO: Figure out why moving following EPC update code to a function doesn't work
-        //TODO: Encapsulate following code in function "wtp_before_do_rfid()"
-
-        //Update counter
-        epc_update_counter++;
-
-        //Triggered every 16 RFID operations
-        if (epc_update_counter%16==1) {
-            //Send packet buffer
-            wio_buf_t* pkt_buf = &ert_wtp_ep->_tx_ctrl._pkt_buf;
-
-            //Write packets to EPC memory
-            if (pkt_buf->pos_a!=pkt_buf->pos_b) {
-                //EPC buffer
-                wio_buf_t* epc_buf = &ert_wtp_ep->_epc_buf;
-                //Packet size
-                uint8_t pkt_size;
-
-                //Reset EPC buffer
-                epc_buf->pos_a = epc_buf->pos_b = 0;
-
-                //Fill EPC buffer with data packets
-                while (pkt_buf->pos_a<pkt_buf->pos_b) {
-                    //Packet size
-                    pkt_size = *(pkt_buf->buffer+pkt_buf->pos_a);
-
-                    //Exceeds EPC capacity
-                    if (epc_buf->pos_a+pkt_size>epc_buf->size)
-                        break;
-                    //Skip packet size
-                    pkt_buf->pos_a++;
-                    //Copy packet data to EPC memory
-                    wio_copy(pkt_buf, epc_buf, pkt_size);
-                }
-                //Write WTP_PKT_END (Ignore failure)
-                wio_write(epc_buf, &WTP_PKT_END, 1);
-                //Reset packet buffer if it's empty
-                if (pkt_buf->pos_a==pkt_buf->pos_b)
-                    pkt_buf->pos_a = pkt_buf->pos_b = 0;
-            }
-        }
+        //Refresh EPC with pending packets (Ignore failure)
+        wtp_before_do_rfid(ert_wtp_ep);
 
         //Do RFID
         WISP_doRFID();
 
+        //Called after the tag replies with its EPC
+        if (ack_flag) {
+            wtp_epc_observed(ert_wtp_ep);
+            ack_flag = false;
+            epc_unobserved_rounds = 0;
+        //No ACK callback for a while; refresh EPC every few RFID operations as before,
+        //in case the ACK callback is never invoked by the WISP base library
+        } else if (++epc_unobserved_rounds>=ERT_EPC_FALLBACK_ROUNDS) {
+            wtp_epc_observed(ert_wtp_ep);
+            epc_unobserved_rounds = 0;
+        }
         //Called after a Read operation
         if (read_flag) {
             wtp_load_read_mem(ert_wtp_ep);
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../sim/link.h"
+#include "../sim/reader.h"
+
+//Brownout benchmark: messages flow in both directions while the client loses power at random rounds.
+//Messages not acknowledged when power is lost are sent again by the application with a session only,
+//or restored from a checkpoint by WTP. The bytes retransmitted per brownout are measured in both directions,
+//as well as messages lost, duplicated or corrupted.
+
+/// Maximum message size
+#define BENCH_MSG_MAX 256
+/// Transmit message buffer size (Same as "wtp_init()" makes for the ERT runtime configuration)
+#define BENCH_TX_MSG_SIZE 150
+/// Receive message data ring size
+#define BENCH_RX_MSG_SIZE 100
+/// Number of modes
+#define BENCH_MODES 3
+
+/// Mode names
+static const char* bench_mode_names[BENCH_MODES] = {"session", "checkpoint", "torn"};
+
+/// Benchmark options type
+typedef struct bench_opts {
+    /// Number of brownouts per mode
+    uint32_t n_brownouts;
+    /// Message size
+    uint16_t msg_size;
+    /// Mean rounds between brownouts
+    uint32_t mean_rounds_on;
+    /// Downlink messages queued on the virtual reader
+    uint8_t n_down_queued;
+    /// Random seed
+    uint32_t seed;
+    /// Inventory time per round (us)
+    uint32_t inventory_us;
+    /// Fixed time per OpSpec (us)
+    uint32_t opspec_us;
+    /// Time per word read or written (us)
+    uint32_t word_us;
+} bench_opts_t;
+
+/// Message stream statistics type
+typedef struct bench_stream {
+    /// Index of next message expected
+    uint32_t expected;
+    /// Messages delivered
+    uint32_t n_delivered;
+    /// Messages skipped
+    uint32_t n_lost;
+    /// Messages delivered again
+    uint32_t n_dup;
+    /// Corrupted messages
+    uint32_t n_corrupted;
+} bench_stream_t;
+
+/// Benchmark state type
+typedef struct bench {
+    /// Virtual link
+    wtp_sim_link_t link;
+    /// Virtual reader
+    wtp_sim_reader_t reader;
+    /// Options
+    bench_opts_t opts;
+    /// Random state
+    uint32_t rand;
+
+    //(Survives power loss)
+    /// Session
+    wtp_session_t session;
+    /// Checkpoint
+    wtp_checkpoint_t checkpoint;
+    /// Transmit message buffer memory
+    uint8_t tx_msg_mem[BENCH_TX_MSG_SIZE];
+    /// Receive message data ring memory
+    uint8_t rx_msg_mem[BENCH_RX_MSG_SIZE];
+    /// Index of next uplink message to send
+    uint32_t up_next;
+    /// Uplink messages acknowledged (Only counted for messages sent in the current power cycle)
+    uint32_t up_acked;
+    /// Downlink messages received by the client
+    bench_stream_t down;
+
+    /// Connected flag
+    bool connected;
+    /// Uplink messages received by the virtual reader
+    bench_stream_t up;
+} bench_t;
+
+/**
+ * @brief Get next random number (xorshift32).
+ *
+ * @param bench Benchmark state.
+ * @return Random number.
+ */
+static uint32_t bench_rand(
+    bench_t* bench
+) {
+    uint32_t x = bench->rand;
+
+    x ^= x<<13;
+    x ^= x>>17;
+    x ^= x<<5;
+
+    return bench->rand = x;
+}
+
+/**
+ * @brief Fill message with test pattern.
+ *
+ * @param data Message data.
+ * @param size Message size.
+ * @param index Message index.
+ */
+static void bench_pattern(
+    uint8_t* data,
+    uint16_t size,
+    uint32_t index
+) {
+    for (uint16_t i=0;i<size;i++)
+        data[i] = (i<4)?(uint8_t)(index>>(i*8)):(uint8_t)(index*31+i);
+}
+
+/**
+ * @brief Verify message and account it in message stream.
+ *
+ * @param bench Benchmark state.
+ * @param stream Message stream.
+ * @param msg_buf Message buffer.
+ */
+static void bench_verify(
+    bench_t* bench,
+    bench_stream_t* stream,
+    wio_buf_t* msg_buf
+) {
+    uint8_t expected[BENCH_MSG_MAX];
+    uint32_t index;
+
+    if (msg_buf->size!=bench->opts.msg_size) {
+        stream->n_corrupted++;
+        return;
+    }
+    memcpy(&index, msg_buf->buffer, 4);
+    bench_pattern(expected, msg_buf->size, index);
+    if (memcmp(msg_buf->buffer, expected, msg_buf->size)!=0) {
+        stream->n_corrupted++;
+        return;
+    }
+
+    //Delivered again
+    if (index<stream->expected) {
+        stream->n_dup++;
+        return;
+    }
+    stream->n_lost += index-stream->expected;
+    stream->n_delivered++;
+    stream->expected = index+1;
+}
+
+/**
+ * @brief Virtual reader uplink message callback.
+ */
+static WIO_CALLBACK(bench_reader_on_recv) {
+    bench_t* bench = (bench_t*)data;
+
+    bench_verify(bench, &bench->up, (wio_buf_t*)result);
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Client message sent callback.
+ */
+static WIO_CALLBACK(bench_on_sent) {
+    bench_t* bench = (bench_t*)data;
+
+    bench->up_acked++;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Client message received callback.
+ */
+static WIO_CALLBACK(bench_on_recv) {
+    bench_t* bench = (bench_t*)data;
+
+    //Keep receiving
+    WIO_TRY(wtp_recv(&bench->link.wtp, bench, bench_on_recv))
+    bench_verify(bench, &bench->down, (wio_buf_t*)result);
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Client connection opened callback.
+ */
+static WIO_CALLBACK(bench_on_open) {
+    bench_t* bench = (bench_t*)data;
+
+    bench->connected = true;
+    WIO_TRY(wtp_recv(&bench->link.wtp, bench, bench_on_recv))
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Power up the client and connect to the virtual reader.
+ *
+ * @param bench Benchmark state.
+ * @param checkpoint Keep transmit and receive control state in the checkpoint.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wio_status_t bench_power_up(
+    bench_t* bench,
+    bool checkpoint
+) {
+    wtp_t* wtp = &bench->link.wtp;
+
+    //Virtual link and client (Same configuration as the ERT runtime)
+    WIO_TRY(wtp_sim_link_init(&bench->link, 0x5101, 64, 10, 200, 200, 5, 5))
+    WIO_TRY(wtp_set_session(wtp, &bench->session))
+    if (checkpoint)
+        WIO_TRY(wtp_set_checkpoint(
+            wtp,
+            &bench->checkpoint,
+            bench->tx_msg_mem,
+            BENCH_TX_MSG_SIZE,
+            bench->rx_msg_mem,
+            BENCH_RX_MSG_SIZE
+        ))
+    //Without a checkpoint, messages not acknowledged are sent again
+    else
+        bench->up_next = bench->up_acked;
+
+    bench->connected = false;
+    WIO_TRY(wtp_on_event(wtp, WTP_EVENT_OPEN, bench, bench_on_open))
+
+    return wtp_connect(wtp);
+}
+
+/**
+ * @brief Run brownouts of one mode.
+ *
+ * @param bench Benchmark state.
+ * @param mode Mode (Index of mode names).
+ * @param _n_rounds Used for returning number of rounds.
+ */
+static void bench_run_mode(
+    bench_t* bench,
+    uint8_t mode,
+    uint32_t* _n_rounds
+) {
+    bench_opts_t* opts = &bench->opts;
+    wtp_sim_reader_t* reader = &bench->reader;
+    wtp_t* wtp = &bench->link.wtp;
+    bool checkpoint = mode!=0;
+
+    //Fresh non-volatile memory and server
+    memset(&bench->session, 0, sizeof(wtp_session_t));
+    memset(&bench->checkpoint, 0, sizeof(wtp_checkpoint_t));
+    memset(&bench->up, 0, sizeof(bench_stream_t));
+    memset(&bench->down, 0, sizeof(bench_stream_t));
+    bench->up_next = bench->up_acked = 0;
+    bench->rand = opts->seed;
+    wtp_sim_reader_init(reader, &bench->link, 24, 64, 64);
+    reader->on_recv = bench_reader_on_recv;
+    reader->on_recv_data = bench;
+    bench_power_up(bench, checkpoint);
+
+    uint8_t msg[BENCH_MSG_MAX];
+    uint32_t n_brownouts = 0;
+    uint32_t round = 0;
+    uint64_t sim_us = 0;
+
+    while (n_brownouts<opts->n_brownouts) {
+        round++;
+        //One uplink message per round while the client has room for it
+        if (bench->connected) {
+            bench_pattern(msg, opts->msg_size, bench->up_next);
+            if (wtp_send(wtp, msg, opts->msg_size, bench, bench_on_sent)==WIO_OK)
+                bench->up_next++;
+        }
+        //Keep downlink messages queued on the virtual reader
+        //(Messages dropped by the virtual reader on power loss are queued again)
+        uint32_t down_next = reader->stats.down_msgs+reader->_tx_n_msgs;
+        while (reader->_tx_n_msgs<opts->n_down_queued) {
+            bench_pattern(msg, opts->msg_size, down_next);
+            if (wtp_sim_reader_send(reader, msg, opts->msg_size)!=WIO_OK)
+                break;
+            down_next++;
+        }
+
+        //RFID round
+        uint32_t n_blockwrites = reader->stats.n_blockwrites;
+        uint16_t op_words;
+        wtp_sim_reader_round(reader, &op_words);
+
+        //Simulated round time
+        uint32_t round_us = opts->inventory_us;
+        if (op_words)
+            round_us += opts->opspec_us+op_words*opts->word_us;
+        sim_us += round_us;
+        wtp_sim_link_advance(&bench->link, (uint32_t)(sim_us/1000)-bench->link._time);
+
+        //Power lost
+        if (bench_rand(bench)%opts->mean_rounds_on)
+            continue;
+        n_brownouts++;
+        //Power lost while committing at the end of a BlockWrite; the commit is torn
+        if ((mode==2)&&(reader->stats.n_blockwrites!=n_blockwrites))
+            bench->checkpoint._slots[wtp->_checkpoint_slot]._crc ^= 0xffff;
+        wtp_sim_link_fini(&bench->link);
+        bench_power_up(bench, checkpoint);
+    }
+    wtp_sim_link_fini(&bench->link);
+
+    WIO_RETURN(_n_rounds, round)
+}
+
+/**
+ * @brief Print benchmark usage.
+ *
+ * @param prog Program name.
+ */
+static void bench_usage(
+    const char* prog
+) {
+    fprintf(stderr,
+        "Usage: %s [-n brownouts] [-s msg_size] [-k mean_rounds_on] [-q down_queued] [-r seed]\n"
+        "          [-t inventory_us,opspec_us,word_us]\n",
+        prog
+    );
+}
+
+int main(int argc, char** argv) {
+    bench_t* bench = calloc(1, sizeof(bench_t));
+    bench_opts_t* opts = &bench->opts;
+    int opt;
+
+    //Default options
+    opts->n_brownouts = 500;
+    opts->msg_size = 40;
+    opts->mean_rounds_on = 60;
+    opts->n_down_queued = 2;
+    opts->seed = 1;
+    opts->inventory_us = 3000;
+    opts->opspec_us = 2000;
+    opts->word_us = 250;
+
+    while ((opt = getopt(argc, argv, "n:s:k:q:r:t:h"))!=-1) {
+        switch (opt) {
+            case 'n': opts->n_brownouts = strtoul(optarg, NULL, 0); break;
+            case 's': opts->msg_size = strtoul(optarg, NULL, 0); break;
+            case 'k': opts->mean_rounds_on = strtoul(optarg, NULL, 0); break;
+            case 'q': opts->n_down_queued = strtoul(optarg, NULL, 0); break;
+            case 'r': opts->seed = strtoul(optarg, NULL, 0); break;
+            case 't':
+                if (sscanf(optarg, "%u,%u,%u", &opts->inventory_us, &opts->opspec_us, &opts->word_us)!=3) {
+                    bench_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    if ((opts->msg_size<4)||(opts->msg_size>BENCH_MSG_MAX)||(opts->mean_rounds_on==0)
+        ||(opts->n_brownouts==0)||(opts->seed==0)) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    printf("%-10s %9s %7s | %7s %9s %5s %4s | %7s %9s %5s %4s | %9s\n",
+        "mode", "brownouts", "rounds",
+        "up msgs", "retx B/bo", "lost", "dup",
+        "dn msgs", "retx B/bo", "lost", "dup",
+        "corrupted");
+
+    int exit_code = 0;
+    for (uint8_t mode=0;mode<BENCH_MODES;mode++) {
+        uint32_t n_rounds;
+        bench_run_mode(bench, mode, &n_rounds);
+
+        wtp_sim_reader_stats_t* stats = &bench->reader.stats;
+        bench_stream_t* up = &bench->up;
+        bench_stream_t* down = &bench->down;
+        //Data bytes beyond the bytes of messages delivered
+        double up_retx = (double)stats->up_data_bytes-(double)up->n_delivered*opts->msg_size;
+        double down_retx = (double)stats->down_data_bytes-(double)down->n_delivered*opts->msg_size;
+
+        printf("%-10s %9u %7u | %7u %9.1f %5u %4u | %7u %9.1f %5u %4u | %9u\n",
+            bench_mode_names[mode],
+            opts->n_brownouts,
+            n_rounds,
+            up->n_delivered,
+            up_retx/opts->n_brownouts,
+            up->n_lost,
+            up->n_dup,
+            down->n_delivered,
+            down_retx/opts->n_brownouts,
+            down->n_lost,
+            down->n_dup,
+            up->n_corrupted+down->n_corrupted
+        );
+        //Messages are never corrupted; with a checkpoint they are also never lost or delivered twice
+        if (up->n_corrupted||down->n_corrupted)
+            exit_code = 2;
+        if (mode&&(up->n_lost||up->n_dup||down->n_lost||down->n_dup))
+            exit_code = 2;
+    }
+
+    free(bench);
+
+    return exit_code;
+}
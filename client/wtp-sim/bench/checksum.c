@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <Math/crc16.h>
+#include "../sim/link.h"
+
+//Checksum benchmark: CPU time of "wtp_verify_checksum()" on the client
+//for each checksum algorithm and a range of downlink packet sizes.
+//(The host runs a table-driven stand-in of the MSP430 CRC module routine)
+
+/// Maximum packet size (BlockWrite memory size)
+#define BENCH_PKT_MAX WTP_SIM_WRITE_MEM_SIZE
+
+/**
+ * @brief Print benchmark usage.
+ *
+ * @param prog Program name.
+ */
+static void bench_usage(
+    const char* prog
+) {
+    fprintf(stderr, "Usage: %s [-n iterations]\n", prog);
+}
+
+/**
+ * @brief Measure checksum verification of one packet.
+ *
+ * @param wtp WTP endpoint instance.
+ * @param checksum Checksum algorithm.
+ * @param pkt_size Packet size (Without checksum).
+ * @param n_iters Number of verifications.
+ * @param ns Mean time per verification in nanoseconds.
+ * @return WIO_ERR_INVALID if verification failed, otherwise WIO_OK.
+ */
+static wio_status_t bench_verify(
+    wtp_t* wtp,
+    wtp_checksum_t checksum,
+    uint8_t pkt_size,
+    uint32_t n_iters,
+    double* ns
+) {
+    uint8_t mem[BENCH_PKT_MAX];
+    wio_buf_t buf;
+
+    //Data packet with checksum
+    for (uint8_t i=0;i<pkt_size;i++)
+        mem[i] = (uint8_t)(i*7);
+    if (checksum==WTP_CHECKSUM_CRC16) {
+        uint16_t crc = crc16_ccitt(CRC_NO_PRELOAD, mem, pkt_size);
+        memcpy(mem+pkt_size, &crc, 2);
+    } else
+        mem[pkt_size] = wtp_xor_checksum(mem, 0, pkt_size);
+    WIO_TRY(wio_buf_init(&buf, mem, BENCH_PKT_MAX))
+
+    wtp->_checksum = checksum;
+    wtp->_pkt_begin = 0;
+
+    uint64_t begin_ns = wtp_sim_now_ns();
+    for (uint32_t i=0;i<n_iters;i++) {
+        //Read cursor at the end of packet
+        buf.pos_a = pkt_size;
+        WIO_TRY(wtp_verify_checksum(wtp, &buf))
+    }
+    *ns = (double)(wtp_sim_now_ns()-begin_ns)/n_iters;
+
+    return WIO_OK;
+}
+
+int main(int argc, char** argv) {
+    uint32_t n_iters = 2000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:h"))!=-1) {
+        switch (opt) {
+            case 'n': n_iters = strtoul(optarg, NULL, 0); break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (n_iters==0) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    //Only packet begin position and checksum algorithm of the endpoint are used
+    wtp_t* wtp = calloc(1, sizeof(wtp_t));
+    static const uint8_t pkt_sizes[] = {4, 8, 16, 24, 29};
+    static const char* names[] = {"xor", "crc16"};
+
+    printf("%-6s %8s %12s %12s\n", "algo", "pkt size", "ns/packet", "ns/byte");
+    for (wtp_checksum_t checksum=0;checksum<WTP_CHECKSUM_MAX;checksum++)
+        for (size_t i=0;i<sizeof(pkt_sizes);i++) {
+            uint8_t pkt_size = pkt_sizes[i];
+            double ns;
+
+            if (bench_verify(wtp, checksum, pkt_size, n_iters, &ns)!=WIO_OK) {
+                fprintf(stderr, "Checksum verification failed\n");
+                return 2;
+            }
+            printf("%-6s %8u %12.2f %12.3f\n", names[checksum], pkt_size, ns, ns/pkt_size);
+        }
+
+    free(wtp);
+    return 0;
+}
@@ -0,0 +1,522 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#include <wtp/fgk.h>
+
+//Compression benchmark: compression ratio and CPU cost of the FGK codec on message traces
+//of the ERT runtime. Every trace runs once per tree size, with one stream per direction
+//("stream") or with every message compressed on its own ("message").
+//(u-RPC frames are laid out after the calls "runtime.c" and "fs.c" make; the u-RPC library is not built on the host)
+
+/// Maximum message size
+#define BENCH_MSG_MAX 128
+/// Maximum number of messages in a trace
+#define BENCH_TRACE_MAX 1024
+/// Number of traces
+#define BENCH_TRACES 4
+
+/// Modeled u-RPC call message type
+static const uint8_t BENCH_URPC_CALL = 0x01;
+/// Modeled u-RPC return message type
+static const uint8_t BENCH_URPC_RET = 0x02;
+/// Modeled u-RPC 16-bit unsigned integer type
+static const uint8_t BENCH_URPC_U16 = 0x03;
+/// Modeled u-RPC 16-bit signed integer type
+static const uint8_t BENCH_URPC_I16 = 0x04;
+/// Modeled u-RPC variable-size data type
+static const uint8_t BENCH_URPC_VARY = 0x08;
+
+/// ERT function IDs, in the order the server adds them
+enum {
+    BENCH_FUNC_SRV_CONSTS,
+    BENCH_FUNC_OPEN,
+    BENCH_FUNC_CLOSE,
+    BENCH_FUNC_READ,
+    BENCH_FUNC_WRITE,
+    BENCH_FUNC_LSEEK
+};
+
+/// Trace message type
+typedef struct bench_msg {
+    /// Uplink message (Otherwise downlink)
+    bool up;
+    /// Message size
+    uint16_t size;
+    /// Message data
+    uint8_t data[BENCH_MSG_MAX];
+} bench_msg_t;
+
+/// Message trace type
+typedef struct bench_trace {
+    /// Trace name
+    const char* name;
+    /// Number of messages
+    uint16_t n_msgs;
+    /// Messages
+    bench_msg_t msgs[BENCH_TRACE_MAX];
+
+    /// Next u-RPC message ID
+    uint16_t msg_id;
+    /// Random number state
+    uint32_t rand;
+} bench_trace_t;
+
+/// Text read back by the file system traces
+static const char bench_text[] =
+    "# WISP sensor log\n"
+    "interval=500\n"
+    "channels=temp,vcap\n"
+    "t=00000 T=23.5 V=2.41\n"
+    "t=00500 T=23.5 V=2.39\n"
+    "t=01000 T=23.6 V=2.38\n"
+    "t=01500 T=23.6 V=2.40\n"
+    "t=02000 T=23.7 V=2.37\n";
+
+/**
+ * @brief Print benchmark usage.
+ *
+ * @param prog Program name.
+ */
+static void bench_usage(
+    const char* prog
+) {
+    fprintf(stderr, "Usage: %s [-n iterations] [-m messages] [-r seed]\n", prog);
+}
+
+/**
+ * @brief Get next random number (xorshift32).
+ *
+ * @param trace Message trace.
+ * @return Random number.
+ */
+static uint32_t bench_rand(
+    bench_trace_t* trace
+) {
+    uint32_t x = trace->rand;
+
+    x ^= x<<13;
+    x ^= x>>17;
+    x ^= x<<5;
+
+    return trace->rand = x;
+}
+
+/**
+ * @brief Begin a new message in trace.
+ *
+ * @param trace Message trace.
+ * @param up Uplink message.
+ * @return New message, or NULL if the trace is full.
+ */
+static bench_msg_t* bench_msg_new(
+    bench_trace_t* trace,
+    bool up
+) {
+    if (trace->n_msgs>=BENCH_TRACE_MAX)
+        return NULL;
+
+    bench_msg_t* msg = trace->msgs+trace->n_msgs++;
+    msg->up = up;
+    msg->size = 0;
+
+    return msg;
+}
+
+/**
+ * @brief Append data to message.
+ *
+ * @param msg Message.
+ * @param data Data.
+ * @param size Data size.
+ */
+static void bench_msg_put(
+    bench_msg_t* msg,
+    const void* data,
+    uint16_t size
+) {
+    size = WIO_MIN(size, BENCH_MSG_MAX-msg->size);
+    memcpy(msg->data+msg->size, data, size);
+    msg->size += size;
+}
+
+/**
+ * @brief Append a typed u-RPC value to message.
+ *
+ * @param msg Message.
+ * @param type u-RPC type.
+ * @param data Value data (Little endian 16-bit integer, or variable-size data).
+ * @param size Value size.
+ */
+static void bench_msg_put_value(
+    bench_msg_t* msg,
+    uint8_t type,
+    const void* data,
+    uint16_t size
+) {
+    bench_msg_put(msg, &type, 1);
+    if (type==BENCH_URPC_VARY)
+        bench_msg_put(msg, &size, 2);
+    bench_msg_put(msg, data, size);
+}
+
+/**
+ * @brief Add a u-RPC call and its return to trace.
+ *
+ * @param trace Message trace.
+ * @param func Function ID.
+ * @param n_args Number of arguments.
+ * @param types Argument types.
+ * @param args Argument data.
+ * @param sizes Argument sizes.
+ * @param ret Return value.
+ * @param ret_data Data returned after return value, or NULL.
+ * @param ret_size Size of data returned.
+ */
+static void bench_rpc(
+    bench_trace_t* trace,
+    uint16_t func,
+    uint8_t n_args,
+    const uint8_t* types,
+    const void** args,
+    const uint16_t* sizes,
+    int16_t ret,
+    const void* ret_data,
+    uint16_t ret_size
+) {
+    uint16_t msg_id = trace->msg_id++;
+
+    //Call: type, message ID, function ID and arguments
+    bench_msg_t* call = bench_msg_new(trace, true);
+    if (!call)
+        return;
+    bench_msg_put(call, &BENCH_URPC_CALL, 1);
+    bench_msg_put(call, &msg_id, 2);
+    bench_msg_put(call, &func, 2);
+    bench_msg_put(call, &n_args, 1);
+    for (uint8_t i=0;i<n_args;i++)
+        bench_msg_put_value(call, types[i], args[i], sizes[i]);
+
+    //Return: type, message ID and results
+    bench_msg_t* reply = bench_msg_new(trace, false);
+    if (!reply)
+        return;
+    uint8_t n_results = ret_data?2:1;
+    bench_msg_put(reply, &BENCH_URPC_RET, 1);
+    bench_msg_put(reply, &msg_id, 2);
+    bench_msg_put(reply, &n_results, 1);
+    bench_msg_put_value(reply, BENCH_URPC_I16, &ret, 2);
+    if (ret_data)
+        bench_msg_put_value(reply, BENCH_URPC_VARY, ret_data, ret_size);
+}
+
+/**
+ * @brief Add ERT connection setup to trace ("ert_srv_consts" and "ert_open").
+ *
+ * @param trace Message trace.
+ * @param path Opened file path.
+ * @return File descriptor.
+ */
+static int16_t bench_trace_setup(
+    bench_trace_t* trace,
+    const char* path
+) {
+    //Service constants (Open flags, whence and error numbers)
+    static const int16_t consts[] = {64, 0, 1, 2, 64, 0, 1, 2, 9, 22};
+    bench_rpc(
+        trace, BENCH_FUNC_SRV_CONSTS,
+        1, (uint8_t[]){BENCH_URPC_VARY}, (const void*[]){"fs"}, (uint16_t[]){2},
+        0, consts, sizeof(consts)
+    );
+
+    int16_t flags = 66, fd = 1;
+    uint16_t mode = 0644;
+    bench_rpc(
+        trace, BENCH_FUNC_OPEN,
+        3, (uint8_t[]){BENCH_URPC_VARY, BENCH_URPC_I16, BENCH_URPC_U16},
+        (const void*[]){path, &flags, &mode}, (uint16_t[]){strlen(path), 2, 2},
+        fd, NULL, 0
+    );
+
+    return fd;
+}
+
+/**
+ * @brief Build sensor logging trace: text lines written to a file, with periodic seeks and reads.
+ *
+ * @param trace Message trace.
+ * @param n_msgs Number of writes.
+ */
+static void bench_trace_log(
+    bench_trace_t* trace,
+    uint16_t n_msgs
+) {
+    int16_t fd = bench_trace_setup(trace, "./log.txt");
+    int16_t temp = 235;
+    uint16_t vcap = 241;
+    int16_t offset = 0;
+
+    for (uint16_t i=0;i<n_msgs;i++) {
+        //Slowly changing sensor values
+        temp += (int16_t)(bench_rand(trace)%3)-1;
+        vcap += (bench_rand(trace)%5)-2;
+        char line[32];
+        uint16_t size = snprintf(
+            line, sizeof(line), "t=%05u T=%d.%d V=%u.%02u\n",
+            (i*500)%100000, temp/10, temp%10, vcap/100, vcap%100
+        );
+
+        bench_rpc(
+            trace, BENCH_FUNC_WRITE,
+            2, (uint8_t[]){BENCH_URPC_I16, BENCH_URPC_VARY}, (const void*[]){&fd, line}, (uint16_t[]){2, size},
+            size, NULL, 0
+        );
+        offset += size;
+
+        //Check file position every 16 lines
+        if (i%16==15) {
+            int16_t zero = 0, whence = 1;
+            bench_rpc(
+                trace, BENCH_FUNC_LSEEK,
+                3, (uint8_t[]){BENCH_URPC_I16, BENCH_URPC_I16, BENCH_URPC_I16},
+                (const void*[]){&fd, &zero, &whence}, (uint16_t[]){2, 2, 2},
+                offset, NULL, 0
+            );
+        }
+    }
+
+    bench_rpc(
+        trace, BENCH_FUNC_CLOSE,
+        1, (uint8_t[]){BENCH_URPC_I16}, (const void*[]){&fd}, (uint16_t[]){2},
+        0, NULL, 0
+    );
+}
+
+/**
+ * @brief Build file reading trace: a text file read in 24-byte chunks.
+ *
+ * @param trace Message trace.
+ * @param n_msgs Number of reads.
+ */
+static void bench_trace_read(
+    bench_trace_t* trace,
+    uint16_t n_msgs
+) {
+    int16_t fd = bench_trace_setup(trace, "./config.txt");
+    uint16_t chunk = 24;
+    uint16_t offset = 0;
+
+    for (uint16_t i=0;i<n_msgs;i++) {
+        uint8_t data[24];
+        for (uint16_t j=0;j<chunk;j++)
+            data[j] = bench_text[(offset+j)%(sizeof(bench_text)-1)];
+        offset += chunk;
+
+        bench_rpc(
+            trace, BENCH_FUNC_READ,
+            2, (uint8_t[]){BENCH_URPC_I16, BENCH_URPC_U16}, (const void*[]){&fd, &chunk}, (uint16_t[]){2, 2},
+            0, data, chunk
+        );
+    }
+}
+
+/**
+ * @brief Build binary sensor trace: 16-bit samples written to a file in blocks of 8.
+ *
+ * @param trace Message trace.
+ * @param n_msgs Number of writes.
+ */
+static void bench_trace_samples(
+    bench_trace_t* trace,
+    uint16_t n_msgs
+) {
+    int16_t fd = bench_trace_setup(trace, "./adc.bin");
+    uint16_t sample = 2048;
+
+    for (uint16_t i=0;i<n_msgs;i++) {
+        uint16_t block[8];
+        for (uint8_t j=0;j<8;j++) {
+            sample += (bench_rand(trace)%33)-16;
+            block[j] = sample;
+        }
+
+        bench_rpc(
+            trace, BENCH_FUNC_WRITE,
+            2, (uint8_t[]){BENCH_URPC_I16, BENCH_URPC_VARY},
+            (const void*[]){&fd, block}, (uint16_t[]){2, sizeof(block)},
+            sizeof(block), NULL, 0
+        );
+    }
+}
+
+/**
+ * @brief Build random trace: incompressible 32-byte messages in both directions.
+ *
+ * @param trace Message trace.
+ * @param n_msgs Number of messages per direction.
+ */
+static void bench_trace_random(
+    bench_trace_t* trace,
+    uint16_t n_msgs
+) {
+    for (uint16_t i=0;i<2*n_msgs;i++) {
+        bench_msg_t* msg = bench_msg_new(trace, i&1);
+        if (!msg)
+            return;
+        for (uint8_t j=0;j<32;j++)
+            msg->data[j] = bench_rand(trace);
+        msg->size = 32;
+    }
+}
+
+/// Direction results type
+typedef struct bench_dir {
+    /// Message bytes
+    uint32_t n_bytes;
+    /// Compressed bytes
+    uint32_t n_compressed;
+    /// Encoding TSC cycles
+    uint64_t enc_cycles;
+    /// Decoding TSC cycles
+    uint64_t dec_cycles;
+} bench_dir_t;
+
+/**
+ * @brief Compress and decompress one direction of a trace.
+ *
+ * @param trace Message trace.
+ * @param up Uplink direction.
+ * @param n_symbols Maximum number of symbols in tree.
+ * @param per_msg Compress every message on its own.
+ * @param n_iters Number of iterations.
+ * @param result Direction results.
+ * @return WIO_ERR_INVALID if a message didn't survive the round trip, otherwise WIO_OK.
+ */
+static wio_status_t bench_dir_run(
+    bench_trace_t* trace,
+    bool up,
+    uint8_t n_symbols,
+    bool per_msg,
+    uint32_t n_iters,
+    bench_dir_t* result
+) {
+    static uint8_t encoded[BENCH_TRACE_MAX][BENCH_MSG_MAX+1];
+    static uint16_t encoded_sizes[BENCH_TRACE_MAX];
+    uint8_t decoded[BENCH_MSG_MAX];
+    wtp_fgk_t encoder, decoder;
+
+    memset(result, 0, sizeof(bench_dir_t));
+    WIO_TRY(wtp_fgk_init(&encoder, n_symbols))
+    WIO_TRY(wtp_fgk_init(&decoder, n_symbols))
+
+    for (uint32_t iter=0;iter<n_iters;iter++) {
+        WIO_TRY(wtp_fgk_reset(&encoder))
+        WIO_TRY(wtp_fgk_reset(&decoder))
+
+        //Encode
+        uint64_t begin = __rdtsc();
+        for (uint16_t i=0;i<trace->n_msgs;i++) {
+            bench_msg_t* msg = trace->msgs+i;
+            if (msg->up!=up)
+                continue;
+            if (per_msg)
+                WIO_TRY(wtp_fgk_reset(&encoder))
+            WIO_TRY(wtp_fgk_encode(&encoder, msg->data, msg->size, encoded[i], encoded_sizes+i))
+        }
+        result->enc_cycles += __rdtsc()-begin;
+
+        //Decode
+        begin = __rdtsc();
+        for (uint16_t i=0;i<trace->n_msgs;i++) {
+            if (trace->msgs[i].up!=up)
+                continue;
+            WIO_TRY(wtp_fgk_decode(&decoder, encoded[i], encoded_sizes[i], decoded, BENCH_MSG_MAX, NULL))
+        }
+        result->dec_cycles += __rdtsc()-begin;
+    }
+
+    //Verify round trip and count bytes
+    WIO_TRY(wtp_fgk_reset(&decoder))
+    for (uint16_t i=0;i<trace->n_msgs;i++) {
+        bench_msg_t* msg = trace->msgs+i;
+        uint16_t size;
+        if (msg->up!=up)
+            continue;
+        WIO_TRY(wtp_fgk_decode(&decoder, encoded[i], encoded_sizes[i], decoded, BENCH_MSG_MAX, &size))
+        if ((size!=msg->size)||memcmp(decoded, msg->data, size))
+            return WIO_ERR_INVALID;
+
+        result->n_bytes += msg->size;
+        result->n_compressed += encoded_sizes[i];
+    }
+
+    wtp_fgk_fini(&encoder);
+    wtp_fgk_fini(&decoder);
+    return WIO_OK;
+}
+
+int main(int argc, char** argv) {
+    uint32_t n_iters = 200;
+    uint16_t n_msgs = 200;
+    uint32_t seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:r:h"))!=-1) {
+        switch (opt) {
+            case 'n': n_iters = strtoul(optarg, NULL, 0); break;
+            case 'm': n_msgs = strtoul(optarg, NULL, 0); break;
+            case 'r': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    if ((n_iters==0)||(n_msgs==0)||(seed==0)) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    static bench_trace_t traces[BENCH_TRACES];
+    static const char* trace_names[BENCH_TRACES] = {"fs-log", "fs-read", "samples", "random"};
+    static void (*const trace_builders[BENCH_TRACES])(bench_trace_t*, uint16_t) = {
+        bench_trace_log, bench_trace_read, bench_trace_samples, bench_trace_random
+    };
+    for (uint8_t i=0;i<BENCH_TRACES;i++) {
+        traces[i].name = trace_names[i];
+        traces[i].rand = seed;
+        trace_builders[i](traces+i, n_msgs);
+    }
+
+    static const uint8_t symbol_counts[] = {16, 32, 64, 127};
+    static const char* mode_names[] = {"stream", "message"};
+
+    printf("%-8s %7s %5s %-7s | %7s %7s | %8s %8s | %9s %9s\n",
+        "trace", "symbols", "tree", "mode", "up", "down", "enc c/B", "dec c/B", "up bytes", "down bytes");
+    for (uint8_t t=0;t<BENCH_TRACES;t++)
+        for (uint8_t s=0;s<sizeof(symbol_counts);s++)
+            for (uint8_t mode=0;mode<2;mode++) {
+                bench_dir_t dirs[2];
+                for (uint8_t up=0;up<2;up++)
+                    if (bench_dir_run(traces+t, up, symbol_counts[s], mode, n_iters, dirs+up)!=WIO_OK) {
+                        fprintf(stderr, "Round trip failed: %s, %u symbols\n", traces[t].name, symbol_counts[s]);
+                        return 2;
+                    }
+
+                uint32_t n_bytes = dirs[0].n_bytes+dirs[1].n_bytes;
+                printf("%-8s %7u %5zu %-7s | %7.3f %7.3f | %8.1f %8.1f | %9u %9u\n",
+                    traces[t].name,
+                    symbol_counts[s],
+                    (2*symbol_counts[s]+1)*sizeof(wtp_fgk_node_t),
+                    mode_names[mode],
+                    (double)dirs[1].n_compressed/dirs[1].n_bytes,
+                    dirs[0].n_bytes?(double)dirs[0].n_compressed/dirs[0].n_bytes:1.0,
+                    (double)(dirs[0].enc_cycles+dirs[1].enc_cycles)/n_iters/n_bytes,
+                    (double)(dirs[0].dec_cycles+dirs[1].dec_cycles)/n_iters/n_bytes,
+                    dirs[1].n_bytes,
+                    dirs[0].n_bytes
+                );
+            }
+
+    return 0;
+}
@@ -0,0 +1,372 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../sim/link.h"
+
+//EPC latency benchmark: control packets are queued at random on the client,
+//and the number of rounds until the reader reports them in an EPC is measured
+//for each packet class and a range of EPC cadences.
+
+/// Number of packet classes
+#define BENCH_CLASSES 4
+/// Maximum number of queued packets per class
+#define BENCH_QUEUE_MAX 64
+/// Latency histogram size in rounds (Longer latencies are counted in the last bucket)
+#define BENCH_HIST_MAX 256
+
+/// Packet class names (In EPC priority order)
+static const char* bench_class_names[BENCH_CLASSES] = {"ack", "open/close", "req-uplink", "set-param"};
+
+/// Benchmark options type
+typedef struct bench_opts {
+    /// Number of RFID rounds per cadence
+    uint32_t n_rounds;
+    /// Probability of queueing a packet of each class in a round
+    double p_queue[BENCH_CLASSES];
+    /// Probability of missing the tag in a round
+    double p_miss;
+    /// Probability of losing the tag report of an observed EPC
+    double p_loss;
+    /// Random seed
+    uint32_t seed;
+} bench_opts_t;
+
+/// Per-class statistics type
+typedef struct bench_class_stats {
+    /// Enqueue rounds of packets waiting for EPC
+    uint32_t queue[BENCH_QUEUE_MAX];
+    /// Number of packets waiting for EPC
+    uint8_t n_queued;
+    /// Enqueue rounds of packets in current EPC content
+    uint32_t in_epc[BENCH_QUEUE_MAX];
+    /// Number of packets in current EPC content
+    uint8_t n_in_epc;
+
+    /// Number of queued packets
+    uint32_t n_packets;
+    /// Number of reported packets
+    uint32_t n_reported;
+    /// Number of packets replaced in EPC before being reported
+    uint32_t n_lost;
+    /// Sum of latencies in rounds
+    uint64_t latency_sum;
+    /// Latency histogram
+    uint32_t hist[BENCH_HIST_MAX];
+} bench_class_stats_t;
+
+/**
+ * @brief Get next pseudo-random number in [0, 1).
+ *
+ * @param state Xorshift generator state.
+ * @return Pseudo-random number.
+ */
+static double bench_random(
+    uint32_t* state
+) {
+    uint32_t x = *state;
+
+    x ^= x<<13;
+    x ^= x>>17;
+    x ^= x<<5;
+    *state = x;
+
+    return x/4294967296.0;
+}
+
+/**
+ * @brief Get packet class of a control packet.
+ *
+ * @param pkt_type Packet type.
+ * @return Packet class.
+ */
+static uint8_t bench_class(
+    wtp_pkt_t pkt_type
+) {
+    if ((pkt_type==WTP_PKT_ACK)||(pkt_type==WTP_PKT_SACK))
+        return 0;
+    else if ((pkt_type==WTP_PKT_OPEN_PARAM)||(pkt_type==WTP_PKT_CLOSE))
+        return 1;
+    else if (pkt_type==WTP_PKT_REQ_UPLINK)
+        return 2;
+    else
+        return 3;
+}
+
+/**
+ * @brief Queue a control packet of given class on the client.
+ *
+ * Acknowledgements are coalesced by the client, so an acknowledgement is only
+ * queued when none is pending.
+ *
+ * @param wtp WTP endpoint instance.
+ * @param cls Packet class.
+ * @param index Packet index (Makes packets of the same class differ).
+ * @return Whether a new packet is queued.
+ */
+static bool bench_queue_packet(
+    wtp_t* wtp,
+    uint8_t cls,
+    uint32_t index
+) {
+    wtp_tx_ctrl_t* tx_ctrl = &wtp->_tx_ctrl;
+    wio_buf_t* pkt_buf = &tx_ctrl->_pkt_buf;
+    uint8_t data[3] = {(uint8_t)index, (uint8_t)(index>>8), (uint8_t)(index>>16)};
+
+    switch (cls) {
+        //Acknowledgement (Built from receive state when EPC is refreshed)
+        case 0:
+            if (wtp->_ack_pending)
+                return false;
+            wtp->_ack_pending = true;
+            return true;
+        //Open or close
+        case 1:
+            if (index&1) {
+                if (wtp_tx_begin_packet(tx_ctrl, WTP_PKT_CLOSE)!=WIO_OK)
+                    return false;
+            } else {
+                if (wtp_tx_begin_packet(tx_ctrl, WTP_PKT_OPEN_PARAM)!=WIO_OK)
+                    return false;
+                wio_write(pkt_buf, data, 2);
+            }
+            break;
+        //Request uplink
+        case 2:
+            if (wtp_tx_begin_packet(tx_ctrl, WTP_PKT_REQ_UPLINK)!=WIO_OK)
+                return false;
+            wio_write(pkt_buf, data, 3);
+            break;
+        //Set parameter (Window size)
+        default:
+            if (wtp_tx_begin_packet(tx_ctrl, WTP_PKT_SET_PARAM)!=WIO_OK)
+                return false;
+            wio_write(pkt_buf, &WTP_PARAM_WINDOW_SIZE, 1);
+            wio_write(pkt_buf, data, 2);
+            break;
+    }
+    wtp_tx_end_packet(tx_ctrl);
+
+    return true;
+}
+
+/**
+ * @brief Move packets of refreshed EPC content out of the per-class queues.
+ *
+ * Packets of the previous EPC content that were never reported are counted as lost.
+ *
+ * @param stats Per-class statistics.
+ * @param epc EPC memory of the tag.
+ */
+static void bench_handle_refresh(
+    bench_class_stats_t* stats,
+    const uint8_t* epc
+) {
+    for (uint8_t i=0;i<BENCH_CLASSES;i++) {
+        stats[i].n_lost += stats[i].n_in_epc;
+        stats[i].n_in_epc = 0;
+    }
+
+    //Packets follow WISP ID and class
+    for (uint8_t pos=2;pos<WTP_SIM_EPC_SIZE;) {
+        wtp_pkt_t pkt_type = epc[pos];
+        uint8_t pkt_size;
+
+        if (pkt_type==WTP_PKT_END)
+            break;
+        else if ((pkt_type==WTP_PKT_OPEN_PARAM)||(pkt_type==WTP_PKT_ACK))
+            pkt_size = 3;
+        else if ((pkt_type==WTP_PKT_REQ_UPLINK)||(pkt_type==WTP_PKT_SET_PARAM))
+            pkt_size = 4;
+        else
+            pkt_size = 1;
+        pos += pkt_size;
+
+        //Oldest queued packet of the class goes into EPC first
+        bench_class_stats_t* cls = stats+bench_class(pkt_type);
+        if (cls->n_queued==0)
+            continue;
+        cls->in_epc[cls->n_in_epc++] = cls->queue[0];
+        memmove(cls->queue, cls->queue+1, (cls->n_queued-1)*sizeof(uint32_t));
+        cls->n_queued--;
+    }
+}
+
+/**
+ * @brief Run benchmark with given EPC cadence.
+ *
+ * @param opts Benchmark options.
+ * @param cadence EPC cadence.
+ * @param stats Per-class statistics.
+ * @param n_updates Number of EPC updates.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wio_status_t bench_run(
+    bench_opts_t* opts,
+    uint8_t cadence,
+    bench_class_stats_t* stats,
+    uint32_t* n_updates
+) {
+    wtp_sim_link_t* link = calloc(1, sizeof(wtp_sim_link_t));
+    uint8_t epc[WTP_SIM_EPC_SIZE];
+    uint32_t rand_state = opts->seed;
+    wio_status_t status = WIO_OK;
+
+    if (!link)
+        return WIO_ERR_NO_MEMORY;
+    memset(stats, 0, BENCH_CLASSES*sizeof(bench_class_stats_t));
+    //Same configuration as the ERT runtime
+    WIO_TRY(wtp_sim_link_init(link, 0x5101, 64, 10, 200, 200, 5, 5))
+    WIO_TRY(wtp_set_epc_cadence(&link->wtp, cadence))
+
+    for (uint32_t round=0;round<opts->n_rounds;round++) {
+        //Queue new packets
+        for (uint8_t i=0;i<BENCH_CLASSES;i++) {
+            bench_class_stats_t* cls = stats+i;
+            if ((bench_random(&rand_state)>=opts->p_queue[i])||(cls->n_queued>=BENCH_QUEUE_MAX))
+                continue;
+            if (bench_queue_packet(&link->wtp, i, cls->n_packets)) {
+                cls->queue[cls->n_queued++] = round;
+                cls->n_packets++;
+            }
+        }
+
+        //Refresh EPC
+        uint32_t prev_updates = link->stats.n_epc_updates;
+        status = wtp_sim_link_before_rfid(link);
+        if (status!=WIO_OK)
+            break;
+        if (link->stats.n_epc_updates!=prev_updates)
+            bench_handle_refresh(stats, link->_epc_mem);
+
+        //Tag missed in this round
+        if (bench_random(&rand_state)<opts->p_miss)
+            continue;
+        wtp_sim_link_inventory(link, epc);
+        //Tag report lost
+        if (bench_random(&rand_state)<opts->p_loss)
+            continue;
+
+        //Packets in EPC reported to the server
+        for (uint8_t i=0;i<BENCH_CLASSES;i++) {
+            bench_class_stats_t* cls = stats+i;
+            for (uint8_t j=0;j<cls->n_in_epc;j++) {
+                uint32_t latency = round-cls->in_epc[j];
+                cls->n_reported++;
+                cls->latency_sum += latency;
+                cls->hist[(latency<BENCH_HIST_MAX)?latency:BENCH_HIST_MAX-1]++;
+            }
+            cls->n_in_epc = 0;
+        }
+    }
+    *n_updates = link->stats.n_epc_updates;
+
+    wtp_sim_link_fini(link);
+    free(link);
+    return status;
+}
+
+/**
+ * @brief Get latency percentile from histogram.
+ *
+ * @param stats Class statistics.
+ * @param pct Percentile.
+ * @return Latency in rounds.
+ */
+static uint32_t bench_percentile(
+    bench_class_stats_t* stats,
+    double pct
+) {
+    uint32_t target = (uint32_t)(stats->n_reported*pct/100.0);
+    uint32_t count = 0;
+
+    for (uint32_t i=0;i<BENCH_HIST_MAX;i++) {
+        count += stats->hist[i];
+        if (count>target)
+            return i;
+    }
+    return BENCH_HIST_MAX-1;
+}
+
+/**
+ * @brief Print benchmark usage.
+ *
+ * @param prog Program name.
+ */
+static void bench_usage(
+    const char* prog
+) {
+    fprintf(stderr,
+        "Usage: %s [-n rounds] [-p p_ack,p_open_close,p_req_uplink,p_set_param]\n"
+        "          [-m p_miss] [-l p_loss] [-S seed]\n",
+        prog
+    );
+}
+
+int main(int argc, char** argv) {
+    bench_opts_t opts;
+    bench_class_stats_t stats[BENCH_CLASSES];
+    int opt;
+
+    //Default options
+    opts.n_rounds = 100000;
+    opts.p_queue[0] = 0.05;
+    opts.p_queue[1] = 0.005;
+    opts.p_queue[2] = 0.02;
+    opts.p_queue[3] = 0.01;
+    opts.p_miss = 0.1;
+    opts.p_loss = 0.05;
+    opts.seed = 1;
+
+    while ((opt = getopt(argc, argv, "n:p:m:l:S:h"))!=-1) {
+        switch (opt) {
+            case 'n': opts.n_rounds = strtoul(optarg, NULL, 0); break;
+            case 'm': opts.p_miss = strtod(optarg, NULL); break;
+            case 'l': opts.p_loss = strtod(optarg, NULL); break;
+            case 'S': opts.seed = strtoul(optarg, NULL, 0); break;
+            case 'p':
+                if (sscanf(optarg, "%lf,%lf,%lf,%lf",
+                    opts.p_queue, opts.p_queue+1, opts.p_queue+2, opts.p_queue+3)!=4) {
+                    bench_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    //Xorshift state must not be zero
+    if ((opts.n_rounds==0)||(opts.seed==0)) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    static const uint8_t cadences[] = {1, 2, 4, 8, 16};
+
+    printf("%7s %-10s %8s %8s %8s %8s %8s %8s\n",
+        "cadence", "class", "packets", "lost", "mean", "p50", "p99", "updates");
+    for (size_t i=0;i<sizeof(cadences);i++) {
+        uint32_t n_updates;
+
+        if (bench_run(&opts, cadences[i], stats, &n_updates)!=WIO_OK) {
+            fprintf(stderr, "Benchmark failed\n");
+            return 2;
+        }
+        for (uint8_t j=0;j<BENCH_CLASSES;j++) {
+            bench_class_stats_t* cls = stats+j;
+            printf("%7u %-10s %8u %8u %8.2f %8u %8u %8u\n",
+                cadences[i],
+                bench_class_names[j],
+                cls->n_packets,
+                cls->n_lost,
+                cls->n_reported?(double)cls->latency_sum/cls->n_reported:0.0,
+                bench_percentile(cls, 50),
+                bench_percentile(cls, 99),
+                n_updates
+            );
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../sim/link.h"
+#include "../sim/reader.h"
+
+//Loopback benchmark: the client sends messages on the uplink,
+//the virtual reader echoes each of them back on the downlink.
+
+/// Maximum message size
+#define BENCH_MSG_MAX 1024
+/// Maximum number of messages in flight
+#define BENCH_INFLIGHT_MAX 8
+
+/// Benchmark options type
+typedef struct bench_opts {
+    /// Number of RFID rounds
+    uint32_t n_rounds;
+    /// Message size
+    uint16_t msg_size;
+    /// Maximum number of messages in flight (Sent but not echoed back)
+    uint8_t n_inflight;
+    /// BlockWrite data size
+    uint8_t write_size;
+    /// Read size (0 for the client default)
+    uint8_t read_size;
+    /// Sliding window size
+    uint16_t window_size;
+    /// Transmit control buffer size
+    uint16_t tx_buf_size;
+    /// Receive control buffer size
+    uint16_t rx_buf_size;
+    /// EPC cadence (Observations of EPC content before it is refreshed)
+    uint8_t epc_cadence;
+    /// Inventory time per round (us)
+    uint32_t inventory_us;
+    /// Fixed time per OpSpec (us)
+    uint32_t opspec_us;
+    /// Time per word read or written (us)
+    uint32_t word_us;
+    /// Send messages from caller memory ("wtp_send_ref()")
+    bool send_ref;
+    /// Uplink only (Messages are not echoed back)
+    bool uplink_only;
+    /// Requested downlink checksum algorithm
+    wtp_checksum_t checksum;
+    /// Requested data packet framing
+    wtp_framing_t framing;
+} bench_opts_t;
+
+/// Benchmark state type
+typedef struct bench {
+    /// Virtual link
+    wtp_sim_link_t link;
+    /// Virtual reader
+    wtp_sim_reader_t reader;
+    /// Options
+    bench_opts_t opts;
+
+    /// Connected flag
+    bool connected;
+    /// Messages in flight
+    uint8_t n_inflight;
+    /// Messages sent
+    uint32_t n_sent;
+    /// Messages echoed back
+    uint32_t n_echoed;
+    /// Echoed bytes
+    uint32_t echoed_bytes;
+    /// Messages acknowledged by the virtual reader
+    uint32_t n_acked;
+    /// Corrupted echoes
+    uint32_t n_corrupted;
+    /// Failed sends
+    uint32_t n_send_errors;
+    /// Messages the virtual reader failed to echo
+    uint32_t n_echo_errors;
+    /// Messages in flight (Borrowed by the client when sending by reference)
+    uint8_t msgs[BENCH_INFLIGHT_MAX][BENCH_MSG_MAX];
+} bench_t;
+
+/**
+ * @brief Fill message with test pattern.
+ *
+ * @param data Message data.
+ * @param size Message size.
+ * @param index Message index.
+ */
+static void bench_pattern(
+    uint8_t* data,
+    uint16_t size,
+    uint32_t index
+) {
+    for (uint16_t i=0;i<size;i++)
+        data[i] = (uint8_t)(index*31+i);
+}
+
+/**
+ * @brief Echo uplink messages back on the downlink.
+ */
+static WIO_CALLBACK(bench_reader_on_recv) {
+    bench_t* bench = (bench_t*)data;
+    wio_buf_t* msg_buf = (wio_buf_t*)result;
+
+    if (wtp_sim_reader_send(&bench->reader, msg_buf->buffer, msg_buf->size)!=WIO_OK)
+        bench->n_echo_errors++;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Client message sent callback.
+ */
+static WIO_CALLBACK(bench_on_sent) {
+    bench_t* bench = (bench_t*)data;
+
+    bench->n_acked++;
+    //Message slot is released once acknowledged when messages are not echoed back
+    if (bench->opts.uplink_only)
+        bench->n_inflight--;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Client message received callback.
+ */
+static WIO_CALLBACK(bench_on_recv) {
+    bench_t* bench = (bench_t*)data;
+    wio_buf_t* msg_buf = (wio_buf_t*)result;
+    uint8_t expected[BENCH_MSG_MAX];
+
+    //Keep receiving
+    WIO_TRY(wtp_recv(&bench->link.wtp, bench, bench_on_recv))
+
+    //Verify echoed message
+    bench_pattern(expected, bench->opts.msg_size, bench->n_echoed);
+    if ((msg_buf->size!=bench->opts.msg_size)||memcmp(msg_buf->buffer, expected, msg_buf->size))
+        bench->n_corrupted++;
+    bench->n_echoed++;
+    bench->echoed_bytes += msg_buf->size;
+    bench->n_inflight--;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Client connection opened callback.
+ */
+static WIO_CALLBACK(bench_on_open) {
+    bench_t* bench = (bench_t*)data;
+
+    bench->connected = true;
+    WIO_TRY(wtp_recv(&bench->link.wtp, bench, bench_on_recv))
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Print benchmark usage.
+ *
+ * @param prog Program name.
+ */
+static void bench_usage(
+    const char* prog
+) {
+    fprintf(stderr,
+        "Usage: %s [-n rounds] [-s msg_size] [-i n_inflight] [-w write_size]\n"
+        "          [-R read_size] [-W window_size] [-b tx_buf_size,rx_buf_size] [-e epc_cadence]\n"
+        "          [-t inventory_us,opspec_us,word_us] [-r] [-u] [-x] [-c]\n",
+        prog
+    );
+}
+
+int main(int argc, char** argv) {
+    bench_t* bench = calloc(1, sizeof(bench_t));
+    bench_opts_t* opts = &bench->opts;
+    int opt;
+
+    //Default options
+    opts->n_rounds = 100000;
+    opts->msg_size = 32;
+    opts->n_inflight = 2;
+    opts->write_size = 24;
+    opts->window_size = 64;
+    opts->tx_buf_size = 200;
+    opts->rx_buf_size = 200;
+    opts->epc_cadence = 1;
+    opts->inventory_us = 3000;
+    opts->opspec_us = 2000;
+    opts->word_us = 250;
+    opts->checksum = WTP_CHECKSUM_CRC16;
+    opts->framing = WTP_FRAMING_STANDARD;
+
+    while ((opt = getopt(argc, argv, "n:s:i:w:R:W:b:e:t:ruxch"))!=-1) {
+        switch (opt) {
+            case 'n': opts->n_rounds = strtoul(optarg, NULL, 0); break;
+            case 's': opts->msg_size = strtoul(optarg, NULL, 0); break;
+            case 'i': opts->n_inflight = strtoul(optarg, NULL, 0); break;
+            case 'w': opts->write_size = strtoul(optarg, NULL, 0); break;
+            case 'R': opts->read_size = strtoul(optarg, NULL, 0); break;
+            case 'W': opts->window_size = strtoul(optarg, NULL, 0); break;
+            case 'e': opts->epc_cadence = strtoul(optarg, NULL, 0); break;
+            case 'r': opts->send_ref = true; break;
+            case 'u': opts->uplink_only = true; break;
+            case 'x': opts->checksum = WTP_CHECKSUM_XOR; break;
+            case 'c': opts->framing = WTP_FRAMING_COMPACT; break;
+            case 'b':
+                if (sscanf(optarg, "%hu,%hu", &opts->tx_buf_size, &opts->rx_buf_size)!=2) {
+                    bench_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                if (sscanf(optarg, "%u,%u,%u", &opts->inventory_us, &opts->opspec_us, &opts->word_us)!=3) {
+                    bench_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    if ((opts->msg_size==0)||(opts->msg_size>BENCH_MSG_MAX)||(opts->epc_cadence==0)
+        ||(opts->n_inflight==0)||(opts->n_inflight>BENCH_INFLIGHT_MAX)||(opts->read_size>WTP_SIM_READ_MEM_SIZE)) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    //Virtual link and client (Same configuration as the ERT runtime)
+    if (wtp_sim_link_init(&bench->link, 0x5101, opts->window_size, 10, opts->tx_buf_size, opts->rx_buf_size, 5, 5)!=WIO_OK) {
+        fprintf(stderr, "Failed to initialize client\n");
+        return 1;
+    }
+    wtp_set_epc_cadence(&bench->link.wtp, opts->epc_cadence);
+    //Virtual reader
+    if (wtp_sim_reader_init(&bench->reader, &bench->link, opts->write_size, opts->window_size, 64)!=WIO_OK) {
+        fprintf(stderr, "Invalid BlockWrite size\n");
+        return 1;
+    }
+    bench->reader.read_size = opts->read_size;
+    if (!opts->uplink_only)
+        bench->reader.on_recv = bench_reader_on_recv;
+    bench->reader.on_recv_data = bench;
+
+    //Connect to virtual reader
+    wtp_t* wtp = &bench->link.wtp;
+    wtp_on_event(wtp, WTP_EVENT_OPEN, bench, bench_on_open);
+    wtp_set_checksum(wtp, opts->checksum);
+    if (wtp_set_framing(wtp, opts->framing)!=WIO_OK) {
+        fprintf(stderr, "Window too big for compact framing\n");
+        return 1;
+    }
+    wtp_connect(wtp);
+
+    uint64_t sim_us = 0;
+    uint64_t begin_ns = wtp_sim_now_ns();
+
+    for (uint32_t round=0;round<opts->n_rounds;round++) {
+        //Keep messages in flight
+        while (bench->connected&&(bench->n_inflight<opts->n_inflight)) {
+            //(A message slot is reused only after its message is echoed back, long after it is acknowledged)
+            uint8_t* msg = bench->msgs[bench->n_sent%opts->n_inflight];
+            bench_pattern(msg, opts->msg_size, bench->n_sent);
+            wio_status_t status = opts->send_ref
+                ?wtp_send_ref(wtp, msg, opts->msg_size, bench, bench_on_sent)
+                :wtp_send(wtp, msg, opts->msg_size, bench, bench_on_sent);
+            if (status!=WIO_OK) {
+                bench->n_send_errors++;
+                break;
+            }
+            bench->n_inflight++;
+            bench->n_sent++;
+        }
+
+        //RFID round
+        uint16_t op_words;
+        wtp_sim_reader_round(&bench->reader, &op_words);
+
+        //Simulated round time
+        uint32_t round_us = opts->inventory_us;
+        if (op_words)
+            round_us += opts->opspec_us+op_words*opts->word_us;
+        sim_us += round_us;
+        wtp_sim_link_advance(&bench->link, (uint32_t)(sim_us/1000)-bench->link._time);
+    }
+
+    double wall_s = (wtp_sim_now_ns()-begin_ns)/1e9;
+    double sim_s = sim_us/1e6;
+    wtp_sim_stats_t* cs = &bench->link.stats;
+    wtp_sim_reader_stats_t* rs = &bench->reader.stats;
+    uint32_t n_client_calls = cs->n_reads+cs->n_blockwrites+cs->n_epc_updates;
+    uint64_t client_ns = cs->read_ns+cs->blockwrite_ns+cs->epc_ns;
+
+    printf("rounds             %u (%.0f rounds/s wall, %.1f s simulated)\n", rs->n_rounds, rs->n_rounds/wall_s, sim_s);
+    printf("opspecs            %u Read, %u BlockWrite, %u EPC changes\n", rs->n_reads, rs->n_blockwrites, rs->n_epcs);
+    printf("uplink goodput     %u B, %.3f B/round, %.1f B/s simulated\n", rs->up_bytes, (double)rs->up_bytes/rs->n_rounds, rs->up_bytes/sim_s);
+    printf("downlink goodput   %u B, %.3f B/round, %.1f B/s simulated\n", bench->echoed_bytes, (double)bench->echoed_bytes/rs->n_rounds, bench->echoed_bytes/sim_s);
+    printf("payload fraction   %.1f%% of Read bytes, %.1f%% of BlockWrite bytes\n",
+        rs->read_bytes?rs->up_bytes*100.0/rs->read_bytes:0.0,
+        rs->write_bytes?rs->down_bytes*100.0/rs->write_bytes:0.0
+    );
+    printf("messages           %u sent, %u acknowledged, %u echoed, %u corrupted, %u send errors\n", bench->n_sent, bench->n_acked, bench->n_echoed, bench->n_corrupted, bench->n_send_errors);
+    printf("reader             %u uplink drops, %u downlink retx bytes, %u echo errors\n", rs->up_drops, rs->down_retx_bytes, bench->n_echo_errors);
+    printf("client cpu Read    %.0f ns/call (%u calls)\n", cs->n_reads?(double)cs->read_ns/cs->n_reads:0.0, cs->n_reads);
+    printf("client cpu BW      %.0f ns/call (%u calls, %u errors)\n", cs->n_blockwrites?(double)cs->blockwrite_ns/cs->n_blockwrites:0.0, cs->n_blockwrites, cs->n_blockwrite_errors);
+    printf("client cpu EPC     %.0f ns/update (%u updates)\n", cs->n_epc_updates?(double)cs->epc_ns/cs->n_epc_updates:0.0, cs->n_epc_updates);
+    printf("client cpu total   %.0f ns/call, %.1f ns/goodput byte\n",
+        n_client_calls?(double)client_ns/n_client_calls:0.0,
+        (rs->up_bytes+bench->echoed_bytes)?(double)client_ns/(rs->up_bytes+bench->echoed_bytes):0.0
+    );
+
+    //High-water marks of client buffers
+    static const char* buf_names[] = {"pkt", "tx msg", "rx msg", "fragments"};
+    for (wtp_buf_id_t i=0;i<WTP_BUF_MAX;i++) {
+        uint16_t used_max, size;
+
+        wtp_get_mem_usage(&bench->link.wtp, i, NULL, &used_max, &size);
+        printf("client mem %-9s %u/%u B high-water\n", buf_names[i], used_max, size);
+    }
+
+    int exit_code = ((bench->n_corrupted==0)&&(bench->n_echo_errors==0))?0:2;
+    wtp_sim_link_fini(&bench->link);
+    free(bench);
+
+    return exit_code;
+}
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <Math/crc16.h>
+#include "../sim/link.h"
+#include "../sim/reader.h"
+
+//Parse benchmark: CPU time of the client handling BlockWrites full of downlink packets of one type,
+//through "wtp_sim_link_blockwrite()" and so "wtp_handle_blockwrite()" of an opened connection.
+//(Data packets carry consecutive sequence numbers, so every message is new to the client)
+
+/// BlockWrite memory size (Length byte and packets)
+#define BENCH_MEM_SIZE WTP_SIM_WRITE_MEM_SIZE
+/// Payload size of data packets (One message per packet)
+#define BENCH_PAYLOAD_SIZE 4
+/// BlockWrites between two timestamps (Hides timestamp overhead)
+#define BENCH_BATCH 64
+/// Rounds given up after if the connection does not open
+#define BENCH_OPEN_ROUNDS 100
+
+/// Benchmark state type
+typedef struct bench {
+    /// Virtual link
+    wtp_sim_link_t link;
+    /// Virtual reader (Opens the connection)
+    wtp_sim_reader_t reader;
+    /// Connected flag
+    bool connected;
+    /// Next downlink sequence number
+    uint16_t seq_num;
+    /// BlockWrites of a batch
+    uint8_t mem[BENCH_BATCH][BENCH_MEM_SIZE];
+} bench_t;
+
+/**
+ * @brief Print benchmark usage.
+ *
+ * @param prog Program name.
+ */
+static void bench_usage(
+    const char* prog
+) {
+    fprintf(stderr, "Usage: %s [-n iterations] [-x]\n", prog);
+}
+
+/**
+ * Connection opened callback.
+ */
+static WIO_CALLBACK(bench_on_open) {
+    bench_t* bench = (bench_t*)data;
+    bench->connected = true;
+    return WIO_OK;
+}
+
+/**
+ * @brief Append data to BlockWrite memory.
+ *
+ * @param mem BlockWrite memory.
+ * @param pos Write position, advanced past the data.
+ * @param data Data.
+ * @param size Data size.
+ */
+static void bench_put(
+    uint8_t* mem,
+    uint8_t* pos,
+    const void* data,
+    uint8_t size
+) {
+    memcpy(mem+*pos, data, size);
+    *pos += size;
+}
+
+/**
+ * @brief Append a packet with checksum to BlockWrite memory.
+ *
+ * @param bench Benchmark state.
+ * @param mem BlockWrite memory.
+ * @param pos Write position, advanced past the packet.
+ * @param pkt_type Packet type.
+ * @return Whether the packet fits.
+ */
+static bool bench_put_pkt(
+    bench_t* bench,
+    uint8_t* mem,
+    uint8_t* pos,
+    wtp_pkt_t pkt_type
+) {
+    wtp_t* wtp = &bench->link.wtp;
+    uint8_t pkt[16];
+    uint8_t size = 0;
+    //Nothing in flight on the uplink; acknowledge what the client has sent
+    uint16_t ack_seq = wtp->_tx_ctrl._seq_num;
+
+    bench_put(pkt, &size, &pkt_type, 1);
+    if (pkt_type==WTP_PKT_ACK)
+        bench_put(pkt, &size, &ack_seq, 2);
+    else if (pkt_type==WTP_PKT_SACK) {
+        uint8_t n_blocks = 2;
+        bench_put(pkt, &size, &ack_seq, 2);
+        bench_put(pkt, &size, &n_blocks, 1);
+        for (uint8_t i=0;i<n_blocks;i++) {
+            uint16_t begin = ack_seq+2+i*4;
+            uint8_t block_size = 2;
+            bench_put(pkt, &size, &begin, 2);
+            bench_put(pkt, &size, &block_size, 1);
+        }
+    } else {
+        uint16_t msg_size = BENCH_PAYLOAD_SIZE;
+        uint8_t payload_size = BENCH_PAYLOAD_SIZE;
+        uint8_t payload[BENCH_PAYLOAD_SIZE];
+        memset(payload, 0x5a, BENCH_PAYLOAD_SIZE);
+
+        if (pkt_type==WTP_PKT_BEGIN_MSG_ACK)
+            bench_put(pkt, &size, &ack_seq, 2);
+        bench_put(pkt, &size, &msg_size, 2);
+        bench_put(pkt, &size, &bench->seq_num, 2);
+        bench_put(pkt, &size, &payload_size, 1);
+        bench_put(pkt, &size, payload, BENCH_PAYLOAD_SIZE);
+    }
+    //Checksum of negotiated algorithm
+    if (wtp->_checksum==WTP_CHECKSUM_CRC16) {
+        uint16_t crc = crc16_ccitt(CRC_NO_PRELOAD, pkt, size);
+        bench_put(pkt, &size, &crc, 2);
+    } else {
+        uint8_t checksum = wtp_xor_checksum(pkt, 0, size);
+        bench_put(pkt, &size, &checksum, 1);
+    }
+
+    if (*pos+size>BENCH_MEM_SIZE)
+        return false;
+    bench_put(mem, pos, pkt, size);
+    //Next message
+    if ((pkt_type==WTP_PKT_BEGIN_MSG)||(pkt_type==WTP_PKT_BEGIN_MSG_ACK))
+        bench->seq_num += BENCH_PAYLOAD_SIZE;
+    return true;
+}
+
+/**
+ * @brief Fill BlockWrite memory with packets of one type.
+ *
+ * @param bench Benchmark state.
+ * @param mem BlockWrite memory.
+ * @param pkt_type Packet type.
+ * @return Number of packets.
+ */
+static uint8_t bench_fill(
+    bench_t* bench,
+    uint8_t* mem,
+    wtp_pkt_t pkt_type
+) {
+    //Packets follow the BlockWrite length byte
+    uint8_t pos = 1;
+    uint8_t n_pkts = 0;
+
+    while (bench_put_pkt(bench, mem, &pos, pkt_type))
+        n_pkts++;
+    mem[0] = pos-1;
+
+    return n_pkts;
+}
+
+/**
+ * @brief Measure handling of BlockWrites of one packet type.
+ *
+ * @param bench Benchmark state.
+ * @param pkt_type Packet type.
+ * @param n_iters Number of timed batches of BlockWrites.
+ * @param _n_pkts Used for returning number of packets per BlockWrite.
+ * @param ns Least mean time per BlockWrite in a batch.
+ * @return Error code if a BlockWrite failed, otherwise WIO_OK.
+ */
+static wio_status_t bench_run(
+    bench_t* bench,
+    wtp_pkt_t pkt_type,
+    uint32_t n_iters,
+    uint8_t* _n_pkts,
+    double* ns
+) {
+    wtp_sim_stats_t* stats = &bench->link.stats;
+    uint64_t best = UINT64_MAX;
+    uint8_t n_pkts = 0;
+
+    for (uint32_t i=0;i<n_iters;i++) {
+        //BlockWrites are made before timing, as data packets go on with sequence numbers
+        for (uint8_t j=0;j<BENCH_BATCH;j++)
+            n_pkts = bench_fill(bench, bench->mem[j], pkt_type);
+
+        uint64_t begin_ns = stats->blockwrite_ns;
+        for (uint8_t j=0;j<BENCH_BATCH;j++)
+            WIO_TRY(wtp_sim_link_blockwrite(&bench->link, bench->mem[j], BENCH_MEM_SIZE))
+        uint64_t elapsed = stats->blockwrite_ns-begin_ns;
+        if (elapsed<best)
+            best = elapsed;
+    }
+    *_n_pkts = n_pkts;
+    *ns = (double)best/BENCH_BATCH;
+
+    return WIO_OK;
+}
+
+int main(int argc, char** argv) {
+    uint32_t n_iters = 2000;
+    wtp_checksum_t checksum = WTP_CHECKSUM_CRC16;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:xh"))!=-1) {
+        switch (opt) {
+            case 'n': n_iters = strtoul(optarg, NULL, 0); break;
+            case 'x': checksum = WTP_CHECKSUM_XOR; break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (n_iters==0) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    //Open connection through virtual reader
+    bench_t* bench = calloc(1, sizeof(bench_t));
+    wtp_t* wtp = &bench->link.wtp;
+    if ((!bench)||(wtp_sim_link_init(&bench->link, 0x5101, 64, 10, 200, 200, 5, 5)!=WIO_OK)
+        ||(wtp_sim_reader_init(&bench->reader, &bench->link, 24, 64, 64)!=WIO_OK)) {
+        fprintf(stderr, "Failed to initialize client\n");
+        return 1;
+    }
+    wtp_on_event(wtp, WTP_EVENT_OPEN, bench, bench_on_open);
+    wtp_set_checksum(wtp, checksum);
+    wtp_connect(wtp);
+    for (uint32_t round=0;(round<BENCH_OPEN_ROUNDS)&&(wtp->_downlink_state!=WTP_STATE_OPENED);round++)
+        wtp_sim_reader_round(&bench->reader, NULL);
+    if (!bench->connected||(wtp->_downlink_state!=WTP_STATE_OPENED)) {
+        fprintf(stderr, "Failed to open connection\n");
+        return 1;
+    }
+    bench->seq_num = wtp->_rx_ctrl._seq_num;
+
+    const wtp_pkt_t pkt_types[] = {
+        WTP_PKT_ACK, WTP_PKT_SACK, WTP_PKT_BEGIN_MSG, WTP_PKT_BEGIN_MSG_ACK
+    };
+    static const char* names[] = {"ack", "sack", "begin", "begin+ack"};
+
+    printf("%-10s %6s | %8s %8s\n", "packet", "pkt/BW", "ns/BW", "ns/pkt");
+    for (size_t i=0;i<sizeof(pkt_types)/sizeof(pkt_types[0]);i++) {
+        uint8_t n_pkts;
+        double ns;
+
+        if (bench_run(bench, pkt_types[i], n_iters, &n_pkts, &ns)!=WIO_OK) {
+            fprintf(stderr, "Client failed to handle %s packets\n", names[i]);
+            return 2;
+        }
+        printf("%-10s %6u | %8.1f %8.1f\n", names[i], n_pkts, ns, ns/n_pkts);
+    }
+
+    wtp_sim_link_fini(&bench->link);
+    free(bench);
+    return 0;
+}
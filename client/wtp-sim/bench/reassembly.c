@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <Math/crc16.h>
+#include "../sim/link.h"
+#include "../sim/reader.h"
+
+//Reassembly benchmark: downlink packets are handed to an opened client out of order,
+//so that staged data fragments become consecutive while the message data ring is full.
+//The client must still receive every message, and stop acknowledging fragments selectively
+//once they are appended.
+
+/// Client receive control buffer size (Message data ring and data fragments buffer take half each)
+#define BENCH_RX_BUF_SIZE 400
+/// Message size (Two messages don't fit into the message data ring at once)
+#define BENCH_MSG_SIZE 100
+/// Payload size of data packets
+#define BENCH_PAYLOAD_SIZE 20
+/// Number of messages
+#define BENCH_N_MSGS 2
+/// Rounds given up after if the connection does not open
+#define BENCH_OPEN_ROUNDS 100
+
+/// Benchmark state type
+typedef struct bench {
+    /// Virtual link
+    wtp_sim_link_t link;
+    /// Virtual reader (Opens the connection)
+    wtp_sim_reader_t reader;
+    /// Connected flag
+    bool connected;
+    /// Downlink sequence number of the first message
+    uint16_t base_seq;
+    /// Messages received
+    uint8_t n_recvd;
+    /// Corrupted messages received
+    uint8_t n_corrupted;
+} bench_t;
+
+/**
+ * @brief Get a byte of message data.
+ *
+ * @param msg Message index.
+ * @param offset Offset in message.
+ * @return Message data byte.
+ */
+static uint8_t bench_msg_byte(
+    uint8_t msg,
+    uint16_t offset
+) {
+    return (uint8_t)(msg*31+offset);
+}
+
+/**
+ * Message received callback.
+ */
+static WIO_CALLBACK(bench_on_recv) {
+    bench_t* bench = (bench_t*)data;
+    wio_buf_t* msg_buf = (wio_buf_t*)result;
+    bool corrupted = msg_buf->size!=BENCH_MSG_SIZE;
+
+    for (uint16_t i=0;(!corrupted)&&(i<msg_buf->size);i++)
+        corrupted = msg_buf->buffer[i]!=bench_msg_byte(bench->n_recvd, i);
+    if (corrupted)
+        bench->n_corrupted++;
+    bench->n_recvd++;
+
+    return wtp_recv(&bench->link.wtp, bench, bench_on_recv);
+}
+
+/**
+ * Connection opened callback.
+ */
+static WIO_CALLBACK(bench_on_open) {
+    bench_t* bench = (bench_t*)data;
+    bench->connected = true;
+    return wtp_recv(&bench->link.wtp, bench, bench_on_recv);
+}
+
+/**
+ * @brief Hand a BlockWrite with one data packet of a message to the client.
+ *
+ * @param bench Benchmark state.
+ * @param msg Message index.
+ * @param offset Offset of packet payload in message.
+ * @return Error code if the client failed to handle the BlockWrite, otherwise WIO_OK.
+ */
+static wio_status_t bench_send_pkt(
+    bench_t* bench,
+    uint8_t msg,
+    uint16_t offset
+) {
+    wtp_t* wtp = &bench->link.wtp;
+    uint8_t mem[WTP_SIM_WRITE_MEM_SIZE];
+    uint8_t* pkt = mem+1;
+    uint8_t size = 0;
+    uint16_t seq_num = bench->base_seq+msg*BENCH_MSG_SIZE+offset;
+
+    //Packet header (Begin message packets declare the message)
+    if (offset==0) {
+        uint16_t msg_size = BENCH_MSG_SIZE;
+        pkt[size++] = WTP_PKT_BEGIN_MSG;
+        memcpy(pkt+size, &msg_size, 2);
+        size += 2;
+    } else
+        pkt[size++] = WTP_PKT_CONT_MSG;
+    memcpy(pkt+size, &seq_num, 2);
+    size += 2;
+    pkt[size++] = BENCH_PAYLOAD_SIZE;
+    for (uint8_t i=0;i<BENCH_PAYLOAD_SIZE;i++)
+        pkt[size++] = bench_msg_byte(msg, offset+i);
+    //Checksum of negotiated algorithm
+    if (wtp->_checksum==WTP_CHECKSUM_CRC16) {
+        uint16_t crc = crc16_ccitt(CRC_NO_PRELOAD, pkt, size);
+        memcpy(pkt+size, &crc, 2);
+        size += 2;
+    } else {
+        pkt[size] = wtp_xor_checksum(pkt, 0, size);
+        size++;
+    }
+    mem[0] = size;
+    memset(mem+1+size, 0, sizeof(mem)-1-size);
+
+    return wtp_sim_link_blockwrite(&bench->link, mem, sizeof(mem));
+}
+
+/**
+ * @brief Get number of blocks the client acknowledges selectively.
+ *
+ * @param bench Benchmark state.
+ * @return Number of blocks.
+ */
+static uint8_t bench_n_sack_blocks(
+    bench_t* bench
+) {
+    wtp_sack_block_t blocks[WTP_SACK_BLOCKS_MAX];
+    uint8_t n_blocks = 0;
+
+    wtp_rx_get_sack(&bench->link.wtp._rx_ctrl, blocks, &n_blocks);
+    return n_blocks;
+}
+
+/**
+ * @brief Run the full message data ring case.
+ *
+ * The first packet of the second message arrives before the last packet of the first message.
+ * When the last packet arrives, the first message fills the ring, so the staged packet only fits
+ * once the first message is read. The packet is then sent again, as a server would after its
+ * retransmission timeout, followed by the rest of the second message.
+ *
+ * @param bench Benchmark state.
+ * @return Number of failed checks.
+ */
+static uint8_t bench_run_ring_full(
+    bench_t* bench
+) {
+    wtp_t* wtp = &bench->link.wtp;
+    uint8_t n_failed = 0;
+    uint16_t last_offset = BENCH_MSG_SIZE-BENCH_PAYLOAD_SIZE;
+
+    //First message but its last packet
+    for (uint16_t offset=0;offset<last_offset;offset+=BENCH_PAYLOAD_SIZE)
+        n_failed += bench_send_pkt(bench, 0, offset)!=WIO_OK;
+    //First packet of second message is staged
+    n_failed += bench_send_pkt(bench, 1, 0)!=WIO_OK;
+    n_failed += bench_n_sack_blocks(bench)!=1;
+    //Last packet of first message; the staged packet is appended once the first message is read
+    n_failed += bench_send_pkt(bench, 0, last_offset)!=WIO_OK;
+    n_failed += (bench->n_recvd!=1)||(bench_n_sack_blocks(bench)!=0);
+    //Retransmission of the staged packet and rest of second message
+    for (uint16_t offset=0;offset<BENCH_MSG_SIZE;offset+=BENCH_PAYLOAD_SIZE)
+        n_failed += bench_send_pkt(bench, 1, offset)!=WIO_OK;
+
+    n_failed += bench->n_recvd!=BENCH_N_MSGS;
+    n_failed += bench->n_corrupted!=0;
+    n_failed += wtp->_rx_ctrl._seq_num!=(uint16_t)(bench->base_seq+BENCH_N_MSGS*BENCH_MSG_SIZE);
+
+    return n_failed;
+}
+
+int main(int argc, char** argv) {
+    wtp_checksum_t checksum = WTP_CHECKSUM_CRC16;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "xh"))!=-1) {
+        switch (opt) {
+            case 'x': checksum = WTP_CHECKSUM_XOR; break;
+            default:
+                fprintf(stderr, "Usage: %s [-x]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    //Open connection through virtual reader
+    bench_t* bench = calloc(1, sizeof(bench_t));
+    if ((!bench)||(wtp_sim_link_init(&bench->link, 0x5101, 64, 10, 200, BENCH_RX_BUF_SIZE, 5, 5)!=WIO_OK)
+        ||(wtp_sim_reader_init(&bench->reader, &bench->link, 24, 64, 64)!=WIO_OK)) {
+        fprintf(stderr, "Failed to initialize client\n");
+        return 1;
+    }
+    wtp_t* wtp = &bench->link.wtp;
+    wtp_on_event(wtp, WTP_EVENT_OPEN, bench, bench_on_open);
+    wtp_set_checksum(wtp, checksum);
+    wtp_connect(wtp);
+    for (uint32_t round=0;(round<BENCH_OPEN_ROUNDS)&&(wtp->_downlink_state!=WTP_STATE_OPENED);round++)
+        wtp_sim_reader_round(&bench->reader, NULL);
+    if (!bench->connected||(wtp->_downlink_state!=WTP_STATE_OPENED)) {
+        fprintf(stderr, "Failed to open connection\n");
+        return 1;
+    }
+    bench->base_seq = wtp->_rx_ctrl._seq_num;
+
+    uint8_t n_failed = bench_run_ring_full(bench);
+    printf("%-10s | %s | received %u/%u, corrupted %u\n", "ring-full", n_failed?"failed":"ok",
+        bench->n_recvd, BENCH_N_MSGS, bench->n_corrupted);
+
+    wtp_sim_link_fini(&bench->link);
+    free(bench);
+    return n_failed?1:0;
+}
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../sim/link.h"
+#include "../sim/reader.h"
+
+//Resume benchmark: the client loses power again and again. After every power-up it connects,
+//sends messages one at a time and the virtual reader echoes them back. The number of rounds
+//until the first message is delivered is measured for a new connection every time,
+//a resumed session, and a session the virtual reader no longer knows.
+
+/// Maximum message size
+#define BENCH_MSG_MAX 256
+/// Latency histogram size in rounds (Longer latencies are counted in the last bucket)
+#define BENCH_HIST_MAX 256
+/// Number of modes
+#define BENCH_MODES 3
+
+/// Mode names
+static const char* bench_mode_names[BENCH_MODES] = {"open", "resume", "unknown"};
+
+/// Benchmark options type
+typedef struct bench_opts {
+    /// Number of power cycles per mode
+    uint32_t n_cycles;
+    /// Message size
+    uint16_t msg_size;
+    /// Rounds of traffic after the first message is delivered, before power is lost
+    uint32_t n_rounds_on;
+    /// Rounds given up after if the first message is not delivered
+    uint32_t n_rounds_max;
+    /// EPC cadence
+    uint8_t epc_cadence;
+    /// Inventory time per round (us)
+    uint32_t inventory_us;
+    /// Fixed time per OpSpec (us)
+    uint32_t opspec_us;
+    /// Time per word read or written (us)
+    uint32_t word_us;
+} bench_opts_t;
+
+/// Benchmark state type
+typedef struct bench {
+    /// Virtual link
+    wtp_sim_link_t link;
+    /// Virtual reader
+    wtp_sim_reader_t reader;
+    /// Options
+    bench_opts_t opts;
+    /// Session (Survives power loss)
+    wtp_session_t session;
+
+    /// Connected flag
+    bool connected;
+    /// Message in flight
+    bool inflight;
+    /// Messages sent
+    uint32_t n_sent;
+    /// Messages echoed back
+    uint32_t n_echoed;
+    /// Corrupted messages
+    uint32_t n_corrupted;
+    /// Message in flight (Borrowed by the client)
+    uint8_t msg[BENCH_MSG_MAX];
+} bench_t;
+
+/// Per-mode statistics type
+typedef struct bench_mode_stats {
+    /// Number of power cycles
+    uint32_t n_cycles;
+    /// Number of power cycles the first message was not delivered in
+    uint32_t n_failed;
+    /// Sum of rounds until the first message was delivered
+    uint64_t rounds_sum;
+    /// Sum of simulated time until the first message was delivered (us)
+    uint64_t time_sum;
+    /// Histogram of rounds until the first message was delivered
+    uint32_t hist[BENCH_HIST_MAX];
+    /// Messages echoed back
+    uint32_t n_echoed;
+    /// Corrupted messages
+    uint32_t n_corrupted;
+} bench_mode_stats_t;
+
+/**
+ * @brief Fill message with test pattern.
+ *
+ * The message begins with its index, so messages dropped on power loss don't break verification.
+ *
+ * @param data Message data.
+ * @param size Message size.
+ * @param index Message index.
+ */
+static void bench_pattern(
+    uint8_t* data,
+    uint16_t size,
+    uint32_t index
+) {
+    for (uint16_t i=0;i<size;i++)
+        data[i] = (i<4)?(uint8_t)(index>>(i*8)):(uint8_t)(index*31+i);
+}
+
+/**
+ * @brief Verify message against test pattern.
+ *
+ * @param bench Benchmark state.
+ * @param msg_buf Message buffer.
+ * @return Whether message matches test pattern.
+ */
+static bool bench_verify(
+    bench_t* bench,
+    wio_buf_t* msg_buf
+) {
+    uint8_t expected[BENCH_MSG_MAX];
+    uint32_t index;
+
+    if (msg_buf->size!=bench->opts.msg_size)
+        return false;
+    memcpy(&index, msg_buf->buffer, 4);
+    bench_pattern(expected, msg_buf->size, index);
+
+    return memcmp(msg_buf->buffer, expected, msg_buf->size)==0;
+}
+
+/**
+ * @brief Echo uplink messages back on the downlink.
+ */
+static WIO_CALLBACK(bench_reader_on_recv) {
+    bench_t* bench = (bench_t*)data;
+    wio_buf_t* msg_buf = (wio_buf_t*)result;
+
+    if (!bench_verify(bench, msg_buf))
+        bench->n_corrupted++;
+    //(Ignore failure; the client sends the next message once this one is acknowledged)
+    wtp_sim_reader_send(&bench->reader, msg_buf->buffer, msg_buf->size);
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Client message sent callback.
+ */
+static WIO_CALLBACK(bench_on_sent) {
+    bench_t* bench = (bench_t*)data;
+
+    bench->inflight = false;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Client message received callback.
+ */
+static WIO_CALLBACK(bench_on_recv) {
+    bench_t* bench = (bench_t*)data;
+    wio_buf_t* msg_buf = (wio_buf_t*)result;
+
+    //Keep receiving
+    WIO_TRY(wtp_recv(&bench->link.wtp, bench, bench_on_recv))
+
+    if (!bench_verify(bench, msg_buf))
+        bench->n_corrupted++;
+    bench->n_echoed++;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Client connection opened callback.
+ */
+static WIO_CALLBACK(bench_on_open) {
+    bench_t* bench = (bench_t*)data;
+
+    bench->connected = true;
+    WIO_TRY(wtp_recv(&bench->link.wtp, bench, bench_on_recv))
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Power up the client and connect to the virtual reader.
+ *
+ * @param bench Benchmark state.
+ * @param keep_session Resume the session if there is one.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wio_status_t bench_power_up(
+    bench_t* bench,
+    bool keep_session
+) {
+    wtp_t* wtp = &bench->link.wtp;
+
+    //Virtual link and client (Same configuration as the ERT runtime)
+    WIO_TRY(wtp_sim_link_init(&bench->link, 0x5101, 64, 10, 200, 200, 5, 5))
+    WIO_TRY(wtp_set_epc_cadence(wtp, bench->opts.epc_cadence))
+    if (!keep_session)
+        memset(&bench->session, 0, sizeof(wtp_session_t));
+    WIO_TRY(wtp_set_session(wtp, &bench->session))
+
+    bench->connected = false;
+    bench->inflight = false;
+    WIO_TRY(wtp_on_event(wtp, WTP_EVENT_OPEN, bench, bench_on_open))
+
+    return wtp_connect(wtp);
+}
+
+/**
+ * @brief Run power cycles of one mode.
+ *
+ * @param bench Benchmark state.
+ * @param mode Mode (Index of mode names).
+ * @param stats Mode statistics.
+ */
+static void bench_run_mode(
+    bench_t* bench,
+    uint8_t mode,
+    bench_mode_stats_t* stats
+) {
+    bench_opts_t* opts = &bench->opts;
+    wtp_sim_reader_t* reader = &bench->reader;
+    wtp_t* wtp = &bench->link.wtp;
+
+    memset(stats, 0, sizeof(bench_mode_stats_t));
+    memset(&bench->session, 0, sizeof(wtp_session_t));
+    bench->n_echoed = bench->n_corrupted = 0;
+
+    for (uint32_t cycle=0;cycle<=opts->n_cycles;cycle++) {
+        //Virtual reader is created again for a new connection, or to forget the session
+        if ((cycle==0)||(mode!=1)) {
+            wtp_sim_reader_init(reader, &bench->link, 24, 64, 64);
+            reader->on_recv = bench_reader_on_recv;
+            reader->on_recv_data = bench;
+        }
+        bench_power_up(bench, mode!=0);
+
+        uint32_t up_msgs = reader->stats.up_msgs;
+        uint32_t first_round = 0;
+        uint64_t sim_us = 0;
+
+        for (uint32_t round=1;round<=opts->n_rounds_max;round++) {
+            //One message in flight at a time
+            if (bench->connected&&!bench->inflight) {
+                bench_pattern(bench->msg, opts->msg_size, bench->n_sent);
+                if (wtp_send_ref(wtp, bench->msg, opts->msg_size, bench, bench_on_sent)==WIO_OK) {
+                    bench->inflight = true;
+                    bench->n_sent++;
+                }
+            }
+
+            //RFID round
+            uint16_t op_words;
+            wtp_sim_reader_round(reader, &op_words);
+
+            //Simulated round time
+            uint32_t round_us = opts->inventory_us;
+            if (op_words)
+                round_us += opts->opspec_us+op_words*opts->word_us;
+            sim_us += round_us;
+            wtp_sim_link_advance(&bench->link, (uint32_t)(sim_us/1000)-bench->link._time);
+
+            //First message delivered
+            if (!first_round&&(reader->stats.up_msgs!=up_msgs)) {
+                first_round = round;
+                //The first power cycle sets up the session and is not counted
+                if (cycle>0) {
+                    stats->rounds_sum += round;
+                    stats->time_sum += sim_us;
+                    stats->hist[WIO_MIN(round, BENCH_HIST_MAX-1)]++;
+                }
+            }
+            //Power lost
+            if (first_round&&(round-first_round>=opts->n_rounds_on))
+                break;
+        }
+
+        if (cycle>0) {
+            stats->n_cycles++;
+            if (!first_round)
+                stats->n_failed++;
+        }
+        wtp_sim_link_fini(&bench->link);
+    }
+
+    stats->n_echoed = bench->n_echoed;
+    stats->n_corrupted = bench->n_corrupted;
+}
+
+/**
+ * @brief Get percentile of rounds from histogram.
+ *
+ * @param stats Mode statistics.
+ * @param percentile Percentile in [0, 1].
+ * @return Rounds.
+ */
+static uint32_t bench_percentile(
+    bench_mode_stats_t* stats,
+    double percentile
+) {
+    uint32_t n_delivered = stats->n_cycles-stats->n_failed;
+    uint32_t target = (uint32_t)(percentile*n_delivered+0.5);
+    uint32_t count = 0;
+
+    for (uint32_t i=0;i<BENCH_HIST_MAX;i++) {
+        count += stats->hist[i];
+        if (count>=target&&count)
+            return i;
+    }
+
+    return BENCH_HIST_MAX-1;
+}
+
+/**
+ * @brief Print benchmark usage.
+ *
+ * @param prog Program name.
+ */
+static void bench_usage(
+    const char* prog
+) {
+    fprintf(stderr,
+        "Usage: %s [-n cycles] [-s msg_size] [-k rounds_on] [-m rounds_max] [-e epc_cadence]\n"
+        "          [-t inventory_us,opspec_us,word_us]\n",
+        prog
+    );
+}
+
+int main(int argc, char** argv) {
+    bench_t* bench = calloc(1, sizeof(bench_t));
+    bench_opts_t* opts = &bench->opts;
+    int opt;
+
+    //Default options
+    opts->n_cycles = 1000;
+    opts->msg_size = 8;
+    opts->n_rounds_on = 20;
+    opts->n_rounds_max = 1000;
+    opts->epc_cadence = 1;
+    opts->inventory_us = 3000;
+    opts->opspec_us = 2000;
+    opts->word_us = 250;
+
+    while ((opt = getopt(argc, argv, "n:s:k:m:e:t:h"))!=-1) {
+        switch (opt) {
+            case 'n': opts->n_cycles = strtoul(optarg, NULL, 0); break;
+            case 's': opts->msg_size = strtoul(optarg, NULL, 0); break;
+            case 'k': opts->n_rounds_on = strtoul(optarg, NULL, 0); break;
+            case 'm': opts->n_rounds_max = strtoul(optarg, NULL, 0); break;
+            case 'e': opts->epc_cadence = strtoul(optarg, NULL, 0); break;
+            case 't':
+                if (sscanf(optarg, "%u,%u,%u", &opts->inventory_us, &opts->opspec_us, &opts->word_us)!=3) {
+                    bench_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    if ((opts->msg_size<4)||(opts->msg_size>BENCH_MSG_MAX)||(opts->epc_cadence==0)||(opts->n_cycles==0)) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    printf("%-8s %7s %7s %8s %5s %5s %5s %10s %8s %9s\n",
+        "mode", "cycles", "failed", "mean", "p50", "p99", "max", "mean ms", "echoed", "corrupted");
+
+    int exit_code = 0;
+    for (uint8_t mode=0;mode<BENCH_MODES;mode++) {
+        bench_mode_stats_t stats;
+        bench_run_mode(bench, mode, &stats);
+
+        uint32_t n_delivered = stats.n_cycles-stats.n_failed;
+        printf("%-8s %7u %7u %8.2f %5u %5u %5u %10.1f %8u %9u\n",
+            bench_mode_names[mode],
+            stats.n_cycles,
+            stats.n_failed,
+            n_delivered?(double)stats.rounds_sum/n_delivered:0.0,
+            bench_percentile(&stats, 0.5),
+            bench_percentile(&stats, 0.99),
+            bench_percentile(&stats, 1.0),
+            n_delivered?stats.time_sum/1e3/n_delivered:0.0,
+            stats.n_echoed,
+            stats.n_corrupted
+        );
+        if (stats.n_failed||stats.n_corrupted)
+            exit_code = 2;
+    }
+
+    free(bench);
+
+    return exit_code;
+}
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#include <wtp/fgk.h>
+#include <wtp/telemetry.h>
+
+//Telemetry benchmark: size and CPU cost of delta telemetry frames for sensor sample traces,
+//against the raw samples as the sensors return them and against FGK compression of the raw samples.
+//(Samples are synthesized after "ACCEL_singleSample()" and "ADC_read()"; the sensors don't run on the host)
+
+/// Maximum number of samples in a trace
+#define BENCH_SAMPLES_MAX 8192
+/// Maximum number of channels in a trace
+#define BENCH_CHANNELS_MAX 3
+/// Number of traces
+#define BENCH_TRACES 3
+/// Maximum frame size
+#define BENCH_FRAME_MAX 512
+
+/// Number of symbols of the FGK codec compared against
+static const uint8_t BENCH_FGK_N_SYMBOLS = 32;
+
+/// Sample trace type
+typedef struct bench_trace {
+    /// Trace name
+    const char* name;
+    /// Number of channels
+    uint8_t n_channels;
+    /// Raw size of a channel value (As the sensor returns it)
+    uint8_t raw_size;
+    /// Number of samples
+    uint16_t n_samples;
+    /// Samples
+    int16_t samples[BENCH_SAMPLES_MAX*BENCH_CHANNELS_MAX];
+
+    /// Random number state
+    uint32_t rand;
+} bench_trace_t;
+
+/// Benchmark result type
+typedef struct bench_result {
+    /// Raw bytes
+    uint32_t n_raw;
+    /// Telemetry frame bytes
+    uint32_t n_frame;
+    /// FGK compressed raw bytes
+    uint32_t n_fgk;
+    /// Encoding cycles
+    uint64_t enc_cycles;
+    /// Decoding cycles
+    uint64_t dec_cycles;
+} bench_result_t;
+
+/**
+ * @brief Print benchmark usage.
+ *
+ * @param prog Program name.
+ */
+static void bench_usage(
+    const char* prog
+) {
+    fprintf(stderr, "Usage: %s [-n iterations] [-s samples] [-k key interval] [-r seed]\n", prog);
+}
+
+/**
+ * @brief Get next random number (xorshift32).
+ *
+ * @param trace Sample trace.
+ * @return Random number.
+ */
+static uint32_t bench_rand(
+    bench_trace_t* trace
+) {
+    uint32_t x = trace->rand;
+    x ^= x<<13;
+    x ^= x>>17;
+    x ^= x<<5;
+    return trace->rand = x;
+}
+
+/**
+ * @brief Get random noise.
+ *
+ * @param trace Sample trace.
+ * @param amplitude Noise amplitude.
+ * @return Noise between -amplitude and amplitude.
+ */
+static int16_t bench_noise(
+    bench_trace_t* trace,
+    int16_t amplitude
+) {
+    return (int16_t)(bench_rand(trace)%(2*amplitude+1))-amplitude;
+}
+
+/**
+ * @brief Clamp a sample to the range of a sensor.
+ *
+ * @param value Sample.
+ * @param min Minimum sample.
+ * @param max Maximum sample.
+ * @return Clamped sample.
+ */
+static int16_t bench_clamp(
+    int16_t value,
+    int16_t min,
+    int16_t max
+) {
+    return (value<min)?min:WIO_MIN(value, max);
+}
+
+/**
+ * @brief Build accelerometer trace: 8-bit 3-axis samples of a tag lying still, with bursts of motion.
+ *
+ * @param trace Sample trace.
+ * @param n_samples Number of samples.
+ */
+static void bench_trace_accel(
+    bench_trace_t* trace,
+    uint16_t n_samples
+) {
+    //Gravity on Z axis (About 16 LSB per g at +-8g)
+    int16_t axes[3] = {0, 0, 16};
+    uint16_t motion = 0;
+
+    for (uint16_t i=0;i<n_samples;i++) {
+        //A burst of motion every 512 samples on average
+        if ((!motion)&&(bench_rand(trace)%512==0))
+            motion = 64;
+
+        for (uint8_t j=0;j<3;j++) {
+            int16_t value = axes[j];
+            if (motion) {
+                axes[j] = bench_clamp(axes[j]+bench_noise(trace, 4), -127, 127);
+                value = axes[j];
+            } else
+                value += bench_noise(trace, 1);
+            trace->samples[i*3+j] = value;
+        }
+
+        //Settle back after motion
+        if (motion&&(--motion==0)) {
+            axes[0] = axes[1] = 0;
+            axes[2] = 16;
+        }
+    }
+
+    trace->n_channels = 3;
+    trace->raw_size = 1;
+    trace->n_samples = n_samples;
+}
+
+/**
+ * @brief Build ADC trace: 12-bit samples of a slowly changing voltage, with rare spikes.
+ *
+ * @param trace Sample trace.
+ * @param n_samples Number of samples.
+ */
+static void bench_trace_adc(
+    bench_trace_t* trace,
+    uint16_t n_samples
+) {
+    int16_t level = 2048;
+
+    for (uint16_t i=0;i<n_samples;i++) {
+        level = bench_clamp(level+bench_noise(trace, 2), 0, 4095);
+        int16_t value = level+bench_noise(trace, 3);
+        //Spike from switching noise once in 256 samples
+        if (bench_rand(trace)%256==0)
+            value = bench_rand(trace)%4096;
+        trace->samples[i] = bench_clamp(value, 0, 4095);
+    }
+
+    trace->n_channels = 1;
+    trace->raw_size = 2;
+    trace->n_samples = n_samples;
+}
+
+/**
+ * @brief Build temperature trace: raw ADC temperature sensor readings, changing by a step now and then.
+ *
+ * @param trace Sample trace.
+ * @param n_samples Number of samples.
+ */
+static void bench_trace_temp(
+    bench_trace_t* trace,
+    uint16_t n_samples
+) {
+    int16_t level = 1890;
+
+    for (uint16_t i=0;i<n_samples;i++) {
+        if (bench_rand(trace)%64==0)
+            level += bench_noise(trace, 1);
+        trace->samples[i] = level+((bench_rand(trace)%8==0)?bench_noise(trace, 1):0);
+    }
+
+    trace->n_channels = 1;
+    trace->raw_size = 2;
+    trace->n_samples = n_samples;
+}
+
+/**
+ * @brief Run a trace in batches of samples.
+ *
+ * @param trace Sample trace.
+ * @param batch Number of samples in a batch.
+ * @param key_interval Number of frames from one key frame to the next.
+ * @param n_iters Number of iterations for timing.
+ * @param result Benchmark result.
+ * @return WIO_ERR_INVALID if a batch didn't decode back, otherwise WIO_OK.
+ */
+static wtp_status_t bench_run(
+    bench_trace_t* trace,
+    uint8_t batch,
+    uint8_t key_interval,
+    uint32_t n_iters,
+    bench_result_t* result
+) {
+    uint8_t n_channels = trace->n_channels;
+    wtp_telemetry_t encoder, decoder;
+    wtp_fgk_t fgk;
+    WIO_TRY(wtp_telemetry_init(&encoder, n_channels, key_interval))
+    WIO_TRY(wtp_telemetry_init(&decoder, n_channels, key_interval))
+    WIO_TRY(wtp_fgk_init(&fgk, BENCH_FGK_N_SYMBOLS))
+
+    memset(result, 0, sizeof(bench_result_t));
+
+    for (uint32_t iter=0;iter<n_iters;iter++) {
+        wtp_telemetry_reset(&encoder);
+        wtp_fgk_reset(&fgk);
+
+        for (uint16_t i=0;i+batch<=trace->n_samples;i+=batch) {
+            const int16_t* samples = trace->samples+i*n_channels;
+            uint8_t frame[BENCH_FRAME_MAX];
+            uint16_t frame_size;
+
+            uint64_t begin = __rdtsc();
+            WIO_TRY(wtp_telemetry_encode(&encoder, samples, batch, frame, sizeof(frame), &frame_size))
+            result->enc_cycles += __rdtsc()-begin;
+
+            int16_t decoded[255*BENCH_CHANNELS_MAX];
+            uint8_t n_decoded;
+            begin = __rdtsc();
+            wtp_status_t status = wtp_telemetry_decode(&decoder, frame, frame_size, decoded, 255, &n_decoded);
+            result->dec_cycles += __rdtsc()-begin;
+            if ((status!=WIO_OK)||(n_decoded!=batch)||memcmp(decoded, samples, batch*n_channels*sizeof(int16_t)))
+                return WIO_ERR_INVALID;
+
+            //Sizes are the same every iteration
+            if (iter)
+                continue;
+            result->n_frame += frame_size;
+
+            //Raw samples as the sensor returns them, compressed with FGK as a stream
+            uint8_t raw[BENCH_FRAME_MAX];
+            uint16_t raw_size = 0;
+            for (uint16_t j=0;j<batch*n_channels;j++) {
+                raw[raw_size++] = samples[j];
+                if (trace->raw_size==2)
+                    raw[raw_size++] = samples[j]>>8;
+            }
+            uint8_t compressed[BENCH_FRAME_MAX+WTP_FGK_HEADER_SIZE];
+            uint16_t compressed_size;
+            WIO_TRY(wtp_fgk_encode(&fgk, raw, raw_size, compressed, &compressed_size))
+            result->n_raw += raw_size;
+            result->n_fgk += compressed_size;
+        }
+    }
+
+    wtp_telemetry_fini(&encoder);
+    wtp_telemetry_fini(&decoder);
+    wtp_fgk_fini(&fgk);
+
+    return WIO_OK;
+}
+
+int main(int argc, char** argv) {
+    uint32_t n_iters = 100;
+    uint16_t n_samples = 4096;
+    uint8_t key_interval = 16;
+    uint32_t seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:k:r:h"))!=-1) {
+        switch (opt) {
+            case 'n': n_iters = strtoul(optarg, NULL, 0); break;
+            case 's': n_samples = strtoul(optarg, NULL, 0); break;
+            case 'k': key_interval = strtoul(optarg, NULL, 0); break;
+            case 'r': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    if ((n_iters==0)||(n_samples==0)||(n_samples>BENCH_SAMPLES_MAX)||(seed==0)) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    static bench_trace_t traces[BENCH_TRACES];
+    static const char* trace_names[BENCH_TRACES] = {"accel", "adc", "temp"};
+    static void (*const trace_builders[BENCH_TRACES])(bench_trace_t*, uint16_t) = {
+        bench_trace_accel, bench_trace_adc, bench_trace_temp
+    };
+    for (uint8_t i=0;i<BENCH_TRACES;i++) {
+        traces[i].name = trace_names[i];
+        traces[i].rand = seed;
+        trace_builders[i](traces+i, n_samples);
+    }
+
+    static const uint8_t batches[] = {4, 8, 16, 32, 64};
+
+    printf("%-6s %5s | %8s %8s | %7s %7s | %10s %10s\n",
+        "trace", "batch", "raw B/s", "frame", "ratio", "fgk", "enc c/smp", "dec c/smp");
+    for (uint8_t t=0;t<BENCH_TRACES;t++)
+        for (uint8_t b=0;b<sizeof(batches);b++) {
+            bench_result_t result;
+            if (bench_run(traces+t, batches[b], key_interval, n_iters, &result)!=WIO_OK) {
+                fprintf(stderr, "Round trip failed: %s, batch of %u\n", traces[t].name, batches[b]);
+                return 2;
+            }
+
+            uint32_t n_batched = n_samples/batches[b]*batches[b];
+            printf("%-6s %5u | %8.2f %8.2f | %7.3f %7.3f | %10.1f %10.1f\n",
+                traces[t].name,
+                batches[b],
+                (double)result.n_raw/n_batched,
+                (double)result.n_frame/n_batched,
+                (double)result.n_frame/result.n_raw,
+                (double)result.n_fgk/result.n_raw,
+                (double)result.enc_cycles/n_iters/n_batched,
+                (double)result.dec_cycles/n_iters/n_batched
+            );
+        }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+//Host stand-in for the TI "msp430.h" device header.
+//Only the registers and bits used by portable WIO code are provided;
+//the registers are plain variables defined in "sim/hw.c".
+
+//=== Timer A2 registers ===
+/// Timer A2 capture/compare control 0
+extern volatile uint16_t TA2CCTL0;
+/// Timer A2 capture/compare 0
+extern volatile uint16_t TA2CCR0;
+/// Timer A2 control
+extern volatile uint16_t TA2CTL;
+
+//=== Timer A control bits ===
+/// Capture/compare interrupt enable
+#define CCIE (0x0010)
+/// Clock source select: ACLK
+#define TASSEL_1 (0x0100)
+/// Mode control: Up mode
+#define MC_1 (0x0010)
+/// Timer A clear
+#define TACLR (0x0004)
+
+//=== Status register bits ===
+/// General interrupt enable
+#define GIE (0x0008)
+
+//=== Intrinsics ===
+/// Set bits in status register (No-op on host)
+#define __bis_SR_register(x) ((void)(x))
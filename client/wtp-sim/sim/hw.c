@@ -0,0 +1,10 @@
+#include <msp430.h>
+
+//Host stand-ins for MSP430 peripheral registers
+
+/// Timer A2 capture/compare control 0
+volatile uint16_t TA2CCTL0 = 0;
+/// Timer A2 capture/compare 0
+volatile uint16_t TA2CCR0 = 0;
+/// Timer A2 control
+volatile uint16_t TA2CTL = 0;
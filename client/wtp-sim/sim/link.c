@@ -0,0 +1,175 @@
+#include <string.h>
+#include <time.h>
+#include "link.h"
+
+/// Size of the virtual link type
+const size_t wtp_sim_link_size = sizeof(wtp_sim_link_t);
+/// Size of the WTP checkpoint type
+const size_t wtp_sim_checkpoint_size = sizeof(wtp_checkpoint_t);
+
+/**
+ * {@inheritDoc}
+ */
+uint64_t wtp_sim_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull+(uint64_t)ts.tv_nsec;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_link_init(
+    wtp_sim_link_t* self,
+    uint16_t wisp_id,
+    uint16_t window_size,
+    uint16_t timeout,
+    uint16_t tx_buf_size,
+    uint16_t rx_buf_size,
+    uint8_t n_send,
+    uint8_t n_recv
+) {
+    //Statistics
+    memset(&self->stats, 0, sizeof(wtp_sim_stats_t));
+
+    //Tag memory
+    memset(self->_epc_mem, 0, WTP_SIM_EPC_SIZE);
+    memset(self->_read_mem, 0, WTP_SIM_READ_MEM_SIZE);
+    memset(self->_write_mem, 0, WTP_SIM_WRITE_MEM_SIZE);
+    //WISP ID
+    memcpy(self->_epc_mem, &wisp_id, 2);
+
+    //Simulated time
+    self->_time = 0;
+
+    //Initialize client WTP endpoint
+    //(The first two bytes of EPC memory are for WISP ID)
+    WIO_TRY(wtp_init(
+        &self->wtp,
+        self->_epc_mem+2,
+        WTP_SIM_EPC_SIZE-2,
+        self->_read_mem,
+        self->_write_mem,
+        window_size,
+        timeout,
+        tx_buf_size,
+        rx_buf_size,
+        n_send,
+        n_recv
+    ))
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_link_fini(
+    wtp_sim_link_t* self
+) {
+    WIO_TRY(wtp_fini(&self->wtp))
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_link_before_rfid(
+    wtp_sim_link_t* self
+) {
+    //Observations of current EPC content
+    uint8_t observations = self->wtp._epc_observations;
+
+    uint64_t begin_ns = wtp_sim_now_ns();
+    WIO_TRY(wtp_before_do_rfid(&self->wtp))
+    self->stats.epc_ns += wtp_sim_now_ns()-begin_ns;
+    //EPC refreshed with new packets
+    if (self->wtp._epc_observations<observations)
+        self->stats.n_epc_updates++;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_link_inventory(
+    wtp_sim_link_t* self,
+    uint8_t* epc
+) {
+    memcpy(epc, self->_epc_mem, WTP_SIM_EPC_SIZE);
+    //Tag replies with its EPC, so the client knows the EPC is observed
+    //(The ERT runtime learns it from the WISP ACK callback)
+    WIO_TRY(wtp_epc_observed(&self->wtp))
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_link_read(
+    wtp_sim_link_t* self,
+    uint8_t* data,
+    uint16_t size
+) {
+    //Out of range check
+    if (size>WTP_SIM_READ_MEM_SIZE)
+        return WIO_ERR_OUT_OF_RANGE;
+    //Reader gets current Read memory content
+    memcpy(data, self->_read_mem, size);
+
+    //Call Read hook
+    uint64_t begin_ns = wtp_sim_now_ns();
+    wio_status_t status = wtp_load_read_mem(&self->wtp);
+    self->stats.read_ns += wtp_sim_now_ns()-begin_ns;
+    self->stats.n_reads++;
+
+    return status;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_link_blockwrite(
+    wtp_sim_link_t* self,
+    const uint8_t* mem,
+    uint16_t size
+) {
+    //Out of range check
+    if (size>WTP_SIM_WRITE_MEM_SIZE)
+        return WIO_ERR_OUT_OF_RANGE;
+    //Write to BlockWrite memory
+    memcpy(self->_write_mem, mem, size);
+
+    //Call BlockWrite hook
+    uint64_t begin_ns = wtp_sim_now_ns();
+    wio_status_t status = wtp_handle_blockwrite(&self->wtp);
+    self->stats.blockwrite_ns += wtp_sim_now_ns()-begin_ns;
+    self->stats.n_blockwrites++;
+    if (status!=WIO_OK)
+        self->stats.n_blockwrite_errors++;
+
+    return status;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_link_advance(
+    wtp_sim_link_t* self,
+    uint32_t ms
+) {
+    uint32_t end_time = self->_time+ms;
+
+    //Fire WIO timer tick for every elapsed tick interval
+    while (self->_time/WTP_SIM_TICK_MS!=end_time/WTP_SIM_TICK_MS) {
+        self->_time += WTP_SIM_TICK_MS-self->_time%WTP_SIM_TICK_MS;
+        wio_timer_callback();
+    }
+    self->_time = end_time;
+
+    return WIO_OK;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wio.h>
+#include <wtp.h>
+
+//=== WTP simulator constants ===
+/// EPC-96 size (WISP ID and class followed by WTP packets)
+#define WTP_SIM_EPC_SIZE 12
+/// RFID Read memory size
+#define WTP_SIM_READ_MEM_SIZE 64
+/// RFID BlockWrite memory size (Same as "_ERT_BW_SIZE")
+#define WTP_SIM_WRITE_MEM_SIZE 0x20
+/// WIO timer tick interval in milliseconds
+#define WTP_SIM_TICK_MS 20
+
+/// WTP simulator client-side statistics type
+typedef struct wtp_sim_stats {
+    /// Number of EPC updates with new packets
+    uint32_t n_epc_updates;
+    /// Number of Read hook invocations
+    uint32_t n_reads;
+    /// Number of BlockWrite hook invocations
+    uint32_t n_blockwrites;
+    /// Number of failed BlockWrite hook invocations
+    uint32_t n_blockwrite_errors;
+
+    /// CPU time spent on EPC updates, including rounds without update (ns)
+    uint64_t epc_ns;
+    /// CPU time spent in Read hook (ns)
+    uint64_t read_ns;
+    /// CPU time spent in BlockWrite hook (ns)
+    uint64_t blockwrite_ns;
+} wtp_sim_stats_t;
+
+/// WTP simulator virtual link type
+typedef struct wtp_sim_link {
+    /// Client WTP endpoint
+    /// (Kept as the first member so a link pointer is also a valid endpoint pointer)
+    wtp_t wtp;
+    /// Client-side statistics
+    wtp_sim_stats_t stats;
+
+    /// EPC memory
+    uint8_t _epc_mem[WTP_SIM_EPC_SIZE];
+    /// RFID Read memory
+    uint8_t _read_mem[WTP_SIM_READ_MEM_SIZE];
+    /// RFID BlockWrite memory
+    uint8_t _write_mem[WTP_SIM_WRITE_MEM_SIZE];
+
+    /// Simulated time in milliseconds
+    uint32_t _time;
+} wtp_sim_link_t;
+
+/// Size of the virtual link type (For foreign function interfaces)
+extern const size_t wtp_sim_link_size;
+/// Size of the WTP checkpoint type (For foreign function interfaces)
+extern const size_t wtp_sim_checkpoint_size;
+
+/**
+ * @brief Initialize virtual link and the client WTP endpoint behind it.
+ *
+ * @param self Virtual link instance.
+ * @param wisp_id WISP ID and class, laid out the same way as "ert_wisp_id".
+ * @param window_size WTP sliding window size.
+ * @param timeout WTP packet retransmission timeout.
+ * @param tx_buf_size Transmit control buffer size.
+ * @param rx_buf_size Receive control buffer size.
+ * @param n_send Capacity of send callbacks.
+ * @param n_recv Capacity of receive callbacks.
+ * @return WIO_ERR_NO_MEMORY if memory allocation failed, otherwise WIO_OK.
+ */
+extern wio_status_t wtp_sim_link_init(
+    wtp_sim_link_t* self,
+    uint16_t wisp_id,
+    uint16_t window_size,
+    uint16_t timeout,
+    uint16_t tx_buf_size,
+    uint16_t rx_buf_size,
+    uint8_t n_send,
+    uint8_t n_recv
+);
+
+/**
+ * @brief Finalize virtual link.
+ *
+ * @param self Virtual link instance.
+ * @return WIO_OK.
+ */
+extern wio_status_t wtp_sim_link_fini(
+    wtp_sim_link_t* self
+);
+
+/**
+ * @brief Run client-side work before an RFID round.
+ *
+ * Refreshes EPC memory with pending control packets by "wtp_before_do_rfid()",
+ * the same way the ERT runtime RFID loop does.
+ *
+ * @param self Virtual link instance.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wio_status_t wtp_sim_link_before_rfid(
+    wtp_sim_link_t* self
+);
+
+/**
+ * @brief Inventory the simulated tag.
+ *
+ * The client is notified that the reader has observed its EPC.
+ *
+ * @param self Virtual link instance.
+ * @param epc Memory for holding the EPC-96 of the tag (WTP_SIM_EPC_SIZE bytes).
+ * @return WIO_OK.
+ */
+extern wio_status_t wtp_sim_link_inventory(
+    wtp_sim_link_t* self,
+    uint8_t* epc
+);
+
+/**
+ * @brief Carry out an RFID Read on the simulated tag.
+ *
+ * The reader gets the content currently in Read memory,
+ * after which the client Read hook reloads the memory.
+ *
+ * @param self Virtual link instance.
+ * @param data Memory for holding read data.
+ * @param size Read size.
+ * @return WIO_ERR_OUT_OF_RANGE if size exceeds Read memory, otherwise status of the Read hook.
+ */
+extern wio_status_t wtp_sim_link_read(
+    wtp_sim_link_t* self,
+    uint8_t* data,
+    uint16_t size
+);
+
+/**
+ * @brief Carry out an RFID BlockWrite on the simulated tag.
+ *
+ * @param self Virtual link instance.
+ * @param mem BlockWrite memory image (1-byte data length followed by data).
+ * @param size Size of the memory image.
+ * @return WIO_ERR_OUT_OF_RANGE if size exceeds BlockWrite memory, otherwise status of the BlockWrite hook.
+ */
+extern wio_status_t wtp_sim_link_blockwrite(
+    wtp_sim_link_t* self,
+    const uint8_t* mem,
+    uint16_t size
+);
+
+/**
+ * @brief Advance simulated time and fire WIO timers.
+ *
+ * @param self Virtual link instance.
+ * @param ms Time to advance in milliseconds.
+ * @return WIO_OK.
+ */
+extern wio_status_t wtp_sim_link_advance(
+    wtp_sim_link_t* self,
+    uint32_t ms
+);
+
+/**
+ * @brief Get a monotonic timestamp for CPU cost measurement.
+ *
+ * @return Timestamp in nanoseconds.
+ */
+extern uint64_t wtp_sim_now_ns(void);
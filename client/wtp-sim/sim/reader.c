@@ -0,0 +1,757 @@
+#include <string.h>
+#include <Math/crc16.h>
+#include "reader.h"
+
+/**
+ * @brief Get checksum size of the downlink checksum algorithm.
+ *
+ * @param self Virtual reader instance.
+ * @return Checksum size.
+ */
+static uint8_t wtp_sim_reader_checksum_size(
+    wtp_sim_reader_t* self
+) {
+    return (self->_checksum==WTP_CHECKSUM_CRC16)?2:1;
+}
+
+/**
+ * @brief Write checksum of a downlink packet after the packet.
+ *
+ * @param self Virtual reader instance.
+ * @param pkt Packet data, followed by space for the checksum.
+ * @param size Packet size.
+ * @return Checksum size.
+ */
+static uint8_t wtp_sim_reader_put_checksum(
+    wtp_sim_reader_t* self,
+    uint8_t* pkt,
+    uint8_t size
+) {
+    if (self->_checksum==WTP_CHECKSUM_CRC16) {
+        uint16_t checksum = crc16_ccitt(CRC_NO_PRELOAD, pkt, size);
+        memcpy(pkt+size, &checksum, 2);
+        return 2;
+    }
+
+    pkt[size] = wtp_xor_checksum(pkt, 0, size);
+    return 1;
+}
+
+/**
+ * @brief Queue a control packet for sending on the downlink.
+ *
+ * Control packets are stored with a 1-byte size prefix and a checksum suffix.
+ *
+ * @param self Virtual reader instance.
+ * @param pkt Packet data.
+ * @param size Packet size.
+ * @return WIO_ERR_NO_MEMORY if control packets buffer is full, otherwise WIO_OK.
+ */
+static wio_status_t wtp_sim_reader_add_ctrl(
+    wtp_sim_reader_t* self,
+    const uint8_t* pkt,
+    uint8_t size
+) {
+    uint8_t checksum_size = wtp_sim_reader_checksum_size(self);
+    //Not enough space for size, packet and checksum
+    if (self->_ctrl_size+size+checksum_size+1>WTP_SIM_CTRL_SIZE)
+        return WIO_ERR_NO_MEMORY;
+
+    uint8_t* ctrl = self->_ctrl+self->_ctrl_size;
+    //Packet size (With checksum)
+    ctrl[0] = size+checksum_size;
+    //Packet data and checksum
+    memcpy(ctrl+1, pkt, size);
+    wtp_sim_reader_put_checksum(self, ctrl+1, size);
+
+    self->_ctrl_size += size+checksum_size+1;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Queue an acknowledgement packet for uplink data.
+ *
+ * @param self Virtual reader instance.
+ * @return WIO_ERR_NO_MEMORY if control packets buffer is full, otherwise WIO_OK.
+ */
+static wio_status_t wtp_sim_reader_add_ack(
+    wtp_sim_reader_t* self
+) {
+    uint8_t pkt[3] = {WTP_PKT_ACK};
+    memcpy(pkt+1, &self->_rx_seq, 2);
+
+    return wtp_sim_reader_add_ctrl(self, pkt, 3);
+}
+
+/**
+ * @brief Handle downlink acknowledgement.
+ *
+ * @param self Virtual reader instance.
+ * @param seq_num Acknowledged sequence number.
+ */
+static void wtp_sim_reader_handle_ack(
+    wtp_sim_reader_t* self,
+    uint16_t seq_num
+) {
+    uint16_t n_acked = seq_num-self->_tx_acked;
+    uint16_t n_queued = self->_tx_end-self->_tx_acked;
+
+    //Nothing new acknowledged or acknowledging data never queued
+    if ((n_acked==0)||(n_acked>n_queued))
+        return;
+
+    //Update acknowledged position
+    self->_tx_acked = seq_num;
+    //Send position falls behind after go-back-N
+    if ((uint16_t)(self->_tx_next-self->_tx_acked)>(uint16_t)(self->_tx_end-self->_tx_acked))
+        self->_tx_next = seq_num;
+    self->_tx_progress_round = self->stats.n_rounds;
+    self->stats.down_bytes += n_acked;
+
+    //Release fully acknowledged messages
+    while (self->_tx_n_msgs) {
+        wtp_sim_tx_msg_t* msg = self->_tx_msgs+self->_tx_msg_begin;
+
+        if ((uint16_t)(self->_tx_acked-msg->begin)<msg->size)
+            break;
+
+        self->_tx_msg_begin = (self->_tx_msg_begin+1)%WTP_SIM_TX_MSGS;
+        self->_tx_n_msgs--;
+        self->stats.down_msgs++;
+    }
+}
+
+/**
+ * @brief Drop state of the previous power cycle of the client.
+ *
+ * Partial uplink message, downlink messages not yet acknowledged, pending control packets
+ * and pending Reads are dropped; downlink goes on from the end of queued data.
+ * Like a new connection, Reads go first when both Reads and BlockWrites are pending.
+ *
+ * @param self Virtual reader instance.
+ * @param seq_num Uplink sequence number to go on from.
+ */
+static void wtp_sim_reader_reset(
+    wtp_sim_reader_t* self,
+    uint16_t seq_num
+) {
+    self->_rx_seq = seq_num;
+    self->_rx_msg_size = self->_rx_msg_recvd = 0;
+    self->_rx_need_ack = false;
+
+    self->_tx_acked = self->_tx_next = self->_tx_end;
+    self->_tx_msg_begin = self->_tx_n_msgs = 0;
+
+    self->_ctrl_size = 0;
+    self->_n_reads = 0;
+    self->_last_read = false;
+}
+
+/**
+ * @brief Open connection and issue a new session token.
+ *
+ * @param self Virtual reader instance.
+ * @param checksum Requested checksum algorithm.
+ * @param framing Requested data packet framing.
+ * @param seq_num Uplink sequence number.
+ */
+static void wtp_sim_reader_open(
+    wtp_sim_reader_t* self,
+    wtp_checksum_t checksum,
+    wtp_framing_t framing,
+    uint16_t seq_num
+) {
+    self->_opened = true;
+    self->stats.n_opens++;
+    //Fall back to XOR checksum for unsupported algorithm
+    self->_checksum = (checksum<WTP_CHECKSUM_MAX)?checksum:WTP_CHECKSUM_XOR;
+    //Compact framing only if 8-bit sequence numbers can address the window
+    self->_framing = ((framing==WTP_FRAMING_COMPACT)&&(self->window_size<=WTP_COMPACT_WINDOW_MAX))
+        ?WTP_FRAMING_COMPACT
+        :WTP_FRAMING_STANDARD;
+    //New session token (Never 0)
+    self->_token++;
+    if (!self->_token)
+        self->_token++;
+    //Uplink goes on from the sequence number, downlink begins anew
+    wtp_sim_reader_reset(self, seq_num);
+    self->_tx_acked = self->_tx_next = self->_tx_end = 0;
+
+    //Open downlink with chosen checksum algorithm, framing and session token, and acknowledge uplink open
+    uint8_t open_pkt[5] = {WTP_PKT_OPEN_PARAM, self->_checksum, self->_framing};
+    memcpy(open_pkt+3, &self->_token, 2);
+    wtp_sim_reader_add_ctrl(self, open_pkt, 5);
+    wtp_sim_reader_add_ack(self);
+    //Advertise uplink window
+    uint8_t pkt[4] = {WTP_PKT_SET_PARAM, WTP_PARAM_WINDOW_SIZE};
+    memcpy(pkt+2, &self->window_size, 2);
+    wtp_sim_reader_add_ctrl(self, pkt, 4);
+    //Set Read size
+    if (self->read_size) {
+        uint8_t read_pkt[3] = {WTP_PKT_SET_PARAM, WTP_PARAM_READ_SIZE, self->read_size};
+        wtp_sim_reader_add_ctrl(self, read_pkt, 3);
+    }
+}
+
+/**
+ * @brief Handle WTP packets inside EPC.
+ *
+ * @param self Virtual reader instance.
+ * @param buf Packets buffer.
+ */
+static void wtp_sim_reader_handle_epc(
+    wtp_sim_reader_t* self,
+    wio_buf_t* buf
+) {
+    wtp_pkt_t pkt_type;
+
+    while (wio_read(buf, &pkt_type, 1)==WIO_OK) {
+        //Open connection
+        if (pkt_type==WTP_PKT_OPEN_PARAM) {
+            //Requested checksum algorithm and framing
+            wtp_checksum_t checksum;
+            wtp_framing_t framing;
+            if (wio_read(buf, &checksum, 1)!=WIO_OK)
+                return;
+            if (wio_read(buf, &framing, 1)!=WIO_OK)
+                return;
+
+            if (!self->_opened)
+                wtp_sim_reader_open(self, checksum, framing, 0);
+        //Resume connection
+        } else if (pkt_type==WTP_PKT_RESUME) {
+            //Session token and uplink sequence number
+            uint16_t token;
+            uint16_t seq_num;
+            if (wio_read(buf, &token, 2)!=WIO_OK)
+                return;
+            if (wio_read(buf, &seq_num, 2)!=WIO_OK)
+                return;
+
+            //Session unknown; open a new connection with default checksum algorithm and framing
+            if (!self->_opened||(token!=self->_token)) {
+                wtp_sim_reader_open(self, WTP_CHECKSUM_CRC16, WTP_FRAMING_STANDARD, seq_num);
+                continue;
+            }
+            self->stats.n_resumes++;
+            //Uplink goes on from the sequence number
+            wtp_sim_reader_reset(self, seq_num);
+
+            //Resume downlink from the end of sent data, and advertise uplink window
+            uint8_t resume_pkt[3] = {WTP_PKT_RESUME};
+            memcpy(resume_pkt+1, &self->_tx_end, 2);
+            wtp_sim_reader_add_ctrl(self, resume_pkt, 3);
+            uint8_t pkt[4] = {WTP_PKT_SET_PARAM, WTP_PARAM_WINDOW_SIZE};
+            memcpy(pkt+2, &self->window_size, 2);
+            wtp_sim_reader_add_ctrl(self, pkt, 4);
+        //Resume connection from a checkpoint
+        } else if (pkt_type==WTP_PKT_RESUME_ACK) {
+            //Downlink acknowledgement, session token and begin of the oldest uplink message not acknowledged
+            uint16_t ack_seq;
+            uint16_t token;
+            uint16_t seq_num;
+            if (wio_read(buf, &ack_seq, 2)!=WIO_OK)
+                return;
+            if (wio_read(buf, &token, 2)!=WIO_OK)
+                return;
+            if (wio_read(buf, &seq_num, 2)!=WIO_OK)
+                return;
+
+            //Session unknown; open a new connection from the begin of the message
+            if (!self->_opened||(token!=self->_token)) {
+                wtp_sim_reader_open(self, WTP_CHECKSUM_CRC16, WTP_FRAMING_STANDARD, seq_num);
+                continue;
+            }
+            self->stats.n_resumes++;
+            wtp_sim_reader_handle_ack(self, ack_seq);
+            //Client kept all downlink data not acknowledged; go back to the acknowledgement
+            if (self->_tx_acked==ack_seq) {
+                self->stats.down_retx_bytes += (uint16_t)(self->_tx_next-self->_tx_acked);
+                self->_tx_next = self->_tx_acked;
+                self->_tx_progress_round = self->stats.n_rounds;
+            //Otherwise drop downlink data in flight
+            } else
+                self->_tx_acked = self->_tx_next = self->_tx_end;
+            //Uplink goes on from received data; acknowledge it so the client skips it
+            self->_ctrl_size = 0;
+            self->_n_reads = 0;
+            self->_last_read = false;
+            self->_rx_need_ack = true;
+
+            //Resume downlink, and advertise uplink window
+            uint8_t resume_pkt[3] = {WTP_PKT_RESUME};
+            memcpy(resume_pkt+1, &self->_tx_acked, 2);
+            wtp_sim_reader_add_ctrl(self, resume_pkt, 3);
+            uint8_t pkt[4] = {WTP_PKT_SET_PARAM, WTP_PARAM_WINDOW_SIZE};
+            memcpy(pkt+2, &self->window_size, 2);
+            wtp_sim_reader_add_ctrl(self, pkt, 4);
+        //Acknowledgement
+        } else if (pkt_type==WTP_PKT_ACK) {
+            uint16_t seq_num;
+            if (wio_read(buf, &seq_num, 2)!=WIO_OK)
+                return;
+
+            wtp_sim_reader_handle_ack(self, seq_num);
+        //Selective acknowledgement (Blocks are ignored; downlink data is retransmitted go-back-N)
+        } else if (pkt_type==WTP_PKT_SACK) {
+            uint16_t seq_num;
+            uint8_t n_blocks;
+            uint8_t blocks[WTP_SACK_BLOCKS_MAX*3];
+            if (wio_read(buf, &seq_num, 2)!=WIO_OK)
+                return;
+            if (wio_read(buf, &n_blocks, 1)!=WIO_OK)
+                return;
+            if ((n_blocks>WTP_SACK_BLOCKS_MAX)||(wio_read(buf, blocks, n_blocks*3)!=WIO_OK))
+                return;
+
+            wtp_sim_reader_handle_ack(self, seq_num);
+        //Request uplink
+        } else if ((pkt_type==WTP_PKT_REQ_UPLINK)||(pkt_type==WTP_PKT_REQ_UPLINK_ACK)) {
+            //Piggybacked acknowledgement
+            if (pkt_type==WTP_PKT_REQ_UPLINK_ACK) {
+                uint16_t seq_num;
+                if (wio_read(buf, &seq_num, 2)!=WIO_OK)
+                    return;
+
+                wtp_sim_reader_handle_ack(self, seq_num);
+            }
+            uint8_t n_reads;
+            if (wio_read(buf, &n_reads, 1)!=WIO_OK)
+                return;
+            if (wio_read(buf, &self->_read_size, 1)!=WIO_OK)
+                return;
+            //Request ID
+            uint8_t req_id;
+            if (wio_read(buf, &req_id, 1)!=WIO_OK)
+                return;
+
+            self->_n_reads += n_reads;
+        //Set parameter
+        } else if (pkt_type==WTP_PKT_SET_PARAM) {
+            wtp_param_t param;
+            uint16_t value = 0;
+            if (wio_read(buf, &param, 1)!=WIO_OK)
+                return;
+            if (wio_read(buf, &value, (param==WTP_PARAM_WINDOW_SIZE)?2:1)!=WIO_OK)
+                return;
+            //Downlink window advertised by the client
+            if (param==WTP_PARAM_WINDOW_SIZE)
+                self->window_size = value;
+        //End of packets or unsupported packets
+        } else
+            return;
+    }
+}
+
+/**
+ * @brief Handle WTP data packets inside Read data.
+ *
+ * @param self Virtual reader instance.
+ * @param buf Packets buffer.
+ */
+static void wtp_sim_reader_handle_read(
+    wtp_sim_reader_t* self,
+    wio_buf_t* buf
+) {
+    wtp_pkt_t pkt_type;
+
+    while (wio_read(buf, &pkt_type, 1)==WIO_OK) {
+        //Packet header
+        uint16_t msg_size = 0;
+        uint16_t seq_num;
+        uint8_t payload_size;
+        //Piggybacked acknowledgement
+        bool ack;
+        uint16_t ack_seq;
+        //Compact data packet
+        if (pkt_type&WTP_PKT_COMPACT_MSG) {
+            uint8_t seq_low;
+            ack = pkt_type&WTP_PKT_COMPACT_ACK;
+            if (ack&&(wio_read(buf, &ack_seq, 2)!=WIO_OK))
+                break;
+            if ((pkt_type&WTP_PKT_COMPACT_BEGIN)&&(wtp_read_varint(buf, &msg_size)!=WIO_OK))
+                break;
+            if (wio_read(buf, &seq_low, 1)!=WIO_OK)
+                break;
+            seq_num = wtp_seq_resolve(seq_low, self->_rx_seq);
+            payload_size = pkt_type&WTP_PKT_COMPACT_SIZE_MASK;
+        //Standard data packet
+        } else if ((pkt_type==WTP_PKT_BEGIN_MSG)||(pkt_type==WTP_PKT_CONT_MSG)
+            ||(pkt_type==WTP_PKT_BEGIN_MSG_ACK)||(pkt_type==WTP_PKT_CONT_MSG_ACK)) {
+            ack = (pkt_type==WTP_PKT_BEGIN_MSG_ACK)||(pkt_type==WTP_PKT_CONT_MSG_ACK);
+            if (ack&&(wio_read(buf, &ack_seq, 2)!=WIO_OK))
+                break;
+            bool msg_begin = (pkt_type==WTP_PKT_BEGIN_MSG)||(pkt_type==WTP_PKT_BEGIN_MSG_ACK);
+            if (msg_begin&&(wio_read(buf, &msg_size, 2)!=WIO_OK))
+                break;
+            if (wio_read(buf, &seq_num, 2)!=WIO_OK)
+                break;
+            if (wio_read(buf, &payload_size, 1)!=WIO_OK)
+                break;
+        //Not a data packet
+        } else
+            break;
+        //Payload
+        uint8_t* payload = buf->buffer+buf->pos_a;
+        if (buf->pos_a+payload_size>buf->size)
+            break;
+        buf->pos_a += payload_size;
+        self->stats.up_data_bytes += payload_size;
+        if (ack)
+            wtp_sim_reader_handle_ack(self, ack_seq);
+
+        //Cut off data already received (Retransmitted by a client restored from a checkpoint)
+        uint16_t n_recvd = self->_rx_seq-seq_num;
+        if ((n_recvd>0)&&(n_recvd<payload_size)) {
+            payload += n_recvd;
+            payload_size -= n_recvd;
+            seq_num = self->_rx_seq;
+            msg_size = 0;
+        }
+        //Only accept data in order
+        if (seq_num!=self->_rx_seq) {
+            self->stats.up_drops++;
+            //Re-acknowledge duplicated data
+            self->_rx_need_ack = true;
+            continue;
+        }
+        //Begin of message
+        if (msg_size) {
+            if (msg_size>WTP_SIM_MSG_MAX) {
+                self->stats.up_drops++;
+                continue;
+            }
+            self->_rx_msg_size = msg_size;
+            self->_rx_msg_recvd = 0;
+        }
+        //Data does not belong to any message
+        if (self->_rx_msg_recvd+payload_size>self->_rx_msg_size) {
+            self->stats.up_drops++;
+            continue;
+        }
+
+        //Append data to message
+        memcpy(self->_rx_msg+self->_rx_msg_recvd, payload, payload_size);
+        self->_rx_msg_recvd += payload_size;
+        self->_rx_seq += payload_size;
+        self->_rx_need_ack = true;
+
+        //Whole message received
+        if (self->_rx_msg_recvd==self->_rx_msg_size) {
+            wio_buf_t* msg_buf = WIO_INST_PTR(wio_buf_t);
+            wio_buf_init(msg_buf, self->_rx_msg, self->_rx_msg_size);
+            msg_buf->pos_b = self->_rx_msg_size;
+
+            self->stats.up_msgs++;
+            self->stats.up_bytes += self->_rx_msg_size;
+            //Reset message
+            self->_rx_msg_size = self->_rx_msg_recvd = 0;
+
+            if (self->on_recv)
+                self->on_recv(self->on_recv_data, WIO_OK, msg_buf);
+        }
+    }
+}
+
+/**
+ * @brief Find the downlink message containing given sequence number.
+ *
+ * @param self Virtual reader instance.
+ * @param seq_num Sequence number.
+ * @return Downlink message, or NULL if not found.
+ */
+static wtp_sim_tx_msg_t* wtp_sim_reader_find_msg(
+    wtp_sim_reader_t* self,
+    uint16_t seq_num
+) {
+    for (uint8_t i=0;i<self->_tx_n_msgs;i++) {
+        wtp_sim_tx_msg_t* msg = self->_tx_msgs+(self->_tx_msg_begin+i)%WTP_SIM_TX_MSGS;
+
+        if ((uint16_t)(seq_num-msg->begin)<msg->size)
+            return msg;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check if there is downlink data that can be sent.
+ *
+ * @param self Virtual reader instance.
+ * @return Whether downlink data can be sent.
+ */
+static bool wtp_sim_reader_can_send_data(
+    wtp_sim_reader_t* self
+) {
+    uint16_t n_sent = self->_tx_next-self->_tx_acked;
+    uint16_t n_queued = self->_tx_end-self->_tx_acked;
+
+    return (n_sent<n_queued)&&(n_sent<self->window_size);
+}
+
+/**
+ * @brief Build BlockWrite memory image from pending control packets and downlink data.
+ *
+ * A pending uplink acknowledgement is piggybacked on the first data packet,
+ * or else written as a standalone packet after the data packets.
+ *
+ * @param self Virtual reader instance.
+ * @param mem BlockWrite memory image.
+ * @return Size of the memory image, or 0 if there's nothing to write.
+ */
+static uint16_t wtp_sim_reader_build_blockwrite(
+    wtp_sim_reader_t* self,
+    uint8_t* mem
+) {
+    uint8_t* data = mem+1;
+    uint8_t used = 0;
+
+    //Control packets
+    uint8_t ctrl_pos = 0;
+    while (ctrl_pos<self->_ctrl_size) {
+        uint8_t pkt_size = self->_ctrl[ctrl_pos];
+
+        if (used+pkt_size>self->write_size)
+            break;
+        memcpy(data+used, self->_ctrl+ctrl_pos+1, pkt_size);
+        used += pkt_size;
+        ctrl_pos += pkt_size+1;
+    }
+    //Remove sent control packets
+    memmove(self->_ctrl, self->_ctrl+ctrl_pos, self->_ctrl_size-ctrl_pos);
+    self->_ctrl_size -= ctrl_pos;
+
+    //Data packets
+    while (wtp_sim_reader_can_send_data(self)) {
+        wtp_sim_tx_msg_t* msg = wtp_sim_reader_find_msg(self, self->_tx_next);
+        if (!msg)
+            break;
+
+        uint16_t seq_num = self->_tx_next;
+        uint16_t msg_offset = seq_num-msg->begin;
+        bool compact = self->_framing==WTP_FRAMING_COMPACT;
+        //Header and checksum size
+        uint8_t header_size;
+        if (compact)
+            header_size = (msg_offset==0)?((msg->size<0x80)?3:(msg->size<0x4000)?4:5):2;
+        else
+            header_size = (msg_offset==0)?6:4;
+        uint8_t overhead = header_size+wtp_sim_reader_checksum_size(self);
+        if (used+overhead>=self->write_size)
+            break;
+        //Piggyback pending acknowledgement if there's still room for payload
+        bool ack = self->_rx_need_ack&&(used+overhead+2<self->write_size);
+        if (ack)
+            overhead += 2;
+
+        //Payload size
+        uint16_t max_avail = self->write_size-used-overhead;
+        uint16_t max_msg = msg->size-msg_offset;
+        uint16_t max_window = self->window_size-(uint16_t)(seq_num-self->_tx_acked);
+        uint8_t payload_size = (uint8_t)WIO_MIN3(max_avail, max_msg, max_window);
+        if (compact)
+            payload_size = WIO_MIN(payload_size, WTP_PKT_COMPACT_SIZE_MASK);
+
+        //Packet header
+        uint8_t* pkt = data+used;
+        uint8_t pos = 0;
+        //Compact header (Packet type carries begin flag and payload size)
+        if (compact) {
+            pkt[pos++] = WTP_PKT_COMPACT_MSG|((msg_offset==0)?WTP_PKT_COMPACT_BEGIN:0)
+                |(ack?WTP_PKT_COMPACT_ACK:0)|payload_size;
+            if (ack) {
+                memcpy(pkt+pos, &self->_rx_seq, 2);
+                pos += 2;
+            }
+            if (msg_offset==0) {
+                wio_buf_t* pkt_buf = WIO_INST_PTR(wio_buf_t);
+                wio_buf_init(pkt_buf, pkt+pos, header_size-2);
+                wtp_write_varint(pkt_buf, msg->size);
+                pos += pkt_buf->pos_b;
+            }
+            pkt[pos++] = (uint8_t)seq_num;
+        //Standard header
+        } else {
+            if (msg_offset==0)
+                pkt[pos++] = ack?WTP_PKT_BEGIN_MSG_ACK:WTP_PKT_BEGIN_MSG;
+            else
+                pkt[pos++] = ack?WTP_PKT_CONT_MSG_ACK:WTP_PKT_CONT_MSG;
+            if (ack) {
+                memcpy(pkt+pos, &self->_rx_seq, 2);
+                pos += 2;
+            }
+            if (msg_offset==0) {
+                memcpy(pkt+pos, &msg->size, 2);
+                pos += 2;
+            }
+            memcpy(pkt+pos, &seq_num, 2);
+            pos += 2;
+            pkt[pos++] = payload_size;
+        }
+        //Payload
+        for (uint8_t i=0;i<payload_size;i++)
+            pkt[pos++] = self->_tx_ring[(uint16_t)(seq_num+i)&(WTP_SIM_TX_RING-1)];
+        self->stats.down_data_bytes += payload_size;
+        //Checksum
+        pos += wtp_sim_reader_put_checksum(self, pkt, pos);
+
+        //Retransmission timeout counts from the first unacknowledged packet
+        if (self->_tx_next==self->_tx_acked)
+            self->_tx_progress_round = self->stats.n_rounds;
+        self->_tx_next += payload_size;
+        used += pos;
+        if (ack)
+            self->_rx_need_ack = false;
+    }
+    //Standalone acknowledgement
+    if (self->_rx_need_ack&&(used+3+wtp_sim_reader_checksum_size(self)<=self->write_size)) {
+        uint8_t* pkt = data+used;
+        pkt[0] = WTP_PKT_ACK;
+        memcpy(pkt+1, &self->_rx_seq, 2);
+        used += 3+wtp_sim_reader_put_checksum(self, pkt, 3);
+        self->_rx_need_ack = false;
+    }
+
+    //Nothing to write
+    if (used==0)
+        return 0;
+    //Data length and padding to word boundary
+    mem[0] = used;
+    if ((used+1)%2) {
+        mem[used+1] = 0;
+        return used+2;
+    }
+
+    return used+1;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_reader_init(
+    wtp_sim_reader_t* self,
+    wtp_sim_link_t* link,
+    uint8_t write_size,
+    uint16_t window_size,
+    uint16_t timeout
+) {
+    //BlockWrite data length, data and padding must fit BlockWrite memory
+    if (write_size+2>WTP_SIM_WRITE_MEM_SIZE)
+        return WIO_ERR_INVALID;
+
+    memset(self, 0, sizeof(wtp_sim_reader_t));
+    self->link = link;
+    self->write_size = write_size;
+    self->window_size = window_size;
+    self->timeout = timeout;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_reader_round(
+    wtp_sim_reader_t* self,
+    uint16_t* _op_words
+) {
+    wtp_sim_link_t* link = self->link;
+    uint16_t op_words = 0;
+
+    self->stats.n_rounds++;
+    //Client-side work before RFID
+    WIO_TRY(wtp_sim_link_before_rfid(link))
+
+    //Inventory; packets are only handled when EPC changes
+    uint8_t epc[WTP_SIM_EPC_SIZE];
+    WIO_TRY(wtp_sim_link_inventory(link, epc))
+    if (memcmp(epc, self->_prev_epc, WTP_SIM_EPC_SIZE)!=0) {
+        memcpy(self->_prev_epc, epc, WTP_SIM_EPC_SIZE);
+        self->stats.n_epcs++;
+
+        wio_buf_t* epc_buf = WIO_INST_PTR(wio_buf_t);
+        wio_buf_init(epc_buf, epc+2, WTP_SIM_EPC_SIZE-2);
+        wtp_sim_reader_handle_epc(self, epc_buf);
+    }
+
+    //Downlink retransmission timeout (Go-back-N)
+    if ((self->_tx_next!=self->_tx_acked)&&(self->stats.n_rounds-self->_tx_progress_round>self->timeout)) {
+        self->stats.down_retx_bytes += (uint16_t)(self->_tx_next-self->_tx_acked);
+        self->_tx_next = self->_tx_acked;
+        self->_tx_progress_round = self->stats.n_rounds;
+    }
+
+    //Choose OpSpec for this round
+    bool can_read = self->_n_reads>0;
+    bool can_write = (self->_ctrl_size>0)||self->_rx_need_ack||wtp_sim_reader_can_send_data(self);
+
+    //Read
+    if (can_read&&(!can_write||!self->_last_read)) {
+        uint8_t data[WTP_SIM_READ_MEM_SIZE];
+        //Read size is rounded up to words
+        uint8_t read_size = (self->_read_size+1)&~1;
+        if (read_size>WTP_SIM_READ_MEM_SIZE)
+            read_size = WTP_SIM_READ_MEM_SIZE;
+
+        self->_n_reads--;
+        self->_last_read = true;
+        self->stats.n_reads++;
+        self->stats.read_bytes += read_size;
+        op_words = read_size/2;
+
+        //Carry out Read (Ignore client-side errors)
+        wtp_sim_link_read(link, data, read_size);
+        //Handle data packets
+        wio_buf_t* read_buf = WIO_INST_PTR(wio_buf_t);
+        wio_buf_init(read_buf, data, read_size);
+        //(Uplink data is acknowledged by next BlockWrite)
+        wtp_sim_reader_handle_read(self, read_buf);
+    //BlockWrite
+    } else if (can_write) {
+        uint8_t mem[WTP_SIM_WRITE_MEM_SIZE];
+        uint16_t mem_size = wtp_sim_reader_build_blockwrite(self, mem);
+
+        if (mem_size) {
+            self->_last_read = false;
+            self->stats.n_blockwrites++;
+            self->stats.write_bytes += mem[0];
+            op_words = mem_size/2;
+
+            //Carry out BlockWrite (Ignore client-side errors)
+            wtp_sim_link_blockwrite(link, mem, mem_size);
+        }
+    }
+
+    WIO_RETURN(_op_words, op_words)
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wio_status_t wtp_sim_reader_send(
+    wtp_sim_reader_t* self,
+    const uint8_t* data,
+    uint16_t size
+) {
+    //Message slots or data ring full
+    if (self->_tx_n_msgs>=WTP_SIM_TX_MSGS)
+        return WIO_ERR_NO_MEMORY;
+    if ((uint16_t)(self->_tx_end-self->_tx_acked)+size>WTP_SIM_TX_RING)
+        return WIO_ERR_NO_MEMORY;
+
+    //Add message information
+    wtp_sim_tx_msg_t* msg = self->_tx_msgs+(self->_tx_msg_begin+self->_tx_n_msgs)%WTP_SIM_TX_MSGS;
+    msg->begin = self->_tx_end;
+    msg->size = size;
+    self->_tx_n_msgs++;
+
+    //Copy message data into ring
+    for (uint16_t i=0;i<size;i++)
+        self->_tx_ring[(uint16_t)(self->_tx_end+i)&(WTP_SIM_TX_RING-1)] = data[i];
+    self->_tx_end += size;
+
+    return WIO_OK;
+}
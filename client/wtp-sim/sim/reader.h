@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wio.h>
+#include "link.h"
+
+//=== Virtual reader constants ===
+/// Control packets buffer size
+#define WTP_SIM_CTRL_SIZE 64
+/// Maximum message size
+#define WTP_SIM_MSG_MAX 1024
+/// Downlink data ring size (Must be a power of 2)
+#define WTP_SIM_TX_RING 2048
+/// Maximum number of pending downlink messages
+#define WTP_SIM_TX_MSGS 16
+
+/// Virtual reader statistics type
+typedef struct wtp_sim_reader_stats {
+    /// Number of RFID rounds
+    uint32_t n_rounds;
+    /// Number of Read OpSpecs
+    uint32_t n_reads;
+    /// Number of BlockWrite OpSpecs
+    uint32_t n_blockwrites;
+    /// Number of EPC changes seen
+    uint32_t n_epcs;
+    /// Number of connections opened
+    uint32_t n_opens;
+    /// Number of sessions resumed
+    uint32_t n_resumes;
+
+    /// Uplink message bytes delivered
+    uint32_t up_bytes;
+    /// Uplink messages delivered
+    uint32_t up_msgs;
+    /// Downlink message bytes acknowledged
+    uint32_t down_bytes;
+    /// Downlink messages acknowledged
+    uint32_t down_msgs;
+    /// Downlink bytes retransmitted
+    uint32_t down_retx_bytes;
+    /// Uplink data packets dropped (Out of order or malformed)
+    uint32_t up_drops;
+    /// Uplink data packet payload bytes received (Including retransmitted data)
+    uint32_t up_data_bytes;
+    /// Downlink data packet payload bytes sent (Including retransmitted data)
+    uint32_t down_data_bytes;
+    /// Bytes read by Read OpSpecs
+    uint32_t read_bytes;
+    /// Bytes written by BlockWrite OpSpecs (Without data length and padding)
+    uint32_t write_bytes;
+} wtp_sim_reader_stats_t;
+
+/// Downlink message information type
+typedef struct wtp_sim_tx_msg {
+    /// Begin sequence number
+    uint16_t begin;
+    /// Message size
+    uint16_t size;
+} wtp_sim_tx_msg_t;
+
+/**
+ * @brief WTP loopback virtual reader type.
+ *
+ * A minimal reader and server-side WTP peer for driving the client through a virtual link.
+ * Each round inventories the tag and carries out at most one Read or BlockWrite,
+ * alternating between the two when both are pending.
+ * Uplink data is accepted in order only and acknowledged by the next BlockWrite,
+ * piggybacked on downlink data if there is any;
+ * downlink data is retransmitted go-back-N on timeout.
+ * A resumed session goes on with the sequence numbers of both directions,
+ * dropping data in flight when the client lost power, unless the client resumes
+ * from a checkpoint: then the partial uplink message is kept, uplink data already received
+ * is cut off retransmitted packets, and downlink data goes back to the acknowledgement
+ * of the resume packet.
+ */
+typedef struct wtp_sim_reader {
+    /// Virtual link
+    wtp_sim_link_t* link;
+    /// Virtual reader statistics
+    wtp_sim_reader_stats_t stats;
+
+    /// BlockWrite data size
+    uint8_t write_size;
+    /// Sliding window size (Downlink window is updated when the client advertises its window)
+    uint16_t window_size;
+    /// Downlink retransmission timeout in rounds
+    uint16_t timeout;
+    /// Read size set on the client when the connection opens (0 for the client default)
+    uint8_t read_size;
+
+    /// Uplink message received callback closure data
+    void* on_recv_data;
+    /// Uplink message received callback (Result is a WIO buffer)
+    wio_callback_t on_recv;
+
+    /// Connection opened flag
+    bool _opened;
+    /// Downlink checksum algorithm (Chosen when the client opens the connection)
+    wtp_checksum_t _checksum;
+    /// Data packet framing (Chosen when the client opens the connection)
+    wtp_framing_t _framing;
+    /// Session token (Issued when the client opens the connection)
+    uint16_t _token;
+    /// Previous EPC
+    uint8_t _prev_epc[WTP_SIM_EPC_SIZE];
+    /// Previous OpSpec is Read
+    bool _last_read;
+
+    /// Pending control packets (With checksum)
+    uint8_t _ctrl[WTP_SIM_CTRL_SIZE];
+    /// Size of pending control packets
+    uint8_t _ctrl_size;
+
+    /// Number of pending Reads
+    uint16_t _n_reads;
+    /// Pending Read size
+    uint8_t _read_size;
+
+    /// Uplink sequence number
+    uint16_t _rx_seq;
+    /// Uplink message data
+    uint8_t _rx_msg[WTP_SIM_MSG_MAX];
+    /// Uplink message size
+    uint16_t _rx_msg_size;
+    /// Uplink message bytes received
+    uint16_t _rx_msg_recvd;
+    /// Uplink acknowledgement pending flag (Cleared once a BlockWrite carries the acknowledgement)
+    bool _rx_need_ack;
+
+    /// Downlink data ring
+    uint8_t _tx_ring[WTP_SIM_TX_RING];
+    /// Downlink acknowledged sequence number
+    uint16_t _tx_acked;
+    /// Downlink next sequence number to send
+    uint16_t _tx_next;
+    /// Downlink end of queued data
+    uint16_t _tx_end;
+    /// Downlink messages
+    wtp_sim_tx_msg_t _tx_msgs[WTP_SIM_TX_MSGS];
+    /// Index of the oldest downlink message
+    uint8_t _tx_msg_begin;
+    /// Number of downlink messages
+    uint8_t _tx_n_msgs;
+    /// Round of last downlink progress
+    uint32_t _tx_progress_round;
+} wtp_sim_reader_t;
+
+/**
+ * @brief Initialize virtual reader.
+ *
+ * @param self Virtual reader instance.
+ * @param link Virtual link to the client.
+ * @param write_size BlockWrite data size.
+ * @param window_size Sliding window size.
+ * @param timeout Downlink retransmission timeout in rounds.
+ * @return WIO_ERR_INVALID if BlockWrite size doesn't fit BlockWrite memory, otherwise WIO_OK.
+ */
+extern wio_status_t wtp_sim_reader_init(
+    wtp_sim_reader_t* self,
+    wtp_sim_link_t* link,
+    uint8_t write_size,
+    uint16_t window_size,
+    uint16_t timeout
+);
+
+/**
+ * @brief Run one RFID round.
+ *
+ * @param self Virtual reader instance.
+ * @param _op_words Used for returning number of words read or written in this round.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wio_status_t wtp_sim_reader_round(
+    wtp_sim_reader_t* self,
+    uint16_t* _op_words
+);
+
+/**
+ * @brief Queue a message for sending on the downlink.
+ *
+ * @param self Virtual reader instance.
+ * @param data Message data.
+ * @param size Message size.
+ * @return WIO_ERR_NO_MEMORY if downlink queue is full, otherwise WIO_OK.
+ */
+extern wio_status_t wtp_sim_reader_send(
+    wtp_sim_reader_t* self,
+    const uint8_t* data,
+    uint16_t size
+);
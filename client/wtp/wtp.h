@@ -2,3 +2,7 @@
 
 //Stub header file for "wtp/endpoint.h"
 #include "wtp/endpoint.h"
+//Stub header file for "wtp/fgk.h"
+#include "wtp/fgk.h"
+//Stub header file for "wtp/telemetry.h"
+#include "wtp/telemetry.h"
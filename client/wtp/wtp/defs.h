@@ -16,6 +16,12 @@ typedef uint8_t wtp_link_state_t;
 typedef uint8_t wtp_event_t;
 /// WTP parameter code type
 typedef uint8_t wtp_param_t;
+/// WTP checksum algorithm type
+typedef uint8_t wtp_checksum_t;
+/// WTP data packet framing type
+typedef uint8_t wtp_framing_t;
+/// WTP buffer ID type
+typedef uint8_t wtp_buf_id_t;
 /// WTP packet handler type
 typedef wtp_status_t (*wtp_pkt_handler_t)(
     struct wtp*,
@@ -29,7 +35,7 @@ static const wtp_status_t WTP_ERR_UNSUPPORT_OP = 0x10;
 //=== WTP packet types ===
 /// No more packets
 static const wtp_pkt_t WTP_PKT_END = 0x00;
-/// Open WTP connection
+/// Open WTP connection (Legacy; without checksum algorithm and framing)
 static const wtp_pkt_t WTP_PKT_OPEN = 0x01;
 /// Close WTP connection
 static const wtp_pkt_t WTP_PKT_CLOSE = 0x02;
@@ -43,9 +49,32 @@ static const wtp_pkt_t WTP_PKT_CONT_MSG = 0x05;
 static const wtp_pkt_t WTP_PKT_REQ_UPLINK = 0x06;
 /// Set WTP parameter
 static const wtp_pkt_t WTP_PKT_SET_PARAM = 0x07;
+/// Selective acknowledgement
+static const wtp_pkt_t WTP_PKT_SACK = 0x08;
+/// Begin message with piggybacked acknowledgement
+static const wtp_pkt_t WTP_PKT_BEGIN_MSG_ACK = 0x09;
+/// Continue message with piggybacked acknowledgement
+static const wtp_pkt_t WTP_PKT_CONT_MSG_ACK = 0x0a;
+/// Request uplink transmission with piggybacked acknowledgement
+static const wtp_pkt_t WTP_PKT_REQ_UPLINK_ACK = 0x0b;
+/// Resume WTP connection of a previous session
+static const wtp_pkt_t WTP_PKT_RESUME = 0x0c;
+/// Resume WTP connection from a checkpoint, acknowledging downlink data kept in it
+static const wtp_pkt_t WTP_PKT_RESUME_ACK = 0x0d;
+/// Open WTP connection with checksum algorithm and framing
+static const wtp_pkt_t WTP_PKT_OPEN_PARAM = 0x0e;
+
+/// Compact message data (Flag of packet type; other bits carry begin and acknowledgement flags and payload size)
+static const wtp_pkt_t WTP_PKT_COMPACT_MSG = 0x80;
+/// Compact message data begins a message
+static const wtp_pkt_t WTP_PKT_COMPACT_BEGIN = 0x40;
+/// Compact message data carries piggybacked acknowledgement
+static const wtp_pkt_t WTP_PKT_COMPACT_ACK = 0x20;
+/// Payload size bits of compact message data packet type
+static const wtp_pkt_t WTP_PKT_COMPACT_SIZE_MASK = 0x1f;
 
 /// WTP Packet max (Marco)
-#define _WTP_PKT_MAX 0x08
+#define _WTP_PKT_MAX 0x0f
 /// WTP Packet max
 static const wtp_pkt_t WTP_PKT_MAX = _WTP_PKT_MAX;
 
@@ -66,9 +95,11 @@ static const wtp_event_t WTP_EVENT_OPEN = 0x00;
 static const wtp_event_t WTP_EVENT_HALF_CLOSE = 0x01;
 /// Connection closed event
 static const wtp_event_t WTP_EVENT_CLOSE = 0x02;
+/// Connection restarted event (The server no longer knew the resumed session)
+static const wtp_event_t WTP_EVENT_RESTART = 0x03;
 
 /// WTP event max (Marco)
-#define _WTP_EVENT_MAX 0x03
+#define _WTP_EVENT_MAX 0x04
 /// WTP event max
 static const wtp_event_t WTP_EVENT_MAX = _WTP_EVENT_MAX;
 
@@ -77,3 +108,34 @@ static const wtp_event_t WTP_EVENT_MAX = _WTP_EVENT_MAX;
 static const wtp_param_t WTP_PARAM_WINDOW_SIZE = 0x00;
 /// Read OpSpec size
 static const wtp_param_t WTP_PARAM_READ_SIZE = 0x01;
+
+//=== WTP checksum algorithms ===
+/// XOR checksum (1 byte)
+static const wtp_checksum_t WTP_CHECKSUM_XOR = 0x00;
+/// CRC-16/CCITT (2 bytes, calculated by "crc16_ccitt()")
+static const wtp_checksum_t WTP_CHECKSUM_CRC16 = 0x01;
+
+/// WTP checksum algorithm max
+static const wtp_checksum_t WTP_CHECKSUM_MAX = 0x02;
+
+//=== WTP data packet framing ===
+/// Standard framing (16-bit sequence number and message size, explicit payload size)
+static const wtp_framing_t WTP_FRAMING_STANDARD = 0x00;
+/// Compact framing (8-bit sequence number, varint message size, payload size in packet type)
+static const wtp_framing_t WTP_FRAMING_COMPACT = 0x01;
+
+/// WTP data packet framing max
+static const wtp_framing_t WTP_FRAMING_MAX = 0x02;
+
+//=== WTP buffers ===
+/// Control packet buffer of transmit control
+static const wtp_buf_id_t WTP_BUF_PKT = 0x00;
+/// Message buffer of transmit control
+static const wtp_buf_id_t WTP_BUF_TX_MSG = 0x01;
+/// Message data ring of receive control
+static const wtp_buf_id_t WTP_BUF_RX_MSG = 0x02;
+/// Data fragments buffer of receive control
+static const wtp_buf_id_t WTP_BUF_FRAGMENTS = 0x03;
+
+/// WTP buffer max
+static const wtp_buf_id_t WTP_BUF_MAX = 0x04;
@@ -1,11 +1,246 @@
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <Math/crc16.h>
 #include "endpoint.h"
 
 //WTP packet handlers
 wtp_pkt_handler_t wtp_pkt_handlers[];
 
+/// Number of EPC scheduling priorities
+static const uint8_t WTP_EPC_PRIORITIES = 4;
+/// CRC-16 preload of checkpoint slots (So a zero-filled slot is not taken for a commit)
+static const uint16_t WTP_CHECKPOINT_CRC_PRELOAD = 0xffff;
+/// CRC-16 preload of sessions (So a zero-filled session is not resumed)
+static const uint16_t WTP_SESSION_CRC_PRELOAD = 0xffff;
+
 /**
- * @brief Handle WTP open packet.
+ * @brief Check if pending acknowledgement can be piggybacked on an uplink packet.
+ *
+ * Only cumulative acknowledgements are piggybacked; while some data is received out of order,
+ * the pending acknowledgement is sent as a selective acknowledgement packet by "wtp_flush_ack()".
+ *
+ * @param self WTP endpoint instance.
+ * @return Whether pending acknowledgement can be piggybacked.
+ */
+static bool wtp_can_piggyback_ack(
+    wtp_t* self
+) {
+    return self->_ack_pending&&!self->_rx_ctrl._fragments_begin;
+}
+
+/**
+ * @brief Calculate CRC-16 of a checkpoint slot.
+ *
+ * @param slot Checkpoint slot.
+ * @return CRC-16 of all fields before the CRC field.
+ */
+static uint16_t wtp_checkpoint_crc(
+    wtp_checkpoint_slot_t* slot
+) {
+    return crc16_ccitt(WTP_CHECKPOINT_CRC_PRELOAD, (uint8_t*)slot, offsetof(wtp_checkpoint_slot_t, _crc));
+}
+
+/**
+ * @brief Calculate CRC-16 of a session.
+ *
+ * @param session Session.
+ * @return CRC-16 of all fields before the CRC field.
+ */
+static uint16_t wtp_session_crc(
+    const wtp_session_t* session
+) {
+    return crc16_ccitt(WTP_SESSION_CRC_PRELOAD, (uint8_t*)session, offsetof(wtp_session_t, crc));
+}
+
+/**
+ * @brief Find the latest complete commit of a checkpoint.
+ *
+ * @param checkpoint Checkpoint.
+ * @return Slot of the latest complete commit, or WTP_CHECKPOINT_SLOTS if there is none.
+ */
+static uint8_t wtp_checkpoint_latest(
+    wtp_checkpoint_t* checkpoint
+) {
+    uint8_t latest = WTP_CHECKPOINT_SLOTS;
+
+    for (uint8_t i=0;i<WTP_CHECKPOINT_SLOTS;i++) {
+        wtp_checkpoint_slot_t* slot = checkpoint->_slots+i;
+
+        //Torn or never written
+        if (slot->_crc!=wtp_checkpoint_crc(slot))
+            continue;
+        //Commit counter wraps around
+        if ((latest==WTP_CHECKPOINT_SLOTS)||((int16_t)(slot->_epoch-checkpoint->_slots[latest]._epoch)>0))
+            latest = i;
+    }
+
+    return latest;
+}
+
+/**
+ * @brief Commit transmit and receive control state into the checkpoint.
+ *
+ * The older slot is written, and its CRC last; until then the latest commit stays intact.
+ * Nothing is committed without a session to resume.
+ *
+ * @param self WTP endpoint instance.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_commit(
+    wtp_t* self
+) {
+    wtp_checkpoint_t* checkpoint = self->_checkpoint;
+    wtp_session_t* session = self->_session;
+
+    //State is not kept, or no session to resume yet
+    if (!checkpoint||!session||!session->token)
+        return WIO_OK;
+
+    //Slot of the latest commit and the one to write
+    uint8_t latest = self->_checkpoint_slot;
+    uint8_t index = latest^1;
+    wtp_checkpoint_slot_t* slot = checkpoint->_slots+index;
+
+    slot->_epoch = checkpoint->_slots[latest]._epoch+1;
+    slot->_token = session->token;
+    WIO_TRY(wtp_tx_save(&self->_tx_ctrl, &slot->_tx_state))
+    WIO_TRY(wtp_rx_save(&self->_rx_ctrl, &slot->_rx_state))
+    slot->_crc = wtp_checkpoint_crc(slot);
+    //Slot now holds the latest commit
+    self->_checkpoint_slot = index;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Send request uplink packet to WTP server.
+ *
+ * Each request carries a different ID, so consecutive requests for the same Reads
+ * still change the EPC and aren't ignored by the server.
+ * A pending cumulative downlink acknowledgement is piggybacked on the request.
+ *
+ * @param self WTP endpoint instance.
+ * @param read_info Read OpSpec information object.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_request_uplink(
+    wtp_t* self,
+    wtp_tx_read_info_t* read_info
+) {
+    wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
+    wio_buf_t* pkt_buf = &tx_ctrl->_pkt_buf;
+    //Piggyback pending acknowledgement
+    bool ack = wtp_can_piggyback_ack(self);
+
+    //Construct request uplink packet
+    //(Space for control packets is reserved by "wtp_tx_begin_packet()")
+    WIO_TRY(wtp_tx_begin_packet(tx_ctrl, ack?WTP_PKT_REQ_UPLINK_ACK:WTP_PKT_REQ_UPLINK))
+    if (ack)
+        wio_write_u16(pkt_buf, self->_rx_ctrl._seq_num);
+    wio_write_u8(pkt_buf, read_info->_n_reads);
+    wio_write_u8(pkt_buf, read_info->_size);
+    wio_write_u8(pkt_buf, tx_ctrl->_req_uplink_id);
+    WIO_TRY(wtp_tx_end_packet(tx_ctrl))
+    //Update request ID
+    tx_ctrl->_req_uplink_id++;
+    //Acknowledgement sent
+    if (ack)
+        self->_ack_pending = false;
+
+    return WIO_OK;
+}
+
+static WIO_CALLBACK(wtp_handle_uplink_timeout);
+static wtp_status_t wtp_send_open(wtp_t* self);
+
+/**
+ * @brief Check whether the endpoint waits for the server to answer its open or resume packet.
+ *
+ * @param self WTP endpoint instance.
+ * @return Whether the connection is being opened or resumed.
+ */
+static bool wtp_opening(
+    wtp_t* self
+) {
+    return (self->_uplink_state==WTP_STATE_OPENING)||(self->_downlink_state==WTP_STATE_OPENING);
+}
+
+/**
+ * @brief Set uplink retransmission timer.
+ *
+ * The timer runs as long as there are messages not yet acknowledged,
+ * or the server has not answered the open or resume packet.
+ *
+ * @param self WTP endpoint instance.
+ * @param restart Restart timer if it is already running.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_set_uplink_timer(
+    wtp_t* self,
+    bool restart
+) {
+    wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
+    wio_timer_t* timer = &tx_ctrl->_timer;
+
+    //Clear running timer
+    if (restart)
+        WIO_TRY(wio_clear_timeout(timer))
+    //Timer already running
+    else if (timer->flag)
+        return WIO_OK;
+
+    //All messages acknowledged and connection opened
+    if ((tx_ctrl->_msg_buf.pos_a==tx_ctrl->_msg_buf.pos_b)&&!wtp_opening(self))
+        return WIO_OK;
+    //Set timeout (Doubled for each consecutive timeout)
+    WIO_TRY(wio_set_timeout(
+        timer,
+        tx_ctrl->_timeout<<tx_ctrl->_backoff,
+        self,
+        wtp_handle_uplink_timeout
+    ))
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Handle uplink retransmission timeout.
+ *
+ * @param data WTP endpoint instance.
+ * @param status Timer status.
+ * @param result Unused.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static WIO_CALLBACK(wtp_handle_uplink_timeout) {
+    wtp_t* self = (wtp_t*)data;
+    //Read OpSpec information for retransmission
+    wtp_tx_read_info_t* read_info;
+
+    //Open or resume packet (Or the server's answer) lost; send it again
+    //(Followed by a request for no Reads, whose ID keeps the EPC from being ignored by the server)
+    if (wtp_opening(self)) {
+        wtp_tx_read_info_t no_reads = {0, 0};
+
+        WIO_TRY(wtp_send_open(self))
+        WIO_TRY(wtp_request_uplink(self, &no_reads))
+    }
+    //Mark data fragments for retransmission
+    WIO_TRY(wtp_tx_handle_timeout(&self->_tx_ctrl, &read_info))
+    //Request Reads again
+    if (read_info)
+        WIO_TRY(wtp_request_uplink(self, read_info))
+    //Load READ memory when necessary
+    if (!self->_read_mem_loaded)
+        WIO_TRY(wtp_load_read_mem(self))
+    //Restart timer
+    WIO_TRY(wtp_set_uplink_timer(self, false))
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Handle WTP open packet with the checksum algorithm and framing chosen by the server.
  *
  * @param self WTP endpoint instance.
  * @param buf Received packets buffer.
@@ -15,43 +250,120 @@ static wtp_status_t wtp_handle_open(
     wtp_t* self,
     wio_buf_t* buf
 ) {
-    //Verify checksum
-    WIO_TRY(wtp_verify_checksum(self, buf))
+    WIO_TRY(wio_ensure(buf, 4))
+    //Checksum algorithm and framing chosen by the server
+    wtp_checksum_t checksum = wio_read_u8(buf);
+    if (checksum>=WTP_CHECKSUM_MAX)
+        return WIO_ERR_INVALID;
+    wtp_framing_t framing = wio_read_u8(buf);
+    if (framing>=WTP_FRAMING_MAX)
+        return WIO_ERR_INVALID;
+    //Session token
+    uint16_t token = wio_read_u16(buf);
+    //Requested checksum algorithm
+    wtp_checksum_t req_checksum = self->_checksum;
+
+    //Verify checksum with chosen algorithm
+    //(Keep requested algorithm if the packet is corrupted)
+    self->_checksum = checksum;
+    wtp_status_t status = wtp_verify_checksum(self, buf);
+    if (status!=WIO_OK) {
+        self->_checksum = req_checksum;
+        return status;
+    }
 
     wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
     //Packet buffer
     wio_buf_t* pkt_buf = &tx_ctrl->_pkt_buf;
-
+    //Open packet sent again by the server, as the acknowledgement of the first one was lost
+    bool reopened = self->_downlink_state==WTP_STATE_OPENED;
+
+    //Send data packets with the chosen framing, replacing the framing of a resumed session
+    //(Compact framing only if requested)
+    tx_ctrl->_framing = (self->_req_framing==WTP_FRAMING_COMPACT)?framing:WTP_FRAMING_STANDARD;
+    //Connection restarted
+    bool restarted = false;
+    //Resuming a session the server no longer knows; the new connection only has uplink data
+    //from the beginning of the oldest message not acknowledged, and downlink begins from 0
+    if ((self->_uplink_state==WTP_STATE_OPENED)&&(self->_downlink_state==WTP_STATE_OPENING)) {
+        wtp_tx_read_info_t* read_info;
+
+        WIO_TRY(wtp_tx_restart(tx_ctrl, &read_info))
+        WIO_TRY(wtp_rx_restart(&self->_rx_ctrl, 0))
+        if (read_info)
+            WIO_TRY(wtp_request_uplink(self, read_info))
+        restarted = true;
+    }
     //Open downlink
     self->_downlink_state = WTP_STATE_OPENED;
+    self->_checkpoint_resumed = false;
+    //Keep new session
+    //(Also when resuming a session the server no longer knows; the uplink goes on with its sequence numbers)
+    wtp_session_t* session = self->_session;
+    if (session) {
+        session->token = token;
+        session->tx_seq_num = tx_ctrl->_seq_num;
+        session->checksum = checksum;
+        session->framing = tx_ctrl->_framing;
+        session->crc = wtp_session_crc(session);
+    }
 
     //Send acknowledgement packet
     WIO_TRY(wtp_tx_begin_packet(tx_ctrl, WTP_PKT_ACK))
-    WIO_TRY(wio_write(pkt_buf, &tx_ctrl->_seq_num, 2))
+    wio_write_u16(pkt_buf, self->_rx_ctrl._seq_num);
     WIO_TRY(wtp_tx_end_packet(tx_ctrl))
-    //Invoke and remove callback
-    WIO_TRY(wtp_trigger_event(self, WTP_EVENT_OPEN, WIO_OK, NULL))
+    //Invoke and remove callback (Already invoked if the uplink opened when resuming, or for the first open packet)
+    if ((self->_uplink_state!=WTP_STATE_OPENED)&&!reopened)
+        WIO_TRY(wtp_trigger_event(self, WTP_EVENT_OPEN, WIO_OK, NULL))
+    //State kept above WTP (e.g. compression streams) no longer matches the server
+    if (restarted)
+        WIO_TRY(wtp_trigger_event(self, WTP_EVENT_RESTART, WIO_OK, NULL))
 
     return WIO_OK;
 }
 
 /**
- * @brief Handle WTP acknowledgement packet.
+ * @brief Handle WTP resume packet.
  *
  * @param self WTP endpoint instance.
  * @param buf Received packets buffer.
  * @return Error code if failed, otherwise WIO_OK.
  */
-static wtp_status_t wtp_handle_ack(
+static wtp_status_t wtp_handle_resume(
     wtp_t* self,
     wio_buf_t* buf
 ) {
-    //Sequence number
-    uint16_t seq_num;
-    WIO_TRY(wio_read(buf, &seq_num, 2))
+    //Downlink sequence number chosen by the server
+    WIO_TRY(wio_ensure(buf, 2))
+    uint16_t seq_num = wio_read_u16(buf);
     //Verify checksum
     WIO_TRY(wtp_verify_checksum(self, buf))
 
+    //Not resuming
+    if (self->_downlink_state!=WTP_STATE_OPENING)
+        return WIO_OK;
+    //Resume downlink from the sequence number
+    //(With state restored from a checkpoint, only when the server skips data in flight; a server going
+    //back to the acknowledgement may have sent data again before this packet, which is kept)
+    if (!self->_checkpoint_resumed||((int16_t)(seq_num-self->_rx_ctrl._seq_num)>0))
+        WIO_TRY(wtp_rx_restart(&self->_rx_ctrl, seq_num))
+    self->_checkpoint_resumed = false;
+    self->_downlink_state = WTP_STATE_OPENED;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Handle acknowledged sequence number.
+ *
+ * @param self WTP endpoint instance.
+ * @param seq_num Acknowledged sequence number.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_handle_ack_seq(
+    wtp_t* self,
+    uint16_t seq_num
+) {
     //Connected acknowledgement
     if (self->_uplink_state==WTP_STATE_OPENING)
         self->_uplink_state = WTP_STATE_OPENED;
@@ -65,8 +377,28 @@ static wtp_status_t wtp_handle_ack(
         wio_queue_t* send_cb_queue = &self->_send_cb_queue;
         wio_queue_t* send_cb_data_queue = &self->_send_cb_data_queue;
 
+        //Transmit control
+        wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
+        //Sequence number before acknowledgement
+        uint16_t prev_seq_num = tx_ctrl->_seq_num;
+
         //Handle acknowledgement with transmit control
-        WIO_TRY(wtp_tx_handle_ack(&self->_tx_ctrl, seq_num, &n_sent_msgs))
+        WIO_TRY(wtp_tx_handle_ack(tx_ctrl, seq_num, &n_sent_msgs))
+        //Acknowledgement makes progress
+        if (tx_ctrl->_seq_num!=prev_seq_num) {
+            //Keep acknowledged sequence number in session
+            if (self->_session) {
+                self->_session->tx_seq_num = tx_ctrl->_seq_num;
+                self->_session->crc = wtp_session_crc(self->_session);
+            }
+            //Commit before released message memory is reused
+            WIO_TRY(wtp_commit(self))
+            //Restart uplink retransmission timer
+            WIO_TRY(wtp_set_uplink_timer(self, true))
+            //Window moved; load READ memory when necessary
+            if (!self->_read_mem_loaded)
+                WIO_TRY(wtp_load_read_mem(self))
+        }
         //Invoke callback functions
         for (uint8_t i=0;i<n_sent_msgs;i++) {
             //Callback function and closure data
@@ -89,32 +421,209 @@ static wtp_status_t wtp_handle_ack(
 }
 
 /**
- * @brief Handle WTP message packet.
+ * @brief Handle WTP acknowledgement packet.
  *
  * @param self WTP endpoint instance.
  * @param buf Received packets buffer.
- * @param begin_msg True for WTP_PKT_BEGIN_MSG and false for WTP_PKT_CONT_MSG.
  * @return Error code if failed, otherwise WIO_OK.
  */
-static wtp_status_t wtp_handle_msg_packet(
+static wtp_status_t wtp_handle_ack(
+    wtp_t* self,
+    wio_buf_t* buf
+) {
+    //Sequence number
+    WIO_TRY(wio_ensure(buf, 2))
+    uint16_t seq_num = wio_read_u16(buf);
+    //Verify checksum
+    WIO_TRY(wtp_verify_checksum(self, buf))
+
+    return wtp_handle_ack_seq(self, seq_num);
+}
+
+/**
+ * @brief Handle WTP selective acknowledgement packet.
+ *
+ * @param self WTP endpoint instance.
+ * @param buf Received packets buffer.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_handle_sack(
+    wtp_t* self,
+    wio_buf_t* buf
+) {
+    //Sequence number and number of blocks
+    WIO_TRY(wio_ensure(buf, 3))
+    uint16_t seq_num = wio_read_u16(buf);
+    uint8_t n_blocks = wio_read_u8(buf);
+    if (n_blocks>WTP_SACK_BLOCKS_MAX)
+        return WIO_ERR_INVALID;
+    //Selective acknowledgement blocks
+    wtp_sack_block_t blocks[WTP_SACK_BLOCKS_MAX];
+    WIO_TRY(wio_ensure(buf, 3*n_blocks))
+    for (uint8_t i=0;i<n_blocks;i++) {
+        blocks[i]._begin = wio_read_u16(buf);
+        blocks[i]._size = wio_read_u8(buf);
+    }
+    //Verify checksum
+    WIO_TRY(wtp_verify_checksum(self, buf))
+
+    //Stop retransmission of data received out of order
+    //(Before handling the acknowledgement, which may load READ memory)
+    if (self->_uplink_state==WTP_STATE_OPENED)
+        for (uint8_t i=0;i<n_blocks;i++)
+            WIO_TRY(wtp_tx_handle_sack(&self->_tx_ctrl, blocks+i))
+
+    return wtp_handle_ack_seq(self, seq_num);
+}
+
+/**
+ * @brief Advertise receive window size to the other side.
+ *
+ * The window is only advertised when it changes by at least WTP_RX_WINDOW_STEP,
+ * or grows back to the sliding window size, to save EPC space.
+ *
+ * @param self WTP endpoint instance.
+ * @param force Advertise window even if it doesn't change much.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_advertise_window(
+    wtp_t* self,
+    bool force
+) {
+    wtp_rx_ctrl_t* rx_ctrl = &self->_rx_ctrl;
+    //Transmit control
+    wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
+    //Packet buffer
+    wio_buf_t* pkt_buf = &tx_ctrl->_pkt_buf;
+    //Current and advertised window size
+    uint16_t window_size;
+    uint16_t adv_window_size = rx_ctrl->_adv_window_size;
+
+    WIO_TRY(wtp_rx_get_window(rx_ctrl, &window_size))
+    //Window doesn't change much
+    if (!force) {
+        uint16_t change = (window_size>adv_window_size)
+            ?window_size-adv_window_size
+            :adv_window_size-window_size;
+        bool window_restored = (window_size==rx_ctrl->_window_size)&&(adv_window_size!=window_size);
+
+        if ((change<WTP_RX_WINDOW_STEP)&&!window_restored)
+            return WIO_OK;
+    }
+
+    //Send set parameter packet
+    WIO_TRY(wtp_tx_begin_packet(tx_ctrl, WTP_PKT_SET_PARAM))
+    wio_write_u8(pkt_buf, WTP_PARAM_WINDOW_SIZE);
+    wio_write_u16(pkt_buf, window_size);
+    WIO_TRY(wtp_tx_end_packet(tx_ctrl))
+    //Update advertised window size
+    rx_ctrl->_adv_window_size = window_size;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Send open or resume packet for the connection being opened or resumed.
+ *
+ * A new connection requests checksum algorithm and framing; a session is resumed with its token,
+ * acknowledging downlink data kept in the checkpoint if the endpoint was restored from it.
+ * The packet is sent again on uplink timeout until the server answers.
+ *
+ * @param self WTP endpoint instance.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_send_open(
+    wtp_t* self
+) {
+    wtp_session_t* session = self->_session;
+    wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
+    //Packet buffer
+    wio_buf_t* pkt_buf = &tx_ctrl->_pkt_buf;
+
+    //Open new connection with requested checksum algorithm and framing
+    if (self->_uplink_state==WTP_STATE_OPENING) {
+        WIO_TRY(wtp_tx_begin_packet(tx_ctrl, WTP_PKT_OPEN_PARAM))
+        wio_write_u8(pkt_buf, self->_checksum);
+        wio_write_u8(pkt_buf, self->_req_framing);
+    //Resume session from the latest commit of the checkpoint, with downlink acknowledgement
+    } else if (self->_checkpoint_resumed) {
+        uint8_t latest = wtp_checkpoint_latest(self->_checkpoint);
+        if (latest>=WTP_CHECKPOINT_SLOTS)
+            return WIO_ERR_INVALID;
+
+        WIO_TRY(wtp_tx_begin_packet(tx_ctrl, WTP_PKT_RESUME_ACK))
+        wio_write_u16(pkt_buf, self->_rx_ctrl._seq_num);
+        wio_write_u16(pkt_buf, session->token);
+        wio_write_u16(pkt_buf, self->_checkpoint->_slots[latest]._tx_state._msg_seq);
+    //Resume session
+    } else {
+        WIO_TRY(wtp_tx_begin_packet(tx_ctrl, WTP_PKT_RESUME))
+        wio_write_u16(pkt_buf, session->token);
+        wio_write_u16(pkt_buf, session->tx_seq_num);
+    }
+    WIO_TRY(wtp_tx_end_packet(tx_ctrl))
+    //Advertise receive window
+    WIO_TRY(wtp_advertise_window(self, true))
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Deliver received message to the next receive callback.
+ *
+ * The message is dropped if there is no receive callback.
+ *
+ * @param self WTP endpoint instance.
+ * @param msg_buf Message buffer.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_deliver_msg(
+    wtp_t* self,
+    wio_buf_t* msg_buf
+) {
+    //Receive callback and closure data queue
+    wio_queue_t* recv_cb_queue = &self->_recv_cb_queue;
+    wio_queue_t* recv_cb_data_queue = &self->_recv_cb_data_queue;
+    //Callback function and closure data
+    wio_callback_t cb = NULL;
+    void* cb_data = NULL;
+
+    //Pop callback and closure data from queue
+    if (recv_cb_queue->size>0) {
+        WIO_TRY(wio_queue_pop(recv_cb_queue, &cb))
+        WIO_TRY(wio_queue_pop(recv_cb_data_queue, &cb_data))
+    }
+    //Invoke callback (Ignore errors)
+    if (cb)
+        cb(cb_data, WIO_OK, msg_buf);
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Handle payload of WTP message packet.
+ *
+ * @param self WTP endpoint instance.
+ * @param buf Received packets buffer, positioned at the payload.
+ * @param seq_num Packet sequence number.
+ * @param payload_size Payload size.
+ * @param new_msg_size New message size for WTP_PKT_BEGIN_MSG, 0 for WTP_PKT_CONT_MSG.
+ * @param ack_seq Piggybacked acknowledged sequence number, or NULL.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_handle_msg_payload(
     wtp_t* self,
     wio_buf_t* buf,
-    bool begin_msg
+    uint16_t seq_num,
+    uint8_t payload_size,
+    uint16_t new_msg_size,
+    uint16_t* ack_seq
 ) {
     //Number of messages received
     uint8_t n_msgs = 0;
 
-    //New message size
-    uint16_t new_msg_size = 0;
-    if (begin_msg)
-        WIO_TRY(wio_read(buf, &new_msg_size, 2))
-    //Sequence number
-    uint16_t seq_num;
-    WIO_TRY(wio_read(buf, &seq_num, 2))
-    //Payload size
-    uint8_t payload_size;
-    WIO_TRY(wio_read(buf, &payload_size, 1))
     //Get pointer to payload
+    WIO_TRY(wio_ensure(buf, payload_size))
     uint8_t* payload = buf->buffer+buf->pos_a;
     //Update read cursor position
     buf->pos_a += payload_size;
@@ -131,53 +640,103 @@ static wtp_status_t wtp_handle_msg_packet(
         &n_msgs
     );
 
-    //Message data buffer
-    wio_buf_t* msg_data_buf = &self->_rx_ctrl._msg_data_buf;
-    //Receive callback and closure data queue
-    wio_queue_t* recv_cb_queue = &self->_recv_cb_queue;
-    wio_queue_t* recv_cb_data_queue = &self->_recv_cb_data_queue;
-
-    //Invoke callback functions with received messages
-    for (uint8_t i=0;i<n_msgs;i++) {
-        //Callback function and closure data
-        wio_callback_t cb = NULL;
-        void* cb_data = NULL;
-        //Pop callback and closure data from queue
-        if (recv_cb_queue->size>0) {
-            WIO_TRY(wio_queue_pop(recv_cb_queue, &cb))
-            WIO_TRY(wio_queue_pop(recv_cb_data_queue, &cb_data))
+    do {
+        //Invoke callback functions with received messages
+        for (uint8_t i=0;i<n_msgs;i++) {
+            //Current message buffer
+            wio_buf_t msg_buf;
+            //Read message from message data ring
+            WIO_TRY(wtp_rx_read_msg(&self->_rx_ctrl, &msg_buf))
+            WIO_TRY(wtp_deliver_msg(self, &msg_buf))
         }
+        //Commit before released message data ring memory is reused
+        if (n_msgs>0)
+            WIO_TRY(wtp_commit(self))
+        //Append staged fragments that did not fit before messages were read
+        WIO_TRY(wtp_rx_assemble(&self->_rx_ctrl, &n_msgs))
+    } while (n_msgs>0);
+
+    //Acknowledge received data (Coalesced with acknowledgements of other data packets until sent)
+    self->_ack_pending = true;
+    //Advertise receive window when it changes
+    WIO_TRY(wtp_advertise_window(self, false))
+    //Handle piggybacked acknowledgement
+    //(After acknowledging received data, so READ memory loaded by it carries the acknowledgement)
+    if (ack_seq)
+        WIO_TRY(wtp_handle_ack_seq(self, *ack_seq))
 
-        //Message size
-        uint16_t msg_size;
-        //Current message buffer
-        wio_buf_t msg_buf;
-
-        //Read message size
-        WIO_TRY(wio_read(msg_data_buf, &msg_size, 2))
-        //Get message data
-        uint8_t* msg_data = msg_data_buf->buffer+msg_data_buf->pos_a;
-        //Update read cursor
-        msg_data_buf->pos_a += msg_size;
-        //Initialize current message buffer
-        WIO_TRY(wio_buf_init(&msg_buf, msg_data, msg_size))
-
-        //Invoke callback (Ignore errors)
-        if (cb)
-            cb(cb_data, WIO_OK, &msg_buf);
-    }
+    return WIO_OK;
+}
 
-    //Transmit control type
-    wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
-    //Packet buffer type
-    wio_buf_t* pkt_buf = &tx_ctrl->_pkt_buf;
+/**
+ * @brief Handle WTP message packet.
+ *
+ * @param self WTP endpoint instance.
+ * @param buf Received packets buffer.
+ * @param begin_msg True for WTP_PKT_BEGIN_MSG and false for WTP_PKT_CONT_MSG.
+ * @param ack Packet carries piggybacked acknowledgement.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_handle_msg_packet(
+    wtp_t* self,
+    wio_buf_t* buf,
+    bool begin_msg,
+    bool ack
+) {
+    WIO_TRY(wio_ensure(buf, (ack?2:0)+(begin_msg?2:0)+3))
+    //Piggybacked acknowledged sequence number
+    uint16_t ack_seq;
+    if (ack)
+        ack_seq = wio_read_u16(buf);
+    //New message size
+    uint16_t new_msg_size = 0;
+    if (begin_msg)
+        new_msg_size = wio_read_u16(buf);
+    //Sequence number
+    uint16_t seq_num = wio_read_u16(buf);
+    //Payload size
+    uint8_t payload_size = wio_read_u8(buf);
 
-    //Send acknowledge packet back to server
-    WIO_TRY(wtp_tx_begin_packet(tx_ctrl, WTP_PKT_ACK))
-    WIO_TRY(wio_write(pkt_buf, &self->_rx_ctrl._seq_num, 2))
-    WIO_TRY(wtp_tx_end_packet(tx_ctrl))
+    return wtp_handle_msg_payload(self, buf, seq_num, payload_size, new_msg_size, ack?&ack_seq:NULL);
+}
 
-    return WIO_OK;
+/**
+ * @brief Handle WTP compact message packet.
+ *
+ * @param self WTP endpoint instance.
+ * @param buf Received packets buffer.
+ * @param pkt_type Packet type with begin and acknowledgement flags and payload size.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_handle_compact_msg(
+    wtp_t* self,
+    wio_buf_t* buf,
+    wtp_pkt_t pkt_type
+) {
+    //Piggybacked acknowledged sequence number
+    uint16_t ack_seq;
+    if (pkt_type&WTP_PKT_COMPACT_ACK) {
+        WIO_TRY(wio_ensure(buf, 2))
+        ack_seq = wio_read_u16(buf);
+    }
+    //New message size
+    uint16_t new_msg_size = 0;
+    if (pkt_type&WTP_PKT_COMPACT_BEGIN)
+        WIO_TRY(wtp_read_varint(buf, &new_msg_size))
+    //Lowest 8 bits of sequence number
+    WIO_TRY(wio_ensure(buf, 1))
+    uint8_t seq_low = wio_read_u8(buf);
+    //Resolve sequence number around begin of receive window
+    uint16_t seq_num = wtp_seq_resolve(seq_low, self->_rx_ctrl._seq_num);
+
+    return wtp_handle_msg_payload(
+        self,
+        buf,
+        seq_num,
+        pkt_type&WTP_PKT_COMPACT_SIZE_MASK,
+        new_msg_size,
+        (pkt_type&WTP_PKT_COMPACT_ACK)?&ack_seq:NULL
+    );
 }
 
 /**
@@ -191,7 +750,7 @@ static wtp_status_t wtp_handle_begin_msg(
     wtp_t* self,
     wio_buf_t* buf
 ) {
-    return wtp_handle_msg_packet(self, buf, true);
+    return wtp_handle_msg_packet(self, buf, true, false);
 }
 
 /**
@@ -205,7 +764,35 @@ static wtp_status_t wtp_handle_cont_msg(
     wtp_t* self,
     wio_buf_t* buf
 ) {
-    return wtp_handle_msg_packet(self, buf, false);
+    return wtp_handle_msg_packet(self, buf, false, false);
+}
+
+/**
+ * @brief Handle WTP begin message packet with piggybacked acknowledgement.
+ *
+ * @param self WTP endpoint instance.
+ * @param buf Received packets buffer.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_handle_begin_msg_ack(
+    wtp_t* self,
+    wio_buf_t* buf
+) {
+    return wtp_handle_msg_packet(self, buf, true, true);
+}
+
+/**
+ * @brief Handle WTP continue message packet with piggybacked acknowledgement.
+ *
+ * @param self WTP endpoint instance.
+ * @param buf Received packets buffer.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_handle_cont_msg_ack(
+    wtp_t* self,
+    wio_buf_t* buf
+) {
+    return wtp_handle_msg_packet(self, buf, false, true);
 }
 
 /**
@@ -219,27 +806,42 @@ static wtp_status_t wtp_handle_set_param(
     wio_buf_t* buf
 ) {
     //Read parameter code
-    wtp_param_t param_code;
-    WIO_TRY(wio_read(buf, &param_code, 1))
-
-    switch (param_code) {
-        //TODO: WTP_PARAM_WINDOW_SIZE
-        case WTP_PARAM_WINDOW_SIZE: {
-            break;
-        }
-        //WTP_PARAM_READ_SIZE
-        case WTP_PARAM_READ_SIZE: {
-            //Suggested READ size
-            uint8_t read_size;
-            WIO_TRY(wio_read(buf, &read_size, 1))
-            //Verify checksum
-            WIO_TRY(wtp_verify_checksum(self, buf))
-
-            //Set READ size
-            self->_tx_ctrl._read_size = read_size;
-
-            break;
-        }
+    WIO_TRY(wio_ensure(buf, 1))
+    wtp_param_t param_code = wio_read_u8(buf);
+
+    //(Parameter codes are constants rather than integer constant expressions,
+    //so they can't be used as case labels)
+    //WTP_PARAM_WINDOW_SIZE
+    if (param_code==WTP_PARAM_WINDOW_SIZE) {
+        //Receive window size of the server
+        WIO_TRY(wio_ensure(buf, 2))
+        uint16_t window_size = wio_read_u16(buf);
+        //Verify checksum
+        WIO_TRY(wtp_verify_checksum(self, buf))
+
+        wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
+        //Empty window still allows one byte, which is sent again on uplink timeout
+        //and probes the window until the server opens it again
+        if (window_size==0)
+            window_size = 1;
+        //Keep window within message buffer and range of sequence numbers of the framing
+        uint16_t window_max = tx_ctrl->_msg_buf.size;
+        if (tx_ctrl->_framing==WTP_FRAMING_COMPACT)
+            window_max = WIO_MIN(window_max, WTP_COMPACT_WINDOW_MAX);
+
+        //Set uplink sliding window size
+        tx_ctrl->_window_size = WIO_MIN(window_size, window_max);
+    }
+    //WTP_PARAM_READ_SIZE
+    else if (param_code==WTP_PARAM_READ_SIZE) {
+        //Suggested READ size
+        WIO_TRY(wio_ensure(buf, 1))
+        uint8_t read_size = wio_read_u8(buf);
+        //Verify checksum
+        WIO_TRY(wtp_verify_checksum(self, buf))
+
+        //Set READ size
+        self->_tx_ctrl._read_size = read_size;
     }
 
     return WIO_OK;
@@ -275,9 +877,25 @@ wtp_status_t wtp_init(
 
     //Read memory loaded flag
     self->_read_mem_loaded = false;
+    //No acknowledgement pending
+    self->_ack_pending = false;
+    //Refresh EPC as soon as its content is observed by default
+    self->_epc_cadence = 1;
+    //Initial EPC content carries no packets and can be replaced right away
+    self->_epc_observations = UINT8_MAX;
 
     //Initialize packet begin position
     self->_pkt_begin = 0;
+    //Request CRC-16 by default
+    self->_checksum = WTP_CHECKSUM_CRC16;
+    //Request standard framing by default
+    self->_req_framing = WTP_FRAMING_STANDARD;
+    //No session by default
+    self->_session = NULL;
+    //No checkpoint by default
+    self->_checkpoint = NULL;
+    self->_checkpoint_slot = 0;
+    self->_checkpoint_resumed = false;
 
     //Transmit control memory unit
     uint16_t tx_mem_unit = tx_buf_size/4;
@@ -327,6 +945,11 @@ wtp_status_t wtp_init(
 wtp_status_t wtp_fini(
     wtp_t* self
 ) {
+    //Message buffers in caller memory
+    if (self->_checkpoint) {
+        self->_tx_ctrl._msg_buf.buffer = NULL;
+        self->_rx_ctrl._msg_data_buf.buffer = NULL;
+    }
     //Transmit control
     WIO_TRY(wtp_tx_fini(&self->_tx_ctrl))
     //Receive control
@@ -345,6 +968,66 @@ wtp_status_t wtp_fini(
     return WIO_OK;
 }
 
+/**
+ * @brief Resume session from a checkpoint.
+ *
+ * The resume packet acknowledges downlink data kept in the checkpoint, and tells the server
+ * where the oldest uplink message not acknowledged begins in case it no longer knows the session.
+ *
+ * @param self WTP endpoint instance.
+ * @param slot Checkpoint slot of the latest commit.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_resume_checkpoint(
+    wtp_t* self,
+    wtp_checkpoint_slot_t* slot
+) {
+    wtp_session_t* session = self->_session;
+    wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
+    wtp_rx_ctrl_t* rx_ctrl = &self->_rx_ctrl;
+
+    //Checksum algorithm and framing of the session
+    //(Before restoring, as the number of Reads needed depends on framing)
+    self->_checksum = session->checksum;
+    tx_ctrl->_framing = session->framing;
+    //Restore transmit and receive control
+    uint8_t n_msgs;
+    wtp_tx_read_info_t* read_info;
+    WIO_TRY(wtp_tx_restore(tx_ctrl, &slot->_tx_state, &n_msgs, &read_info))
+    WIO_TRY(wtp_rx_restore(rx_ctrl, &slot->_rx_state))
+    session->tx_seq_num = tx_ctrl->_seq_num;
+    session->crc = wtp_session_crc(session);
+    //Restored messages have no send callbacks
+    wio_callback_t cb = NULL;
+    void* cb_data = NULL;
+    for (uint8_t i=0;i<n_msgs;i++) {
+        WIO_TRY(wio_queue_push(&self->_send_cb_queue, &cb))
+        WIO_TRY(wio_queue_push(&self->_send_cb_data_queue, &cb_data))
+    }
+
+    //Uplink opens without waiting for the server; downlink opens once the server replies
+    self->_uplink_state = WTP_STATE_OPENED;
+    self->_downlink_state = WTP_STATE_OPENING;
+    self->_checkpoint_resumed = true;
+    //Send resume packet with acknowledgement
+    WIO_TRY(wtp_send_open(self))
+    //Request Reads for messages not acknowledged
+    if (read_info)
+        WIO_TRY(wtp_request_uplink(self, read_info))
+    WIO_TRY(wtp_set_uplink_timer(self, false))
+
+    //Invoke and remove callback
+    WIO_TRY(wtp_trigger_event(self, WTP_EVENT_OPEN, WIO_OK, NULL))
+
+    //Deliver messages fully received but not delivered before power loss
+    //(Receive callbacks are usually added by the open event callback)
+    wio_buf_t msg_buf;
+    while (wtp_rx_read_msg(rx_ctrl, &msg_buf)==WIO_OK)
+        WIO_TRY(wtp_deliver_msg(self, &msg_buf))
+
+    return wtp_commit(self);
+}
+
 /**
  * {@inheritDoc}
  */
@@ -356,13 +1039,143 @@ wtp_status_t wtp_connect(
     //Uplink already opened
     if (self->_uplink_state==WTP_STATE_OPENED)
         return WIO_ERR_ALREADY;
+    //Resume session (A session never written, torn or corrupted opens a new connection)
+    wtp_session_t* session = self->_session;
+    if (session&&wtp_session_valid(session)) {
+        //Latest commit of the session
+        wtp_checkpoint_t* checkpoint = self->_checkpoint;
+        if (checkpoint) {
+            uint8_t latest = wtp_checkpoint_latest(checkpoint);
+
+            if ((latest<WTP_CHECKPOINT_SLOTS)&&(checkpoint->_slots[latest]._token==session->token))
+                return wtp_resume_checkpoint(self, checkpoint->_slots+latest);
+        }
+
+        //Skip sequence numbers of uplink data that may still be in flight,
+        //which also keeps resume packets of consecutive power cycles different
+        uint16_t seq_num = session->tx_seq_num+tx_ctrl->_window_size;
+        session->tx_seq_num = seq_num;
+        session->crc = wtp_session_crc(session);
+        tx_ctrl->_seq_num = seq_num;
+        tx_ctrl->_msg_begin_seq = seq_num;
+        //Checksum algorithm and framing of the session
+        self->_checksum = session->checksum;
+        tx_ctrl->_framing = session->framing;
+
+        //Uplink opens without waiting for the server; downlink opens once the server replies
+        self->_uplink_state = WTP_STATE_OPENED;
+        self->_downlink_state = WTP_STATE_OPENING;
+        //Send resume packet (Sent again on uplink timeout until the server replies)
+        WIO_TRY(wtp_send_open(self))
+        WIO_TRY(wtp_set_uplink_timer(self, false))
+        //Invoke and remove callback
+        WIO_TRY(wtp_trigger_event(self, WTP_EVENT_OPEN, WIO_OK, NULL))
+
+        return WIO_OK;
+    }
+
     //Set uplink state
     self->_uplink_state = WTP_STATE_OPENING;
 
-    //Construct WTP connect packet
-    WIO_TRY(wtp_tx_begin_packet(tx_ctrl, WTP_PKT_OPEN))
-    //End packet
-    WIO_TRY(wtp_tx_end_packet(tx_ctrl))
+    //Send open packet (Sent again on uplink timeout until the server replies)
+    WIO_TRY(wtp_send_open(self))
+    WIO_TRY(wtp_set_uplink_timer(self, false))
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_set_checksum(
+    wtp_t* self,
+    wtp_checksum_t checksum
+) {
+    //Already connecting or connected
+    if (self->_uplink_state!=WTP_STATE_CLOSED)
+        return WIO_ERR_ALREADY;
+    //Unsupported algorithm
+    if (checksum>=WTP_CHECKSUM_MAX)
+        return WIO_ERR_INVALID;
+
+    self->_checksum = checksum;
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_set_framing(
+    wtp_t* self,
+    wtp_framing_t framing
+) {
+    //Already connecting or connected
+    if (self->_uplink_state!=WTP_STATE_CLOSED)
+        return WIO_ERR_ALREADY;
+    //Unsupported framing
+    if (framing>=WTP_FRAMING_MAX)
+        return WIO_ERR_INVALID;
+    //8-bit sequence numbers of compact framing cannot address bigger windows
+    if (framing==WTP_FRAMING_COMPACT&&self->_rx_ctrl._window_size>WTP_COMPACT_WINDOW_MAX)
+        return WIO_ERR_INVALID;
+
+    self->_req_framing = framing;
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_set_session(
+    wtp_t* self,
+    wtp_session_t* session
+) {
+    //Already connecting or connected
+    if (self->_uplink_state!=WTP_STATE_CLOSED)
+        return WIO_ERR_ALREADY;
+
+    self->_session = session;
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+bool wtp_session_valid(
+    const wtp_session_t* session
+) {
+    return (session->crc==wtp_session_crc(session))&&(session->token!=0)
+        &&(session->checksum<WTP_CHECKSUM_MAX)&&(session->framing<WTP_FRAMING_MAX);
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_set_checkpoint(
+    wtp_t* self,
+    wtp_checkpoint_t* checkpoint,
+    uint8_t* tx_msg_mem,
+    uint16_t tx_msg_size,
+    uint8_t* rx_msg_mem,
+    uint16_t rx_msg_size
+) {
+    //Already connecting or connected
+    if (self->_uplink_state!=WTP_STATE_CLOSED)
+        return WIO_ERR_ALREADY;
+
+    //Move message buffers into caller memory
+    //(Content is kept; cursors are restored from the checkpoint when connecting)
+    if (!self->_checkpoint) {
+        free(self->_tx_ctrl._msg_buf.buffer);
+        free(self->_rx_ctrl._msg_data_buf.buffer);
+    }
+    WIO_TRY(wio_buf_init(&self->_tx_ctrl._msg_buf, tx_msg_mem, tx_msg_size))
+    WIO_TRY(wio_buf_init(&self->_rx_ctrl._msg_data_buf, rx_msg_mem, rx_msg_size))
+
+    //Next commit goes into the slot not holding the latest one
+    uint8_t latest = wtp_checkpoint_latest(checkpoint);
+    self->_checkpoint = checkpoint;
+    self->_checkpoint_slot = (latest<WTP_CHECKPOINT_SLOTS)?latest:0;
 
     return WIO_OK;
 }
@@ -379,32 +1192,50 @@ wtp_status_t wtp_close(
 }
 
 /**
- * {@inheritDoc}
+ * @brief Send message to WTP server.
+ *
+ * @param self WTP endpoint instance.
+ * @param data Data to send.
+ * @param size Size of data.
+ * @param borrow Send data from caller memory instead of copying it.
+ * @param cb_data Callback closure data.
+ * @param cb Callback function.
+ * @return Error code if failed, otherwise WIO_OK.
  */
-wtp_status_t wtp_send(
+static wtp_status_t wtp_send_msg(
     wtp_t* self,
     uint8_t* data,
     uint16_t size,
+    bool borrow,
     void* cb_data,
     wio_callback_t cb
 ) {
-    //Add callback and closure data to queue
-    WIO_TRY(wio_queue_push(&self->_send_cb_queue, &cb))
-    WIO_TRY(wio_queue_push(&self->_send_cb_data_queue, &cb_data))
+    //No space for callback and closure data
+    if (self->_send_cb_queue.size>=self->_send_cb_queue.capacity)
+        return WIO_ERR_NO_MEMORY;
 
     wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
     //New message READ OpSpec information
     wtp_tx_read_info_t* read_info;
 
     //Add message to transmit control
-    WIO_TRY(wtp_tx_add_msg(tx_ctrl, data, size, &read_info))
+    if (borrow)
+        WIO_TRY(wtp_tx_add_msg_ref(tx_ctrl, data, size, &read_info))
+    else
+        WIO_TRY(wtp_tx_add_msg(tx_ctrl, data, size, &read_info))
+    //Add callback and closure data to queue
+    WIO_TRY(wio_queue_push(&self->_send_cb_queue, &cb))
+    WIO_TRY(wio_queue_push(&self->_send_cb_data_queue, &cb_data))
+    //Commit before any of the message is sent
+    WIO_TRY(wtp_commit(self))
 
-    wio_buf_t* pkt_buf = &tx_ctrl->_pkt_buf;
     //Send request uplink packet
-    WIO_TRY(wtp_tx_begin_packet(tx_ctrl, WTP_PKT_REQ_UPLINK))
-    WIO_TRY(wio_write(pkt_buf, &read_info->_n_reads, 1))
-    WIO_TRY(wio_write(pkt_buf, &read_info->_size, 1))
-    WIO_TRY(wtp_tx_end_packet(tx_ctrl))
+    //(The message is queued already; without room for the request, Reads are requested again on uplink timeout)
+    wtp_status_t status = wtp_request_uplink(self, read_info);
+    if ((status!=WIO_OK)&&(status!=WIO_ERR_NO_MEMORY))
+        return status;
+    //Start uplink retransmission timer
+    WIO_TRY(wtp_set_uplink_timer(self, false))
 
     //Load READ memory when necessary
     if (!self->_read_mem_loaded)
@@ -413,6 +1244,32 @@ wtp_status_t wtp_send(
     return WIO_OK;
 }
 
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_send(
+    wtp_t* self,
+    uint8_t* data,
+    uint16_t size,
+    void* cb_data,
+    wio_callback_t cb
+) {
+    return wtp_send_msg(self, data, size, false, cb_data, cb);
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_send_ref(
+    wtp_t* self,
+    uint8_t* data,
+    uint16_t size,
+    void* cb_data,
+    wio_callback_t cb
+) {
+    return wtp_send_msg(self, data, size, true, cb_data, cb);
+}
+
 /**
  * {@inheritDoc}
  */
@@ -480,27 +1337,17 @@ wtp_status_t wtp_load_read_mem(
     //Read information queue
     wio_queue_t* read_info_queue = &tx_ctrl->_read_info_queue;
 
-    //No fragments to load
-    if (read_info_queue->size==0) {
-        self->_read_mem_loaded = false;
-        //Set the first byte of the Read buffer to WTP_PKT_END
-        self->_read_mem[0] = WTP_PKT_END;
+    //Read memory not loaded
+    self->_read_mem_loaded = false;
+    //Set the first byte of the Read buffer to WTP_PKT_END
+    self->_read_mem[0] = WTP_PKT_END;
 
+    //No Reads requested
+    if (read_info_queue->size==0)
         return WIO_OK;
-    }
-    //Set Read memory loaded flag
-    self->_read_mem_loaded = true;
-
     //Get next READ OpSpec size
     wtp_tx_read_info_t* read_info = WIO_QUEUE_END(read_info_queue, wtp_tx_read_info_t);
     uint8_t read_size = read_info->_size;
-    //Update number of reads
-    read_info->_n_reads--;
-    //Pop read information when necessary
-    if (read_info->_n_reads==0)
-        WIO_TRY(wio_queue_pop(read_info_queue, NULL))
-    //Initialize read buffer
-    WIO_TRY(wio_buf_init(read_buf, self->_read_mem, read_size))
 
     //Data fragments queue
     wio_queue_t* fragments_queue = &tx_ctrl->_fragments_queue;
@@ -524,26 +1371,86 @@ wtp_status_t wtp_load_read_mem(
     }
     //Try to make new data fragment to send
     if (!send_fragment)
-        WIO_TRY(wtp_tx_make_fragment(tx_ctrl, tx_ctrl->_read_size, &send_fragment))
-    //No more fragments to send
+        WIO_TRY(wtp_tx_make_fragment(tx_ctrl, read_size, &send_fragment))
+    //No more fragments to send (Window may be full; keep the Read for later)
     if (!send_fragment)
         return WIO_OK;
 
-    //Write packet header
-    if (send_fragment->_msg_size) {
-        WIO_TRY(wio_write(read_buf, &WTP_PKT_BEGIN_MSG, 1))
-        WIO_TRY(wio_write(read_buf, &send_fragment->_msg_size, 2))
+    //Fragment sent so far
+    uint8_t sent = send_fragment->_sent;
+    //Send WTP_PKT_BEGIN_MSG only for the first piece of the first fragment of a message
+    bool msg_begin = send_fragment->_msg_size&&(sent==0);
+    //Header size
+    uint8_t header_size = wtp_tx_header_size(tx_ctrl, msg_begin?send_fragment->_msg_size:0);
+    //READ OpSpec too small for any data
+    if (read_size<=header_size)
+        return WIO_OK;
+    //Packet data size (A retransmitted fragment may not fit into a READ OpSpec that shrank since)
+    uint8_t data_size = WIO_MIN(send_fragment->_size-sent, read_size-header_size);
+    //(Payload size of compact data packet is limited by bits of packet type)
+    bool compact = tx_ctrl->_framing==WTP_FRAMING_COMPACT;
+    if (compact)
+        data_size = WIO_MIN(data_size, WTP_PKT_COMPACT_SIZE_MASK);
+    //Piggyback pending acknowledgement only if the Read has room left for it
+    //(READ OpSpecs are requested just big enough for the message, so data must not shrink)
+    bool ack = wtp_can_piggyback_ack(self)&&(header_size+data_size+2<=read_size);
+    //Packet sequence number
+    uint16_t seq_num = send_fragment->_seq_num+sent;
+
+    //Set Read memory loaded flag
+    self->_read_mem_loaded = true;
+    //Update number of reads
+    read_info->_n_reads--;
+    //Pop read information when necessary
+    if (read_info->_n_reads==0)
+        WIO_TRY(wio_queue_pop(read_info_queue, NULL))
+    //Initialize read buffer
+    WIO_TRY(wio_buf_init(read_buf, self->_read_mem, read_size))
+    //Update sent size; fragment is sent once all its data is sent
+    send_fragment->_sent += data_size;
+    if (send_fragment->_sent>=send_fragment->_size) {
+        send_fragment->_need_send = false;
+        send_fragment->_sent = 0;
+    }
+
+    //(Header, piggybacked acknowledgement and data are sized above to fit into READ OpSpec)
+    //Write compact packet header (Packet type carries begin and acknowledgement flags and payload size)
+    if (compact) {
+        wtp_pkt_t pkt_type = WTP_PKT_COMPACT_MSG|data_size;
+        if (msg_begin)
+            pkt_type |= WTP_PKT_COMPACT_BEGIN;
+        if (ack)
+            pkt_type |= WTP_PKT_COMPACT_ACK;
+        wio_write_u8(read_buf, pkt_type);
+        if (ack)
+            wio_write_u16(read_buf, self->_rx_ctrl._seq_num);
+        if (msg_begin)
+            WIO_TRY(wtp_write_varint(read_buf, send_fragment->_msg_size))
+        //Lowest 8 bits of sequence number
+        wio_write_u8(read_buf, (uint8_t)seq_num);
+    //Write standard packet header
     } else {
-        WIO_TRY(wio_write(read_buf, &WTP_PKT_CONT_MSG, 1))
+        if (msg_begin)
+            wio_write_u8(read_buf, ack?WTP_PKT_BEGIN_MSG_ACK:WTP_PKT_BEGIN_MSG);
+        else
+            wio_write_u8(read_buf, ack?WTP_PKT_CONT_MSG_ACK:WTP_PKT_CONT_MSG);
+        if (ack)
+            wio_write_u16(read_buf, self->_rx_ctrl._seq_num);
+        if (msg_begin)
+            wio_write_u16(read_buf, send_fragment->_msg_size);
+        wio_write_u16(read_buf, seq_num);
+        wio_write_u8(read_buf, data_size);
     }
-    WIO_TRY(wio_write(read_buf, &send_fragment->_seq_num, 2))
-    WIO_TRY(wio_write(read_buf, &send_fragment->_size, 1))
     //Write packet data
-    WIO_TRY(wio_write(read_buf, send_fragment->_data, send_fragment->_size))
+    WIO_TRY(wio_write(read_buf, send_fragment->_data+sent, data_size))
     //Write end packet byte (Ignore failure)
     wio_write(read_buf, &WTP_PKT_END, 1);
+    //Acknowledgement sent
+    if (ack)
+        self->_ack_pending = false;
 
-    //TODO: Set fragment timeout
+    //Start uplink retransmission timer
+    WIO_TRY(wtp_set_uplink_timer(self, false))
 
     return WIO_OK;
 }
@@ -551,40 +1458,219 @@ wtp_status_t wtp_load_read_mem(
 /**
  * {@inheritDoc}
  */
-wtp_status_t wtp_handle_blockwrite(
+wtp_status_t wtp_flush_ack(
     wtp_t* self
 ) {
-    //Write status
-    wtp_status_t status;
-    //Write buffer
-    wio_buf_t* write_buf = WIO_INST_PTR(wio_buf_t);
+    wtp_tx_ctrl_t* tx_ctrl = &self->_tx_ctrl;
+    //Packet buffer
+    wio_buf_t* pkt_buf = &tx_ctrl->_pkt_buf;
+    //Selective acknowledgement blocks
+    wtp_sack_block_t blocks[WTP_SACK_BLOCKS_MAX];
+    uint8_t n_blocks;
+
+    //Acknowledgement already piggybacked
+    if (!self->_ack_pending)
+        return WIO_OK;
+
+    //Send acknowledgement, or selective acknowledgement when some data is received out of order
+    WIO_TRY(wtp_rx_get_sack(&self->_rx_ctrl, blocks, &n_blocks))
+    WIO_TRY(wtp_tx_begin_packet(tx_ctrl, n_blocks?WTP_PKT_SACK:WTP_PKT_ACK))
+    wio_write_u16(pkt_buf, self->_rx_ctrl._seq_num);
+    //Write selective acknowledgement blocks
+    if (n_blocks) {
+        wio_write_u8(pkt_buf, n_blocks);
+        for (uint8_t i=0;i<n_blocks;i++) {
+            wio_write_u16(pkt_buf, blocks[i]._begin);
+            wio_write_u8(pkt_buf, blocks[i]._size);
+        }
+    }
+    WIO_TRY(wtp_tx_end_packet(tx_ctrl))
+    self->_ack_pending = false;
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Get EPC scheduling priority of a control packet.
+ *
+ * @param pkt_type Packet type.
+ * @return Priority of the packet (Packets of smaller value go into EPC first).
+ */
+static uint8_t wtp_epc_priority(
+    wtp_pkt_t pkt_type
+) {
+    //Acknowledgements (Including request uplink and resume packets carrying an acknowledgement)
+    if ((pkt_type==WTP_PKT_ACK)||(pkt_type==WTP_PKT_SACK)||(pkt_type==WTP_PKT_REQ_UPLINK_ACK)
+        ||(pkt_type==WTP_PKT_RESUME_ACK))
+        return 0;
+    //Open, resume and close
+    else if ((pkt_type==WTP_PKT_OPEN_PARAM)||(pkt_type==WTP_PKT_RESUME)||(pkt_type==WTP_PKT_CLOSE))
+        return 1;
+    //Request uplink
+    else if (pkt_type==WTP_PKT_REQ_UPLINK)
+        return 2;
+    //Set parameter
+    else
+        return 3;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_before_do_rfid(
+    wtp_t* self
+) {
+    //Packet buffer
+    wio_buf_t* pkt_buf = &self->_tx_ctrl._pkt_buf;
+    //EPC buffer
+    wio_buf_t* epc_buf = &self->_epc_buf;
+
+    //Current EPC content not observed enough times yet
+    if (self->_epc_observations<self->_epc_cadence)
+        return WIO_OK;
+    //Send acknowledgement not piggybacked on other packets
+    WIO_TRY(wtp_flush_ack(self))
+    //No packets to send; keep current EPC content
+    if (pkt_buf->pos_a==pkt_buf->pos_b)
+        return WIO_OK;
+
+    //Reset EPC buffer
+    epc_buf->pos_a = epc_buf->pos_b = 0;
+
+    //Fill EPC buffer with packets of higher priority first
+    for (uint8_t priority=0;priority<WTP_EPC_PRIORITIES;priority++)
+        for (uint16_t pos=pkt_buf->pos_a;pos<pkt_buf->pos_b;pos+=pkt_buf->buffer[pos]+1) {
+            //Packet size and data
+            uint8_t pkt_size = pkt_buf->buffer[pos];
+            uint8_t* pkt = pkt_buf->buffer+pos+1;
+
+            //Packet already moved or of other priority
+            if ((*pkt==WTP_PKT_END)||(wtp_epc_priority(*pkt)!=priority))
+                continue;
+            //Exceeds EPC capacity
+            //(Later packets of the same priority wait as well to keep their order;
+            //packets of lower priority may still fill remaining space)
+            if (epc_buf->pos_b+pkt_size>epc_buf->size)
+                break;
+            //Copy packet data to EPC memory
+            WIO_TRY(wio_write(epc_buf, pkt, pkt_size))
+            //Mark packet as moved
+            *pkt = WTP_PKT_END;
+        }
+    //Write WTP_PKT_END (Ignore failure)
+    wio_write(epc_buf, &WTP_PKT_END, 1);
+
+    //Move remaining packets to the begin of packet buffer, keeping their order
+    //(Otherwise the buffer fills up when packets are produced faster than EPC can hold)
+    uint16_t end = 0;
+    for (uint16_t pos=pkt_buf->pos_a;pos<pkt_buf->pos_b;) {
+        //Packet size (With size byte)
+        uint16_t pkt_size = pkt_buf->buffer[pos]+1;
+
+        if (pkt_buf->buffer[pos+1]!=WTP_PKT_END) {
+            if (end!=pos)
+                memmove(pkt_buf->buffer+end, pkt_buf->buffer+pos, pkt_size);
+            end += pkt_size;
+        }
+        pos += pkt_size;
+    }
+    pkt_buf->pos_a = 0;
+    pkt_buf->pos_b = end;
+
+    //New EPC content not observed yet
+    self->_epc_observations = 0;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_epc_observed(
+    wtp_t* self
+) {
+    //Saturate instead of wrapping around while EPC content is kept
+    if (self->_epc_observations<UINT8_MAX)
+        self->_epc_observations++;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_set_epc_cadence(
+    wtp_t* self,
+    uint8_t cadence
+) {
+    //EPC content must be observed at least once
+    if (cadence==0)
+        return WIO_ERR_INVALID;
+
+    self->_epc_cadence = cadence;
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_get_mem_usage(
+    wtp_t* self,
+    wtp_buf_id_t buf_id,
+    uint16_t* _used,
+    uint16_t* _used_max,
+    uint16_t* _size
+) {
+    wio_buf_t* buf;
+
+    if (buf_id==WTP_BUF_PKT)
+        buf = &self->_tx_ctrl._pkt_buf;
+    else if (buf_id==WTP_BUF_TX_MSG)
+        buf = &self->_tx_ctrl._msg_buf;
+    else if (buf_id==WTP_BUF_RX_MSG)
+        buf = &self->_rx_ctrl._msg_data_buf;
+    else if (buf_id==WTP_BUF_FRAGMENTS)
+        buf = &self->_rx_ctrl._fragments_buf;
+    else
+        return WIO_ERR_INVALID;
+
+    WIO_RETURN(_used, wio_used(buf))
+    WIO_RETURN(_used_max, buf->used_max)
+    WIO_RETURN(_size, buf->size)
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Handle WTP packets of a BlockWrite.
+ *
+ * @param self WTP endpoint instance.
+ * @param write_buf BlockWrite buffer.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_handle_packets(
+    wtp_t* self,
+    wio_buf_t* write_buf
+) {
     //Packet type
     wtp_pkt_t pkt_type;
 
-    //BlockWrite size
-    uint16_t blockwrite_size = *self->_write_mem;
-    //BlockWrite memory
-    uint8_t* blockwrite_mem = self->_write_mem+1;
-
-    //Initialize write buffer
-    WIO_TRY(wio_buf_init(write_buf, blockwrite_mem, blockwrite_size))
     //Read packets
     while (true) {
         //Set packet begin position
         self->_pkt_begin = write_buf->pos_a;
 
-        //Read packet type
-        status = wio_read(write_buf, &pkt_type, 1);
-        //No more packets
-        if (status==WIO_ERR_OUT_OF_RANGE)
-            pkt_type = WTP_PKT_END;
-        //Read error
-        else if (status!=WIO_OK)
-            return status;
+        //Read packet type (No more packets at the end of BlockWrite)
+        pkt_type = (wio_ensure(write_buf, 1)==WIO_OK)?wio_read_u8(write_buf):WTP_PKT_END;
 
         //No more packets
         if (pkt_type==WTP_PKT_END)
             break;
+        //Compact message packet
+        if (pkt_type&WTP_PKT_COMPACT_MSG) {
+            WIO_TRY(wtp_handle_compact_msg(self, write_buf, pkt_type))
+            continue;
+        }
         //Unsupported operation
         if (pkt_type>=WTP_PKT_MAX)
             return WTP_ERR_UNSUPPORT_OP;
@@ -599,6 +1685,30 @@ wtp_status_t wtp_handle_blockwrite(
     return WIO_OK;
 }
 
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_handle_blockwrite(
+    wtp_t* self
+) {
+    //Write buffer
+    wio_buf_t* write_buf = WIO_INST_PTR(wio_buf_t);
+
+    //BlockWrite size
+    uint16_t blockwrite_size = *self->_write_mem;
+    //BlockWrite memory
+    uint8_t* blockwrite_mem = self->_write_mem+1;
+
+    //Initialize write buffer
+    WIO_TRY(wio_buf_init(write_buf, blockwrite_mem, blockwrite_size))
+    //Handle packets
+    wtp_status_t status = wtp_handle_packets(self, write_buf);
+    //Commit before acknowledgements of received data go out (Also when a packet is broken)
+    WIO_TRY(wtp_commit(self))
+
+    return status;
+}
+
 /**
  * {@inheritDoc}
  */
@@ -608,14 +1718,33 @@ wtp_status_t wtp_verify_checksum(
 ) {
     //Get packet end position
     uint16_t pkt_end = write_buf->pos_a;
-    //Calculate checksum
-    uint8_t calc_checksum = wtp_xor_checksum(write_buf->buffer, self->_pkt_begin, pkt_end);
 
-    //Read checksum from buffer
-    uint8_t pkt_checksum;
-    WIO_TRY(wio_read(write_buf, &pkt_checksum, 1))
+    //CRC-16 (Packet is never empty as it begins with packet type)
+    if (self->_checksum==WTP_CHECKSUM_CRC16) {
+        //Checksum within buffer (So is the packet before it)
+        WIO_TRY(wio_ensure(write_buf, 2))
+        uint16_t calc_checksum = crc16_ccitt(
+            CRC_NO_PRELOAD,
+            write_buf->buffer+self->_pkt_begin,
+            pkt_end-self->_pkt_begin
+        );
+
+        //Read checksum from buffer
+        uint16_t pkt_checksum = wio_read_u16(write_buf);
+
+        return (calc_checksum==pkt_checksum)?WIO_OK:WIO_ERR_INVALID;
+    }
+    //XOR checksum
+    else {
+        //Checksum within buffer (So is the packet before it)
+        WIO_TRY(wio_ensure(write_buf, 1))
+        uint8_t calc_checksum = wtp_xor_checksum(write_buf->buffer, self->_pkt_begin, pkt_end);
 
-    return (calc_checksum==pkt_checksum)?WIO_OK:WIO_ERR_INVALID;
+        //Read checksum from buffer
+        uint8_t pkt_checksum = wio_read_u8(write_buf);
+
+        return (calc_checksum==pkt_checksum)?WIO_OK:WIO_ERR_INVALID;
+    }
 }
 
 /**
@@ -637,11 +1766,18 @@ uint8_t wtp_xor_checksum(
 /// WTP packet handlers
 wtp_pkt_handler_t wtp_pkt_handlers[_WTP_PKT_MAX] = {
     NULL, //WTP_PKT_END
-    wtp_handle_open, //WTP_PKT_OPEN
+    NULL, //WTP_PKT_OPEN (Only answers legacy clients)
     NULL, //WTP_PKT_CLOSE
     wtp_handle_ack, //WTP_PKT_ACK
     wtp_handle_begin_msg, //WTP_PKT_BEGIN_MSG
     wtp_handle_cont_msg, //WTP_PKT_CONT_MSG
     NULL, //WTP_PKT_REQ_UPLINK
     wtp_handle_set_param, //WTP_PKT_SET_PARAM
+    wtp_handle_sack, //WTP_PKT_SACK
+    wtp_handle_begin_msg_ack, //WTP_PKT_BEGIN_MSG_ACK
+    wtp_handle_cont_msg_ack, //WTP_PKT_CONT_MSG_ACK
+    NULL, //WTP_PKT_REQ_UPLINK_ACK
+    wtp_handle_resume, //WTP_PKT_RESUME
+    NULL, //WTP_PKT_RESUME_ACK
+    wtp_handle_open //WTP_PKT_OPEN_PARAM
 };
@@ -4,6 +4,55 @@
 #include "defs.h"
 #include "transmission.h"
 
+/**
+ * @brief WTP session type.
+ *
+ * Kept in memory that survives power loss (FRAM on the WISP), so the connection can be
+ * resumed without opening a new one. A zero-filled session, or one torn by power loss
+ * in the middle of an update, fails its CRC and has nothing to resume.
+ */
+typedef struct wtp_session {
+    /// Session token issued by the server (0 if there is no session)
+    uint16_t token;
+    /// Uplink sequence number acknowledged by the server
+    uint16_t tx_seq_num;
+    /// Downlink checksum algorithm chosen by the server
+    wtp_checksum_t checksum;
+    /// Uplink data packet framing
+    wtp_framing_t framing;
+    /// CRC-16 of all fields above (Written after every update)
+    uint16_t crc;
+} wtp_session_t;
+
+/// Number of WTP checkpoint slots
+#define WTP_CHECKPOINT_SLOTS 2
+
+/// WTP checkpoint slot type
+typedef struct wtp_checkpoint_slot {
+    /// Commit counter (The slot with the bigger one holds the latest checkpoint)
+    uint16_t _epoch;
+    /// Session token the state belongs to
+    uint16_t _token;
+    /// Transmit control state
+    wtp_tx_state_t _tx_state;
+    /// Receive control state
+    wtp_rx_state_t _rx_state;
+    /// CRC-16 of all fields above (Written last, so a slot torn by power loss is never used)
+    uint16_t _crc;
+} wtp_checkpoint_slot_t;
+
+/**
+ * @brief WTP checkpoint type.
+ *
+ * Kept in memory that survives power loss (FRAM on the WISP) together with the message buffers.
+ * The state is committed into the older slot, so the latest complete commit survives power loss
+ * in the middle of another one. A zero-filled checkpoint holds no state.
+ */
+typedef struct wtp_checkpoint {
+    /// Checkpoint slots
+    wtp_checkpoint_slot_t _slots[WTP_CHECKPOINT_SLOTS];
+} wtp_checkpoint_t;
+
 /// WTP endpoint type
 typedef struct wtp {
     /// Downlink state
@@ -20,9 +69,28 @@ typedef struct wtp {
 
     /// Read memory loaded flag
     bool _read_mem_loaded;
+    /// Downlink acknowledgement pending flag
+    /// (One acknowledgement for all data received since the last one, piggybacked when possible)
+    bool _ack_pending;
+    /// Number of times EPC content is observed before it is refreshed
+    uint8_t _epc_cadence;
+    /// Number of times current EPC content is observed
+    uint8_t _epc_observations;
 
     /// Packet begin position
     uint16_t _pkt_begin;
+    /// Downlink checksum algorithm (Requested when connecting, then chosen by the server)
+    wtp_checksum_t _checksum;
+    /// Data packet framing requested when connecting
+    wtp_framing_t _req_framing;
+    /// Session to resume and keep up to date (NULL if sessions are not kept)
+    wtp_session_t* _session;
+    /// Checkpoint of transmit and receive control state (NULL if state is not kept)
+    wtp_checkpoint_t* _checkpoint;
+    /// Slot of the latest commit
+    uint8_t _checkpoint_slot;
+    /// Resuming with state restored from the checkpoint
+    bool _checkpoint_resumed;
 
     /// Transmit control instance
     wtp_tx_ctrl_t _tx_ctrl;
@@ -53,7 +121,7 @@ typedef struct wtp {
  * @param epc_buf_size Size of the EPC-96 data section.
  * @param read_mem Read memory.
  * @param write_mem BlockWrite memory.
- * @param window_size WTP sliding window size.
+ * @param window_size WTP sliding window size (Maximum receive window, and uplink window until the server advertises its own).
  * @param timeout WTP packet retransmission timeout.
  * @param tx_buf_size Transmit control buffer size.
  * @param rx_buf_size Receive control buffer size.
@@ -88,6 +156,13 @@ extern wtp_status_t wtp_fini(
 /**
  * @brief Connect to WTP server.
  *
+ * If a session is set and holds a token, the connection of the session is resumed instead of
+ * opening a new one: the uplink opens right away (WTP_EVENT_OPEN is triggered before returning),
+ * so data can be requested in the same EPC as the resume packet. The downlink opens once
+ * the server replies. If the server no longer knows the session, it opens a new connection.
+ * With a checkpoint holding state of the session, the state is restored first and messages
+ * fully received but not delivered before power loss are delivered right after WTP_EVENT_OPEN.
+ *
  * @param self WTP endpoint instance.
  * @return Error code if failed, otherwise WIO_OK.
  */
@@ -95,6 +170,98 @@ extern wtp_status_t wtp_connect(
     wtp_t* self
 );
 
+/**
+ * @brief Set checksum algorithm to request when connecting to WTP server.
+ *
+ * CRC-16 is requested by default. The server falls back to XOR checksum
+ * if it doesn't support the requested algorithm.
+ *
+ * @param self WTP endpoint instance.
+ * @param checksum Checksum algorithm.
+ * @return WIO_ERR_ALREADY if already connecting or connected,
+ *     WIO_ERR_INVALID for invalid algorithm, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_set_checksum(
+    wtp_t* self,
+    wtp_checksum_t checksum
+);
+
+/**
+ * @brief Set data packet framing to request when connecting to WTP server.
+ *
+ * Standard framing is requested by default. Compact framing is only used in both directions
+ * once the server accepts it; data packets of either framing are always accepted.
+ *
+ * @param self WTP endpoint instance.
+ * @param framing Data packet framing.
+ * @return WIO_ERR_ALREADY if already connecting or connected,
+ *     WIO_ERR_INVALID for invalid framing or a window too big for compact framing, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_set_framing(
+    wtp_t* self,
+    wtp_framing_t framing
+);
+
+/**
+ * @brief Set session to resume when connecting to WTP server.
+ *
+ * The session is updated with the token, checksum algorithm and framing once the server
+ * opens the connection, and with the uplink sequence number whenever uplink data is acknowledged.
+ * Messages in flight when the client loses power are lost in both directions,
+ * unless the state is kept with "wtp_set_checkpoint()".
+ *
+ * @param self WTP endpoint instance.
+ * @param session Session in non-volatile memory, or NULL to always open a new connection.
+ * @return WIO_ERR_ALREADY if already connecting or connected, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_set_session(
+    wtp_t* self,
+    wtp_session_t* session
+);
+
+/**
+ * @brief Check whether a session can be resumed.
+ *
+ * The session must pass its CRC, hold a token, and name a supported checksum algorithm and framing.
+ * "wtp_connect()" opens a new connection instead of resuming a session that fails the check.
+ *
+ * @param session Session in non-volatile memory.
+ * @return Whether the session can be resumed.
+ */
+extern bool wtp_session_valid(
+    const wtp_session_t* session
+);
+
+/**
+ * @brief Keep transmit and receive control state in a checkpoint across power loss.
+ *
+ * The transmit message buffer and the receive message data ring are moved into caller memory,
+ * which must survive power loss like the checkpoint. The state is committed whenever
+ * uplink data is acknowledged, downlink messages are delivered, a message is sent, and
+ * at the end of every BlockWrite, so acknowledgements never go out for data not committed.
+ * When the session is resumed, messages not acknowledged are sent again from the acknowledged
+ * sequence number, and a downlink message being received goes on from its received size.
+ * Messages sent with "wtp_send_ref()" must be in memory that survives power loss as well.
+ * Downlink messages are delivered at most once: a message whose callback is running
+ * when the client loses power is not delivered again.
+ *
+ * @param self WTP endpoint instance.
+ * @param checkpoint Checkpoint in non-volatile memory.
+ * @param tx_msg_mem Transmit message buffer memory in non-volatile memory.
+ * @param tx_msg_size Transmit message buffer size.
+ * @param rx_msg_mem Receive message data ring memory in non-volatile memory.
+ * @param rx_msg_size Receive message data ring size.
+ * @return WIO_ERR_ALREADY if already connecting or connected, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_set_checkpoint(
+    wtp_t* self,
+    wtp_checkpoint_t* checkpoint,
+    uint8_t* tx_msg_mem,
+    uint16_t tx_msg_size,
+    uint8_t* rx_msg_mem,
+    uint16_t rx_msg_size
+);
+
 /**
  * @brief Disconnect from WTP server.
  *
@@ -123,6 +290,28 @@ extern wtp_status_t wtp_send(
     wio_callback_t cb
 );
 
+/**
+ * @brief Send message to WTP server without copying message data.
+ *
+ * Data fragments point straight into caller memory, so messages larger than
+ * the transmit message buffer can be sent.
+ * Data is borrowed until the callback is invoked, and must not be changed or released before that.
+ *
+ * @param self WTP endpoint instance.
+ * @param data Data to send.
+ * @param size Size of data.
+ * @param cb_data Callback closure data.
+ * @param cb Callback function.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_send_ref(
+    wtp_t* self,
+    uint8_t* data,
+    uint16_t size,
+    void* cb_data,
+    wio_callback_t cb
+);
+
 /**
  * @brief Receive message from WTP server.
  *
@@ -179,6 +368,82 @@ extern wtp_status_t wtp_load_read_mem(
     wtp_t* self
 );
 
+/**
+ * @brief Send pending downlink acknowledgement as a standalone packet.
+ *
+ * Acknowledgements are piggybacked on uplink data and request uplink packets when possible.
+ * This is called by "wtp_before_do_rfid()" right before packets are moved into EPC memory,
+ * so an acknowledgement that nothing carried still goes out with the EPC.
+ * The acknowledgement becomes a selective acknowledgement if some data is received out of order.
+ *
+ * @param self WTP endpoint instance.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_flush_ack(
+    wtp_t* self
+);
+
+/**
+ * @brief Refresh EPC memory with pending control packets before an RFID operation.
+ *
+ * EPC memory is only refreshed once its current content has been observed by the reader
+ * as many times as the EPC cadence. Packets are moved into EPC memory by priority:
+ * acknowledgements first, then open and close, request uplink and set parameter packets.
+ *
+ * @param self WTP endpoint instance.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_before_do_rfid(
+    wtp_t* self
+);
+
+/**
+ * @brief Notify WTP endpoint that the reader has observed current EPC content.
+ *
+ * @param self WTP endpoint instance.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_epc_observed(
+    wtp_t* self
+);
+
+/**
+ * @brief Set EPC cadence.
+ *
+ * EPC content is refreshed with pending control packets once the reader has observed it
+ * "cadence" times. The default cadence of 1 refreshes EPC as soon as the reader observes it;
+ * a bigger cadence gives the server more chances to receive packets when tag reports are lost.
+ *
+ * @param self WTP endpoint instance.
+ * @param cadence EPC cadence.
+ * @return WIO_ERR_INVALID if cadence is 0, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_set_epc_cadence(
+    wtp_t* self,
+    uint8_t cadence
+);
+
+/**
+ * @brief Get memory usage of a WTP buffer.
+ *
+ * Memory in use includes unused space skipped at the end of ring buffers when an allocation
+ * wraps around. The high-water mark tells how small a buffer could be for the traffic so far.
+ *
+ * @param self WTP endpoint instance.
+ * @param buf_id Buffer ID.
+ * @param _used Used for returning size of memory in use.
+ * @param _used_max Used for returning most memory in use so far.
+ * @param _size Used for returning buffer size.
+ * @return WIO_ERR_INVALID for invalid buffer ID, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_get_mem_usage(
+    wtp_t* self,
+    wtp_buf_id_t buf_id,
+    uint16_t* _used,
+    uint16_t* _used_max,
+    uint16_t* _size
+);
+
 /**
  * @brief Handle RFID BLOCKWRITE operation.
  *
@@ -192,6 +457,8 @@ extern wtp_status_t wtp_handle_blockwrite(
 /**
  * @brief Verify the checksum of received WTP packet.
  *
+ * The checksum is calculated with the downlink checksum algorithm.
+ *
  * @param self WTP endpoint instance.
  * @param write_buf Received WTP packets buffer.
  * @return Error code if checksum validation failed, otherwise WIO_OK.
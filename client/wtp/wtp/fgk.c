@@ -0,0 +1,410 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fgk.h"
+
+/// Node weight without leaf flag
+#define WTP_FGK_WEIGHT(node) ((node)->_weight&WTP_FGK_WEIGHT_MAX)
+
+/**
+ * @brief Reset FGK tree to a single NYT leaf.
+ *
+ * @param self FGK codec instance.
+ */
+static void wtp_fgk_reset_tree(
+    wtp_fgk_t* self
+) {
+    wtp_fgk_node_t* root = self->_nodes;
+
+    root->_weight = WTP_FGK_LEAF;
+    root->_parent = 0;
+    root->_link = 0;
+
+    self->_n_nodes = 1;
+    self->_nyt = 0;
+}
+
+/**
+ * @brief Find the leaf of a symbol.
+ *
+ * Nodes are visited in decreasing order of weight, so frequent symbols are found first.
+ *
+ * @param self FGK codec instance.
+ * @param symbol Symbol.
+ * @return Leaf index, or 0 if the symbol is not in tree (The root is never a symbol leaf).
+ */
+static uint8_t wtp_fgk_find(
+    wtp_fgk_t* self,
+    uint8_t symbol
+) {
+    wtp_fgk_node_t* nodes = self->_nodes;
+
+    for (uint8_t i=1;i<self->_n_nodes;i++)
+        if ((nodes[i]._weight&WTP_FGK_LEAF)&&(nodes[i]._link==symbol)&&(i!=self->_nyt))
+            return i;
+
+    return 0;
+}
+
+/**
+ * @brief Swap the subtrees at two tree positions.
+ *
+ * Parent links belong to positions, so only weights and children are swapped.
+ *
+ * @param self FGK codec instance.
+ * @param a First position.
+ * @param b Second position.
+ */
+static void wtp_fgk_swap(
+    wtp_fgk_t* self,
+    uint8_t a,
+    uint8_t b
+) {
+    wtp_fgk_node_t* nodes = self->_nodes;
+    wtp_fgk_node_t* node_a = nodes+a;
+    wtp_fgk_node_t* node_b = nodes+b;
+
+    uint16_t weight = node_a->_weight;
+    uint8_t link = node_a->_link;
+    node_a->_weight = node_b->_weight;
+    node_a->_link = node_b->_link;
+    node_b->_weight = weight;
+    node_b->_link = link;
+
+    //Children follow their parents to new positions
+    if (!(node_a->_weight&WTP_FGK_LEAF))
+        nodes[node_a->_link]._parent = nodes[node_a->_link+1]._parent = a;
+    if (!(node_b->_weight&WTP_FGK_LEAF))
+        nodes[node_b->_link]._parent = nodes[node_b->_link+1]._parent = b;
+}
+
+/**
+ * @brief Update FGK tree after a symbol is coded.
+ *
+ * @param self FGK codec instance.
+ * @param symbol Symbol.
+ * @param leaf Leaf of symbol, or 0 for a new symbol.
+ */
+static void wtp_fgk_update(
+    wtp_fgk_t* self,
+    uint8_t symbol,
+    uint8_t leaf
+) {
+    wtp_fgk_node_t* nodes = self->_nodes;
+    uint8_t q = leaf;
+
+    //New symbol
+    if (!q) {
+        //Tree is full; the symbol stays escaped
+        if (self->_n_nodes_max-self->_n_nodes<2)
+            return;
+
+        //Split NYT leaf into a leaf of the symbol and a new NYT leaf
+        uint8_t parent = self->_nyt;
+        q = self->_n_nodes;
+
+        nodes[parent]._weight = 0;
+        nodes[parent]._link = q;
+        nodes[q]._weight = WTP_FGK_LEAF;
+        nodes[q]._parent = parent;
+        nodes[q]._link = symbol;
+        nodes[q+1]._weight = WTP_FGK_LEAF;
+        nodes[q+1]._parent = parent;
+        nodes[q+1]._link = 0;
+
+        self->_nyt = q+1;
+        self->_n_nodes += 2;
+    }
+
+    while (true) {
+        //Leader of the block of nodes with the same weight
+        uint16_t weight = WTP_FGK_WEIGHT(nodes+q);
+        uint8_t leader = q;
+        while ((leader>0)&&(WTP_FGK_WEIGHT(nodes+leader-1)==weight))
+            leader--;
+        //Move node to the front of its block
+        if ((leader!=q)&&(leader!=nodes[q]._parent)) {
+            wtp_fgk_swap(self, q, leader);
+            q = leader;
+        }
+
+        nodes[q]._weight++;
+        //Root reached
+        if (!q)
+            break;
+        q = nodes[q]._parent;
+    }
+}
+
+/**
+ * @brief Write code of a tree node.
+ *
+ * Bits beyond the end of output are counted but not written.
+ *
+ * @param self FGK codec instance.
+ * @param node Tree node index.
+ * @param out Output memory (Cleared in advance).
+ * @param n_bits Number of bits written.
+ * @param n_bits_max Maximum number of bits to write.
+ * @return Number of bits written with the code.
+ */
+static uint32_t wtp_fgk_put_code(
+    wtp_fgk_t* self,
+    uint8_t node,
+    uint8_t* out,
+    uint32_t n_bits,
+    uint32_t n_bits_max
+) {
+    wtp_fgk_node_t* nodes = self->_nodes;
+
+    //Code length
+    uint8_t depth = 0;
+    for (uint8_t i=node;i;i=nodes[i]._parent)
+        depth++;
+
+    //Bits are collected from leaf to root, and written from root to leaf
+    uint32_t pos = n_bits+depth;
+    for (uint8_t i=node;i;i=nodes[i]._parent) {
+        pos--;
+        if ((i-nodes[nodes[i]._parent]._link)&&(pos<n_bits_max))
+            out[pos>>3] |= 0x80>>(pos&7);
+    }
+
+    return n_bits+depth;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_fgk_init(
+    wtp_fgk_t* self,
+    uint8_t n_symbols
+) {
+    if ((n_symbols<1)||(n_symbols>WTP_FGK_SYMBOLS_MAX))
+        return WIO_ERR_INVALID;
+
+    self->_n_nodes_max = 2*n_symbols+1;
+    self->_nodes = malloc(self->_n_nodes_max*sizeof(wtp_fgk_node_t));
+    if (!self->_nodes)
+        return WIO_ERR_NO_MEMORY;
+
+    return wtp_fgk_reset(self);
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_fgk_fini(
+    wtp_fgk_t* self
+) {
+    free(self->_nodes);
+    self->_nodes = NULL;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_fgk_reset(
+    wtp_fgk_t* self
+) {
+    wtp_fgk_reset_tree(self);
+
+    self->_in_stream = false;
+    self->_msg_index = 0;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_fgk_encode(
+    wtp_fgk_t* self,
+    const uint8_t* data,
+    uint16_t size,
+    uint8_t* out,
+    uint16_t* _out_size
+) {
+    if (size>UINT16_MAX-WTP_FGK_HEADER_SIZE)
+        return WIO_ERR_OUT_OF_RANGE;
+
+    uint8_t* payload = out+WTP_FGK_HEADER_SIZE;
+    //Compressed data must be smaller than message data
+    uint32_t n_bits_max = (uint32_t)size*8;
+    uint32_t n_bits = 0;
+    memset(payload, 0, size);
+
+    //Begin a new stream after reset
+    uint8_t header = 0;
+    if (!self->_in_stream) {
+        header |= WTP_FGK_RESET;
+        self->_in_stream = true;
+    }
+    header |= (self->_msg_index&WTP_FGK_HEADER_MASK)<<WTP_FGK_INDEX_SHIFT;
+    self->_msg_index++;
+
+    for (uint16_t i=0;i<size;i++) {
+        uint8_t symbol = data[i];
+
+        //Reset tree before weights overflow
+        if (WTP_FGK_WEIGHT(self->_nodes)>=WTP_FGK_WEIGHT_MAX)
+            wtp_fgk_reset_tree(self);
+
+        uint8_t leaf = wtp_fgk_find(self, symbol);
+        //Known symbol
+        if (leaf)
+            n_bits = wtp_fgk_put_code(self, leaf, payload, n_bits, n_bits_max);
+        //New symbol follows NYT code as a literal
+        else {
+            n_bits = wtp_fgk_put_code(self, self->_nyt, payload, n_bits, n_bits_max);
+            for (uint8_t j=0;j<8;j++,n_bits++)
+                if ((symbol&(0x80>>j))&&(n_bits<n_bits_max))
+                    payload[n_bits>>3] |= 0x80>>(n_bits&7);
+        }
+
+        wtp_fgk_update(self, symbol, leaf);
+    }
+
+    uint32_t out_size = (n_bits+7)/8;
+    //Compressed message
+    if (out_size<size)
+        header |= WTP_FGK_COMPRESSED|((out_size*8-n_bits)&WTP_FGK_HEADER_MASK);
+    //Stored message
+    else {
+        out_size = size;
+        memcpy(payload, data, size);
+    }
+    out[0] = header;
+
+    WIO_RETURN(_out_size, out_size+WTP_FGK_HEADER_SIZE)
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Decompress message payload.
+ *
+ * @param self FGK codec instance.
+ * @param header Message header.
+ * @param payload Message payload.
+ * @param size Payload size.
+ * @param out Memory for message.
+ * @param out_size_max Size of memory for message.
+ * @param _out_size Used for returning message size.
+ * @return WIO_ERR_INVALID if payload is corrupted, WIO_ERR_OUT_OF_RANGE if message is too large, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_fgk_decode_payload(
+    wtp_fgk_t* self,
+    uint8_t header,
+    const uint8_t* payload,
+    uint16_t size,
+    uint8_t* out,
+    uint16_t out_size_max,
+    uint16_t* _out_size
+) {
+    wtp_fgk_node_t* nodes = self->_nodes;
+    uint16_t out_size = 0;
+
+    //Stored message (The tree is updated as if it were compressed)
+    if (!(header&WTP_FGK_COMPRESSED)) {
+        if (size>out_size_max)
+            return WIO_ERR_OUT_OF_RANGE;
+
+        for (uint16_t i=0;i<size;i++) {
+            if (WTP_FGK_WEIGHT(nodes)>=WTP_FGK_WEIGHT_MAX)
+                wtp_fgk_reset_tree(self);
+            wtp_fgk_update(self, payload[i], wtp_fgk_find(self, payload[i]));
+        }
+        memcpy(out, payload, size);
+
+        WIO_RETURN(_out_size, size)
+        return WIO_OK;
+    }
+
+    //Number of bits without padding
+    uint8_t n_padding = header&WTP_FGK_HEADER_MASK;
+    if ((size==0)||(n_padding>=8))
+        return WIO_ERR_INVALID;
+    uint32_t n_bits = (uint32_t)size*8-n_padding;
+    uint32_t pos = 0;
+
+    while (pos<n_bits) {
+        if (WTP_FGK_WEIGHT(nodes)>=WTP_FGK_WEIGHT_MAX)
+            wtp_fgk_reset_tree(self);
+
+        //Walk from root to leaf
+        uint8_t node = 0;
+        while (!(nodes[node]._weight&WTP_FGK_LEAF)) {
+            if (pos>=n_bits)
+                return WIO_ERR_INVALID;
+            node = nodes[node]._link+((payload[pos>>3]>>(7-(pos&7)))&1);
+            pos++;
+        }
+
+        uint8_t symbol;
+        //Literal of a new symbol
+        if (node==self->_nyt) {
+            if (n_bits-pos<8)
+                return WIO_ERR_INVALID;
+            symbol = 0;
+            for (uint8_t j=0;j<8;j++,pos++)
+                symbol = (symbol<<1)|((payload[pos>>3]>>(7-(pos&7)))&1);
+            node = 0;
+        } else
+            symbol = nodes[node]._link;
+
+        if (out_size>=out_size_max)
+            return WIO_ERR_OUT_OF_RANGE;
+        out[out_size++] = symbol;
+
+        wtp_fgk_update(self, symbol, node);
+    }
+
+    WIO_RETURN(_out_size, out_size)
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_fgk_decode(
+    wtp_fgk_t* self,
+    const uint8_t* data,
+    uint16_t size,
+    uint8_t* out,
+    uint16_t out_size_max,
+    uint16_t* _out_size
+) {
+    if (size<WTP_FGK_HEADER_SIZE)
+        return WIO_ERR_INVALID;
+    uint8_t header = data[0];
+
+    //First message of a new stream
+    if (header&WTP_FGK_RESET) {
+        wtp_fgk_reset(self);
+        self->_in_stream = true;
+    //Messages missing or out of stream
+    } else if ((!self->_in_stream)
+        ||(((header>>WTP_FGK_INDEX_SHIFT)&WTP_FGK_HEADER_MASK)!=(self->_msg_index&WTP_FGK_HEADER_MASK))) {
+        self->_in_stream = false;
+        return WIO_ERR_INVALID;
+    }
+    self->_msg_index++;
+
+    wtp_status_t status = wtp_fgk_decode_payload(
+        self,
+        header,
+        data+WTP_FGK_HEADER_SIZE,
+        size-WTP_FGK_HEADER_SIZE,
+        out,
+        out_size_max,
+        _out_size
+    );
+    //Tree is out of sync with the encoder
+    if (status!=WIO_OK)
+        self->_in_stream = false;
+
+    return status;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <stdbool.h>
+#include <wio.h>
+#include "defs.h"
+
+//=== WTP FGK constants ===
+/// Message header size
+static const uint8_t WTP_FGK_HEADER_SIZE = 1;
+/// Header flag of compressed messages (Otherwise message data is stored as is)
+static const uint8_t WTP_FGK_COMPRESSED = 0x80;
+/// Header flag of the first message of a stream (The receiver resets its tree)
+static const uint8_t WTP_FGK_RESET = 0x40;
+/// Header shift of message index in stream (Modulo 8, checked by the receiver)
+static const uint8_t WTP_FGK_INDEX_SHIFT = 3;
+/// Header mask of message index and number of padding bits
+static const uint8_t WTP_FGK_HEADER_MASK = 0x07;
+/// Leaf flag of node weight
+static const uint16_t WTP_FGK_LEAF = 0x8000;
+/// Maximum node weight (The tree is reset when the root reaches it)
+static const uint16_t WTP_FGK_WEIGHT_MAX = 0x7fff;
+/// Maximum number of symbols in tree (So that node indices fit into 8 bits)
+static const uint8_t WTP_FGK_SYMBOLS_MAX = 127;
+
+/// WTP FGK tree node type
+typedef struct wtp_fgk_node {
+    /// Weight (Leaves are flagged with WTP_FGK_LEAF)
+    uint16_t _weight;
+    /// Parent node index
+    uint8_t _parent;
+    /// Index of the first child for internal nodes (The second child follows it), or symbol for leaves
+    uint8_t _link;
+} wtp_fgk_node_t;
+
+/// WTP FGK (Adaptive Huffman) codec type
+typedef struct wtp_fgk {
+    /// Tree nodes, in decreasing order of weight (The root is the first node)
+    wtp_fgk_node_t* _nodes;
+    /// Maximum number of tree nodes
+    uint8_t _n_nodes_max;
+    /// Number of tree nodes
+    uint8_t _n_nodes;
+    /// Index of the NYT (Not yet transmitted) leaf
+    uint8_t _nyt;
+
+    /// A stream of messages is in progress
+    bool _in_stream;
+    /// Index of next message in stream
+    uint8_t _msg_index;
+} wtp_fgk_t;
+
+/**
+ * @brief Initialize FGK codec.
+ *
+ * The tree holds at most 2*n_symbols+1 nodes of 4 bytes. Symbols seen after
+ * the tree is full are sent as escaped 8-bit literals.
+ *
+ * @param self FGK codec instance.
+ * @param n_symbols Maximum number of symbols in tree (At most WTP_FGK_SYMBOLS_MAX).
+ * @return WIO_ERR_INVALID for invalid number of symbols, WIO_ERR_NO_MEMORY if allocation failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_fgk_init(
+    wtp_fgk_t* self,
+    uint8_t n_symbols
+);
+
+/**
+ * @brief Finalize FGK codec.
+ *
+ * @param self FGK codec instance.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_fgk_fini(
+    wtp_fgk_t* self
+);
+
+/**
+ * @brief Reset FGK codec and begin a new stream.
+ *
+ * The next encoded message is flagged with WTP_FGK_RESET. Reset the encoder
+ * before every message to compress messages independently of each other.
+ *
+ * @param self FGK codec instance.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_fgk_reset(
+    wtp_fgk_t* self
+);
+
+/**
+ * @brief Compress a message.
+ *
+ * Messages are stored as is when compression doesn't make them smaller,
+ * so the output is at most one header byte larger than the input.
+ * The decoder must see every message encoded in a stream, in order.
+ *
+ * @param self FGK codec instance.
+ * @param data Message data.
+ * @param size Message size.
+ * @param out Memory for compressed message (At least size+WTP_FGK_HEADER_SIZE bytes).
+ * @param _out_size Used for returning compressed message size.
+ * @return WIO_ERR_OUT_OF_RANGE if message is too large, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_fgk_encode(
+    wtp_fgk_t* self,
+    const uint8_t* data,
+    uint16_t size,
+    uint8_t* out,
+    uint16_t* _out_size
+);
+
+/**
+ * @brief Decompress a message.
+ *
+ * The stream is broken on failure, and messages are rejected until the
+ * encoder begins a new stream.
+ *
+ * @param self FGK codec instance.
+ * @param data Compressed message data.
+ * @param size Compressed message size.
+ * @param out Memory for message.
+ * @param out_size_max Size of memory for message.
+ * @param _out_size Used for returning message size.
+ * @return WIO_ERR_INVALID if message is corrupted or out of stream,
+ * WIO_ERR_OUT_OF_RANGE if message is too large, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_fgk_decode(
+    wtp_fgk_t* self,
+    const uint8_t* data,
+    uint16_t size,
+    uint8_t* out,
+    uint16_t out_size_max,
+    uint16_t* _out_size
+);
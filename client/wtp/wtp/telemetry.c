@@ -0,0 +1,385 @@
+#include <stdlib.h>
+#include "telemetry.h"
+
+/// Zig-zag mapping of a delta (Small deltas of both signs get small codes)
+#define WTP_TELEMETRY_ZIGZAG(delta) ((uint16_t)(((uint16_t)(delta)<<1)^(uint16_t)((int16_t)(delta)>>15)))
+/// Inverse zig-zag mapping of a code
+#define WTP_TELEMETRY_UNZIGZAG(code) ((int16_t)(((code)>>1)^(uint16_t)-((code)&1)))
+
+/**
+ * @brief Get size of a varint.
+ *
+ * @param value Value.
+ * @return Varint size.
+ */
+static uint8_t wtp_telemetry_varint_size(
+    uint16_t value
+) {
+    if (value<0x80)
+        return 1;
+    else if (value<0x4000)
+        return 2;
+    else
+        return 3;
+}
+
+/**
+ * @brief Write a varint (7 bits per byte, lowest bits first).
+ *
+ * @param out Memory for varint.
+ * @param value Value.
+ * @return Memory after varint.
+ */
+static uint8_t* wtp_telemetry_put_varint(
+    uint8_t* out,
+    uint16_t value
+) {
+    while (value>=0x80) {
+        *(out++) = (value&0x7f)|0x80;
+        value >>= 7;
+    }
+    *(out++) = value;
+
+    return out;
+}
+
+/**
+ * @brief Read a varint.
+ *
+ * @param data Varint data.
+ * @param end End of data.
+ * @param _value Used for returning value.
+ * @return Data after varint, or NULL if the varint is corrupted.
+ */
+static const uint8_t* wtp_telemetry_get_varint(
+    const uint8_t* data,
+    const uint8_t* end,
+    uint16_t* _value
+) {
+    uint32_t value = 0;
+
+    for (uint8_t shift=0;shift<21;shift+=7) {
+        if (data>=end)
+            return NULL;
+        uint8_t byte = *(data++);
+        value |= (uint32_t)(byte&0x7f)<<shift;
+
+        if (!(byte&0x80)) {
+            if (value>UINT16_MAX)
+                return NULL;
+            *_value = value;
+            return data;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Encode deltas of a channel into a channel block.
+ *
+ * @param samples First sample of channel to encode.
+ * @param n_channels Number of channels.
+ * @param n_deltas Number of deltas.
+ * @param prev Sample before the first sample.
+ * @param out Memory for channel block.
+ * @param end End of memory.
+ * @return Memory after channel block, or NULL if the block doesn't fit.
+ */
+static uint8_t* wtp_telemetry_put_block(
+    const int16_t* samples,
+    uint8_t n_channels,
+    uint8_t n_deltas,
+    int16_t prev,
+    uint8_t* out,
+    uint8_t* end
+) {
+    //Largest zig-zag delta and total varint size
+    uint16_t codes = 0;
+    uint16_t varint_size = 0;
+    int16_t last = prev;
+
+    for (uint8_t i=0;i<n_deltas;i++) {
+        uint16_t code = WTP_TELEMETRY_ZIGZAG(samples[i*n_channels]-last);
+        last = samples[i*n_channels];
+
+        codes |= code;
+        varint_size += wtp_telemetry_varint_size(code);
+    }
+
+    //Bit-packed delta width
+    uint8_t width = 0;
+    while (codes>>width)
+        width++;
+    uint16_t packed_size = ((uint16_t)n_deltas*width+7)/8;
+
+    //Zig-zag varints (Smaller when a few deltas are much larger than the others)
+    if (varint_size<packed_size) {
+        if (end-out<1+varint_size)
+            return NULL;
+        *(out++) = WTP_TELEMETRY_VARINT;
+
+        for (uint8_t i=0;i<n_deltas;i++) {
+            out = wtp_telemetry_put_varint(out, WTP_TELEMETRY_ZIGZAG(samples[i*n_channels]-prev));
+            prev = samples[i*n_channels];
+        }
+    //Bit-packed deltas, highest bits first
+    } else {
+        if (end-out<1+packed_size)
+            return NULL;
+        *(out++) = width;
+
+        uint32_t bits = 0;
+        uint8_t n_bits = 0;
+        for (uint8_t i=0;i<n_deltas;i++) {
+            bits = (bits<<width)|WTP_TELEMETRY_ZIGZAG(samples[i*n_channels]-prev);
+            n_bits += width;
+            prev = samples[i*n_channels];
+
+            for (;n_bits>=8;n_bits-=8)
+                *(out++) = bits>>(n_bits-8);
+        }
+        if (n_bits)
+            *(out++) = bits<<(8-n_bits);
+    }
+
+    return out;
+}
+
+/**
+ * @brief Decode a channel block into deltas of a channel.
+ *
+ * @param data Channel block data.
+ * @param end End of data.
+ * @param samples First sample of channel to decode.
+ * @param n_channels Number of channels.
+ * @param n_deltas Number of deltas.
+ * @param prev Sample before the first sample.
+ * @return Data after channel block, or NULL if the block is corrupted.
+ */
+static const uint8_t* wtp_telemetry_get_block(
+    const uint8_t* data,
+    const uint8_t* end,
+    int16_t* samples,
+    uint8_t n_channels,
+    uint8_t n_deltas,
+    int16_t prev
+) {
+    if (data>=end)
+        return NULL;
+    uint8_t mode = *(data++);
+
+    //Zig-zag varints
+    if (mode==WTP_TELEMETRY_VARINT) {
+        for (uint8_t i=0;i<n_deltas;i++) {
+            uint16_t code;
+            data = wtp_telemetry_get_varint(data, end, &code);
+            if (!data)
+                return NULL;
+
+            prev += WTP_TELEMETRY_UNZIGZAG(code);
+            samples[i*n_channels] = prev;
+        }
+    //Bit-packed deltas
+    } else {
+        uint8_t width = mode;
+        if (width>16)
+            return NULL;
+        if (end-data<((uint16_t)n_deltas*width+7)/8)
+            return NULL;
+
+        uint32_t bits = 0;
+        uint8_t n_bits = 0;
+        for (uint8_t i=0;i<n_deltas;i++) {
+            for (;n_bits<width;n_bits+=8)
+                bits = (bits<<8)|*(data++);
+            n_bits -= width;
+
+            uint16_t code = (bits>>n_bits)&((1UL<<width)-1);
+            prev += WTP_TELEMETRY_UNZIGZAG(code);
+            samples[i*n_channels] = prev;
+        }
+    }
+
+    return data;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_telemetry_init(
+    wtp_telemetry_t* self,
+    uint8_t n_channels,
+    uint8_t key_interval
+) {
+    if ((n_channels<1)||(n_channels>WTP_TELEMETRY_CHANNELS_MAX))
+        return WIO_ERR_INVALID;
+
+    self->_n_channels = n_channels;
+    self->_key_interval = key_interval;
+    self->_prev = malloc(n_channels*sizeof(int16_t));
+    if (!self->_prev)
+        return WIO_ERR_NO_MEMORY;
+
+    return wtp_telemetry_reset(self);
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_telemetry_fini(
+    wtp_telemetry_t* self
+) {
+    free(self->_prev);
+    self->_prev = NULL;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_telemetry_reset(
+    wtp_telemetry_t* self
+) {
+    self->_in_stream = false;
+    self->_frame_index = 0;
+    self->_n_since_key = 0;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_telemetry_encode(
+    wtp_telemetry_t* self,
+    const int16_t* samples,
+    uint8_t n_samples,
+    uint8_t* out,
+    uint16_t out_size_max,
+    uint16_t* _out_size
+) {
+    if (n_samples<1)
+        return WIO_ERR_INVALID;
+    uint8_t n_channels = self->_n_channels;
+    uint8_t* end = out+out_size_max;
+    if (out_size_max<WTP_TELEMETRY_HEADER_SIZE+1)
+        return WIO_ERR_OUT_OF_RANGE;
+
+    //Begin a new stream after reset, or send a key frame every key interval
+    bool key = (!self->_in_stream)||(self->_key_interval&&(self->_n_since_key>=self->_key_interval));
+    uint8_t* pos = out;
+    *(pos++) = (key?WTP_TELEMETRY_KEY:0)|(self->_frame_index&WTP_TELEMETRY_INDEX_MASK);
+    *(pos++) = n_samples;
+    if (key)
+        *(pos++) = n_channels;
+
+    for (uint8_t i=0;i<n_channels;i++) {
+        const int16_t* channel = samples+i;
+        int16_t prev = self->_prev[i];
+        uint8_t n_deltas = n_samples;
+
+        //Key frames carry the first sample as is
+        if (key) {
+            prev = channel[0];
+            if (end-pos<wtp_telemetry_varint_size(WTP_TELEMETRY_ZIGZAG(prev)))
+                return WIO_ERR_OUT_OF_RANGE;
+            pos = wtp_telemetry_put_varint(pos, WTP_TELEMETRY_ZIGZAG(prev));
+
+            channel += n_channels;
+            n_deltas--;
+        }
+
+        pos = wtp_telemetry_put_block(channel, n_channels, n_deltas, prev, pos, end);
+        if (!pos)
+            return WIO_ERR_OUT_OF_RANGE;
+    }
+
+    //Update stream after the whole frame is encoded
+    for (uint8_t i=0;i<n_channels;i++)
+        self->_prev[i] = samples[(n_samples-1)*n_channels+i];
+    self->_in_stream = true;
+    self->_frame_index++;
+    self->_n_since_key = key?1:(self->_n_since_key+1);
+
+    WIO_RETURN(_out_size, pos-out)
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_telemetry_decode(
+    wtp_telemetry_t* self,
+    const uint8_t* data,
+    uint16_t size,
+    int16_t* samples,
+    uint8_t n_samples_max,
+    uint8_t* _n_samples
+) {
+    if (size<WTP_TELEMETRY_HEADER_SIZE)
+        return WIO_ERR_INVALID;
+    const uint8_t* end = data+size;
+    uint8_t n_channels = self->_n_channels;
+
+    uint8_t header = *(data++);
+    uint8_t n_samples = *(data++);
+    bool key = header&WTP_TELEMETRY_KEY;
+
+    //Frames missing or out of stream
+    if ((!key)&&((!self->_in_stream)||((header&WTP_TELEMETRY_INDEX_MASK)!=(self->_frame_index&WTP_TELEMETRY_INDEX_MASK)))) {
+        self->_in_stream = false;
+        return WIO_ERR_INVALID;
+    }
+    //First frame of a new stream
+    if (key) {
+        wtp_telemetry_reset(self);
+        if ((data>=end)||(*(data++)!=n_channels))
+            return WIO_ERR_INVALID;
+        self->_frame_index = header&WTP_TELEMETRY_INDEX_MASK;
+    }
+    if (n_samples<1) {
+        self->_in_stream = false;
+        return WIO_ERR_INVALID;
+    }
+    if (n_samples>n_samples_max) {
+        self->_in_stream = false;
+        return WIO_ERR_OUT_OF_RANGE;
+    }
+
+    for (uint8_t i=0;i<n_channels;i++) {
+        int16_t* channel = samples+i;
+        int16_t prev = self->_prev[i];
+        uint8_t n_deltas = n_samples;
+
+        //Key frames carry the first sample as is
+        if (key) {
+            uint16_t code;
+            data = wtp_telemetry_get_varint(data, end, &code);
+            if (!data)
+                return WIO_ERR_INVALID;
+
+            prev = channel[0] = WTP_TELEMETRY_UNZIGZAG(code);
+            channel += n_channels;
+            n_deltas--;
+        }
+
+        data = wtp_telemetry_get_block(data, end, channel, n_channels, n_deltas, prev);
+        //Frame is corrupted; wait for next key frame
+        if (!data) {
+            self->_in_stream = false;
+            return WIO_ERR_INVALID;
+        }
+    }
+
+    for (uint8_t i=0;i<n_channels;i++)
+        self->_prev[i] = samples[(n_samples-1)*n_channels+i];
+    self->_in_stream = true;
+    self->_frame_index++;
+
+    WIO_RETURN(_n_samples, n_samples)
+
+    return WIO_OK;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdbool.h>
+#include <wio.h>
+#include "defs.h"
+
+//=== WTP telemetry constants ===
+/// Frame header size (Header flags and index, number of samples)
+static const uint8_t WTP_TELEMETRY_HEADER_SIZE = 2;
+/// Header flag of key frames (The first sample is sent as is, and the receiver resets its state)
+static const uint8_t WTP_TELEMETRY_KEY = 0x80;
+/// Header mask of frame index in stream (Modulo 128, checked by the receiver)
+static const uint8_t WTP_TELEMETRY_INDEX_MASK = 0x7f;
+/// Channel block flag of zig-zag varint deltas (Otherwise deltas are bit-packed)
+static const uint8_t WTP_TELEMETRY_VARINT = 0x80;
+/// Channel block mask of bit-packed delta width
+static const uint8_t WTP_TELEMETRY_WIDTH_MASK = 0x1f;
+/// Maximum number of channels
+static const uint8_t WTP_TELEMETRY_CHANNELS_MAX = 16;
+
+/// WTP telemetry codec type
+typedef struct wtp_telemetry {
+    /// Last sample of previous frame
+    int16_t* _prev;
+    /// Number of channels
+    uint8_t _n_channels;
+    /// Number of frames from one key frame to the next (0 for key frames only at the beginning of a stream)
+    uint8_t _key_interval;
+
+    /// A stream of frames is in progress
+    bool _in_stream;
+    /// Index of next frame in stream
+    uint8_t _frame_index;
+    /// Number of frames since last key frame, including it
+    uint8_t _n_since_key;
+} wtp_telemetry_t;
+
+/**
+ * @brief Initialize telemetry codec.
+ *
+ * @param self Telemetry codec instance.
+ * @param n_channels Number of channels of each sample (At most WTP_TELEMETRY_CHANNELS_MAX).
+ * @param key_interval Number of frames from one key frame to the next (0 for key frames only at the beginning of a stream).
+ * @return WIO_ERR_INVALID for invalid number of channels, WIO_ERR_NO_MEMORY if allocation failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_telemetry_init(
+    wtp_telemetry_t* self,
+    uint8_t n_channels,
+    uint8_t key_interval
+);
+
+/**
+ * @brief Finalize telemetry codec.
+ *
+ * @param self Telemetry codec instance.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_telemetry_fini(
+    wtp_telemetry_t* self
+);
+
+/**
+ * @brief Reset telemetry codec and begin a new stream.
+ *
+ * The next encoded frame is a key frame.
+ *
+ * @param self Telemetry codec instance.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_telemetry_reset(
+    wtp_telemetry_t* self
+);
+
+/**
+ * @brief Encode a batch of samples into a frame.
+ *
+ * Every channel is sent as deltas against the previous sample, bit-packed at the width
+ * of the largest zig-zag delta or as zig-zag varints, whichever is smaller. A frame takes
+ * at most WTP_TELEMETRY_HEADER_SIZE+1+n_channels*(4+2*n_samples) bytes.
+ * The decoder must see every frame encoded in a stream, in order.
+ *
+ * @param self Telemetry codec instance.
+ * @param samples Samples, with channels of each sample next to each other.
+ * @param n_samples Number of samples (At least 1).
+ * @param out Memory for frame.
+ * @param out_size_max Size of memory for frame.
+ * @param _out_size Used for returning frame size.
+ * @return WIO_ERR_INVALID for no samples, WIO_ERR_OUT_OF_RANGE if frame is too large, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_telemetry_encode(
+    wtp_telemetry_t* self,
+    const int16_t* samples,
+    uint8_t n_samples,
+    uint8_t* out,
+    uint16_t out_size_max,
+    uint16_t* _out_size
+);
+
+/**
+ * @brief Decode a frame into a batch of samples.
+ *
+ * The stream is broken on failure, and frames are rejected until the
+ * encoder sends a key frame.
+ *
+ * @param self Telemetry codec instance.
+ * @param data Frame data.
+ * @param size Frame size.
+ * @param samples Memory for samples.
+ * @param n_samples_max Number of samples that fit into memory.
+ * @param _n_samples Used for returning number of samples.
+ * @return WIO_ERR_INVALID if frame is corrupted or out of stream,
+ * WIO_ERR_OUT_OF_RANGE if frame has too many samples, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_telemetry_decode(
+    wtp_telemetry_t* self,
+    const uint8_t* data,
+    uint16_t size,
+    int16_t* samples,
+    uint8_t n_samples_max,
+    uint8_t* _n_samples
+);
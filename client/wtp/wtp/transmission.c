@@ -2,6 +2,167 @@
 #include <string.h>
 #include "transmission.h"
 
+/**
+ * @brief Read next message in a transmit or receive message buffer.
+ *
+ * Message size and message data (Or reference to borrowed message data) are allocated separately
+ * in the message buffer, so either of them may wrap around to the beginning of the buffer.
+ * The read cursor is moved to the end of the message.
+ *
+ * @param msg_buf Message buffer.
+ * @param _msg_size Used for returning message size.
+ * @param _msg_data Used for returning message data.
+ * @return WIO_OK.
+ */
+static wtp_status_t wtp_read_msg(
+    wio_buf_t* msg_buf,
+    uint16_t* _msg_size,
+    uint8_t** _msg_data
+) {
+    uint16_t msg_size;
+    uint8_t* msg_data;
+
+    //Message size (Wraps around the same way as "wio_alloc()")
+    if (msg_buf->size-msg_buf->pos_a<2)
+        msg_buf->pos_a = 0;
+    memcpy(&msg_size, msg_buf->buffer+msg_buf->pos_a, 2);
+    msg_buf->pos_a += 2;
+
+    //Size of message data in message buffer
+    uint16_t mem_size = (msg_size&WTP_TX_MSG_REF)?sizeof(uint8_t*):msg_size;
+    if (msg_buf->size-msg_buf->pos_a<mem_size)
+        msg_buf->pos_a = 0;
+    //Borrowed message data
+    if (msg_size&WTP_TX_MSG_REF) {
+        memcpy(&msg_data, msg_buf->buffer+msg_buf->pos_a, sizeof(uint8_t*));
+        msg_size &= ~WTP_TX_MSG_REF;
+    //Copied message data
+    } else
+        msg_data = msg_buf->buffer+msg_buf->pos_a;
+    msg_buf->pos_a += mem_size;
+
+    WIO_RETURN(_msg_size, msg_size)
+    WIO_RETURN(_msg_data, msg_data)
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Get number of READ OpSpecs needed for message data.
+ *
+ * @param self WTP transmit control instance.
+ * @param size Message data size.
+ * @param header_size Header size of the first data packet (Following ones are WTP_PKT_CONT_MSG).
+ * @return Number of READ OpSpecs.
+ */
+static uint16_t wtp_tx_count_reads(
+    wtp_tx_ctrl_t* self,
+    uint16_t size,
+    uint8_t header_size
+) {
+    uint8_t cont_size = wtp_tx_header_size(self, 0);
+    uint16_t n_reads = 1;
+    //Payload size of the first and following Reads
+    uint16_t begin_payload = self->_read_size-header_size;
+    uint16_t cont_payload = self->_read_size-cont_size;
+    //(Payload size of compact data packet is limited by bits of packet type)
+    if (self->_framing==WTP_FRAMING_COMPACT) {
+        begin_payload = WIO_MIN(begin_payload, WTP_PKT_COMPACT_SIZE_MASK);
+        cont_payload = WIO_MIN(cont_payload, WTP_PKT_COMPACT_SIZE_MASK);
+    }
+
+    if (size>begin_payload)
+        n_reads += (size-begin_payload+cont_payload-1)/cont_payload;
+
+    return n_reads;
+}
+
+/**
+ * @brief Add a new message to transmit control.
+ *
+ * @param self WTP transmit control instance.
+ * @param data Message data.
+ * @param size Message size.
+ * @param borrow Store a reference to message data instead of copying it.
+ * @param _read_info Used for returning Read OpSpec information object.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_tx_push_msg(
+    wtp_tx_ctrl_t* self,
+    uint8_t* data,
+    uint16_t size,
+    bool borrow,
+    wtp_tx_read_info_t** _read_info
+) {
+    wio_buf_t* msg_buf = &self->_msg_buf;
+    //READ information queue
+    wio_queue_t* read_info_queue = &self->_read_info_queue;
+
+    //Message too large or too many messages
+    if (size>WTP_TX_MSG_MAX)
+        return WIO_ERR_OUT_OF_RANGE;
+    if (read_info_queue->size>=read_info_queue->capacity)
+        return WIO_ERR_NO_MEMORY;
+
+    //Header size of first and following data packets
+    uint8_t begin_size = wtp_tx_header_size(self, size);
+    uint8_t cont_size = wtp_tx_header_size(self, 0);
+    //Number of READ OpSpecs needed
+    uint16_t n_reads = wtp_tx_count_reads(self, size, begin_size);
+    if (n_reads>UINT8_MAX)
+        return WIO_ERR_OUT_OF_RANGE;
+    //Smallest READ size, in words, carrying the message with as many Reads
+    //(Data is spread over all Reads instead of leaving the last Read mostly empty)
+    uint16_t read_size = (size+begin_size+(n_reads-1)*cont_size+n_reads-1)/n_reads;
+    read_size = (read_size+1)&~1;
+    read_size = WIO_MIN(read_size, self->_read_size);
+    //(No Read carries more payload than a compact data packet)
+    if (self->_framing==WTP_FRAMING_COMPACT) {
+        uint16_t compact_size = (WTP_PKT_COMPACT_SIZE_MASK+begin_size+1)&~1;
+        read_size = WIO_MIN(read_size, compact_size);
+    }
+
+    //All messages acknowledged; restart from the beginning of the buffer
+    //(Otherwise a message bigger than both free ends of the buffer can't be allocated)
+    if (msg_buf->pos_a==msg_buf->pos_b) {
+        msg_buf->pos_a = msg_buf->pos_b = 0;
+        self->_msg_begin_pos = 0;
+    }
+    //Message buffer before allocation
+    wio_buf_t msg_buf_before = *msg_buf;
+    //Size of message data in message buffer
+    uint16_t mem_size = borrow?sizeof(uint8_t*):size;
+    //Allocate memory for message size and message data
+    uint8_t* msg_size_mem;
+    uint8_t* msg_mem;
+    WIO_TRY(wio_alloc(msg_buf, 2, &msg_size_mem))
+    if (wio_alloc(msg_buf, mem_size, &msg_mem)!=WIO_OK) {
+        //Release message size memory
+        *msg_buf = msg_buf_before;
+        return WIO_ERR_NO_MEMORY;
+    }
+    //Write message size
+    uint16_t msg_size = borrow?(size|WTP_TX_MSG_REF):size;
+    memcpy(msg_size_mem, &msg_size, 2);
+    //Write reference to message data or copy message data
+    if (borrow)
+        memcpy(msg_mem, &data, sizeof(uint8_t*));
+    else
+        memcpy(msg_mem, data, size);
+
+    //Create READ OpSpec information
+    wtp_tx_read_info_t read_info;
+    read_info._size = (uint8_t)read_size;
+    read_info._n_reads = (uint8_t)n_reads;
+    //Push into READ information queue
+    WIO_TRY(wio_queue_push(read_info_queue, &read_info))
+
+    //Return READ information
+    WIO_RETURN(_read_info, WIO_QUEUE_BEGIN(read_info_queue, wtp_tx_read_info_t))
+
+    return WIO_OK;
+}
+
 /**
  * {@inheritDoc}
  */
@@ -23,6 +184,8 @@ wtp_status_t wtp_tx_init(
     self->_timeout = timeout;
     //Read size
     self->_read_size = read_size;
+    //Standard framing until negotiated
+    self->_framing = WTP_FRAMING_STANDARD;
 
     //Packet buffer
     WIO_TRY(wio_buf_alloc_init(&self->_pkt_buf, pkt_buf_size))
@@ -43,6 +206,13 @@ wtp_status_t wtp_tx_init(
     //Message ends sequence number queue
     WIO_TRY(wio_queue_init(&self->_msg_ends_queue, sizeof(uint16_t), n_msgs))
 
+    //Uplink retransmission timer
+    WIO_TRY(wio_timer_init(&self->_timer))
+    //Retransmission timeout backoff
+    self->_backoff = 0;
+    //Request uplink packet ID
+    self->_req_uplink_id = 0;
+
     return WIO_OK;
 }
 
@@ -52,6 +222,8 @@ wtp_status_t wtp_tx_init(
 wtp_status_t wtp_tx_fini(
     wtp_tx_ctrl_t* self
 ) {
+    //Uplink retransmission timer
+    WIO_TRY(wio_clear_timeout(&self->_timer))
     //Packet buffer
     free(self->_pkt_buf.buffer);
     //Message buffer
@@ -69,12 +241,16 @@ wtp_status_t wtp_tx_begin_packet(
 ) {
     wio_buf_t* pkt_buf = &self->_pkt_buf;
 
+    //Not enough space for packet size and packet
+    //(A half-written packet would corrupt framing of all following packets)
+    if (pkt_buf->pos_b+1+WTP_PKT_CTRL_MAX>pkt_buf->size)
+        return WIO_ERR_NO_MEMORY;
     //Allocate current packet size memory
     WIO_TRY(wio_alloc(pkt_buf, 1, &self->_pkt_size))
     //Packet begin position
     self->_pkt_begin = pkt_buf->pos_b;
-    //Write packet type
-    WIO_TRY(wio_write(pkt_buf, &pkt_type, 1))
+    //Write packet type (Space was checked above)
+    wio_write_u8(pkt_buf, pkt_type);
 
     return WIO_OK;
 }
@@ -89,6 +265,8 @@ wtp_status_t wtp_tx_end_packet(
     uint16_t pkt_size = self->_pkt_buf.pos_b-self->_pkt_begin;
     //Write packet size
     *self->_pkt_size = (uint8_t)pkt_size;
+    //Update high-water mark (Packet data is written with "wio_write()")
+    wio_update_used_max(&self->_pkt_buf);
 
     return WIO_OK;
 }
@@ -102,34 +280,36 @@ wtp_status_t wtp_tx_add_msg(
     uint16_t size,
     wtp_tx_read_info_t** _read_info
 ) {
-    wio_buf_t* msg_buf = &self->_msg_buf;
-
-    //Write message size
-    WIO_TRY(wio_write(msg_buf, &size, 2))
-    //Allocate memory for message data
-    uint8_t* msg_data;
-    WIO_TRY(wio_alloc(msg_buf, size, &msg_data))
-    //Copy message data
-    memcpy(msg_data, data, size);
-
-    //READ information queue
-    wio_queue_t* read_info_queue = &self->_read_info_queue;
-
-    //Payload size per Read
-    uint16_t payload_size = self->_read_size-6;
-    //Number of READ OpSpecs needed
-    uint8_t n_reads = (uint8_t)(size/payload_size+1);
-    //Create READ OpSpec information
-    wtp_tx_read_info_t read_info;
-    read_info._size = (n_reads==1)?(size+6):self->_read_size;
-    read_info._n_reads = n_reads;
-    //Push into READ information queue
-    WIO_TRY(wio_queue_push(read_info_queue, &read_info))
+    return wtp_tx_push_msg(self, data, size, false, _read_info);
+}
 
-    //Return READ information
-    WIO_RETURN(_read_info, WIO_QUEUE_BEGIN(read_info_queue, wtp_tx_read_info_t))
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_tx_add_msg_ref(
+    wtp_tx_ctrl_t* self,
+    uint8_t* data,
+    uint16_t size,
+    wtp_tx_read_info_t** _read_info
+) {
+    return wtp_tx_push_msg(self, data, size, true, _read_info);
+}
 
-    return WIO_OK;
+/**
+ * {@inheritDoc}
+ */
+uint8_t wtp_tx_header_size(
+    wtp_tx_ctrl_t* self,
+    uint16_t msg_size
+) {
+    //Compact framing: packet type, varint message size and 8-bit sequence number
+    if (self->_framing==WTP_FRAMING_COMPACT) {
+        if (!msg_size)
+            return 2;
+        return (msg_size<0x80)?3:(msg_size<0x4000)?4:5;
+    }
+    //Standard framing: 6 for WTP_PKT_BEGIN_MSG and 4 for WTP_PKT_CONT_MSG
+    return msg_size?6:4;
 }
 
 /**
@@ -150,47 +330,27 @@ wtp_status_t wtp_tx_make_fragment(
     //No messages to make fragment from
     if (msg_buf->pos_a==msg_buf->pos_b)
         return WIO_OK;
-    //Read message size
+    //Read message
     uint16_t msg_size;
-    WIO_TRY(wio_read(msg_buf, &msg_size, 2))
-
-    //Load next message data into fragment
-    if (self->_msg_fragmented>=msg_size) {
-        //Update message begin
-        self->_msg_begin_seq += msg_size;
-        //Update fragmented position
-        self->_msg_fragmented = 0;
-
-        //Skip previous message data
-        WIO_TRY(wio_free(msg_buf, msg_size))
-        //Update next message buffer position
-        self->_msg_begin_pos = msg_buf->pos_a;
-
-        //No messages to make fragment from
-        if (msg_buf->pos_a==msg_buf->pos_b)
-            return WIO_OK;
-        //Read message size
-        WIO_TRY(wio_read(msg_buf, &msg_size, 2))
-    }
-
-    if (self->_msg_fragmented==0) {
-        //Message ends queue
-        wio_queue_t* msg_ends_queue = &self->_msg_ends_queue;
-        //Message end
-        uint16_t msg_end = self->_msg_begin_seq+msg_size;
-
-        //Add message end to queue
-        WIO_TRY(wio_queue_push(msg_ends_queue, &msg_end))
-    }
+    uint8_t* msg_data;
+    WIO_TRY(wtp_read_msg(msg_buf, &msg_size, &msg_data))
 
     //Sequence number and fragmented position
     uint16_t msg_fragmented = self->_msg_fragmented;
     //Sequence number
     uint16_t seq_num = self->_msg_begin_seq+msg_fragmented;
 
+    //Header size
+    uint8_t header_size = wtp_tx_header_size(self, (msg_fragmented==0)?msg_size:0);
+    //READ OpSpec too small for any data
+    if (avail_size<=header_size)
+        return WIO_OK;
+
     //Maximum packet data size using different criterion
-    //(Header size is 6 for WTP_PKT_BEGIN_MSG and 4 for WTP_PKT_CONT_MSG)
-    uint16_t max_avail = avail_size-((msg_fragmented==0)?6:4);
+    uint16_t max_avail = avail_size-header_size;
+    //(Payload size of compact data packet is limited by bits of packet type)
+    if (self->_framing==WTP_FRAMING_COMPACT)
+        max_avail = WIO_MIN(max_avail, WTP_PKT_COMPACT_SIZE_MASK);
     uint16_t max_msg = msg_size-msg_fragmented;
     uint16_t max_window = self->_seq_num+self->_window_size-seq_num;
     //Fragment data size
@@ -198,13 +358,24 @@ wtp_status_t wtp_tx_make_fragment(
     if (fragment_data_size==0)
         return WIO_OK;
 
+    //First fragment of the message
+    if (msg_fragmented==0) {
+        //Message ends queue
+        wio_queue_t* msg_ends_queue = &self->_msg_ends_queue;
+        //Message end
+        uint16_t msg_end = self->_msg_begin_seq+msg_size;
+
+        //Add message end to queue
+        WIO_TRY(wio_queue_push(msg_ends_queue, &msg_end))
+    }
+
     //Data fragments queue
     wio_queue_t* fragments_queue = &self->_fragments_queue;
 
     //Update fragmented position
     self->_msg_fragmented += fragment_data_size;
     //Get fragment data position
-    uint8_t* fragment_data = msg_buf->buffer+msg_buf->pos_a+msg_fragmented;
+    uint8_t* fragment_data = msg_data+msg_fragmented;
     //Make fragment
     wtp_tx_fragment_t fragment;
     fragment._seq_num = seq_num;
@@ -212,15 +383,111 @@ wtp_status_t wtp_tx_make_fragment(
     fragment._data = fragment_data;
     fragment._size = fragment_data_size;
     fragment._need_send = false;
+    fragment._sent = 0;
+    fragment._sacked = false;
     //Push fragment into queue
     WIO_TRY(wio_queue_push(fragments_queue, &fragment))
 
+    //Whole message fragmented; move on to next message
+    //(The message may be acknowledged and its memory reused before next fragment is made)
+    if (self->_msg_fragmented>=msg_size) {
+        //Update message begin
+        self->_msg_begin_seq += msg_size;
+        //Update fragmented position
+        self->_msg_fragmented = 0;
+        //Update next message buffer position
+        self->_msg_begin_pos = msg_buf->pos_a;
+    }
+
     //Return fragment
     WIO_RETURN(_fragment, WIO_QUEUE_BEGIN(fragments_queue, wtp_tx_fragment_t))
 
     return WIO_OK;
 }
 
+/**
+ * @brief Get size of message data not fragmented yet.
+ *
+ * @param self WTP transmit control instance.
+ * @return Size of message data not fragmented yet.
+ */
+static uint32_t wtp_tx_unfragmented_size(
+    wtp_tx_ctrl_t* self
+) {
+    //Message buffer (Shallow copy, read from next message)
+    wio_buf_t* msg_buf = WIO_INST_PTR(wio_buf_t);
+    *msg_buf = self->_msg_buf;
+    msg_buf->pos_a = self->_msg_begin_pos;
+    //Unfragmented size
+    uint32_t size = 0;
+
+    while (msg_buf->pos_a!=msg_buf->pos_b) {
+        uint16_t msg_size;
+
+        wtp_read_msg(msg_buf, &msg_size, NULL);
+        size += msg_size;
+    }
+
+    return (size>self->_msg_fragmented)?size-self->_msg_fragmented:0;
+}
+
+/**
+ * @brief Skip message data not fragmented yet that the other side already has.
+ *
+ * The other side may acknowledge data beyond fragmented data after the state is restored
+ * from a checkpoint, since data sent before power loss isn't fragmented again until it is retransmitted.
+ * All data fragments must be acknowledged before.
+ *
+ * @param self WTP transmit control instance.
+ * @param size Size of data to skip.
+ * @param _n_msgs Increased by number of messages skipped to the end.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_tx_skip(
+    wtp_tx_ctrl_t* self,
+    uint16_t size,
+    uint8_t* _n_msgs
+) {
+    //Message buffer
+    wio_buf_t* msg_buf = WIO_INST_PTR(wio_buf_t);
+    //Message ends queue
+    wio_queue_t* msg_ends_queue = &self->_msg_ends_queue;
+
+    while (size>0) {
+        //Read next message
+        //(The only message not released is the one being fragmented, so both cursors point to it)
+        *msg_buf = self->_msg_buf;
+        msg_buf->pos_a = self->_msg_begin_pos;
+        uint16_t msg_size;
+        WIO_TRY(wtp_read_msg(msg_buf, &msg_size, NULL))
+        //Rest of the message
+        uint16_t rest_size = msg_size-self->_msg_fragmented;
+
+        //Message partly skipped
+        if (size<rest_size) {
+            //Add message end to queue (Like the first fragment of the message)
+            if (self->_msg_fragmented==0) {
+                uint16_t msg_end = self->_msg_begin_seq+msg_size;
+
+                WIO_TRY(wio_queue_push(msg_ends_queue, &msg_end))
+            }
+            self->_msg_fragmented += size;
+            break;
+        }
+
+        //Whole message skipped; release message memory
+        size -= rest_size;
+        if (self->_msg_fragmented>0)
+            WIO_TRY(wio_queue_pop(msg_ends_queue, NULL))
+        self->_msg_begin_seq += msg_size;
+        self->_msg_fragmented = 0;
+        self->_msg_begin_pos = self->_msg_buf.pos_a = msg_buf->pos_a;
+        (*_n_msgs)++;
+    }
+
+    return WIO_OK;
+}
+
 /**
  * {@inheritDoc}
  */
@@ -232,9 +499,19 @@ wtp_status_t wtp_tx_handle_ack(
     //Number of messages sent
     uint8_t n_sent_msgs = 0;
 
-    //Invalid sequence number; drop acknowledgement
-    if (seq_num>self->_msg_begin_seq+self->_msg_fragmented)
-        return WIO_ERR_INVALID;
+    //Acknowledged and fragmented size (Relative to current sequence number, so they wrap around correctly)
+    uint16_t acked_size = seq_num-self->_seq_num;
+    uint16_t fragmented_size = self->_msg_begin_seq+self->_msg_fragmented-self->_seq_num;
+    //Size of data acknowledged beyond fragmented data
+    uint16_t skip_size = 0;
+    if (acked_size>fragmented_size) {
+        skip_size = acked_size-fragmented_size;
+        //Invalid sequence number; drop acknowledgement
+        if (skip_size>wtp_tx_unfragmented_size(self))
+            return WIO_ERR_INVALID;
+        //All data fragments acknowledged; the rest is skipped
+        acked_size = fragmented_size;
+    }
 
     //Fragments queue
     wio_queue_t* fragments_queue = &self->_fragments_queue;
@@ -246,21 +523,21 @@ wtp_status_t wtp_tx_handle_ack(
     for (uint8_t i=0;i<fragments_queue->size;i++) {
         //Current fragment
         wtp_tx_fragment_t* fragment = WIO_QUEUE_AT(fragments_queue, wtp_tx_fragment_t, queue_index);
-        //Fragment end
-        uint16_t fragment_end = fragment->_seq_num+fragment->_size;
+        //Fragment end (Relative to current sequence number)
+        uint16_t fragment_end = fragment->_seq_num+fragment->_size-self->_seq_num;
 
         //No fragment to acknowledge or sequence number not at fragments border
-        if (fragment_end>seq_num)
+        if (fragment_end>acked_size)
             return WIO_OK;
         //Update number of fragments
         n_fragments++;
         //End of acknowledged range
-        if (fragment_end==seq_num)
+        if (fragment_end==acked_size)
             break;
 
         //Update queue index
         queue_index++;
-        if (queue_index==fragments_queue->size)
+        if (queue_index>=fragments_queue->capacity)
             queue_index = 0;
     }
 
@@ -275,31 +552,38 @@ wtp_status_t wtp_tx_handle_ack(
         wtp_tx_fragment_t fragment;
         //Pop fragment from queue
         WIO_TRY(wio_queue_pop(fragments_queue, &fragment))
-        //Fragment end
-        uint16_t fragment_end = fragment._seq_num+fragment._size;
+        //Fragment end (Relative to current sequence number)
+        uint16_t fragment_end = fragment._seq_num+fragment._size-self->_seq_num;
 
         if (msg_ends_queue->size) {
             //Get next message end
             uint16_t* msg_end = WIO_QUEUE_END(msg_ends_queue, uint16_t);
 
             //Whole message sent
-            if (*msg_end<=fragment_end) {
+            if ((uint16_t)(*msg_end-self->_seq_num)<=fragment_end) {
                 //Update number of sent messages
                 n_sent_msgs++;
 
                 //Pop message end
                 WIO_TRY(wio_queue_pop(msg_ends_queue, NULL))
-                //Read message memory size
-                uint16_t msg_size;
-                WIO_TRY(wio_read(msg_buf, &msg_size, 2))
-                //Release message memory
-                WIO_TRY(wio_free(msg_buf, msg_size))
+                //Release message memory (Moves read cursor to next message)
+                WIO_TRY(wtp_read_msg(msg_buf, NULL, NULL))
             }
         }
-
-        //TODO: Resolve fragment timer
     }
 
+    //Skip data acknowledged beyond fragmented data
+    if (skip_size>0)
+        WIO_TRY(wtp_tx_skip(self, skip_size, &n_sent_msgs))
+
+    //Acknowledgement makes progress; reset retransmission timeout backoff
+    if (acked_size+skip_size>0)
+        self->_backoff = 0;
+    //All messages acknowledged; drop Reads that are no longer needed
+    //(Messages may take fewer Reads than requested when Read size changes)
+    if (msg_buf->pos_a==msg_buf->pos_b)
+        while (self->_read_info_queue.size>0)
+            WIO_TRY(wio_queue_pop(&self->_read_info_queue, NULL))
     //Update sequence number
     self->_seq_num = seq_num;
     //Return number of messages sent
@@ -308,6 +592,302 @@ wtp_status_t wtp_tx_handle_ack(
     return WIO_OK;
 }
 
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_tx_handle_sack(
+    wtp_tx_ctrl_t* self,
+    wtp_sack_block_t* block
+) {
+    //Fragments queue
+    wio_queue_t* fragments_queue = &self->_fragments_queue;
+    //Block range relative to current sequence number
+    uint16_t rel_block_begin = block->_begin-self->_seq_num;
+    uint16_t rel_block_end = rel_block_begin+block->_size;
+
+    //Mark data fragments inside the block
+    uint8_t queue_index = fragments_queue->end;
+    for (uint8_t i=0;i<fragments_queue->size;i++) {
+        wtp_tx_fragment_t* fragment = WIO_QUEUE_AT(fragments_queue, wtp_tx_fragment_t, queue_index);
+        //Fragment range relative to current sequence number
+        uint16_t rel_fragment_begin = fragment->_seq_num-self->_seq_num;
+        uint16_t rel_fragment_end = rel_fragment_begin+fragment->_size;
+
+        //Fragments after the block
+        if (rel_fragment_begin>=rel_block_end)
+            break;
+        //Fragment inside the block
+        if ((rel_fragment_begin>=rel_block_begin)&&(rel_fragment_end<=rel_block_end)) {
+            fragment->_sacked = true;
+            fragment->_need_send = false;
+            fragment->_sent = 0;
+        }
+
+        //Update queue index
+        queue_index++;
+        if (queue_index>=fragments_queue->capacity)
+            queue_index = 0;
+    }
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_tx_handle_timeout(
+    wtp_tx_ctrl_t* self,
+    wtp_tx_read_info_t** _read_info
+) {
+    //Fragments queue
+    wio_queue_t* fragments_queue = &self->_fragments_queue;
+    //READ OpSpec information queue
+    wio_queue_t* read_info_queue = &self->_read_info_queue;
+    //Number of Reads to request
+    uint16_t n_reads = 0;
+
+    //Mark data fragments not yet acknowledged for retransmission
+    uint8_t queue_index = fragments_queue->end;
+    for (uint8_t i=0;i<fragments_queue->size;i++) {
+        wtp_tx_fragment_t* fragment = WIO_QUEUE_AT(fragments_queue, wtp_tx_fragment_t, queue_index);
+
+        //Received by the other side out of order; no need to retransmit
+        if (!fragment->_sacked) {
+            fragment->_need_send = true;
+            fragment->_sent = 0;
+            n_reads++;
+        }
+
+        //Update queue index
+        queue_index++;
+        if (queue_index>=fragments_queue->capacity)
+            queue_index = 0;
+    }
+
+    //Pending Reads (Requested Reads may be lost or used up while the window is full)
+    uint16_t n_pending_reads = 0;
+    while (read_info_queue->size>0) {
+        wtp_tx_read_info_t read_info;
+
+        WIO_TRY(wio_queue_pop(read_info_queue, &read_info))
+        n_pending_reads += read_info._n_reads;
+    }
+    //Request at least one Read for message data not fragmented yet
+    if ((n_pending_reads==0)&&(self->_msg_begin_pos!=self->_msg_buf.pos_b))
+        n_pending_reads = 1;
+    n_reads += n_pending_reads;
+
+    //Back off retransmission timeout
+    if (self->_backoff<WTP_TX_BACKOFF_MAX)
+        self->_backoff++;
+
+    //Nothing to request
+    if (n_reads==0) {
+        WIO_RETURN(_read_info, NULL)
+        return WIO_OK;
+    }
+
+    //Create READ OpSpec information
+    wtp_tx_read_info_t read_info;
+    read_info._size = self->_read_size;
+    read_info._n_reads = (uint8_t)WIO_MIN(n_reads, UINT8_MAX);
+    //Push into READ information queue
+    WIO_TRY(wio_queue_push(read_info_queue, &read_info))
+
+    //Return READ information
+    WIO_RETURN(_read_info, WIO_QUEUE_BEGIN(read_info_queue, wtp_tx_read_info_t))
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_tx_save(
+    wtp_tx_ctrl_t* self,
+    wtp_tx_state_t* state
+) {
+    //Begin of the oldest message not acknowledged
+    uint16_t msg_seq = self->_msg_begin_seq;
+    //Oldest message is already fragmented; its begin is known from its end
+    if (self->_msg_ends_queue.size>0) {
+        wio_buf_t* msg_buf = WIO_INST_PTR(wio_buf_t);
+        uint16_t msg_size;
+
+        *msg_buf = self->_msg_buf;
+        WIO_TRY(wtp_read_msg(msg_buf, &msg_size, NULL))
+        msg_seq = *WIO_QUEUE_END((&self->_msg_ends_queue), uint16_t)-msg_size;
+    }
+
+    state->_seq_num = self->_seq_num;
+    state->_msg_seq = msg_seq;
+    state->_msg_pos_a = self->_msg_buf.pos_a;
+    state->_msg_pos_b = self->_msg_buf.pos_b;
+    state->_req_uplink_id = self->_req_uplink_id;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_tx_restore(
+    wtp_tx_ctrl_t* self,
+    wtp_tx_state_t* state,
+    uint8_t* _n_msgs,
+    wtp_tx_read_info_t** _read_info
+) {
+    wio_buf_t* msg_buf = &self->_msg_buf;
+    //READ information queue
+    wio_queue_t* read_info_queue = &self->_read_info_queue;
+    //Acknowledged position in the oldest message
+    uint16_t msg_acked = state->_seq_num-state->_msg_seq;
+
+    //Cursors outside of message buffer
+    if ((state->_msg_pos_a>msg_buf->size)||(state->_msg_pos_b>msg_buf->size))
+        return WIO_ERR_INVALID;
+
+    //Drop data fragments, message ends and Reads
+    while (self->_fragments_queue.size>0)
+        WIO_TRY(wio_queue_pop(&self->_fragments_queue, NULL))
+    while (self->_msg_ends_queue.size>0)
+        WIO_TRY(wio_queue_pop(&self->_msg_ends_queue, NULL))
+    while (read_info_queue->size>0)
+        WIO_TRY(wio_queue_pop(read_info_queue, NULL))
+
+    //Fragment again from the acknowledged sequence number
+    msg_buf->pos_a = state->_msg_pos_a;
+    msg_buf->pos_b = state->_msg_pos_b;
+    self->_seq_num = state->_seq_num;
+    self->_msg_begin_seq = state->_msg_seq;
+    self->_msg_begin_pos = state->_msg_pos_a;
+    self->_msg_fragmented = msg_acked;
+    self->_backoff = 0;
+    self->_req_uplink_id = state->_req_uplink_id+WTP_TX_REQ_ID_SKIP;
+
+    //Message buffer (Shallow copy)
+    wio_buf_t* msgs = WIO_INST_PTR(wio_buf_t);
+    *msgs = *msg_buf;
+    //Number of messages and Reads needed for them
+    uint8_t n_msgs = 0;
+    uint16_t n_reads = 0;
+
+    while (msgs->pos_a!=msgs->pos_b) {
+        uint16_t msg_size;
+
+        //More messages than the transmit control holds
+        if (n_msgs>=read_info_queue->capacity)
+            return WIO_ERR_INVALID;
+        WIO_TRY(wtp_read_msg(msgs, &msg_size, NULL))
+
+        //Oldest message partly acknowledged
+        if ((n_msgs==0)&&(msg_acked>0)) {
+            uint16_t msg_end = state->_msg_seq+msg_size;
+
+            if (msg_acked>=msg_size)
+                return WIO_ERR_INVALID;
+            WIO_TRY(wio_queue_push(&self->_msg_ends_queue, &msg_end))
+            n_reads += wtp_tx_count_reads(self, msg_size-msg_acked, wtp_tx_header_size(self, 0));
+        } else
+            n_reads += wtp_tx_count_reads(self, msg_size, wtp_tx_header_size(self, msg_size));
+        n_msgs++;
+    }
+    //Data acknowledged without a message
+    if ((n_msgs==0)&&(msg_acked>0))
+        return WIO_ERR_INVALID;
+    WIO_RETURN(_n_msgs, n_msgs)
+
+    //Nothing to request
+    if (n_reads==0) {
+        WIO_RETURN(_read_info, NULL)
+        return WIO_OK;
+    }
+
+    //Create READ OpSpec information for all messages
+    wtp_tx_read_info_t read_info;
+    read_info._size = self->_read_size;
+    read_info._n_reads = (uint8_t)WIO_MIN(n_reads, UINT8_MAX);
+    //Push into READ information queue
+    WIO_TRY(wio_queue_push(read_info_queue, &read_info))
+
+    //Return READ information
+    WIO_RETURN(_read_info, WIO_QUEUE_BEGIN(read_info_queue, wtp_tx_read_info_t))
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_tx_restart(
+    wtp_tx_ctrl_t* self,
+    wtp_tx_read_info_t** _read_info
+) {
+    wtp_tx_state_t state;
+
+    WIO_TRY(wtp_tx_save(self, &state))
+    //Nothing of the oldest message is acknowledged
+    state._seq_num = state._msg_seq;
+
+    return wtp_tx_restore(self, &state, NULL, _read_info);
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_write_varint(
+    wio_buf_t* buf,
+    uint16_t value
+) {
+    //Groups of 7 bits except for the last one
+    while (value>=0x80) {
+        WIO_TRY(wio_ensure_write(buf, 1))
+        wio_write_u8(buf, (uint8_t)(value|0x80));
+        value >>= 7;
+    }
+    //Last group
+    WIO_TRY(wio_ensure_write(buf, 1))
+    wio_write_u8(buf, (uint8_t)value);
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_read_varint(
+    wio_buf_t* buf,
+    uint16_t* _value
+) {
+    uint16_t value = 0;
+
+    //At most 3 groups for a 16-bit integer
+    for (uint8_t shift=0;shift<21;shift+=7) {
+        WIO_TRY(wio_ensure(buf, 1))
+        uint8_t byte = wio_read_u8(buf);
+        value |= (uint16_t)(byte&0x7f)<<shift;
+
+        //Last group
+        if (!(byte&0x80)) {
+            WIO_RETURN(_value, value)
+            return WIO_OK;
+        }
+    }
+
+    return WIO_ERR_INVALID;
+}
+
+/**
+ * {@inheritDoc}
+ */
+uint16_t wtp_seq_resolve(
+    uint8_t low,
+    uint16_t base
+) {
+    //Signed offset of lowest 8 bits from base
+    return base+(int8_t)(uint8_t)(low-(uint8_t)base);
+}
+
 /**
  * {@inheritDoc}
  */
@@ -322,9 +902,13 @@ wtp_status_t wtp_rx_init(
     self->_seq_num = 0;
     //Window size
     self->_window_size = window_size;
+    self->_adv_window_size = window_size;
 
-    //Message data buffer
+    //Message data ring
     WIO_TRY(wio_buf_alloc_init(&self->_msg_data_buf, msg_data_size))
+    //No message being received
+    self->_msg_data = NULL;
+    self->_msg_recvd = 0;
 
     //Data fragments buffer
     WIO_TRY(wio_buf_alloc_init(&self->_fragments_buf, fragments_size))
@@ -361,6 +945,133 @@ wtp_status_t wtp_rx_fini(
     return WIO_OK;
 }
 
+/**
+ * @brief Append in-order data to the message being received.
+ *
+ * Memory for size and data of a message is allocated from the message data ring
+ * when the first byte of the message arrives.
+ *
+ * @param self WTP receive control instance.
+ * @param data Data.
+ * @param size Data size.
+ * @param _n_msgs Incremented when the message is fully received.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_rx_append_data(
+    wtp_rx_ctrl_t* self,
+    uint8_t* data,
+    uint16_t size,
+    uint8_t* _n_msgs
+) {
+    //Current message information
+    if (self->_msg_info_begin>=self->_msg_info_size)
+        return WIO_ERR_INVALID;
+    wtp_rx_msg_info_t* current_msg_info = self->_msg_info_store+self->_msg_info_begin;
+
+    //Begin of current message
+    if (!self->_msg_data) {
+        wio_buf_t* msg_data_buf = &self->_msg_data_buf;
+
+        //Data does not begin a declared message
+        if (current_msg_info->_begin!=self->_seq_num)
+            return WIO_ERR_INVALID;
+        //All messages read; restart from the beginning of the ring
+        if (msg_data_buf->pos_a==msg_data_buf->pos_b)
+            msg_data_buf->pos_a = msg_data_buf->pos_b = 0;
+
+        //Message data ring before allocation
+        wio_buf_t msg_data_buf_before = *msg_data_buf;
+        //Allocate memory for message size and message data
+        uint8_t* msg_size_mem;
+        WIO_TRY(wio_alloc(msg_data_buf, 2, &msg_size_mem))
+        if (wio_alloc(msg_data_buf, current_msg_info->_size, &self->_msg_data)!=WIO_OK) {
+            //Release message size memory
+            *msg_data_buf = msg_data_buf_before;
+            self->_msg_data = NULL;
+            return WIO_ERR_NO_MEMORY;
+        }
+        //Write message size
+        memcpy(msg_size_mem, &current_msg_info->_size, 2);
+        self->_msg_recvd = 0;
+    }
+
+    //Data exceeds current message
+    if (self->_msg_recvd+size>current_msg_info->_size)
+        return WIO_ERR_INVALID;
+    //Copy data
+    memcpy(self->_msg_data+self->_msg_recvd, data, size);
+    self->_msg_recvd += size;
+    //Update sequence number
+    self->_seq_num += size;
+
+    //End of current message
+    if (self->_msg_recvd==current_msg_info->_size) {
+        //Release current item
+        current_msg_info->_in_use = false;
+        //Update begin of linked list
+        self->_msg_info_begin = current_msg_info->_next;
+        //No message being received
+        self->_msg_data = NULL;
+        //Update number of messages fully received
+        (*_n_msgs)++;
+    }
+
+    return WIO_OK;
+}
+
+/**
+ * @brief Append staged data fragments at the receive sequence number to message data ring.
+ *
+ * @param self WTP receive control instance.
+ * @param release Release the first fragment that can't be placed instead of keeping it staged.
+ * @param _n_msgs Number of messages fully received, increased by new messages.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+static wtp_status_t wtp_rx_append_fragments(
+    wtp_rx_ctrl_t* self,
+    bool release,
+    uint8_t* _n_msgs
+) {
+    //Data fragments buffer
+    wio_buf_t* fragments_buf = &self->_fragments_buf;
+    //Data fragment
+    wtp_rx_fragment_t* fragment = self->_fragments_begin;
+
+    while (fragment&&(fragment->_seq_num==self->_seq_num)) {
+        bool appended = wtp_rx_append_data(self, fragment->_data, fragment->_size, _n_msgs)==WIO_OK;
+        //Fragment can't be placed yet; keep it staged
+        if (!appended&&!release)
+            break;
+        //Set assembled flag (Also when released; the data is received again in order)
+        fragment->_assembled = true;
+        //Move to next fragment
+        fragment = fragment->_next;
+        if (!appended)
+            break;
+    }
+    //Update begin of data fragments linked list
+    self->_fragments_begin = fragment;
+
+    //Remove assembled data fragments
+    while (fragments_buf->pos_a!=fragments_buf->pos_b) {
+        //No fragment fits at the end of buffer; move to begin of the buffer
+        if (fragments_buf->size-fragments_buf->pos_a<sizeof(wtp_rx_fragment_t)) {
+            fragments_buf->pos_a = 0;
+            continue;
+        }
+        //Next data fragment in buffer
+        fragment = (wtp_rx_fragment_t*)(fragments_buf->buffer+fragments_buf->pos_a);
+
+        //Already assembled; release fragment memory
+        if (fragment->_assembled)
+            WIO_TRY(wio_free(fragments_buf, sizeof(wtp_rx_fragment_t)+fragment->_size))
+        else
+            break;
+    }
+
+    return WIO_OK;
+}
+
 /**
  * {@inheritDoc}
  */
@@ -379,6 +1090,22 @@ wtp_status_t wtp_rx_handle_packet(
     if (!((rel_pkt_begin<rel_pkt_end)&&(rel_pkt_end<=self->_window_size)))
         return WIO_ERR_INVALID;
 
+    //Data fragments buffer
+    wio_buf_t* fragments_buf = &self->_fragments_buf;
+    //Data fragments before and after insertion position
+    wtp_rx_fragment_t* fragment_a = NULL;
+    wtp_rx_fragment_t* fragment_b = self->_fragments_begin;
+
+    //Find position for insertion
+    //(Sequence numbers are compared relative to current sequence number, so they wrap around correctly)
+    while (fragment_b&&((uint16_t)(fragment_b->_seq_num-self->_seq_num)<rel_pkt_begin)) {
+        fragment_a = fragment_b;
+        fragment_b = fragment_b->_next;
+    }
+    //Drop data packet if it overlaps with other data fragments
+    if (fragment_b&&(rel_pkt_end>(uint16_t)(fragment_b->_seq_num-self->_seq_num)))
+        return WIO_ERR_INVALID;
+
     wtp_rx_msg_info_t* msg_info_store = self->_msg_info_store;
     uint8_t msg_info_size = self->_msg_info_size;
     //Begin of message
@@ -386,152 +1113,313 @@ wtp_status_t wtp_rx_handle_packet(
         //Message information before and after insertion position
         uint8_t before_msg_info = self->_msg_info_size;
         uint8_t after_msg_info = self->_msg_info_begin;
+        //Begin of message being received (No message information begins before it)
+        uint16_t msg_base = self->_seq_num-(self->_msg_data?self->_msg_recvd:0);
+        //Packet begin relative to begin of message being received
+        uint16_t rel_msg_begin = seq_num-msg_base;
 
         //Find position for insertion
-        while ((after_msg_info<msg_info_size)&&(msg_info_store[after_msg_info]._begin<seq_num)) {
+        while ((after_msg_info<msg_info_size)
+            &&((uint16_t)(msg_info_store[after_msg_info]._begin-msg_base)<rel_msg_begin)) {
             before_msg_info = after_msg_info;
             after_msg_info = msg_info_store[after_msg_info]._next;
         }
+        wtp_rx_msg_info_t* next_msg_info = (after_msg_info<msg_info_size)?(msg_info_store+after_msg_info):NULL;
+
+        //Same message declared by an earlier copy of the packet
+        if (next_msg_info&&(next_msg_info->_begin==seq_num)&&(next_msg_info->_size==new_msg_size)) {
         //Drop new message packet if it overlaps with declared messages
-        if ((after_msg_info<msg_info_size)&&(seq_num+new_msg_size>msg_info_store[after_msg_info]._begin))
+        } else if (next_msg_info&&(rel_msg_begin+new_msg_size>(uint16_t)(next_msg_info->_begin-msg_base))) {
             return WIO_ERR_INVALID;
+        } else {
+            //Look for spare message information item
+            uint8_t index;
+            for (index=0;index<msg_info_size;index++)
+                if (!msg_info_store[index]._in_use)
+                    break;
+            //No item available
+            if (index>=msg_info_size)
+                return WIO_ERR_NO_MEMORY;
+            //Initialize message information item
+            msg_info_store[index]._in_use = true;
+            msg_info_store[index]._begin = seq_num;
+            msg_info_store[index]._size = new_msg_size;
+            //Insert message information
+            if (before_msg_info<msg_info_size)
+                msg_info_store[before_msg_info]._next = index;
+            else
+                self->_msg_info_begin = index;
+            msg_info_store[index]._next = after_msg_info;
+        }
+    }
 
-        //Look for spare message information item
-        uint8_t index;
-        for (index=0;index<msg_info_size;index++)
-            if (!msg_info_store[index]._in_use)
-                break;
-        //No item available
-        if (index>=msg_info_size)
-            return WIO_ERR_NO_MEMORY;
-        //Initialize message information item
-        msg_info_store[index]._in_use = true;
-        msg_info_store[index]._begin = seq_num;
-        msg_info_store[index]._size = new_msg_size;
-        //Insert message information
-        if (before_msg_info<msg_info_size)
-            msg_info_store[before_msg_info]._next = index;
+    //Number of new messages
+    uint8_t n_msgs = 0;
+
+    //Out-of-order packet; stage data as a data fragment
+    if (seq_num!=self->_seq_num) {
+        //New data fragment
+        wtp_rx_fragment_t* new_fragment;
+        uint8_t* new_fragment_data;
+
+        //Unused space at the end of data fragments buffer
+        uint16_t tail_size = fragments_buf->size-fragments_buf->pos_b;
+        //Allocation will wrap around; fill unused space with an assembled padding fragment
+        //(Fragments are released in allocation order, so stale data must not be read as a fragment)
+        if ((tail_size<sizeof(wtp_rx_fragment_t)+size)&&(tail_size>=sizeof(wtp_rx_fragment_t))) {
+            wtp_rx_fragment_t* padding = (wtp_rx_fragment_t*)(fragments_buf->buffer+fragments_buf->pos_b);
+
+            padding->_size = tail_size-sizeof(wtp_rx_fragment_t);
+            padding->_assembled = true;
+        }
+        //Allocate memory for new data fragment
+        WIO_TRY(wio_alloc(
+            fragments_buf,
+            sizeof(wtp_rx_fragment_t)+size,
+            &new_fragment
+        ))
+        //New fragment data memory
+        new_fragment_data = (uint8_t*)new_fragment+sizeof(wtp_rx_fragment_t);
+        //Initialize data fragment
+        new_fragment->_seq_num = seq_num;
+        new_fragment->_data = new_fragment_data;
+        new_fragment->_size = size;
+        new_fragment->_assembled = false;
+        //Copy fragment data
+        memcpy(new_fragment_data, data, size);
+        //Insert data fragment
+        if (fragment_a)
+            fragment_a->_next = new_fragment;
         else
-            self->_msg_info_begin = index;
-        msg_info_store[index]._next = after_msg_info;
+            self->_fragments_begin = new_fragment;
+        new_fragment->_next = fragment_b;
+
+        //No new data in order
+        WIO_RETURN(_n_msgs, 0)
+        return WIO_OK;
     }
 
-    //Data fragments buffer
-    wio_buf_t* fragments_buf = &self->_fragments_buf;
-    //Data fragments before and after insertion position
-    wtp_rx_fragment_t* fragment_a = NULL;
-    wtp_rx_fragment_t* fragment_b = self->_fragments_begin;
-    //New data fragment
-    wtp_rx_fragment_t* new_fragment;
-    uint8_t* new_fragment_data;
+    //In-order packet; place data straight into message data ring
+    WIO_TRY(wtp_rx_append_data(self, data, size, &n_msgs))
 
-    //Find position for insertion
-    while (fragment_b&&(fragment_b->_seq_num<seq_num)) {
-        fragment_a = fragment_b;
-        fragment_b = fragment_b->_next;
-    }
-    //Drop data packet if it overlaps with other data fragments
-    if (fragment_b&&(seq_num+size>fragment_b->_seq_num))
-        return WIO_ERR_INVALID;
+    //Append staged data fragments that are now consecutive
+    //(Fragments that can't be placed yet stay staged until messages are read)
+    WIO_TRY(wtp_rx_append_fragments(self, false, &n_msgs))
 
-    //Allocate memory for new data fragment
-    WIO_TRY(wio_alloc(
-        fragments_buf,
-        sizeof(wtp_rx_fragment_t)+size,
-        &new_fragment
-    ))
-    //New fragment data memory
-    new_fragment_data = (uint8_t*)new_fragment+sizeof(wtp_rx_fragment_t);
-    //Initialize data fragment
-    new_fragment->_seq_num = seq_num;
-    new_fragment->_data = new_fragment_data;
-    new_fragment->_size = size;
-    new_fragment->_assembled = false;
-    //Copy fragment data
-    memcpy(new_fragment_data, data, size);
-    //Insert data fragment
-    if (fragment_a)
-        fragment_a->_next = new_fragment;
-    else
-        self->_fragments_begin = new_fragment;
-    new_fragment->_next = fragment_b;
+    //Return value
+    WIO_RETURN(_n_msgs, n_msgs)
 
-    //Message data buffer
-    wio_buf_t* msg_data_buf = &self->_msg_data_buf;
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_rx_assemble(
+    wtp_rx_ctrl_t* self,
+    uint8_t* _n_msgs
+) {
     //Number of new messages
     uint8_t n_msgs = 0;
-    //Data fragments linked list item
-    fragment_a = self->_fragments_begin;
-
-    //Move acknowledged message data
-    if (msg_data_buf->pos_b!=msg_data_buf->pos_a)
-        memmove(
-            msg_data_buf->buffer,
-            msg_data_buf->buffer+msg_data_buf->pos_a,
-            msg_data_buf->pos_b-msg_data_buf->pos_a
-        );
-    //Update read and write cursor position
-    msg_data_buf->pos_b -= msg_data_buf->pos_a;
-    msg_data_buf->pos_a = 0;
-
-    while (fragment_a) {
-        //Message begin check
-        if (self->_msg_info_begin<msg_info_size) {
-            wtp_rx_msg_info_t* current_msg_info = msg_info_store+self->_msg_info_begin;
-
-            if (self->_seq_num==current_msg_info->_begin) {
-                //Write size of next message
-                WIO_TRY(wio_write(msg_data_buf, &current_msg_info->_size, 2))
-            }
-        }
 
-        //Append consecutive data fragments
-        if (fragment_a->_seq_num==self->_seq_num) {
-            //Copy fragment data
-            WIO_TRY(wio_write(msg_data_buf, fragment_a->_data, fragment_a->_size))
-            //Update sequence number
-            self->_seq_num += fragment_a->_size;
+    //Release fragments that still can't be placed, so they are no longer acknowledged selectively
+    WIO_TRY(wtp_rx_append_fragments(self, true, &n_msgs))
+    //Return value
+    WIO_RETURN(_n_msgs, n_msgs)
 
-            //Set assembled flag
-            fragment_a->_assembled = true;
-        } else
-            break;
+    return WIO_OK;
+}
 
-        //Message end check
-        if (self->_msg_info_begin<msg_info_size) {
-            wtp_rx_msg_info_t* current_msg_info = msg_info_store+self->_msg_info_begin;
-            uint16_t current_msg_end = current_msg_info->_begin+current_msg_info->_size;
-
-            if (self->_seq_num==current_msg_end) {
-                //Release current item
-                current_msg_info->_in_use = false;
-                //Update begin of linked list
-                self->_msg_info_begin = current_msg_info->_next;
-                //Update number of messages fully received
-                n_msgs++;
-            }
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_rx_get_sack(
+    wtp_rx_ctrl_t* self,
+    wtp_sack_block_t* blocks,
+    uint8_t* _n_blocks
+) {
+    //Number of blocks
+    uint8_t n_blocks = 0;
+    //Current block
+    wtp_sack_block_t* block = NULL;
+
+    //Merge consecutive data fragments into blocks
+    for (wtp_rx_fragment_t* fragment=self->_fragments_begin;fragment;fragment=fragment->_next) {
+        //Extend current block
+        //(A block smaller than the received range only causes needless retransmission)
+        if (block&&(fragment->_seq_num==(uint16_t)(block->_begin+block->_size))
+            &&(block->_size+fragment->_size<=UINT8_MAX)) {
+            block->_size += fragment->_size;
+            continue;
         }
+        //No more blocks available
+        if (n_blocks>=WTP_SACK_BLOCKS_MAX)
+            break;
+        //Begin new block
+        block = blocks+n_blocks;
+        block->_begin = fragment->_seq_num;
+        block->_size = fragment->_size;
+        n_blocks++;
+    }
 
-        //Move to next fragment
-        fragment_a = fragment_a->_next;
+    //Return number of blocks
+    WIO_RETURN(_n_blocks, n_blocks)
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_rx_get_window(
+    wtp_rx_ctrl_t* self,
+    uint16_t* _window_size
+) {
+    wio_buf_t* fragments_buf = &self->_fragments_buf;
+    //End of staged data relative to current sequence number
+    uint16_t staged_end = 0;
+    //Largest free space in data fragments buffer
+    uint16_t free_size = wio_alloc_max(fragments_buf);
+    //Largest free space in message data ring
+    uint16_t ring_free_size = wio_alloc_max(&self->_msg_data_buf);
+    //Data the message data ring can still take
+    uint16_t ring_size = 0;
+
+    for (wtp_rx_fragment_t* fragment=self->_fragments_begin;fragment;fragment=fragment->_next)
+        staged_end = fragment->_seq_num+fragment->_size-self->_seq_num;
+    //Data size of the largest fragment
+    free_size = (free_size>sizeof(wtp_rx_fragment_t))?free_size-sizeof(wtp_rx_fragment_t):0;
+    //Rest of the message being received (Already allocated) and data of a new message after its size
+    if (self->_msg_data)
+        ring_size = self->_msg_info_store[self->_msg_info_begin]._size-self->_msg_recvd;
+    ring_size += (ring_free_size>2)?ring_free_size-2:0;
+
+    //Return window size
+    //(Never 0; the byte the other side may still send probes the window until it opens again)
+    uint16_t window_size = WIO_MIN(staged_end+free_size, self->_window_size);
+    window_size = WIO_MIN(window_size, ring_size);
+    WIO_RETURN(_window_size, (window_size>0)?window_size:1)
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_rx_read_msg(
+    wtp_rx_ctrl_t* self,
+    wio_buf_t* msg_buf
+) {
+    wio_buf_t* msg_data_buf = &self->_msg_data_buf;
+    //Message data ring read cursor
+    uint16_t msg_data_pos_a = msg_data_buf->pos_a;
+
+    //No message in ring
+    if (msg_data_pos_a==msg_data_buf->pos_b)
+        return WIO_ERR_EMPTY;
+    //Read next message
+    uint16_t msg_size;
+    uint8_t* msg_data;
+    WIO_TRY(wtp_read_msg(msg_data_buf, &msg_size, &msg_data))
+    //Message not fully received yet
+    if (msg_data==self->_msg_data) {
+        msg_data_buf->pos_a = msg_data_pos_a;
+        return WIO_ERR_EMPTY;
     }
-    //Update begin of data fragments linked list
-    self->_fragments_begin = fragment_a;
 
-    //Remove assembled data fragments
-    while (fragments_buf->pos_a!=fragments_buf->pos_b) {
-        //Next data fragment in buffer
-        fragment_a = (wtp_rx_fragment_t*)(fragments_buf->buffer+fragments_buf->pos_a);
+    //Initialize message buffer
+    WIO_TRY(wio_buf_init(msg_buf, msg_data, msg_size))
 
-        //Already assembled; release fragment memory
-        if (fragment_a->_assembled)
-            WIO_TRY(wio_free(fragments_buf, sizeof(wtp_rx_fragment_t)+fragment_a->_size))
-        else
-            break;
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_rx_save(
+    wtp_rx_ctrl_t* self,
+    wtp_rx_state_t* state
+) {
+    wio_buf_t* msg_data_buf = &self->_msg_data_buf;
+
+    state->_seq_num = self->_seq_num;
+    state->_msg_pos_a = msg_data_buf->pos_a;
+    state->_msg_pos_b = msg_data_buf->pos_b;
+    //Message being received
+    if (self->_msg_data) {
+        state->_msg_data_pos = self->_msg_data-msg_data_buf->buffer;
+        state->_msg_recvd = self->_msg_recvd;
+        state->_msg_size = self->_msg_info_store[self->_msg_info_begin]._size;
+    } else
+        state->_msg_data_pos = state->_msg_recvd = state->_msg_size = 0;
+
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_rx_restore(
+    wtp_rx_ctrl_t* self,
+    wtp_rx_state_t* state
+) {
+    wio_buf_t* msg_data_buf = &self->_msg_data_buf;
+
+    //Cursors or message being received outside of message data ring
+    if ((state->_msg_pos_a>msg_data_buf->size)||(state->_msg_pos_b>msg_data_buf->size))
+        return WIO_ERR_INVALID;
+    if (state->_msg_size&&((state->_msg_recvd>state->_msg_size)
+        ||(state->_msg_data_pos+state->_msg_size>msg_data_buf->size)||(self->_msg_info_size==0)))
+        return WIO_ERR_INVALID;
+
+    //Data received out of order is dropped
+    WIO_TRY(wtp_rx_restart(self, state->_seq_num))
+    //Messages not read yet
+    msg_data_buf->pos_a = state->_msg_pos_a;
+    msg_data_buf->pos_b = state->_msg_pos_b;
+
+    //Message being received
+    if (state->_msg_size) {
+        wtp_rx_msg_info_t* msg_info = self->_msg_info_store;
+
+        msg_info->_in_use = true;
+        msg_info->_begin = state->_seq_num-state->_msg_recvd;
+        msg_info->_size = state->_msg_size;
+        msg_info->_next = self->_msg_info_size;
+        self->_msg_info_begin = 0;
+
+        self->_msg_data = msg_data_buf->buffer+state->_msg_data_pos;
+        self->_msg_recvd = state->_msg_recvd;
     }
 
-    //Return value
-    WIO_RETURN(_n_msgs, n_msgs)
+    return WIO_OK;
+}
+
+/**
+ * {@inheritDoc}
+ */
+wtp_status_t wtp_rx_restart(
+    wtp_rx_ctrl_t* self,
+    uint16_t seq_num
+) {
+    //Sequence number
+    self->_seq_num = seq_num;
+
+    //Message data ring
+    self->_msg_data_buf.pos_a = self->_msg_data_buf.pos_b = 0;
+    //No message being received
+    self->_msg_data = NULL;
+    self->_msg_recvd = 0;
+
+    //Data fragments buffer
+    self->_fragments_buf.pos_a = self->_fragments_buf.pos_b = 0;
+    //Begin of data fragments linked list
+    self->_fragments_begin = NULL;
+
+    //Message information
+    for (uint8_t i=0;i<self->_msg_info_size;i++)
+        self->_msg_info_store[i]._in_use = false;
+    self->_msg_info_begin = self->_msg_info_size;
 
     return WIO_OK;
 }
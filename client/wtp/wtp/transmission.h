@@ -4,6 +4,31 @@
 #include <wio.h>
 #include "defs.h"
 
+/// Borrowed message flag of message size in message buffer
+static const uint16_t WTP_TX_MSG_REF = 0x8000;
+/// Maximum message size
+static const uint16_t WTP_TX_MSG_MAX = 0x7fff;
+/// Maximum retransmission timeout backoff (Timeout is doubled at most 3 times)
+static const uint8_t WTP_TX_BACKOFF_MAX = 3;
+/// Request uplink IDs skipped on restoring (Requests after the last commit may repeat EPCs the server just saw)
+static const uint8_t WTP_TX_REQ_ID_SKIP = 0x80;
+/// Minimum change of receive window size to advertise
+static const uint16_t WTP_RX_WINDOW_STEP = 16;
+/// Maximum window size for compact framing (8-bit sequence numbers are resolved within half of their range)
+static const uint16_t WTP_COMPACT_WINDOW_MAX = 128;
+/// Maximum number of blocks in a selective acknowledgement (So that the packet fits into EPC)
+#define WTP_SACK_BLOCKS_MAX 2
+/// Maximum control packet size (Selective acknowledgement with most blocks)
+#define WTP_PKT_CTRL_MAX (4+3*WTP_SACK_BLOCKS_MAX)
+
+/// WTP selective acknowledgement block type
+typedef struct wtp_sack_block {
+    /// Begin sequence number
+    uint16_t _begin;
+    /// Size
+    uint8_t _size;
+} wtp_sack_block_t;
+
 /// WTP READ OpSpec information type
 typedef struct wtp_tx_read_info {
     /// Read size
@@ -26,6 +51,10 @@ typedef struct wtp_tx_fragment {
 
     /// Need send flag
     bool _need_send;
+    /// Size already sent (Fragment is resent in pieces when it doesn't fit into a READ OpSpec)
+    uint8_t _sent;
+    /// Selectively acknowledged flag (Fragment is never retransmitted)
+    bool _sacked;
 } wtp_tx_fragment_t;
 
 /// WTP sliding window-based transmit control type
@@ -38,6 +67,8 @@ typedef struct wtp_tx_ctrl {
     uint16_t _timeout;
     /// READ size
     uint8_t _read_size;
+    /// Data packet framing (Standard until the server accepts compact framing)
+    wtp_framing_t _framing;
 
     /// Send packets buffer
     wio_buf_t _pkt_buf;
@@ -62,6 +93,13 @@ typedef struct wtp_tx_ctrl {
     wio_queue_t _read_info_queue;
     /// Message ends sequence number queue
     wio_queue_t _msg_ends_queue;
+
+    /// Uplink retransmission timer
+    wio_timer_t _timer;
+    /// Retransmission timeout backoff (Number of consecutive timeouts)
+    uint8_t _backoff;
+    /// Request uplink packet ID
+    uint8_t _req_uplink_id;
 } wtp_tx_ctrl_t;
 
 /// WTP received data fragment type
@@ -98,9 +136,15 @@ typedef struct wtp_rx_ctrl {
     uint16_t _seq_num;
     /// Sliding window size
     uint16_t _window_size;
+    /// Window size advertised to the other side
+    uint16_t _adv_window_size;
 
-    /// Acknowledged message data buffer
+    /// Message data ring (Size and data of each message, in sequence order)
     wio_buf_t _msg_data_buf;
+    /// Data of the message being received
+    uint8_t* _msg_data;
+    /// Received size of the message being received
+    uint16_t _msg_recvd;
 
     /// Data fragments buffer
     wio_buf_t _fragments_buf;
@@ -115,6 +159,36 @@ typedef struct wtp_rx_ctrl {
     uint8_t _msg_info_begin;
 } wtp_rx_ctrl_t;
 
+/// WTP transmit control state kept in a checkpoint
+typedef struct wtp_tx_state {
+    /// Acknowledged sequence number
+    uint16_t _seq_num;
+    /// Begin sequence number of the oldest message not acknowledged
+    uint16_t _msg_seq;
+    /// Message buffer read cursor (Oldest message not acknowledged)
+    uint16_t _msg_pos_a;
+    /// Message buffer write cursor
+    uint16_t _msg_pos_b;
+    /// Request uplink ID
+    uint8_t _req_uplink_id;
+} wtp_tx_state_t;
+
+/// WTP receive control state kept in a checkpoint
+typedef struct wtp_rx_state {
+    /// Sequence number
+    uint16_t _seq_num;
+    /// Message data ring read cursor
+    uint16_t _msg_pos_a;
+    /// Message data ring write cursor
+    uint16_t _msg_pos_b;
+    /// Ring position of data of the message being received
+    uint16_t _msg_data_pos;
+    /// Received size of the message being received
+    uint16_t _msg_recvd;
+    /// Size of the message being received (0 if no message is being received)
+    uint16_t _msg_size;
+} wtp_rx_state_t;
+
 /**
  * @brief Initialize WTP transmit control type.
  *
@@ -152,9 +226,12 @@ extern wtp_status_t wtp_tx_fini(
 /**
  * @brief Begin construction of WTP packet.
  *
+ * The packet is only begun when the packet buffer can hold a control packet of
+ * any size, so that the packet is never left half-written in the buffer.
+ *
  * @param self WTP transmit control instance.
  * @param pkt_type Packet type.
- * @return WIO_ERR_OUT_OF_RANGE if exceeds packet buffer memory range, otherwise WIO_OK.
+ * @return WIO_ERR_NO_MEMORY if the packet buffer is nearly full, otherwise WIO_OK.
  */
 extern wtp_status_t wtp_tx_begin_packet(
     wtp_tx_ctrl_t* self,
@@ -174,6 +251,8 @@ extern wtp_status_t wtp_tx_end_packet(
 /**
  * @brief Add a new message to transmit control.
  *
+ * Message data is copied into the message buffer.
+ *
  * @param self WTP transmit control instance.
  * @param data Message data.
  * @param size Message size.
@@ -187,6 +266,38 @@ extern wtp_status_t wtp_tx_add_msg(
     wtp_tx_read_info_t** _read_info
 );
 
+/**
+ * @brief Add a new message borrowed from caller to transmit control.
+ *
+ * Only a reference to message data is stored in the message buffer,
+ * so data fragments point straight into caller memory.
+ * Message data must stay valid and unchanged until the message is acknowledged.
+ *
+ * @param self WTP transmit control instance.
+ * @param data Message data.
+ * @param size Message size.
+ * @param _read_info Used for returning Read OpSpec information object.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_tx_add_msg_ref(
+    wtp_tx_ctrl_t* self,
+    uint8_t* data,
+    uint16_t size,
+    wtp_tx_read_info_t** _read_info
+);
+
+/**
+ * @brief Get header size of data packet sent with current framing.
+ *
+ * @param self WTP transmit control instance.
+ * @param msg_size Message size for WTP_PKT_BEGIN_MSG, 0 for WTP_PKT_CONT_MSG.
+ * @return Header size.
+ */
+extern uint8_t wtp_tx_header_size(
+    wtp_tx_ctrl_t* self,
+    uint16_t msg_size
+);
+
 /**
  * @brief Make a new sending data fragment.
  *
@@ -204,6 +315,9 @@ extern wtp_status_t wtp_tx_make_fragment(
 /**
  * @brief Handle WTP acknowledgement.
  *
+ * Data acknowledged beyond fragmented data is skipped without being fragmented,
+ * as the other side may already have it when the state is restored from a checkpoint.
+ *
  * @param self WTP transmit control instance.
  * @param seq_num Sequence number.
  * @param _n_msgs Used for returning number of messages sent.
@@ -215,6 +329,129 @@ extern wtp_status_t wtp_tx_handle_ack(
     uint8_t* _n_msgs
 );
 
+/**
+ * @brief Handle WTP selective acknowledgement block.
+ *
+ * Data fragments inside the block were received by the other side out of order,
+ * so they are no longer retransmitted.
+ *
+ * @param self WTP transmit control instance.
+ * @param block Selective acknowledgement block.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_tx_handle_sack(
+    wtp_tx_ctrl_t* self,
+    wtp_sack_block_t* block
+);
+
+/**
+ * @brief Handle uplink retransmission timeout.
+ *
+ * All data fragments not yet acknowledged (Cumulatively or selectively) are marked for retransmission,
+ * and Reads still pending are merged into a single READ OpSpec information item
+ * to be requested again from the server.
+ *
+ * @param self WTP transmit control instance.
+ * @param _read_info Used for returning Read OpSpec information object (NULL if nothing to request).
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_tx_handle_timeout(
+    wtp_tx_ctrl_t* self,
+    wtp_tx_read_info_t** _read_info
+);
+
+/**
+ * @brief Save transmit control state into a checkpoint.
+ *
+ * Only cursors of the message buffer are saved; the buffer itself must be in memory
+ * that survives power loss. Data fragments in flight are not saved, since they are made again
+ * from the messages after restoring.
+ *
+ * @param self WTP transmit control instance.
+ * @param state Used for returning transmit control state.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_tx_save(
+    wtp_tx_ctrl_t* self,
+    wtp_tx_state_t* state
+);
+
+/**
+ * @brief Restore transmit control state from a checkpoint.
+ *
+ * Messages not acknowledged are fragmented again from the acknowledged sequence number,
+ * and Reads for all of them are merged into a single READ OpSpec information item.
+ *
+ * @param self WTP transmit control instance.
+ * @param state Transmit control state.
+ * @param _n_msgs Used for returning number of messages not acknowledged.
+ * @param _read_info Used for returning Read OpSpec information object (NULL if nothing to request).
+ * @return WIO_ERR_INVALID if the state doesn't fit the message buffer, error code if failed,
+ *     otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_tx_restore(
+    wtp_tx_ctrl_t* self,
+    wtp_tx_state_t* state,
+    uint8_t* _n_msgs,
+    wtp_tx_read_info_t** _read_info
+);
+
+/**
+ * @brief Send all messages not acknowledged again from the beginning of the oldest one.
+ *
+ * Used when the other side opens a new connection instead of resuming from a checkpoint,
+ * so it only has data from the beginning of a message.
+ *
+ * @param self WTP transmit control instance.
+ * @param _read_info Used for returning Read OpSpec information object (NULL if nothing to request).
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_tx_restart(
+    wtp_tx_ctrl_t* self,
+    wtp_tx_read_info_t** _read_info
+);
+
+/**
+ * @brief Write an unsigned variable-length integer.
+ *
+ * The integer is stored in groups of 7 bits, least significant group first;
+ * the highest bit of every byte but the last one is set.
+ *
+ * @param buf Buffer to write to.
+ * @param value Integer to write.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_write_varint(
+    wio_buf_t* buf,
+    uint16_t value
+);
+
+/**
+ * @brief Read an unsigned variable-length integer.
+ *
+ * @param buf Buffer to read from.
+ * @param _value Used for returning integer read.
+ * @return WIO_ERR_INVALID if the integer is longer than 16 bits, error code if reading failed,
+ *     otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_read_varint(
+    wio_buf_t* buf,
+    uint16_t* _value
+);
+
+/**
+ * @brief Resolve a sequence number from its lowest 8 bits.
+ *
+ * @param low Lowest 8 bits of the sequence number.
+ * @param base Base sequence number (The resolved sequence number is between
+ *     128 bytes before and 127 bytes after it).
+ * @return Resolved sequence number.
+ */
+extern uint16_t wtp_seq_resolve(
+    uint8_t low,
+    uint16_t base
+);
+
 /**
  * @brief Initialize WTP receive control type.
  *
@@ -246,6 +483,9 @@ extern wtp_status_t wtp_rx_fini(
 /**
  * @brief Handle incoming data packet.
  *
+ * Packets arriving in order are written straight into the message data ring,
+ * and only out-of-order packets are staged as data fragments.
+ *
  * @param self WTP receive control instance.
  * @param seq_num Packet sequence number.
  * @param data Payload data.
@@ -262,3 +502,112 @@ extern wtp_status_t wtp_rx_handle_packet(
     uint16_t new_msg_size,
     uint8_t* _n_msgs
 );
+
+/**
+ * @brief Append staged data fragments that became consecutive after messages were read.
+ *
+ * Fragments that don't fit into message data ring when their packet is handled stay staged;
+ * call this after reading received messages, as the memory released may fit them. A fragment
+ * that still can't be placed is released, so it is no longer acknowledged selectively
+ * and its retransmission is received in order.
+ *
+ * @param self WTP receive control instance.
+ * @param _n_msgs Used for returning number of messages received.
+ * @return Error code if failed, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_rx_assemble(
+    wtp_rx_ctrl_t* self,
+    uint8_t* _n_msgs
+);
+
+/**
+ * @brief Get selective acknowledgement blocks for data received out of order.
+ *
+ * Consecutive data fragments are merged into one block.
+ *
+ * @param self WTP receive control instance.
+ * @param blocks Used for returning at most WTP_SACK_BLOCKS_MAX blocks.
+ * @param _n_blocks Used for returning number of blocks (0 if all data is received in order).
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_rx_get_sack(
+    wtp_rx_ctrl_t* self,
+    wtp_sack_block_t* blocks,
+    uint8_t* _n_blocks
+);
+
+/**
+ * @brief Get receive window size that can currently be accepted.
+ *
+ * Data received out of order is staged in the data fragments buffer,
+ * so the window covers staged data plus the largest data fragment that still fits into the buffer.
+ * It never exceeds the sliding window size or the data the message data ring can still take,
+ * and is at least 1 byte, so the other side keeps probing a full receiver.
+ *
+ * @param self WTP receive control instance.
+ * @param _window_size Used for returning window size.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_rx_get_window(
+    wtp_rx_ctrl_t* self,
+    uint16_t* _window_size
+);
+
+/**
+ * @brief Read next fully received message.
+ *
+ * Message memory is released by this function;
+ * message data stays valid until next packet is handled.
+ *
+ * @param self WTP receive control instance.
+ * @param msg_buf Used for returning message data.
+ * @return WIO_ERR_EMPTY if no message available, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_rx_read_msg(
+    wtp_rx_ctrl_t* self,
+    wio_buf_t* msg_buf
+);
+
+/**
+ * @brief Save receive control state into a checkpoint.
+ *
+ * Only cursors of the message data ring are saved; the ring itself must be in memory
+ * that survives power loss. Data received out of order is not saved and is received again.
+ *
+ * @param self WTP receive control instance.
+ * @param state Used for returning receive control state.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_rx_save(
+    wtp_rx_ctrl_t* self,
+    wtp_rx_state_t* state
+);
+
+/**
+ * @brief Restore receive control state from a checkpoint.
+ *
+ * Messages fully received but not read yet stay in the message data ring,
+ * and the message being received goes on from its received size.
+ *
+ * @param self WTP receive control instance.
+ * @param state Receive control state.
+ * @return WIO_ERR_INVALID if the state doesn't fit the message data ring, otherwise WIO_OK.
+ */
+extern wtp_status_t wtp_rx_restore(
+    wtp_rx_ctrl_t* self,
+    wtp_rx_state_t* state
+);
+
+/**
+ * @brief Receive from a new sequence number.
+ *
+ * The message being received, messages not read yet and data received out of order are dropped.
+ *
+ * @param self WTP receive control instance.
+ * @param seq_num Sequence number to receive from.
+ * @return WIO_OK.
+ */
+extern wtp_status_t wtp_rx_restart(
+    wtp_rx_ctrl_t* self,
+    uint16_t seq_num
+);
@@ -5,6 +5,7 @@ from six import iteritems
 from sllurp.llrp import LLRPClientFactory
 from urpc import URPC, urpc_sig, StringType, urpc_type_repr, VARY
 from wtp import WTPServer
+from wtp.compression import FGKConnection
 
 from wisp_ert.util import not_implemented
 
@@ -38,14 +39,17 @@ class Runtime(object):
     """!
     @brief The WISP extended runtime class.
     """
-    def __init__(self, antennas=[1], n_tags_per_report=5, **kwargs):
+    def __init__(self, antennas=[1], n_tags_per_report=5, compress=False, **kwargs):
         """!
         @brief The WISP extended runtime constructor.
 
         @param antennas Antennas to be enabled.
         @param n_tags_per_report Number of tags per tag report.
+        @param compress Compress u-RPC messages (WISPs must set "ert_compress" as well).
         @param kwargs Other arguments.
         """
+        ## Compress u-RPC messages
+        self._compress = compress
         ## Services
         self._services = {}
         ## Services factory
@@ -66,9 +70,11 @@ class Runtime(object):
         @param connection New WTP connection.
         """
         _logger.debug("New WISP ERT client: #%d", connection.wisp_id)
+        # Compressed message layer
+        channel = FGKConnection(connection) if self._compress else connection
         # Create u-RPC endpoint for new client
         rpc_ep = URPC(
-            send_callback=connection.send
+            send_callback=channel.send
         )
         # Add service constants query function
         rpc_ep.add_func(
@@ -86,13 +92,14 @@ class Runtime(object):
             # Add functions to u-RPC endpoint
             for name, func in iteritems(service.functions):
                 rpc_ep.add_func(func=func, name=name)
-        # Add RPC endpoint
+        # Add RPC endpoint and message channel
         service_insts["_rpc"] = rpc_ep
+        service_insts["_channel"] = channel
         # Add to runtime client table
         self._services[connection] = service_insts
         # Start receiving messages from WTP endpoint
         wtp_recv_cb = functools.partial(Runtime._wtp_recv_cb, self, connection)
-        connection.recv().addCallback(wtp_recv_cb)
+        channel.recv().addCallback(wtp_recv_cb)
     def _service_constants(self, connection, name):
         """!
         @brief Get service C constants by service name.
@@ -119,11 +126,11 @@ class Runtime(object):
         @param data Received data.
         """
         # Call u-RPC endpoint
-        rpc_ep = self._services[connection]["_rpc"]
-        rpc_ep.recv_callback(data)
+        service_insts = self._services[connection]
+        service_insts["_rpc"].recv_callback(data)
         # Wait for next message
         wtp_recv_cb = functools.partial(Runtime._wtp_recv_cb, self, connection)
-        connection.recv().addCallback(wtp_recv_cb)
+        service_insts["_channel"].recv().addCallback(wtp_recv_cb)
     def add_service(self, name, factory, *args, **kwargs):
         """!
         @brief Add a service class to runtime.
@@ -0,0 +1,111 @@
+from __future__ import absolute_import, unicode_literals
+import random
+
+## LLRP OpSpec result: No response from tag
+LLRP_RESULT_NO_RESPONSE = 2
+
+class ChannelModel(object):
+    """!
+    @brief Deterministic lossy channel model between the fake reader and the simulated tag.
+
+    All decisions are drawn from a private random number generator seeded at construction,
+    so the same seed and the same traffic always produce the same losses.
+    """
+    def __init__(self, seed=0, opspec_loss=0.0, word_loss=0.0, reply_loss=0.5, partial_write=0.0,
+        epc_loss=0.0, epc_dup=0.0, reorder=0.0, cliff_words=None, cliff_loss=0.0):
+        """!
+        @brief Channel model constructor.
+
+        The failure probability of an OpSpec grows with its size:
+        p = 1-(1-opspec_loss)*(1-word_loss)^n_words.
+        OpSpecs longer than "cliff_words" additionally fail with "cliff_loss",
+        like a tag running out of energy during long OpSpecs.
+
+        @param seed Random seed.
+        @param opspec_loss Per-OpSpec failure probability independent of size.
+        @param word_loss Additional failure probability per word of an OpSpec.
+        @param reply_loss Probability that a failed Read reached the tag and only the reply got lost.
+        @param partial_write Probability that a failed BlockWrite wrote a prefix of its words.
+        @param epc_loss Probability that the tag is missed in a round.
+        @param epc_dup Probability that the EPC of the tag is reported twice in a round.
+        @param reorder Probability that a tag report is delivered after the next one.
+        @param cliff_words Number of words above which OpSpecs fail more often, or None.
+        @param cliff_loss Additional failure probability of OpSpecs above "cliff_words".
+        """
+        ## Random number generator
+        self._random = random.Random(seed)
+        ## Per-OpSpec failure probability
+        self.opspec_loss = opspec_loss
+        ## Per-word failure probability
+        self.word_loss = word_loss
+        ## Lost Read reply probability
+        self.reply_loss = reply_loss
+        ## Partial BlockWrite probability
+        self.partial_write = partial_write
+        ## Missed tag probability
+        self.epc_loss = epc_loss
+        ## Duplicated EPC report probability
+        self.epc_dup = epc_dup
+        ## Reordered tag report probability
+        self.reorder = reorder
+        ## Number of words above which OpSpecs fail more often
+        self.cliff_words = cliff_words
+        ## Additional failure probability above "cliff_words"
+        self.cliff_loss = cliff_loss
+    def _chance(self, p):
+        """!
+        @brief Draw an event with given probability.
+
+        @param p Probability of the event.
+        @return Whether the event happens.
+        """
+        return p>0 and self._random.random()<p
+    def opspec_failed(self, n_words):
+        """!
+        @brief Decide whether an OpSpec fails.
+
+        @param n_words Number of words read or written.
+        @return Whether the OpSpec fails.
+        """
+        p = 1-(1-self.opspec_loss)*(1-self.word_loss)**n_words
+        if self.cliff_words!=None and n_words>self.cliff_words:
+            p = 1-(1-p)*(1-self.cliff_loss)
+        return self._chance(p)
+    def read_reply_lost(self):
+        """!
+        @brief Decide whether a failed Read reached the tag.
+
+        @return Whether the tag served the Read and the reply got lost.
+        """
+        return self._chance(self.reply_loss)
+    def words_written(self, n_words):
+        """!
+        @brief Decide how many words a failed BlockWrite wrote.
+
+        @param n_words Number of words of the BlockWrite.
+        @return Number of words actually written.
+        """
+        if n_words>1 and self._chance(self.partial_write):
+            return self._random.randrange(1, n_words)
+        return 0
+    def tag_missed(self):
+        """!
+        @brief Decide whether the tag is missed in a round.
+
+        @return Whether the tag is missed.
+        """
+        return self._chance(self.epc_loss)
+    def epc_duplicated(self):
+        """!
+        @brief Decide whether the EPC of the tag is reported twice.
+
+        @return Whether the EPC is reported twice.
+        """
+        return self._chance(self.epc_dup)
+    def report_delayed(self):
+        """!
+        @brief Decide whether a tag report is delivered after the next one.
+
+        @return Whether the tag report is delayed.
+        """
+        return self._chance(self.reorder)
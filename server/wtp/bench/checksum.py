@@ -0,0 +1,100 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse, random, struct, timeit
+from six.moves import range
+
+import wtp.constants as consts
+from wtp.util import ChecksumStream, CHECKSUM_ALGOS
+from bench.goodput import int_list
+
+## Names of checksum algorithms
+_ALGO_NAMES = {
+    consts.WTP_CHECKSUM_XOR: "xor",
+    consts.WTP_CHECKSUM_CRC16: "crc16"
+}
+
+def build_stream(n_packets, packet, checksum_algo=consts.WTP_CHECKSUM_XOR):
+    """!
+    @brief Build a stream of packets, each followed by its checksum.
+
+    @param n_packets Number of packets.
+    @param packet Packet data.
+    @param checksum_algo Checksum algorithm.
+    @return Stream data.
+    """
+    checksum_func, checksum_type = CHECKSUM_ALGOS[checksum_algo]
+    stream = ChecksumStream(checksum_func=checksum_func, checksum_type=checksum_type)
+    for _ in range(n_packets):
+        stream.begin_checksum()
+        stream.write_data("BHB", 0x04, 0, len(packet))
+        stream.write(packet)
+        stream.write_checksum()
+    return stream.getvalue()
+
+def count_undetected(checksum_algo, packet_size, n_trials, seed=1):
+    """!
+    @brief Count corrupted packets with matching checksum.
+
+    Every trial corrupts a packet like a partial BlockWrite does: the packet
+    and its checksum are written up to a word boundary, and the rest of the
+    memory keeps random data of previous BlockWrites.
+
+    @param checksum_algo Checksum algorithm.
+    @param packet_size Packet payload size.
+    @param n_trials Number of corrupted packets.
+    @param seed Random seed.
+    @return Number of corrupted packets passing checksum validation.
+    """
+    rand = random.Random(seed)
+    checksum_func, checksum_type = CHECKSUM_ALGOS[checksum_algo]
+    checksum_size = struct.calcsize(checksum_type)
+    header = struct.pack("<BHB", 0x04, 0, packet_size)
+    n_undetected = 0
+    for _ in range(n_trials):
+        packet = header+bytes(bytearray(rand.getrandbits(8) for _ in range(packet_size)))
+        data = packet+struct.pack(checksum_type, checksum_func(packet))
+        # Written prefix ends at a word boundary before the end of packet
+        written = 2*rand.randrange(len(data)//2)
+        stale = bytes(bytearray(rand.getrandbits(8) for _ in range(len(data)-written)))
+        corrupted = data[:written]+stale
+        # Stale data happens to be the same as the packet
+        if corrupted==data:
+            continue
+        pkt_checksum = struct.unpack(checksum_type, corrupted[-checksum_size:])[0]
+        if checksum_func(corrupted[:-checksum_size])==pkt_checksum:
+            n_undetected += 1
+    return n_undetected
+
+def main():
+    parser = argparse.ArgumentParser(description="WTP checksum CPU cost and error detection benchmark")
+    parser.add_argument("-n", "--n-packets", type=int_list, default=[1, 8, 64, 512],
+        help="Packets per stream")
+    parser.add_argument("-p", "--packet-size", type=int, default=16, help="Packet payload size")
+    parser.add_argument("-s", "--sizes", type=int_list, default=[8, 32, 256, 4096, 65536],
+        help="Buffer sizes of checksum functions")
+    parser.add_argument("-N", "--number", type=int, default=20000, help="Packets or bytes per measurement (Thousands of bytes for checksum functions)")
+    parser.add_argument("-e", "--trials", type=int, default=200000, help="Corrupted packets per algorithm")
+    args = parser.parse_args()
+
+    packet = bytes(bytearray(i&0xff for i in range(args.packet_size)))
+    for algo, name in sorted(_ALGO_NAMES.items()):
+        for n_packets in args.n_packets:
+            number = max(1, args.number//n_packets)
+            best_s = min(timeit.repeat(lambda: build_stream(n_packets, packet, algo), number=number, repeat=3))
+            print("%-5s stream of %4d packets: %7.2f us/packet" % (name, n_packets, best_s*1e6/(number*n_packets)))
+    for algo, name in sorted(_ALGO_NAMES.items()):
+        checksum_func = CHECKSUM_ALGOS[algo][0]
+        for size in args.sizes:
+            buf = bytes(bytearray((i*7)&0xff for i in range(size)))
+            number = max(1, args.number*1000//size)
+            best_s = min(timeit.repeat(lambda: checksum_func(buf), number=number, repeat=3))
+            print("%-5s checksum %6d bytes: %7.2f ns/byte" % (name, size, best_s*1e9/(number*size)))
+    if args.trials:
+        for algo, name in sorted(_ALGO_NAMES.items()):
+            n_undetected = count_undetected(algo, args.packet_size, args.trials)
+            print("%-5s undetected partial writes: %d of %d (%.4f%%)" % (
+                name, n_undetected, args.trials, n_undetected*100.0/args.trials
+            ))
+
+if __name__=="__main__":
+    main()
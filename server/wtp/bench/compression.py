@@ -0,0 +1,244 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse, random, struct, timeit
+from six.moves import range
+from twisted.internet.task import Clock
+
+from wtp import WTPServer
+from wtp.compression import FGKCodec, FGKConnection
+from bench.wtp_sim import load_library, SimClient, SimFGKCodec
+from bench.fake_reader import FakeLLRPClientFactory, FakeReader
+from bench.goodput import int_list
+
+## Modeled u-RPC call and return headers (Type, message ID, function ID or number of results, ...)
+_URPC_CALL = struct.Struct("<BHHB")
+_URPC_RET = struct.Struct("<BHB")
+## Modeled u-RPC types
+_URPC_U16 = 0x03
+_URPC_I16 = 0x04
+_URPC_VARY = 0x08
+## ERT function IDs, in the order the server adds them
+_FUNC_OPEN, _FUNC_CLOSE, _FUNC_READ, _FUNC_WRITE = 1, 2, 3, 4
+
+def _value(urpc_type, value):
+    """!
+    @brief Pack a typed u-RPC value.
+
+    @param urpc_type u-RPC type.
+    @param value Integer or bytes value.
+    @return Packed value.
+    """
+    if urpc_type==_URPC_VARY:
+        return struct.pack("<BH", urpc_type, len(value))+value
+    return struct.pack("<Bh" if urpc_type==_URPC_I16 else "<BH", urpc_type, value)
+
+def build_trace(n_msgs, seed=1):
+    """!
+    @brief Build a trace of u-RPC file system traffic of the ERT runtime.
+
+    The client opens a log file, appends sensor lines to it and reads it back
+    in 24-byte chunks; every call is followed by its return.
+    (u-RPC frames are laid out after the calls "runtime.c" and "fs.c" make)
+
+    @param n_msgs Number of writes and reads.
+    @param seed Random seed.
+    @return A list of (uplink, message data) tuples.
+    """
+    rand = random.Random(seed)
+    trace = []
+    log = bytearray()
+    def rpc(func, args, ret, ret_data=None):
+        msg_id = len(trace)//2
+        trace.append((True, _URPC_CALL.pack(0x01, msg_id, func, len(args))+b"".join(_value(*arg) for arg in args)))
+        results = _value(_URPC_I16, ret)+(_value(_URPC_VARY, ret_data) if ret_data!=None else b"")
+        trace.append((False, _URPC_RET.pack(0x02, msg_id, 2 if ret_data!=None else 1)+results))
+    rpc(_FUNC_OPEN, [(_URPC_VARY, b"./log.txt"), (_URPC_I16, 66), (_URPC_U16, 0o644)], 1)
+    temp, vcap = 235, 241
+    for i in range(n_msgs):
+        temp += rand.randint(-1, 1)
+        vcap += rand.randint(-2, 2)
+        line = ("t=%05d T=%d.%d V=%d.%02d\n" % ((i*500)%100000, temp//10, temp%10, vcap//100, vcap%100)).encode()
+        log += line
+        rpc(_FUNC_WRITE, [(_URPC_I16, 1), (_URPC_VARY, line)], len(line))
+    for i in range(n_msgs):
+        chunk = bytes(log[i*24:(i+1)*24])
+        rpc(_FUNC_READ, [(_URPC_I16, 1), (_URPC_U16, 24)], 0, chunk)
+    rpc(_FUNC_CLOSE, [(_URPC_I16, 1)], 0)
+    return trace
+
+def run_codecs(lib, trace, n_symbols, per_msg):
+    """!
+    @brief Compress a trace with the client and server codecs.
+
+    Uplink messages are encoded by the client codec and decoded by the server codec,
+    and the other way round for downlink messages.
+
+    @param lib WTP simulator library.
+    @param trace Message trace.
+    @param n_symbols Maximum number of symbols in tree.
+    @param per_msg Compress every message on its own.
+    @return Benchmark results.
+    """
+    codecs = {
+        True: (SimFGKCodec(lib, n_symbols), FGKCodec(n_symbols)),
+        False: (FGKCodec(n_symbols), SimFGKCodec(lib, n_symbols))
+    }
+    n_bytes = {True: 0, False: 0}
+    n_compressed = {True: 0, False: 0}
+    n_corrupted = 0
+    for up, msg_data in trace:
+        encoder, decoder = codecs[up]
+        if per_msg:
+            encoder.reset()
+        compressed = encoder.encode(msg_data)
+        if decoder.decode(compressed)!=msg_data:
+            n_corrupted += 1
+        n_bytes[up] += len(msg_data)
+        n_compressed[up] += len(compressed)
+    for up in (True, False):
+        codecs[up][0 if up else 1].close()
+    # Server codec time per byte
+    down_msgs = [msg_data for up, msg_data in trace if not up]
+    def encode_all():
+        encoder = FGKCodec(n_symbols)
+        return [encoder.encode(msg_data) for msg_data in down_msgs]
+    compressed = encode_all()
+    def decode_all():
+        decoder = FGKCodec(n_symbols)
+        for data in compressed:
+            decoder.decode(data)
+    n_down = float(sum(len(msg_data) for msg_data in down_msgs))
+    return {
+        "up_ratio": float(n_compressed[True])/n_bytes[True],
+        "down_ratio": float(n_compressed[False])/n_bytes[False],
+        "enc_us": min(timeit.repeat(encode_all, number=1, repeat=3))*1e6/n_down,
+        "dec_us": min(timeit.repeat(decode_all, number=1, repeat=3))*1e6/n_down,
+        "n_corrupted": n_corrupted
+    }
+
+def run_link(lib, trace, n_symbols, timing, lose_session=False, n_rounds_max=200000):
+    """!
+    @brief Run a trace over the simulated link, one call in flight.
+
+    The server replies to each uplink message with the next downlink message of the trace.
+    Client codecs begin new streams when the connection opens or restarts, like the ERT runtime.
+    With session loss, the client loses power halfway through the trace and resumes its session
+    with a new server that no longer knows it; the call in flight is made again.
+
+    @param lib WTP simulator library.
+    @param trace Message trace.
+    @param n_symbols Maximum number of symbols in tree, or 0 without compression.
+    @param timing Inventory, OpSpec and per-word time in microseconds.
+    @param lose_session Lose the server-side session halfway through the trace.
+    @param n_rounds_max Rounds given up after.
+    @return Benchmark results.
+    """
+    client = SimClient(lib, session=lose_session)
+    client_codecs = (SimFGKCodec(lib, n_symbols), SimFGKCodec(lib, n_symbols)) if n_symbols else None
+    calls = [msg_data for up, msg_data in trace if up]
+    replies = [msg_data for up, msg_data in trace if not up]
+    state = {"connected": False, "inflight": False, "n_calls": 0, "n_replies": 0, "n_corrupted": 0}
+    # Simulated time and words of readers of previous servers
+    totals = {"time_us": 0, "n_read_words": 0, "n_write_words": 0}
+
+    def make_server():
+        clock = Clock()
+        factory = FakeLLRPClientFactory()
+        server = WTPServer(reactor=clock, llrp_factory=factory)
+        @server.on("connect")
+        def on_connect(connection):
+            channel = FGKConnection(connection, n_symbols) if n_symbols else connection
+            def on_recv(msg_data):
+                # One call in flight; its reply is the next one the client waits for
+                index = state["n_replies"]
+                if msg_data!=calls[index]:
+                    state["n_corrupted"] += 1
+                state["n_calls"] += 1
+                channel.send(replies[index])
+                channel.recv().addCallback(on_recv)
+            channel.recv().addCallback(on_recv)
+        return FakeReader(client, factory, clock, 0x01, *timing)
+    def reset_codecs():
+        if client_codecs:
+            for codec in client_codecs:
+                codec.reset()
+    def on_client_recv(msg_data):
+        if client_codecs:
+            msg_data = client_codecs[1].decode(msg_data)
+        if msg_data!=replies[state["n_replies"]]:
+            state["n_corrupted"] += 1
+        state["n_replies"] += 1
+        state["inflight"] = False
+        client.recv(on_client_recv)
+    def on_open():
+        state["connected"] = True
+        reset_codecs()
+        client.recv(on_client_recv)
+    client.on_open(on_open)
+    client.on_restart(reset_codecs)
+    reader = make_server()
+    client.connect()
+
+    n_rounds = 0
+    lost = not lose_session
+    while state["n_replies"]<len(replies) and n_rounds<n_rounds_max:
+        # Power lost halfway through the trace, and the server forgets the session
+        if not lost and state["n_replies"]>=len(replies)//2:
+            for key in totals:
+                totals[key] += getattr(reader, key)
+            client.power_cycle()
+            reset_codecs()
+            reader = make_server()
+            state["connected"] = state["inflight"] = False
+            client.connect()
+            lost = True
+        if state["connected"] and not state["inflight"]:
+            msg_data = calls[state["n_replies"]]
+            client.send(client_codecs[0].encode(msg_data) if client_codecs else msg_data)
+            state["inflight"] = True
+        reader.round()
+        n_rounds += 1
+    client.close()
+    if client_codecs:
+        for codec in client_codecs:
+            codec.close()
+    return {
+        "n_rounds": n_rounds,
+        "sim_s": (totals["time_us"]+reader.time_us)/1e6,
+        "n_read_words": totals["n_read_words"]+reader.n_read_words,
+        "n_write_words": totals["n_write_words"]+reader.n_write_words,
+        "n_replies": state["n_replies"],
+        "n_corrupted": state["n_corrupted"]
+    }
+
+def main():
+    parser = argparse.ArgumentParser(description="FGK compression of u-RPC file system traffic")
+    parser.add_argument("-m", "--msgs", type=int, default=100, help="Writes and reads in trace")
+    parser.add_argument("-S", "--symbols", type=int_list, default=[16, 32, 64], help="Maximum symbols in tree")
+    parser.add_argument("-r", "--seed", type=int, default=1, help="Random seed")
+    parser.add_argument("-t", "--timing", type=int_list, default=[3000, 2000, 250],
+        help="Inventory, OpSpec and per-word time (us)")
+    args = parser.parse_args()
+
+    lib = load_library()
+    trace = build_trace(args.msgs, args.seed)
+    print("%7s %-7s | %6s %6s | %9s %9s | %s" % (
+        "symbols", "mode", "up", "down", "enc us/B", "dec us/B", "corrupted"))
+    for n_symbols in args.symbols:
+        for per_msg in (False, True):
+            r = run_codecs(lib, trace, n_symbols, per_msg)
+            print("%7d %-7s | %6.3f %6.3f | %9.2f %9.2f | %d" % (
+                n_symbols, "message" if per_msg else "stream", r["up_ratio"], r["down_ratio"],
+                r["enc_us"], r["dec_us"], r["n_corrupted"]))
+    print()
+    print("%7s %-7s | %7s %9s | %8s %8s | %7s %s" % (
+        "symbols", "session", "rounds", "sim s", "R words", "BW words", "replies", "corrupted"))
+    for n_symbols in [0]+args.symbols:
+        for lose_session in (False, True):
+            r = run_link(lib, trace, n_symbols, args.timing, lose_session)
+            print("%7s %-7s | %7d %9.1f | %8d %8d | %7d %d" % (
+                n_symbols or "off", "lost" if lose_session else "kept", r["n_rounds"], r["sim_s"],
+                r["n_read_words"], r["n_write_words"], r["n_replies"], r["n_corrupted"]))
+
+if __name__=="__main__":
+    main()
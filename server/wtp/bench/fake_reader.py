@@ -0,0 +1,298 @@
+from __future__ import absolute_import, unicode_literals
+from binascii import hexlify
+from six.moves import range
+from twisted.internet.defer import succeed, fail
+
+from bench.channel import LLRP_RESULT_NO_RESPONSE
+
+class FakeLLRPMessage(object):
+    """!
+    @brief Fake LLRP message carrying a RO_ACCESS_REPORT.
+    """
+    def __init__(self, reports):
+        """!
+        @brief Fake LLRP message constructor.
+
+        @param reports Tag report data.
+        """
+        ## LLRP message dictionary
+        self.msgdict = {
+            "RO_ACCESS_REPORT": {
+                "TagReportData": reports
+            }
+        }
+
+class FakeLLRPProtocol(object):
+    """!
+    @brief Fake LLRP client protocol.
+
+    AccessSpecs are stored by the protocol and carried out by the fake reader
+    the next time the target tag is singulated.
+    """
+    def __init__(self, max_access_specs=None):
+        """!
+        @brief Fake LLRP client protocol constructor.
+
+        @param max_access_specs Maximum number of pending AccessSpecs, or None for no limit.
+        """
+        ## Pending AccessSpecs, keyed by AccessSpec ID
+        self.access_specs = {}
+        ## Maximum number of pending AccessSpecs
+        self.max_access_specs = max_access_specs
+        ## Largest number of pending AccessSpecs
+        self.max_pending = 0
+    def nextAccess(self, stopSpecPar, accessSpecID, param, target):
+        """!
+        @brief Add an AccessSpec.
+
+        @param stopSpecPar AccessSpec stop parameter.
+        @param accessSpecID AccessSpec ID.
+        @param param OpSpecs.
+        @param target Target tag information.
+        @return A deferred object resolved once the AccessSpec is added.
+        """
+        access_specs = self.access_specs
+        # Reader rejects AccessSpecs beyond its capacity
+        if self.max_access_specs!=None and len(access_specs)>=self.max_access_specs:
+            return fail(RuntimeError("Too many AccessSpecs"))
+        access_specs[accessSpecID] = param
+        self.max_pending = max(self.max_pending, len(access_specs))
+        return succeed(None)
+
+class FakeLLRPClientFactory(object):
+    """!
+    @brief Fake LLRP client factory, replacing sllurp's LLRPClientFactory.
+    """
+    def __init__(self, max_access_specs=None):
+        """!
+        @brief Fake LLRP client factory constructor.
+
+        @param max_access_specs Maximum number of pending AccessSpecs of the reader, or None for no limit.
+        """
+        ## Connected protocols
+        self.protocols = [FakeLLRPProtocol(max_access_specs)]
+        ## Tag report callbacks
+        self._tag_report_cbs = []
+    def addTagReportCallback(self, cb):
+        """!
+        @brief Add tag report callback.
+
+        @param cb Tag report callback.
+        """
+        self._tag_report_cbs.append(cb)
+    def report(self, reports):
+        """!
+        @brief Deliver tag reports to callbacks.
+
+        @param reports Tag report data.
+        """
+        llrp_msg = FakeLLRPMessage(reports)
+        for cb in self._tag_report_cbs:
+            cb(llrp_msg)
+
+class FakeReader(object):
+    """!
+    @brief In-process fake RFID reader driving a simulated client.
+
+    Every round the fake reader singulates every tag, carries out the pending AccessSpec
+    of the tag and reports the EPC together with OpSpec results.
+    Simulated time of a round is a fixed inventory time plus a fixed time per OpSpec and a time per word.
+    An optional channel model makes OpSpecs fail, misses, duplicates or reorders tag reports.
+    """
+    def __init__(self, client, factory, clock, wisp_id, inventory_us=3000, opspec_us=2000, word_us=250,
+        channel=None):
+        """!
+        @brief Fake reader constructor.
+
+        @param client Simulated client.
+        @param factory Fake LLRP client factory.
+        @param clock Twisted clock used by the server.
+        @param wisp_id WISP ID used as AccessSpec ID.
+        @param inventory_us Inventory time per tag and round in microseconds.
+        @param opspec_us Fixed time per OpSpec in microseconds.
+        @param word_us Time per word read or written in microseconds.
+        @param channel Channel model, or None for a lossless channel.
+        """
+        ## Simulated clients and their WISP IDs
+        self.tags = [(client, wisp_id)]
+        ## Fake LLRP client factory
+        self.factory = factory
+        ## Twisted clock
+        self.clock = clock
+        ## Inventory time per tag and round
+        self.inventory_us = inventory_us
+        ## Fixed time per OpSpec
+        self.opspec_us = opspec_us
+        ## Time per word
+        self.word_us = word_us
+        ## Number of rounds
+        self.n_rounds = 0
+        ## Number of Read OpSpecs
+        self.n_reads = 0
+        ## Number of BlockWrite OpSpecs
+        self.n_writes = 0
+        ## Number of words read by Read OpSpecs
+        self.n_read_words = 0
+        ## Number of words written by BlockWrite OpSpecs
+        self.n_write_words = 0
+        ## Channel model
+        self.channel = channel
+        ## Number of failed Read OpSpecs
+        self.n_read_failures = 0
+        ## Number of failed BlockWrite OpSpecs
+        self.n_write_failures = 0
+        ## Number of partial BlockWrites
+        self.n_partial_writes = 0
+        ## Number of BlockWrites rejected by the client
+        self.n_write_errors = 0
+        ## Number of rounds the tag is missed
+        self.n_missed = 0
+        ## Number of duplicated EPC reports
+        self.n_dups = 0
+        ## Number of reordered tag reports
+        self.n_reordered = 0
+        ## Simulated time in microseconds
+        self.time_us = 0
+        ## Tag report delayed by reordering
+        self._delayed_report = None
+    def add_tag(self, client, wisp_id):
+        """!
+        @brief Add another simulated tag to the field of the reader.
+
+        @param client Simulated client.
+        @param wisp_id WISP ID used as AccessSpec ID.
+        """
+        self.tags.append((client, wisp_id))
+    def _read(self, client, opspec):
+        """!
+        @brief Carry out a Read OpSpec.
+
+        @param client Simulated client.
+        @param opspec Read OpSpec.
+        @return OpSpec result and number of words read.
+        """
+        n_words = opspec["WordCount"]
+        channel = self.channel
+        self.n_reads += 1
+        self.n_read_words += n_words
+        # Read failed
+        if channel and channel.opspec_failed(n_words):
+            self.n_read_failures += 1
+            # Tag served the Read but the reply got lost
+            if channel.read_reply_lost():
+                client.read(2*n_words)
+            return {
+                "OpSpecID": opspec["OpSpecID"],
+                "Result": LLRP_RESULT_NO_RESPONSE,
+                "ReadDataWordCount": 0,
+                "ReadData": b""
+            }, n_words
+        read_data = client.read(2*n_words)
+        return {
+            "OpSpecID": opspec["OpSpecID"],
+            "Result": 0,
+            "ReadDataWordCount": n_words,
+            "ReadData": read_data
+        }, n_words
+    def _write(self, client, opspec):
+        """!
+        @brief Carry out a BlockWrite OpSpec.
+
+        @param client Simulated client.
+        @param opspec BlockWrite OpSpec.
+        @return OpSpec result and number of words written.
+        """
+        n_words = opspec["WriteDataWordCount"]
+        # Undo byte swapping of "write_opspec()"
+        mem = bytearray(opspec["WriteData"])
+        for i in range(n_words):
+            mem[2*i], mem[2*i+1] = mem[2*i+1], mem[2*i]
+        channel = self.channel
+        self.n_writes += 1
+        self.n_write_words += n_words
+        # BlockWrite failed
+        if channel and channel.opspec_failed(n_words):
+            self.n_write_failures += 1
+            # Words after the failure keep data of previous BlockWrites
+            n_written = channel.words_written(n_words)
+            if n_written:
+                self.n_partial_writes += 1
+                if client.blockwrite(mem[:2*n_written])!=0:
+                    self.n_write_errors += 1
+            return {
+                "OpSpecID": opspec["OpSpecID"],
+                "Result": LLRP_RESULT_NO_RESPONSE,
+                "NumWordsWritten": n_written
+            }, n_words
+        if client.blockwrite(mem)!=0:
+            self.n_write_errors += 1
+        return {
+            "OpSpecID": opspec["OpSpecID"],
+            "Result": 0,
+            "NumWordsWritten": n_words
+        }, n_words
+    def round(self):
+        """!
+        @brief Run one RFID round over all tags and advance simulated time.
+        """
+        self.n_rounds += 1
+        for client, wisp_id in self.tags:
+            self._singulate(client, wisp_id)
+    def _singulate(self, client, wisp_id):
+        """!
+        @brief Singulate one tag and advance simulated time.
+
+        @param client Simulated client.
+        @param wisp_id WISP ID.
+        """
+        # Client-side work before RFID
+        client.before_rfid()
+        channel = self.channel
+        round_us = self.inventory_us
+        reports = []
+        # Singulate tag
+        if channel and channel.tag_missed():
+            self.n_missed += 1
+        else:
+            epc_hex = hexlify(client.inventory())
+            report = {
+                "EPC-96": epc_hex
+            }
+            # Carry out pending AccessSpec
+            opspecs = self.factory.protocols[0].access_specs.pop(wisp_id, None)
+            if opspecs:
+                opspec_results = []
+                for opspec in opspecs:
+                    if "WriteData" in opspec:
+                        result, n_words = self._write(client, opspec)
+                    else:
+                        result, n_words = self._read(client, opspec)
+                    opspec_results.append(result)
+                    round_us += self.opspec_us+self.word_us*n_words
+                    # Reader skips remaining OpSpecs after a failed one
+                    if result["Result"]!=0:
+                        break
+                report["OpSpecResult"] = opspec_results
+            reports.append(report)
+            # Duplicated EPC report
+            if channel and channel.epc_duplicated():
+                self.n_dups += 1
+                reports.append({
+                    "EPC-96": epc_hex
+                })
+        # Deliver tag report delayed by previous singulation after reports of this one
+        if self._delayed_report:
+            reports.append(self._delayed_report)
+            self._delayed_report = None
+        elif reports and channel and channel.report_delayed():
+            self.n_reordered += 1
+            self._delayed_report = reports.pop(0)
+        # Report tag
+        if reports:
+            self.factory.report(reports)
+        # Advance simulated time of server and clients
+        # (WIO timers of all clients share one timer list, so only the first client is advanced)
+        prev_ms = self.time_us//1000
+        self.time_us += round_us
+        self.clock.advance(round_us/1e6)
+        self.tags[0][0].advance(self.time_us//1000-prev_ms)
@@ -0,0 +1,257 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse, struct, functools
+from twisted.internet.task import Clock
+
+import wtp.constants as consts
+from wtp import WTPServer
+from wtp.transmission import SlidingWindowTxControl
+from wtp.cong_ctrl import EWMAOpSpecSizeControl
+from bench.wtp_sim import load_library, SimClient, SimClientError, WTP_BUF_MAX
+from bench.fake_reader import FakeLLRPClientFactory, FakeReader
+
+## Message header format (Message index)
+_MSG_HEADER = "<I"
+
+def percentile(values, p):
+    """!
+    @brief Get percentile of values (Nearest-rank).
+
+    @param values Sorted values.
+    @param p Percentile.
+    @return Percentile value, or NaN if there are no values.
+    """
+    if not values:
+        return float("nan")
+    index = max(0, min(len(values)-1, int(round(p/100.0*len(values)+0.5))-1))
+    return values[index]
+
+class RetransmitCounter(object):
+    """!
+    @brief Count downlink retransmissions of the server transmit control.
+    """
+    def __init__(self):
+        """!
+        @brief Retransmission counter constructor.
+        """
+        ## Number of retransmitted fragments
+        self.n_fragments = 0
+        ## Retransmitted bytes
+        self.n_bytes = 0
+        ## Original timeout handler
+        self._orig_handler = None
+    def __enter__(self):
+        """!
+        @brief Start counting retransmissions.
+        """
+        orig_handler = self._orig_handler = SlidingWindowTxControl._handle_packet_timeout
+        @functools.wraps(orig_handler)
+        def handler(tx_ctrl, fragment, *args):
+            self.n_fragments += 1
+            self.n_bytes += len(fragment.data)
+            return orig_handler(tx_ctrl, fragment, *args)
+        SlidingWindowTxControl._handle_packet_timeout = handler
+        return self
+    def __exit__(self, *args):
+        """!
+        @brief Stop counting retransmissions.
+        """
+        SlidingWindowTxControl._handle_packet_timeout = self._orig_handler
+
+def run_echo(lib, msg_size, window_size, opspec_init, n_rounds, n_inflight, buf_size, timing, channel=None,
+    timeout=45, n_opspecs_max=consts.LLRP_N_OPSPECS_MAX, opspec_ctrl_factory=EWMAOpSpecSizeControl,
+    checksum_algo=None, framing=None, epc_cadence=None):
+    """!
+    @brief Run echo benchmark for one configuration.
+
+    The client keeps a number of messages in flight on the uplink,
+    and the server echoes every message back on the downlink.
+
+    @param lib WTP simulator library.
+    @param msg_size Message size.
+    @param window_size Sliding window size of both sides.
+    @param opspec_init Initial Read and BlockWrite size.
+    @param n_rounds Number of RFID rounds.
+    @param n_inflight Maximum number of messages in flight.
+    @param buf_size Client transmit and receive buffer size.
+    @param timing Inventory, OpSpec and per-word time in microseconds.
+    @param channel Channel model, or None for a lossless channel.
+    @param timeout Server retransmission timeout in seconds.
+    @param n_opspecs_max Maximum number of OpSpecs in one AccessSpec.
+    @param opspec_ctrl_factory Server OpSpec size control class.
+    @param checksum_algo Checksum algorithm requested by the client, or None for the client default.
+    @param framing Data packet framing requested by the client, or None for the client default.
+    @param epc_cadence Client EPC cadence, or None for the client default.
+    @return Benchmark results.
+    """
+    clock = Clock()
+    factory = FakeLLRPClientFactory()
+    server = WTPServer(
+        reactor=clock,
+        llrp_factory=factory,
+        window_size=window_size,
+        opspec_init=opspec_init,
+        timeout=timeout,
+        n_opspecs_max=n_opspecs_max,
+        opspec_ctrl_factory=opspec_ctrl_factory
+    )
+    client = SimClient(lib, window_size=window_size, tx_buf_size=buf_size, rx_buf_size=buf_size,
+        checksum_algo=checksum_algo, framing=framing, epc_cadence=epc_cadence)
+    reader = FakeReader(client, factory, clock, 0x01, *timing, channel=channel)
+    # Benchmark state
+    state = {
+        "connected": False,
+        "connection": None,
+        "n_inflight": 0,
+        "n_sent": 0,
+        "n_send_errors": 0,
+        "n_corrupted": 0
+    }
+    # Send time of messages in flight
+    up_sent = {}
+    down_sent = {}
+    # Latencies in milliseconds
+    up_lats = []
+    down_lats = []
+    # Sum of Read and BlockWrite sizes, and number of sampled rounds
+    opspec_size_sums = [0, 0, 0]
+
+    def make_msg(index):
+        header = struct.pack(_MSG_HEADER, index)
+        return header+bytes(bytearray((index*31+i)&0xff for i in range(msg_size-len(header))))
+    def now_ms():
+        return reader.time_us/1000.0
+    # Server side
+    @server.on("connect")
+    def on_connect(connection):
+        state["connection"] = connection
+        def on_recv(msg_data):
+            index = struct.unpack_from(_MSG_HEADER, bytes(msg_data))[0]
+            up_lats.append(now_ms()-up_sent.pop(index))
+            # Echo message
+            down_sent[index] = now_ms()
+            connection.send(msg_data)
+            connection.recv().addCallback(on_recv)
+        connection.recv().addCallback(on_recv)
+    # Client side
+    def on_client_recv(msg_data):
+        index = struct.unpack_from(_MSG_HEADER, msg_data)[0]
+        # Corrupted message index
+        if index not in down_sent:
+            state["n_corrupted"] += 1
+        else:
+            down_lats.append(now_ms()-down_sent.pop(index))
+            if msg_data!=make_msg(index):
+                state["n_corrupted"] += 1
+        state["n_inflight"] -= 1
+        client.recv(on_client_recv)
+    def on_open():
+        state["connected"] = True
+        client.recv(on_client_recv)
+    client.on_open(on_open)
+    client.connect()
+
+    with RetransmitCounter() as retx:
+        for _ in range(n_rounds):
+            # Keep messages in flight
+            while state["connected"] and state["n_inflight"]<n_inflight:
+                index = state["n_sent"]
+                try:
+                    client.send(make_msg(index))
+                except SimClientError:
+                    state["n_send_errors"] += 1
+                    break
+                up_sent[index] = now_ms()
+                state["n_inflight"] += 1
+                state["n_sent"] += 1
+            reader.round()
+            # Sample OpSpec sizes
+            if state["connection"]:
+                opspec_ctrl = state["connection"]._opspec_ctrl
+                opspec_size_sums[0] += opspec_ctrl.read_size
+                opspec_size_sums[1] += opspec_ctrl.write_size
+                opspec_size_sums[2] += 1
+    # High-water marks of client buffers
+    mem_max = [client.mem_usage(buf_id)[1] for buf_id in range(WTP_BUF_MAX)]
+    client.close()
+
+    sim_s = reader.time_us/1e6
+    up_bytes = len(up_lats)*msg_size
+    down_bytes = len(down_lats)*msg_size
+    up_lats.sort()
+    down_lats.sort()
+    n_opspecs = reader.n_reads+reader.n_writes
+    return {
+        "up_goodput": up_bytes/sim_s,
+        "down_goodput": down_bytes/sim_s,
+        "up_lats": [percentile(up_lats, p) for p in (50, 90, 99)],
+        "down_lats": [percentile(down_lats, p) for p in (50, 90, 99)],
+        "opspecs_per_byte": float(n_opspecs)/(up_bytes+down_bytes) if up_bytes+down_bytes else float("nan"),
+        "n_reads": reader.n_reads,
+        "n_writes": reader.n_writes,
+        "up_payload": up_bytes/(2.0*reader.n_read_words) if reader.n_read_words else 0.0,
+        "down_payload": down_bytes/(2.0*reader.n_write_words) if reader.n_write_words else 0.0,
+        "n_retx": retx.n_fragments,
+        "retx_bytes": retx.n_bytes,
+        "n_up": len(up_lats),
+        "n_down": len(down_lats),
+        "n_read_failures": reader.n_read_failures,
+        "n_write_failures": reader.n_write_failures,
+        "n_write_errors": reader.n_write_errors,
+        "mean_read_size": float(opspec_size_sums[0])/max(opspec_size_sums[2], 1),
+        "mean_write_size": float(opspec_size_sums[1])/max(opspec_size_sums[2], 1),
+        "n_corrupted": state["n_corrupted"],
+        "n_send_errors": state["n_send_errors"],
+        "mem_max": mem_max
+    }
+
+def int_list(value):
+    """!
+    @brief Parse comma-separated integers.
+
+    @param value Comma-separated integers.
+    @return List of integers.
+    """
+    return [int(item, 0) for item in value.split(",")]
+
+def main():
+    parser = argparse.ArgumentParser(description="WTP end-to-end goodput and latency benchmark")
+    parser.add_argument("-n", "--rounds", type=int, default=5000, help="RFID rounds per configuration")
+    parser.add_argument("-s", "--msg-sizes", type=int_list, default=[8, 32, 64], help="Message sizes")
+    parser.add_argument("-W", "--window-sizes", type=int_list, default=[32, 64, 128], help="Window sizes")
+    parser.add_argument("-o", "--opspec-inits", type=int_list, default=[8, 16, consts.WTP_OPSPEC_INIT],
+        help="Initial OpSpec sizes")
+    parser.add_argument("-O", "--opspecs", type=int, default=consts.LLRP_N_OPSPECS_MAX,
+        help="Maximum OpSpecs per AccessSpec")
+    parser.add_argument("-i", "--inflight", type=int, default=2, help="Messages in flight")
+    parser.add_argument("-b", "--buf-size", type=int, default=400,
+        help="Client buffer size (Receive fragments take more space on 64-bit hosts)")
+    parser.add_argument("-t", "--timing", type=int_list, default=[3000, 2000, 250],
+        help="Inventory, OpSpec and per-word time (us)")
+    parser.add_argument("-x", "--xor", action="store_true", help="Request XOR checksum instead of CRC-16")
+    parser.add_argument("-c", "--compact", action="store_true", help="Request compact data packet framing")
+    args = parser.parse_args()
+    checksum_algo = consts.WTP_CHECKSUM_XOR if args.xor else consts.WTP_CHECKSUM_CRC16
+    framing = consts.WTP_FRAMING_COMPACT if args.compact else consts.WTP_FRAMING_STANDARD
+
+    lib = load_library()
+    print("%5s %5s %5s | %8s %8s | %-20s | %-20s | %8s | %-11s | %9s | %s" % (
+        "size", "win", "init", "up B/s", "down B/s", "up p50/p90/p99 ms", "down p50/p90/p99 ms",
+        "ops/B", "payload R/BW", "retx", "msgs up/down"
+    ))
+    for msg_size in args.msg_sizes:
+        for window_size in args.window_sizes:
+            for opspec_init in args.opspec_inits:
+                r = run_echo(lib, msg_size, window_size, opspec_init, args.rounds, args.inflight,
+                    args.buf_size, args.timing, n_opspecs_max=args.opspecs, checksum_algo=checksum_algo,
+                    framing=framing)
+                print("%5d %5d %5d | %8.1f %8.1f | %6.0f %6.0f %6.0f | %6.0f %6.0f %6.0f | %8.3f | %4.0f%% %4.0f%% | %4d/%4d | %d/%d%s" % (
+                    msg_size, window_size, opspec_init, r["up_goodput"], r["down_goodput"],
+                    r["up_lats"][0], r["up_lats"][1], r["up_lats"][2],
+                    r["down_lats"][0], r["down_lats"][1], r["down_lats"][2],
+                    r["opspecs_per_byte"], r["up_payload"]*100, r["down_payload"]*100, r["n_retx"], r["retx_bytes"], r["n_up"], r["n_down"],
+                    " (%d corrupted)" % r["n_corrupted"] if r["n_corrupted"] else ""
+                ))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,81 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse
+
+import wtp.constants as consts
+from bench.wtp_sim import load_library, WTP_BUF_RX_MSG, WTP_BUF_FRAGMENTS
+from bench.channel import ChannelModel
+from bench.goodput import run_echo, int_list
+
+def float_list(value):
+    """!
+    @brief Parse comma-separated floating point numbers.
+
+    @param value Comma-separated floating point numbers.
+    @return List of floating point numbers.
+    """
+    return [float(item) for item in value.split(",")]
+
+def main():
+    parser = argparse.ArgumentParser(description="WTP benchmark over a lossy channel")
+    parser.add_argument("-n", "--rounds", type=int, default=5000, help="RFID rounds per configuration")
+    parser.add_argument("-l", "--losses", type=float_list, default=[0, 0.05, 0.1, 0.2, 0.4],
+        help="Per-OpSpec failure probabilities")
+    parser.add_argument("--word-loss", type=float, default=0.0, help="Additional failure probability per word")
+    parser.add_argument("--reply-loss", type=float, default=0.5, help="Fraction of failed Reads served by the tag")
+    parser.add_argument("--partial", type=float, default=0.5, help="Fraction of failed BlockWrites written partially")
+    parser.add_argument("--epc-loss", type=float, default=0.0, help="Probability of missing the tag in a round")
+    parser.add_argument("--epc-dup", type=float, default=0.0, help="Probability of duplicated EPC reports")
+    parser.add_argument("--reorder", type=float, default=0.0, help="Probability of reordered tag reports")
+    parser.add_argument("-E", "--epc-cadence", type=int, default=1,
+        help="Client EPC cadence (Observations of EPC content before it is refreshed)")
+    parser.add_argument("--seeds", type=int_list, default=[1, 2, 3], help="Random seeds")
+    parser.add_argument("-s", "--msg-size", type=int, default=32, help="Message size")
+    parser.add_argument("-W", "--window-size", type=int, default=64, help="Window size")
+    parser.add_argument("-o", "--opspec-init", type=int, default=consts.WTP_OPSPEC_INIT, help="Initial OpSpec size")
+    parser.add_argument("-O", "--opspecs", type=int, default=consts.LLRP_N_OPSPECS_MAX,
+        help="Maximum OpSpecs per AccessSpec")
+    parser.add_argument("-T", "--timeout", type=float, default=1, help="Server retransmission timeout (s)")
+    parser.add_argument("-i", "--inflight", type=int, default=2, help="Messages in flight")
+    parser.add_argument("-b", "--buf-size", type=int, default=400, help="Client buffer size")
+    parser.add_argument("-t", "--timing", type=int_list, default=[3000, 2000, 250],
+        help="Inventory, OpSpec and per-word time (us)")
+    parser.add_argument("-x", "--xor", action="store_true", help="Request XOR checksum instead of CRC-16")
+    parser.add_argument("-c", "--compact", action="store_true", help="Request compact data packet framing")
+    args = parser.parse_args()
+    checksum_algo = consts.WTP_CHECKSUM_XOR if args.xor else consts.WTP_CHECKSUM_CRC16
+    framing = consts.WTP_FRAMING_COMPACT if args.compact else consts.WTP_FRAMING_STANDARD
+
+    lib = load_library()
+    print("%5s %5s | %8s %8s | %-13s | %-8s | %-11s | %-11s | %9s | %-9s | %-9s | %s" % (
+        "loss", "seed", "up B/s", "down B/s", "up p50/p99 ms", "down p50", "fail R/BW", "mean R/BW", "retx",
+        "BW errors", "rx/frag B", "msgs up/down"
+    ))
+    for loss in args.losses:
+        for seed in args.seeds:
+            channel = ChannelModel(
+                seed=seed,
+                opspec_loss=loss,
+                word_loss=args.word_loss,
+                reply_loss=args.reply_loss,
+                partial_write=args.partial,
+                epc_loss=args.epc_loss,
+                epc_dup=args.epc_dup,
+                reorder=args.reorder
+            )
+            r = run_echo(lib, args.msg_size, args.window_size, args.opspec_init, args.rounds, args.inflight,
+                args.buf_size, args.timing, channel, args.timeout, args.opspecs, checksum_algo=checksum_algo,
+                framing=framing, epc_cadence=args.epc_cadence)
+            # Runs delivering no data in a direction stalled (e.g. the connection never opened)
+            stalled = r["up_goodput"]==0 or r["down_goodput"]==0
+            print("%5.2f %5d | %8.1f %8.1f | %6.0f %6.0f | %8.0f | %5d %5d | %5.1f %5.1f | %4d/%4d | %9d | %4d/%4d | %d/%d%s%s" % (
+                loss, seed, r["up_goodput"], r["down_goodput"], r["up_lats"][0], r["up_lats"][2], r["down_lats"][0],
+                r["n_read_failures"], r["n_write_failures"], r["mean_read_size"], r["mean_write_size"],
+                r["n_retx"], r["retx_bytes"], r["n_write_errors"],
+                r["mem_max"][WTP_BUF_RX_MSG], r["mem_max"][WTP_BUF_FRAGMENTS], r["n_up"], r["n_down"],
+                " (%d corrupted)" % r["n_corrupted"] if r["n_corrupted"] else "",
+                " (stalled)" if stalled else ""
+            ))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,196 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse, struct
+from twisted.internet.task import Clock
+
+import wtp.constants as consts
+from wtp import WTPServer
+from bench.wtp_sim import load_library, SimClient, SimClientError
+from bench.fake_reader import FakeLLRPClientFactory, FakeReader
+from bench.goodput import percentile, int_list
+
+## Message header format (Message index)
+_MSG_HEADER = "<I"
+## WISP class of tags
+_WISP_CLASS = 0x51
+
+def run_multi_echo(lib, n_tags, msg_size, n_rounds, n_inflight, max_in_flight, reader_capacity, timing,
+    window_size=64, buf_size=400, client_timeout=10, weights=None, downlink=False):
+    """!
+    @brief Run echo benchmark with multiple tags sharing one reader.
+
+    Every tag keeps a number of messages in flight on the uplink,
+    and the server echoes every message back on the downlink.
+    In downlink mode the server instead keeps a number of messages
+    in flight to every tag, and the tags send nothing.
+
+    @param lib WTP simulator library.
+    @param n_tags Number of tags.
+    @param msg_size Message size.
+    @param n_rounds Number of RFID rounds.
+    @param n_inflight Maximum number of messages in flight per tag.
+    @param max_in_flight Maximum number of AccessSpecs on the reader for the scheduler.
+    @param reader_capacity Maximum number of AccessSpecs the fake reader accepts, or None for no limit.
+    @param timing Inventory, OpSpec and per-word time in microseconds.
+    @param window_size Sliding window size of both sides.
+    @param buf_size Client transmit and receive buffer size.
+    @param client_timeout Client retransmission timeout in WIO timer ticks.
+    @param weights Scheduling weights of tags, or None for equal weights.
+    @param downlink Whether to run downlink mode.
+    @return Benchmark results.
+    """
+    clock = Clock()
+    factory = FakeLLRPClientFactory(max_access_specs=reader_capacity)
+    server = WTPServer(
+        reactor=clock,
+        llrp_factory=factory,
+        window_size=window_size,
+        n_access_specs_max=max_in_flight
+    )
+    wisp_ids = list(range(1, n_tags+1))
+    clients = [
+        SimClient(lib, wisp_id=(_WISP_CLASS<<8)|wisp_id, window_size=window_size, timeout=client_timeout,
+            tx_buf_size=buf_size, rx_buf_size=buf_size)
+        for wisp_id in wisp_ids
+    ]
+    reader = FakeReader(clients[0], factory, clock, wisp_ids[0], *timing)
+    for client, wisp_id in zip(clients[1:], wisp_ids[1:]):
+        reader.add_tag(client, wisp_id)
+    if weights:
+        for wisp_id, weight in zip(wisp_ids, weights):
+            server.scheduler.set_weight(wisp_id, weight)
+    # Benchmark state of tags
+    tags = dict((wisp_id, {
+        "connected": False,
+        "n_inflight": 0,
+        "n_sent": 0,
+        "n_send_errors": 0,
+        "n_corrupted": 0,
+        # Send time of messages in flight
+        "up_sent": {},
+        # Round trip latencies in milliseconds
+        "lats": []
+    }) for wisp_id in wisp_ids)
+    # Largest scheduler queue depth of all tags
+    max_queue_depth = [0]
+
+    def make_msg(wisp_id, index):
+        header = struct.pack(_MSG_HEADER, index)
+        return header+bytes(bytearray((index*31+wisp_id+i)&0xff for i in range(msg_size-len(header))))
+    def now_ms():
+        return reader.time_us/1000.0
+    # Server side
+    @server.on("connect")
+    def on_connect(connection):
+        tag = tags[connection.wisp_id]
+        def on_recv(msg_data):
+            connection.send(msg_data)
+            connection.recv().addCallback(on_recv)
+        def send_next(_=None):
+            index = tag["n_sent"]
+            tag["n_sent"] += 1
+            tag["up_sent"][index] = now_ms()
+            connection.send(make_msg(connection.wisp_id, index)).addCallback(send_next)
+        if downlink:
+            for _ in range(n_inflight):
+                send_next()
+        else:
+            connection.recv().addCallback(on_recv)
+    # Client side
+    def start_client(client, wisp_id):
+        tag = tags[wisp_id]
+        def on_client_recv(msg_data):
+            index = struct.unpack_from(_MSG_HEADER, msg_data)[0]
+            send_time = tag["up_sent"].pop(index, None)
+            # Corrupted message index
+            if send_time==None or msg_data!=make_msg(wisp_id, index):
+                tag["n_corrupted"] += 1
+            else:
+                tag["lats"].append(now_ms()-send_time)
+            tag["n_inflight"] -= 1
+            client.recv(on_client_recv)
+        def on_open():
+            tag["connected"] = True
+            client.recv(on_client_recv)
+        client.on_open(on_open)
+        client.connect()
+    for client, wisp_id in zip(clients, wisp_ids):
+        start_client(client, wisp_id)
+
+    for _ in range(n_rounds):
+        # Keep messages in flight
+        for client, wisp_id in zip(clients, wisp_ids):
+            tag = tags[wisp_id]
+            while not downlink and tag["connected"] and tag["n_inflight"]<n_inflight:
+                index = tag["n_sent"]
+                try:
+                    client.send(make_msg(wisp_id, index))
+                except SimClientError:
+                    tag["n_send_errors"] += 1
+                    break
+                tag["up_sent"][index] = now_ms()
+                tag["n_inflight"] += 1
+                tag["n_sent"] += 1
+        reader.round()
+        max_queue_depth[0] = max([max_queue_depth[0]]+list(server.scheduler.queue_depths().values()))
+    for client in clients:
+        client.close()
+
+    sim_s = reader.time_us/1e6
+    # Echoed messages are carried on both links
+    n_links = 1 if downlink else 2
+    goodputs = [n_links*len(tags[wisp_id]["lats"])*msg_size/sim_s for wisp_id in wisp_ids]
+    p99s = []
+    for wisp_id in wisp_ids:
+        lats = sorted(tags[wisp_id]["lats"])
+        p99s.append(percentile(lats, 99))
+    return {
+        "goodput": sum(goodputs),
+        "min_goodput": min(goodputs),
+        "goodputs": goodputs,
+        "worst_p99": max(p99s),
+        "max_pending": factory.protocols[0].max_pending,
+        "max_queue_depth": max_queue_depth[0],
+        "n_reads": reader.n_reads,
+        "n_writes": reader.n_writes,
+        "sim_s": sim_s,
+        "n_corrupted": sum(tag["n_corrupted"] for tag in tags.values())
+    }
+
+def main():
+    parser = argparse.ArgumentParser(description="WTP multi-tag goodput and fairness benchmark")
+    parser.add_argument("-n", "--rounds", type=int, default=2000, help="RFID rounds per configuration")
+    parser.add_argument("-N", "--tags", type=int_list, default=[1, 2, 4, 8, 16], help="Numbers of tags")
+    parser.add_argument("-s", "--msg-size", type=int, default=32, help="Message size")
+    parser.add_argument("-i", "--inflight", type=int, default=2, help="Messages in flight per tag")
+    parser.add_argument("-m", "--max-in-flight", type=int_list, default=[1, 4, consts.LLRP_N_ACCESS_SPECS_MAX],
+        help="Scheduler AccessSpec limits")
+    parser.add_argument("-c", "--capacity", type=int, default=None,
+        help="Reader AccessSpec capacity (No limit by default)")
+    parser.add_argument("-T", "--client-timeout", type=int, default=10,
+        help="Client retransmission timeout (WIO timer ticks)")
+    parser.add_argument("-w", "--weights", type=int_list, default=None, help="Scheduling weights of tags")
+    parser.add_argument("-d", "--downlink", action="store_true", help="Downlink only instead of echo")
+    parser.add_argument("-t", "--timing", type=int_list, default=[3000, 2000, 250],
+        help="Inventory, OpSpec and per-word time (us)")
+    args = parser.parse_args()
+
+    lib = load_library()
+    print("%5s %5s | %9s %9s | %11s | %7s %7s%s" % (
+        "tags", "limit", "agg B/s", "min B/s", "worst p99ms", "pending", "queue",
+        " | per-tag B/s" if args.weights else ""
+    ))
+    for n_tags in args.tags:
+        for max_in_flight in args.max_in_flight:
+            r = run_multi_echo(lib, n_tags, args.msg_size, args.rounds, args.inflight, max_in_flight,
+                args.capacity, args.timing, client_timeout=args.client_timeout, weights=args.weights,
+                downlink=args.downlink)
+            print("%5d %5d | %9.1f %9.1f | %11.0f | %7d %7d%s%s" % (
+                n_tags, max_in_flight, r["goodput"], r["min_goodput"], r["worst_p99"],
+                r["max_pending"], r["max_queue_depth"],
+                " | "+" ".join("%.0f" % goodput for goodput in r["goodputs"]) if args.weights else "",
+                " (%d corrupted)" % r["n_corrupted"] if r["n_corrupted"] else ""
+            ))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,66 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse
+
+import wtp.constants as consts
+from wtp.cong_ctrl import NaiveOpSpecSizeControl, EWMAOpSpecSizeControl
+from bench.wtp_sim import load_library
+from bench.channel import ChannelModel
+from bench.goodput import run_echo, int_list
+
+## OpSpec size controls to compare
+CONTROLS = {
+    "naive": NaiveOpSpecSizeControl,
+    "ewma": EWMAOpSpecSizeControl
+}
+
+## Loss profiles (Name and channel model parameters)
+PROFILES = [
+    ("clean", {}),
+    ("flat-5%", {"opspec_loss": 0.05}),
+    ("flat-10%", {"opspec_loss": 0.1}),
+    ("word-1%", {"word_loss": 0.01}),
+    ("word-2%", {"word_loss": 0.02}),
+    ("word-5%", {"word_loss": 0.05}),
+    ("mixed", {"opspec_loss": 0.05, "word_loss": 0.01}),
+    # Energy-limited tag: OpSpecs longer than 10 words mostly fail
+    ("cliff-10w", {"opspec_loss": 0.02, "cliff_words": 10, "cliff_loss": 0.8}),
+    ("cliff-12w", {"opspec_loss": 0.02, "cliff_words": 12, "cliff_loss": 0.5})
+]
+
+def main():
+    parser = argparse.ArgumentParser(description="OpSpec size control benchmark over simulated loss profiles")
+    parser.add_argument("-n", "--rounds", type=int, default=5000, help="RFID rounds per configuration")
+    parser.add_argument("-c", "--controls", default="naive,ewma", help="OpSpec size controls to compare")
+    parser.add_argument("--seeds", type=int_list, default=[1, 2, 3], help="Random seeds")
+    parser.add_argument("-s", "--msg-size", type=int, default=32, help="Message size")
+    parser.add_argument("-W", "--window-size", type=int, default=64, help="Window size")
+    parser.add_argument("-o", "--opspec-init", type=int, default=consts.WTP_OPSPEC_INIT, help="Initial OpSpec size")
+    parser.add_argument("-T", "--timeout", type=float, default=0.5, help="Server retransmission timeout (s)")
+    parser.add_argument("-i", "--inflight", type=int, default=2, help="Messages in flight")
+    parser.add_argument("-b", "--buf-size", type=int, default=400, help="Client buffer size")
+    parser.add_argument("-t", "--timing", type=int_list, default=[3000, 2000, 250],
+        help="Inventory, OpSpec and per-word time (us)")
+    args = parser.parse_args()
+
+    lib = load_library()
+    controls = args.controls.split(",")
+    print("%-10s %-6s | %8s %8s | %-11s | %-11s | %s" % (
+        "profile", "ctrl", "up B/s", "down B/s", "fail R/BW", "mean R/BW", "msgs up/down"
+    ))
+    for name, params in PROFILES:
+        for control in controls:
+            # Sum of results over seeds
+            sums = [0.0]*8
+            for seed in args.seeds:
+                channel = ChannelModel(seed=seed, partial_write=0.5, **params)
+                r = run_echo(lib, args.msg_size, args.window_size, args.opspec_init, args.rounds, args.inflight,
+                    args.buf_size, args.timing, channel, args.timeout, opspec_ctrl_factory=CONTROLS[control])
+                for i, key in enumerate(("up_goodput", "down_goodput", "n_read_failures", "n_write_failures",
+                    "mean_read_size", "mean_write_size", "n_up", "n_down")):
+                    sums[i] += r[key]
+            means = [value/len(args.seeds) for value in sums]
+            print("%-10s %-6s | %8.1f %8.1f | %5.0f %5.0f | %5.1f %5.1f | %.0f/%.0f" % tuple([name, control]+means))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,168 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse, struct
+from twisted.internet.task import Clock
+
+from wtp import WTPServer
+from bench.wtp_sim import load_library, SimClient, SimClientError
+from bench.fake_reader import FakeLLRPClientFactory, FakeReader
+from bench.goodput import percentile, int_list
+
+## Message header format (Message index)
+_MSG_HEADER = "<I"
+## Modes: name, whether the client keeps a session, whether the server is kept across power cycles,
+## and whether the client keeps a checkpoint
+_MODES = [
+    ("open", False, False, False),
+    ("resume", True, True, False),
+    ("ckpt", True, True, True),
+    ("unknown", True, False, False)
+]
+
+def run_cycles(lib, keep_session, keep_server, keep_checkpoint, n_cycles, msg_size, n_rounds_on, n_rounds_max, timing):
+    """!
+    @brief Run power cycles of one mode.
+
+    After every power-up the client connects and sends messages one at a time,
+    and the server echoes every message back.
+
+    @param lib WTP simulator library.
+    @param keep_session Whether the client keeps a session to resume.
+    @param keep_server Whether the server is kept across power cycles (Otherwise it forgets the session).
+    @param keep_checkpoint Whether the client keeps a checkpoint of messages in flight.
+    @param n_cycles Number of power cycles.
+    @param msg_size Message size.
+    @param n_rounds_on Rounds of traffic after the first message is delivered, before power is lost.
+    @param n_rounds_max Rounds given up after if the first message is not delivered.
+    @param timing Inventory, OpSpec and per-word time in microseconds.
+    @return Benchmark results.
+    """
+    client = SimClient(lib, session=keep_session, checkpoint=keep_checkpoint)
+    # Benchmark state
+    state = {
+        "connected": False,
+        "inflight": False,
+        "n_sent": 0,
+        "n_up": 0,
+        "n_echoed": 0,
+        "n_corrupted": 0,
+        "n_send_errors": 0,
+        "n_dropped": 0
+    }
+    # Rounds and simulated time until the first message is delivered
+    rounds = []
+    times = []
+    n_failed = 0
+
+    def make_msg(index):
+        header = struct.pack(_MSG_HEADER, index)
+        return header+bytes(bytearray((index*31+i)&0xff for i in range(msg_size-len(header))))
+    def verify(msg_data):
+        index = struct.unpack_from(_MSG_HEADER, bytes(msg_data))[0]
+        return bytes(msg_data)==make_msg(index)
+    def make_server():
+        clock = Clock()
+        factory = FakeLLRPClientFactory()
+        server = WTPServer(reactor=clock, llrp_factory=factory)
+        reader = FakeReader(client, factory, clock, 0x01, *timing)
+        @server.on("connect")
+        def on_connect(connection):
+            def on_recv(msg_data):
+                state["n_up"] += 1
+                if not verify(msg_data):
+                    state["n_corrupted"] += 1
+                # Echo message (Dropped if the client loses power before it is acknowledged)
+                def on_dropped(failure):
+                    state["n_dropped"] += 1
+                connection.send(msg_data).addErrback(on_dropped)
+                connection.recv().addCallback(on_recv)
+            connection.recv().addCallback(on_recv)
+        return reader
+    # Client side
+    def on_sent():
+        state["inflight"] = False
+    def on_client_recv(msg_data):
+        state["n_echoed"] += 1
+        if not verify(msg_data):
+            state["n_corrupted"] += 1
+        client.recv(on_client_recv)
+    def on_open():
+        state["connected"] = True
+        client.recv(on_client_recv)
+    client.on_open(on_open)
+
+    reader = None
+    for cycle in range(n_cycles+1):
+        # Server is created again for a new connection, or to forget the session
+        if not reader or not keep_server:
+            reader = make_server()
+        if cycle>0:
+            client.power_cycle()
+        state["connected"] = state["inflight"] = False
+        client.connect()
+
+        n_up = state["n_up"]
+        begin_us = reader.time_us
+        first_round = None
+        for round_index in range(1, n_rounds_max+1):
+            # One message in flight at a time
+            if state["connected"] and not state["inflight"]:
+                try:
+                    client.send(make_msg(state["n_sent"]), on_sent)
+                    state["inflight"] = True
+                    state["n_sent"] += 1
+                except SimClientError:
+                    state["n_send_errors"] += 1
+            reader.round()
+            # First message delivered (The first power cycle sets up the session and is not counted)
+            if first_round==None and state["n_up"]!=n_up:
+                first_round = round_index
+                if cycle>0:
+                    rounds.append(round_index)
+                    times.append((reader.time_us-begin_us)/1000.0)
+            # Power lost
+            if first_round!=None and round_index-first_round>=n_rounds_on:
+                break
+        if cycle>0 and first_round==None:
+            n_failed += 1
+    client.close()
+
+    rounds.sort()
+    times.sort()
+    return {
+        "n_cycles": n_cycles,
+        "n_failed": n_failed,
+        "mean_rounds": float(sum(rounds))/len(rounds) if rounds else float("nan"),
+        "rounds": [percentile(rounds, p) for p in (50, 99, 100)],
+        "mean_ms": sum(times)/len(times) if times else float("nan"),
+        "n_echoed": state["n_echoed"],
+        "n_dropped": state["n_dropped"],
+        "n_corrupted": state["n_corrupted"]
+    }
+
+def main():
+    parser = argparse.ArgumentParser(description="WTP time to first message after power cycles")
+    parser.add_argument("-n", "--cycles", type=int, default=200, help="Power cycles per mode")
+    parser.add_argument("-s", "--msg-size", type=int, default=8, help="Message size")
+    parser.add_argument("-k", "--rounds-on", type=int, default=20,
+        help="Rounds of traffic after the first message is delivered, before power is lost")
+    parser.add_argument("-m", "--rounds-max", type=int, default=1000,
+        help="Rounds given up after if the first message is not delivered")
+    parser.add_argument("-t", "--timing", type=int_list, default=[3000, 2000, 250],
+        help="Inventory, OpSpec and per-word time (us)")
+    args = parser.parse_args()
+
+    lib = load_library()
+    print("%-8s %6s %6s | %6s %4s %4s %4s | %8s | %6s %7s %9s" % (
+        "mode", "cycles", "failed", "mean", "p50", "p99", "max", "mean ms", "echoed", "dropped", "corrupted"
+    ))
+    for name, keep_session, keep_server, keep_checkpoint in _MODES:
+        r = run_cycles(lib, keep_session, keep_server, keep_checkpoint, args.cycles, args.msg_size, args.rounds_on,
+            args.rounds_max, args.timing)
+        print("%-8s %6d %6d | %6.2f %4d %4d %4d | %8.1f | %6d %7d %9d" % (
+            name, r["n_cycles"], r["n_failed"], r["mean_rounds"], r["rounds"][0], r["rounds"][1],
+            r["rounds"][2], r["mean_ms"], r["n_echoed"], r["n_dropped"], r["n_corrupted"]
+        ))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,141 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse, sys
+from twisted.internet.defer import Deferred
+
+from wtp.scheduler import AccessSpecScheduler
+
+def _opspecs(name):
+    """!
+    @brief Make OpSpecs of a one-word Read.
+
+    @param name Name telling AccessSpecs apart.
+    @return OpSpecs.
+    """
+    return [{"OpSpecID": name, "WordCount": 1}]
+
+class FakeAccessSpecs(object):
+    """!
+    @brief AccessSpec sending function with add results decided by the scenario.
+    """
+    def __init__(self):
+        ## Pending add deferreds and OpSpecs of sent AccessSpecs, keyed by WISP ID
+        self.sent = {}
+        ## Number of AccessSpecs sent
+        self.n_sent = 0
+    def __call__(self, wisp_id, opspecs):
+        d = Deferred()
+        self.sent[wisp_id] = (d, opspecs)
+        self.n_sent += 1
+        return d
+    def accept(self, wisp_id):
+        """!
+        @brief Add an AccessSpec to the reader.
+
+        @param wisp_id WISP ID.
+        """
+        self.sent.pop(wisp_id)[0].callback(None)
+    def reject(self, wisp_id):
+        """!
+        @brief Reject an AccessSpec.
+
+        @param wisp_id WISP ID.
+        """
+        self.sent.pop(wisp_id)[0].errback(RuntimeError("Too many AccessSpecs"))
+
+def run_resubmit():
+    """!
+    @brief Cancel a tag with an AccessSpec on the reader and submit for it again.
+
+    @return Number of failed checks.
+    """
+    send = FakeAccessSpecs()
+    scheduler = AccessSpecScheduler(send, max_in_flight=2)
+    results = []
+    scheduler.submit(1, _opspecs("old")).addCallback(results.append)
+    send.accept(1)
+    scheduler.cancel(1)
+    scheduler.submit(1, _opspecs("new")).addCallback(results.append)
+    n_failed = int(send.n_sent!=1)
+    # Results of the cancelled AccessSpec are dropped, and the new one is sent
+    scheduler.complete(1, "old")
+    n_failed += int(results!=[] or send.sent.get(1, (None, None))[1]!=_opspecs("new"))
+    send.accept(1)
+    scheduler.complete(1, "new")
+    n_failed += int(results!=["new"] or scheduler.n_in_flight()!=0)
+    return n_failed
+
+def run_resubmit_rejected():
+    """!
+    @brief Cancel a tag whose AccessSpec is then rejected, and submit for it again.
+
+    @return Number of failed checks.
+    """
+    send = FakeAccessSpecs()
+    scheduler = AccessSpecScheduler(send, max_in_flight=2)
+    results = []
+    scheduler.submit(2, _opspecs("other"))
+    send.accept(2)
+    scheduler.submit(1, _opspecs("old")).addErrback(lambda failure: results.append("error"))
+    scheduler.cancel(1)
+    scheduler.submit(1, _opspecs("new")).addCallback(results.append)
+    # Rejection of the cancelled AccessSpec neither fails nor queues it again
+    send.reject(1)
+    n_failed = int(results!=[] or send.sent.get(1, (None, None))[1]!=_opspecs("new"))
+    send.accept(1)
+    scheduler.complete(1, "new")
+    n_failed += int(results!=["new"] or scheduler.max_in_flight!=2)
+    return n_failed
+
+def run_transient_reject(max_in_flight, n_rounds):
+    """!
+    @brief Reject one AccessSpec while another is on the reader, then keep tags busy.
+
+    @param max_in_flight Configured in-flight limit.
+    @param n_rounds Rounds of completing every AccessSpec on the reader.
+    @return Number of failed checks and in-flight limits after each round.
+    """
+    send = FakeAccessSpecs()
+    scheduler = AccessSpecScheduler(send, max_in_flight=max_in_flight)
+    wisp_ids = list(range(1, max_in_flight+1))
+    def keep_busy(wisp_id):
+        def on_done(_):
+            scheduler.submit(wisp_id, _opspecs(wisp_id)).addCallback(on_done)
+        return on_done
+    # The reader rejects the second AccessSpec once
+    for wisp_id in wisp_ids[:2]:
+        scheduler.submit(wisp_id, _opspecs(wisp_id)).addCallback(keep_busy(wisp_id))
+    send.accept(wisp_ids[0])
+    send.reject(wisp_ids[1])
+    n_failed = int(scheduler.max_in_flight!=1)
+    for wisp_id in wisp_ids[2:]:
+        scheduler.submit(wisp_id, _opspecs(wisp_id)).addCallback(keep_busy(wisp_id))
+    limits = []
+    for _ in range(n_rounds):
+        for wisp_id in list(send.sent):
+            send.accept(wisp_id)
+        for wisp_id in wisp_ids:
+            scheduler.complete(wisp_id, [])
+        limits.append(scheduler.max_in_flight)
+    n_failed += int(limits[-1]!=max_in_flight)
+    return n_failed, limits
+
+def main():
+    parser = argparse.ArgumentParser(description="AccessSpec scheduler cancellation and in-flight limit scenarios")
+    parser.add_argument("-m", "--max-in-flight", type=int, default=8, help="Configured in-flight limit")
+    parser.add_argument("-n", "--rounds", type=int, default=12, help="Rounds after a transient rejection")
+    args = parser.parse_args()
+
+    n_failed = 0
+    for name, run in (("resubmit", run_resubmit), ("resubmit-rejected", run_resubmit_rejected)):
+        failed = run()
+        n_failed += failed
+        print("%-18s | %s" % (name, "failed" if failed else "ok"))
+    failed, limits = run_transient_reject(args.max_in_flight, args.rounds)
+    n_failed += failed
+    print("%-18s | %s | limits %s" % ("transient-reject", "failed" if failed else "ok",
+        " ".join("%d" % limit for limit in limits)))
+    return 1 if n_failed else 0
+
+if __name__=="__main__":
+    sys.exit(main())
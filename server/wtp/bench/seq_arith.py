@@ -0,0 +1,130 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse, random, timeit
+from six.moves import range
+from twisted.internet.task import Clock
+
+import wtp.constants as consts
+from wtp.transmission import SlidingWindowTxControl, SlidingWindowRxControl
+from wtp.util import xor_checksum
+
+def make_rx_packets(n_packets, packet_size, msg_size, window_size, reorder, seed=1):
+    """!
+    @brief Make data packets of consecutive messages, as sent by a client.
+
+    Sequence numbers start close to the end of the sequence space so that
+    they wrap around during the run.
+
+    @param n_packets Number of packets.
+    @param packet_size Packet payload size.
+    @param msg_size Message size.
+    @param window_size Receive window size.
+    @param reorder Probability of swapping a packet with the next one.
+    @param seed Random seed.
+    @return Initial sequence number and list of (Sequence number, data, message size) tuples.
+    """
+    rand = random.Random(seed)
+    init_seq = consts.WTP_SEQ_MAX-window_size*4
+    packets = []
+    seq_num = init_seq
+    while len(packets)<n_packets:
+        for offset in range(0, msg_size, packet_size):
+            size = min(packet_size, msg_size-offset)
+            packets.append((seq_num%consts.WTP_SEQ_MAX, b"\x5a"*size, msg_size if offset==0 else None))
+            seq_num += size
+    packets = packets[:n_packets]
+    # Swap neighbouring packets
+    for i in range(len(packets)-1):
+        if rand.random()<reorder:
+            packets[i], packets[i+1] = packets[i+1], packets[i]
+    return init_seq, packets
+
+def run_rx(init_seq, packets, window_size):
+    """!
+    @brief Feed data packets to a receive control.
+
+    @param init_seq Initial sequence number.
+    @param packets Data packets.
+    @param window_size Receive window size.
+    @return Number of received messages.
+    """
+    rx_ctrl = SlidingWindowRxControl(window_size)
+    rx_ctrl.seq_num += init_seq
+    n_msgs = 0
+    for seq_num, data, msg_size in packets:
+        n_msgs += len(rx_ctrl.handle_packet(seq_num, data, msg_size))
+    return n_msgs
+
+def run_tx(n_msgs, msg_size, write_size, window_size, ack_every):
+    """!
+    @brief Send messages through a transmit control and acknowledge them.
+
+    @param n_msgs Number of messages.
+    @param msg_size Message size.
+    @param write_size BlockWrite size.
+    @param window_size Transmit window size.
+    @param ack_every Number of BlockWrites between acknowledgements.
+    @return Number of packets sent.
+    """
+    clock = Clock()
+    tx_ctrl = SlidingWindowTxControl(clock, write_size, window_size, xor_checksum, "B", 45, lambda: None)
+    # Start close to the end of the sequence space
+    tx_ctrl._seq_num += consts.WTP_SEQ_MAX-window_size*4
+    tx_ctrl._msg_begin += consts.WTP_SEQ_MAX-window_size*4
+    msg = b"\xa5"*msg_size
+    for _ in range(n_msgs):
+        tx_ctrl.add_msg(msg)
+    n_packets = 0
+    n_writes = 0
+    while True:
+        if not tx_ctrl.get_write_data():
+            # Window full or no more data; acknowledge everything sent
+            if not tx_ctrl._fragments:
+                break
+        n_writes += 1
+        if n_writes%ack_every==0 or not tx_ctrl._messages:
+            fragments = tx_ctrl._fragments
+            if fragments:
+                n_packets += len(fragments)
+                last = fragments[-1]
+                tx_ctrl.handle_ack(int(last.seq_num+len(last.data))%consts.WTP_SEQ_MAX)
+    return n_packets
+
+def best_time(func, repeat):
+    """!
+    @brief Get best run time of a function.
+
+    @param func Function to run.
+    @param repeat Number of runs.
+    @return Best run time in seconds and result of the function.
+    """
+    result = []
+    best_s = min(timeit.repeat(lambda: result.append(func()), number=1, repeat=repeat))
+    return best_s, result[-1]
+
+def main():
+    parser = argparse.ArgumentParser(description="WTP sequence number arithmetic per-packet CPU benchmark")
+    parser.add_argument("-n", "--packets", type=int, default=50000, help="Packets per run")
+    parser.add_argument("-p", "--packet-size", type=int, default=16, help="Packet payload size")
+    parser.add_argument("-s", "--msg-size", type=int, default=64, help="Message size")
+    parser.add_argument("-W", "--window-size", type=int, default=128, help="Window size")
+    parser.add_argument("-R", "--reorder", type=float, default=0.1, help="Probability of swapping neighbouring packets")
+    parser.add_argument("-r", "--repeat", type=int, default=5, help="Runs (Best run is reported)")
+    args = parser.parse_args()
+
+    init_seq, packets = make_rx_packets(args.packets, args.packet_size, args.msg_size, args.window_size, 0)
+    rx_s, n_msgs = best_time(lambda: run_rx(init_seq, packets, args.window_size), args.repeat)
+    print("rx in order:  %6.2f us/packet (%d messages)" % (rx_s*1e6/len(packets), n_msgs))
+    init_seq, packets = make_rx_packets(args.packets, args.packet_size, args.msg_size, args.window_size,
+        args.reorder)
+    rx_s, n_msgs = best_time(lambda: run_rx(init_seq, packets, args.window_size), args.repeat)
+    print("rx reordered: %6.2f us/packet (%d messages)" % (rx_s*1e6/len(packets), n_msgs))
+    # Packets of one BlockWrite carry 4 bytes of header and 1 byte of checksum each
+    write_size = args.packet_size+7
+    n_msgs = args.packets*args.packet_size//args.msg_size
+    tx_s, n_tx_packets = best_time(lambda: run_tx(n_msgs, args.msg_size, write_size, args.window_size, 4),
+        args.repeat)
+    print("tx + ack:     %6.2f us/packet (%d packets)" % (tx_s*1e6/max(n_tx_packets, 1), n_tx_packets))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,78 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse, random, struct, timeit
+from binascii import hexlify
+from six.moves import range
+from twisted.internet.task import Clock
+
+import wtp.constants as consts
+from wtp import WTPServer
+from bench.fake_reader import FakeLLRPClientFactory, FakeLLRPMessage
+
+## Class of non-WISP tags
+_OTHER_CLASS = 0x30
+
+def make_reports(n_wisps, n_others, n_reports, update_interval, batch_size, seed=1):
+    """!
+    @brief Make batches of tag reports of an inventory.
+
+    WISP EPCs carry no packets and change every "update_interval" reports
+    of the WISP, like EPCs of idle WISPs. EPCs of other tags never change.
+
+    @param n_wisps Number of WISPs.
+    @param n_others Number of non-WISP tags.
+    @param n_reports Number of tag reports.
+    @param update_interval Reports of a WISP between EPC changes.
+    @param batch_size Tag reports per LLRP message.
+    @param seed Random seed.
+    @return List of LLRP messages.
+    """
+    rand = random.Random(seed)
+    tags = [(wisp_id, consts.RFID_WISP_CLASS) for wisp_id in range(n_wisps)]
+    tags += [(rand.randrange(256), _OTHER_CLASS) for _ in range(n_others)]
+    # Number of reports of each tag
+    counters = [0]*len(tags)
+    reports = []
+    for _ in range(n_reports):
+        index = rand.randrange(len(tags))
+        tag_id, tag_class = tags[index]
+        # EPC of WISP changes every few reports
+        counter = counters[index]//update_interval if tag_class==consts.RFID_WISP_CLASS else index
+        counters[index] += 1
+        epc_data = struct.pack("<BBBI", tag_id, tag_class, consts.WTP_PKT_END, counter)
+        epc_data += bytes(bytearray(consts.RFID_EPC_SIZE-len(epc_data)))
+        reports.append({
+            "EPC-96": hexlify(epc_data)
+        })
+    return [FakeLLRPMessage(reports[i:i+batch_size]) for i in range(0, n_reports, batch_size)]
+
+def run_ingest(llrp_msgs):
+    """!
+    @brief Feed tag reports to a new server.
+
+    @param llrp_msgs LLRP messages.
+    """
+    factory = FakeLLRPClientFactory()
+    server = WTPServer(reactor=Clock(), llrp_factory=factory)
+    for llrp_msg in llrp_msgs:
+        server._handle_tag_report(llrp_msg)
+
+def main():
+    parser = argparse.ArgumentParser(description="WTP server tag report ingestion benchmark")
+    parser.add_argument("-n", "--reports", type=int, default=100000, help="Tag reports per run")
+    parser.add_argument("-w", "--wisps", type=int, default=200, help="Number of WISPs (At most 256)")
+    parser.add_argument("-o", "--others", type=int, default=300, help="Number of non-WISP tags")
+    parser.add_argument("-u", "--update-interval", type=int, default=16, help="Reports between WISP EPC changes")
+    parser.add_argument("-b", "--batch-size", type=int, default=32, help="Tag reports per LLRP message")
+    parser.add_argument("-r", "--repeat", type=int, default=5, help="Runs (Best run is reported)")
+    args = parser.parse_args()
+
+    llrp_msgs = make_reports(args.wisps, args.others, args.reports, args.update_interval, args.batch_size)
+    best_s = min(timeit.repeat(lambda: run_ingest(llrp_msgs), number=1, repeat=args.repeat))
+    print("%d reports (%d WISPs, %d other tags, %d per message): %.3f s, %.0f reports/s, %.2f us/report" % (
+        args.reports, args.wisps, args.others, args.batch_size, best_s, args.reports/best_s,
+        best_s*1e6/args.reports
+    ))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,194 @@
+#! /usr/bin/env python
+from __future__ import absolute_import, print_function, unicode_literals
+import argparse, random, struct, timeit
+from six.moves import range
+from twisted.internet.task import Clock
+
+from wtp import WTPServer
+from wtp.telemetry import TelemetryCodec
+from bench.wtp_sim import load_library, SimClient, SimTelemetryCodec
+from bench.fake_reader import FakeLLRPClientFactory, FakeReader
+from bench.goodput import int_list
+
+def build_accel(n_samples, rand):
+    """!
+    @brief Build accelerometer trace: 8-bit 3-axis samples of a tag lying still, with bursts of motion.
+
+    (Same model as "wtp-sensors" of the client simulator)
+
+    @param n_samples Number of samples.
+    @param rand Random number generator.
+    @return Samples, number of channels and raw size of a channel value.
+    """
+    samples = []
+    axes = [0, 0, 16]
+    motion = 0
+    for _ in range(n_samples):
+        if not motion and rand.randrange(512)==0:
+            motion = 64
+        for j in range(3):
+            if motion:
+                axes[j] = max(-127, min(127, axes[j]+rand.randint(-4, 4)))
+                samples.append(axes[j])
+            else:
+                samples.append(axes[j]+rand.randint(-1, 1))
+        if motion:
+            motion -= 1
+            if not motion:
+                axes = [0, 0, 16]
+    return samples, 3, 1
+
+def build_adc(n_samples, rand):
+    """!
+    @brief Build ADC trace: 12-bit samples of a slowly changing voltage, with rare spikes.
+
+    @param n_samples Number of samples.
+    @param rand Random number generator.
+    @return Samples, number of channels and raw size of a channel value.
+    """
+    samples = []
+    level = 2048
+    for _ in range(n_samples):
+        level = max(0, min(4095, level+rand.randint(-2, 2)))
+        value = level+rand.randint(-3, 3)
+        if rand.randrange(256)==0:
+            value = rand.randrange(4096)
+        samples.append(max(0, min(4095, value)))
+    return samples, 1, 2
+
+def pack_raw(samples, raw_size):
+    """!
+    @brief Pack samples as the sensors return them.
+
+    @param samples Samples.
+    @param raw_size Raw size of a channel value.
+    @return Raw sample data.
+    """
+    return struct.pack("<%d%s" % (len(samples), "b" if raw_size==1 else "H"), *samples)
+
+def run_codecs(lib, samples, n_channels, raw_size, batch, key_interval):
+    """!
+    @brief Encode a trace with the client codec and decode it with the server codec.
+
+    @param lib WTP simulator library.
+    @param samples Samples.
+    @param n_channels Number of channels.
+    @param raw_size Raw size of a channel value.
+    @param batch Number of samples in a frame.
+    @param key_interval Number of frames from one key frame to the next.
+    @return Benchmark results.
+    """
+    encoder = SimTelemetryCodec(lib, n_channels, key_interval)
+    decoder = TelemetryCodec()
+    step = batch*n_channels
+    batches = [samples[i:i+step] for i in range(0, len(samples)-step+1, step)]
+    frames = []
+    n_corrupted = 0
+    for batch_samples in batches:
+        frame = encoder.encode(batch_samples)
+        if list(decoder.decode(frame))!=batch_samples:
+            n_corrupted += 1
+        frames.append(frame)
+    encoder.close()
+    # Server codec, the other way round
+    py_encoder = TelemetryCodec(n_channels, key_interval)
+    py_frames = [py_encoder.encode(batch_samples) for batch_samples in batches]
+    if py_frames!=frames:
+        n_corrupted += 1
+    def decode_all():
+        py_decoder = TelemetryCodec()
+        for frame in frames:
+            py_decoder.decode(frame)
+    n_samples = float(len(batches)*batch)
+    return {
+        "raw": len(batches)*step*raw_size/n_samples,
+        "frame": sum(len(frame) for frame in frames)/n_samples,
+        "dec_us": min(timeit.repeat(decode_all, number=1, repeat=3))*1e6/n_samples,
+        "frames": frames,
+        "n_corrupted": n_corrupted
+    }
+
+def run_link(lib, msgs, timing, n_rounds_max=200000):
+    """!
+    @brief Send messages from the client over the simulated link, one message in flight.
+
+    @param lib WTP simulator library.
+    @param msgs Uplink messages.
+    @param timing Inventory, OpSpec and per-word time in microseconds.
+    @param n_rounds_max Rounds given up after.
+    @return Benchmark results.
+    """
+    clock = Clock()
+    factory = FakeLLRPClientFactory()
+    server = WTPServer(reactor=clock, llrp_factory=factory)
+    client = SimClient(lib)
+    reader = FakeReader(client, factory, clock, 0x01, *timing)
+    state = {"connected": False, "inflight": False, "n_sent": 0, "n_recv": 0}
+
+    @server.on("connect")
+    def on_connect(connection):
+        def on_recv(msg_data):
+            state["n_recv"] += 1
+            connection.recv().addCallback(on_recv)
+        connection.recv().addCallback(on_recv)
+    def on_sent():
+        state["inflight"] = False
+    def on_open():
+        state["connected"] = True
+    client.on_open(on_open)
+    client.connect()
+
+    n_rounds = 0
+    while state["n_recv"]<len(msgs) and n_rounds<n_rounds_max:
+        if state["connected"] and not state["inflight"] and state["n_sent"]<len(msgs):
+            client.send(msgs[state["n_sent"]], on_sent)
+            state["n_sent"] += 1
+            state["inflight"] = True
+        reader.round()
+        n_rounds += 1
+    client.close()
+    return {
+        "n_rounds": n_rounds,
+        "sim_s": reader.time_us/1e6,
+        "n_read_words": reader.n_read_words,
+        "n_recv": state["n_recv"]
+    }
+
+def main():
+    parser = argparse.ArgumentParser(description="Delta telemetry framing of sensor samples")
+    parser.add_argument("-s", "--samples", type=int, default=2048, help="Samples in trace")
+    parser.add_argument("-b", "--batches", type=int_list, default=[8, 16, 32], help="Samples in a frame")
+    parser.add_argument("-k", "--key-interval", type=int, default=16, help="Frames from one key frame to the next")
+    parser.add_argument("-r", "--seed", type=int, default=1, help="Random seed")
+    parser.add_argument("-t", "--timing", type=int_list, default=[3000, 2000, 250],
+        help="Inventory, OpSpec and per-word time (us)")
+    args = parser.parse_args()
+
+    lib = load_library()
+    traces = [
+        ("accel",)+build_accel(args.samples, random.Random(args.seed)),
+        ("adc",)+build_adc(args.samples, random.Random(args.seed))
+    ]
+    print("%-6s %5s | %8s %8s %6s | %9s | %s" % (
+        "trace", "batch", "raw B/s", "frame", "ratio", "dec us/s", "corrupted"))
+    results = {}
+    for name, samples, n_channels, raw_size in traces:
+        for batch in args.batches:
+            r = run_codecs(lib, samples, n_channels, raw_size, batch, args.key_interval)
+            results[(name, batch)] = r
+            print("%-6s %5d | %8.2f %8.2f %6.3f | %9.2f | %d" % (
+                name, batch, r["raw"], r["frame"], r["frame"]/r["raw"], r["dec_us"], r["n_corrupted"]))
+    print()
+    print("%-6s %5s %-6s | %7s %9s | %8s | %s" % (
+        "trace", "batch", "format", "rounds", "sim s", "R words", "received"))
+    for name, samples, n_channels, raw_size in traces:
+        for batch in args.batches:
+            step = batch*n_channels
+            raw_msgs = [pack_raw(samples[i:i+step], raw_size) for i in range(0, len(samples)-step+1, step)]
+            for fmt, msgs in (("raw", raw_msgs), ("frame", results[(name, batch)]["frames"])):
+                r = run_link(lib, msgs, args.timing)
+                print("%-6s %5d %-6s | %7d %9.1f | %8d | %d" % (
+                    name, batch, fmt, r["n_rounds"], r["sim_s"], r["n_read_words"], r["n_recv"]))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,519 @@
+from __future__ import absolute_import, unicode_literals
+import os, ctypes
+from collections import deque
+from ctypes import c_void_p, c_char_p, c_bool, c_int16, c_uint8, c_uint16, c_uint32, c_size_t, POINTER
+
+## Default location of the WTP simulator library
+_DEFAULT_LIB_PATH = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "..", "..", "..", "client", "wtp-sim", "build", "libwtp-sim.so"
+)
+
+## WIO callback function type
+WIO_CALLBACK = ctypes.CFUNCTYPE(c_uint8, c_void_p, c_uint8, c_void_p)
+
+## WTP events
+WTP_EVENT_OPEN = 0x00
+WTP_EVENT_HALF_CLOSE = 0x01
+WTP_EVENT_CLOSE = 0x02
+WTP_EVENT_RESTART = 0x03
+## WTP buffers
+WTP_BUF_PKT = 0x00
+WTP_BUF_TX_MSG = 0x01
+WTP_BUF_RX_MSG = 0x02
+WTP_BUF_FRAGMENTS = 0x03
+WTP_BUF_MAX = 0x04
+
+## Simulated tag memory sizes
+WTP_SIM_EPC_SIZE = 12
+WTP_SIM_READ_MEM_SIZE = 64
+WTP_SIM_WRITE_MEM_SIZE = 0x20
+## WIO OK status
+WIO_OK = 0
+
+class WioBuf(ctypes.Structure):
+    """!
+    @brief WIO buffer structure.
+    """
+    _fields_ = [
+        ("buffer", POINTER(c_uint8)),
+        ("size", c_uint16),
+        ("pos_a", c_uint16),
+        ("pos_b", c_uint16),
+        ("used_max", c_uint16)
+    ]
+
+class WtpSession(ctypes.Structure):
+    """!
+    @brief WTP session structure.
+    """
+    _fields_ = [
+        ("token", c_uint16),
+        ("tx_seq_num", c_uint16),
+        ("checksum", c_uint8),
+        ("framing", c_uint8),
+        ("crc", c_uint16)
+    ]
+
+class WtpFgk(ctypes.Structure):
+    """!
+    @brief WTP FGK codec structure.
+    """
+    _fields_ = [
+        ("nodes", c_void_p),
+        ("n_nodes_max", c_uint8),
+        ("n_nodes", c_uint8),
+        ("nyt", c_uint8),
+        ("in_stream", c_bool),
+        ("msg_index", c_uint8)
+    ]
+
+class WtpTelemetry(ctypes.Structure):
+    """!
+    @brief WTP telemetry codec structure.
+    """
+    _fields_ = [
+        ("prev", c_void_p),
+        ("n_channels", c_uint8),
+        ("key_interval", c_uint8),
+        ("in_stream", c_bool),
+        ("frame_index", c_uint8),
+        ("n_since_key", c_uint8)
+    ]
+
+def load_library(path=None):
+    """!
+    @brief Load WTP simulator library.
+
+    The library is built by "make" in "client/wtp-sim".
+    Its location can be overridden with the "WTP_SIM_LIB" environment variable.
+
+    @param path Path of the library.
+    @return WTP simulator library.
+    """
+    lib = ctypes.CDLL(path or os.environ.get("WTP_SIM_LIB", _DEFAULT_LIB_PATH))
+    # Function signatures
+    lib.wtp_sim_link_init.argtypes = [c_void_p, c_uint16, c_uint16, c_uint16, c_uint16, c_uint16, c_uint8, c_uint8]
+    lib.wtp_sim_link_fini.argtypes = [c_void_p]
+    lib.wtp_sim_link_before_rfid.argtypes = [c_void_p]
+    lib.wtp_sim_link_inventory.argtypes = [c_void_p, c_char_p]
+    lib.wtp_sim_link_read.argtypes = [c_void_p, c_char_p, c_uint16]
+    lib.wtp_sim_link_blockwrite.argtypes = [c_void_p, c_char_p, c_uint16]
+    lib.wtp_sim_link_advance.argtypes = [c_void_p, c_uint32]
+    lib.wtp_connect.argtypes = [c_void_p]
+    lib.wtp_set_checksum.argtypes = [c_void_p, c_uint8]
+    lib.wtp_set_framing.argtypes = [c_void_p, c_uint8]
+    lib.wtp_set_epc_cadence.argtypes = [c_void_p, c_uint8]
+    lib.wtp_set_session.argtypes = [c_void_p, POINTER(WtpSession)]
+    lib.wtp_set_checkpoint.argtypes = [c_void_p, c_void_p, c_void_p, c_uint16, c_void_p, c_uint16]
+    lib.wtp_send.argtypes = [c_void_p, c_char_p, c_uint16, c_void_p, WIO_CALLBACK]
+    lib.wtp_recv.argtypes = [c_void_p, c_void_p, WIO_CALLBACK]
+    lib.wtp_on_event.argtypes = [c_void_p, c_uint8, c_void_p, WIO_CALLBACK]
+    lib.wtp_get_mem_usage.argtypes = [c_void_p, c_uint8, POINTER(c_uint16), POINTER(c_uint16), POINTER(c_uint16)]
+    lib.wtp_fgk_init.argtypes = [POINTER(WtpFgk), c_uint8]
+    lib.wtp_fgk_fini.argtypes = [POINTER(WtpFgk)]
+    lib.wtp_fgk_reset.argtypes = [POINTER(WtpFgk)]
+    lib.wtp_fgk_encode.argtypes = [POINTER(WtpFgk), c_char_p, c_uint16, c_void_p, POINTER(c_uint16)]
+    lib.wtp_fgk_decode.argtypes = [POINTER(WtpFgk), c_char_p, c_uint16, c_void_p, c_uint16, POINTER(c_uint16)]
+    lib.wtp_telemetry_init.argtypes = [POINTER(WtpTelemetry), c_uint8, c_uint8]
+    lib.wtp_telemetry_fini.argtypes = [POINTER(WtpTelemetry)]
+    lib.wtp_telemetry_reset.argtypes = [POINTER(WtpTelemetry)]
+    lib.wtp_telemetry_encode.argtypes = [POINTER(WtpTelemetry), c_void_p, c_uint8, c_void_p, c_uint16, POINTER(c_uint16)]
+    lib.wtp_telemetry_decode.argtypes = [POINTER(WtpTelemetry), c_char_p, c_uint16, c_void_p, c_uint8, POINTER(c_uint8)]
+    for func in (lib.wtp_sim_link_init, lib.wtp_sim_link_fini, lib.wtp_sim_link_before_rfid,
+        lib.wtp_sim_link_inventory, lib.wtp_sim_link_read, lib.wtp_sim_link_blockwrite,
+        lib.wtp_sim_link_advance, lib.wtp_connect, lib.wtp_set_checksum, lib.wtp_set_framing, lib.wtp_send,
+        lib.wtp_recv, lib.wtp_on_event, lib.wtp_get_mem_usage, lib.wtp_set_epc_cadence, lib.wtp_set_session, lib.wtp_set_checkpoint,
+        lib.wtp_fgk_init, lib.wtp_fgk_fini, lib.wtp_fgk_reset, lib.wtp_fgk_encode, lib.wtp_fgk_decode,
+        lib.wtp_telemetry_init, lib.wtp_telemetry_fini, lib.wtp_telemetry_reset, lib.wtp_telemetry_encode,
+        lib.wtp_telemetry_decode):
+        func.restype = c_uint8
+    return lib
+
+class SimClientError(Exception):
+    """!
+    @brief WTP simulator client error.
+    """
+    def __init__(self, func, status):
+        """!
+        @brief WTP simulator client error constructor.
+
+        @param func Name of the failed function.
+        @param status WIO status code.
+        """
+        super(SimClientError, self).__init__("%s failed with status %d" % (func, status))
+        ## WIO status code
+        self.status = status
+
+class SimClient(object):
+    """!
+    @brief Client-side WTP endpoint behind a virtual link.
+    """
+    def __init__(self, lib, wisp_id=0x5101, window_size=64, timeout=10, tx_buf_size=200,
+        rx_buf_size=200, n_send=5, n_recv=5, checksum_algo=None, framing=None, epc_cadence=None,
+        session=False, checkpoint=False):
+        """!
+        @brief Simulated client constructor.
+
+        (Default parameters are the same as the ERT runtime)
+
+        @param lib WTP simulator library.
+        @param wisp_id WISP ID and class.
+        @param window_size Sliding window size.
+        @param timeout Packet retransmission timeout.
+        @param tx_buf_size Transmit control buffer size.
+        @param rx_buf_size Receive control buffer size.
+        @param n_send Capacity of send callbacks.
+        @param n_recv Capacity of receive callbacks.
+        @param checksum_algo Checksum algorithm to request, or None for the client default (CRC-16).
+        @param framing Data packet framing to request, or None for the client default (Standard framing).
+        @param epc_cadence EPC cadence, or None for the client default (Refresh as soon as EPC is observed).
+        @param session Keep a session for resuming the connection after power cycles.
+        @param checkpoint Keep transmit and receive control state in a checkpoint across power cycles
+            (Needs a session).
+        """
+        ## Simulator library
+        self._lib = lib
+        ## Virtual link memory
+        self._link = ctypes.create_string_buffer(c_size_t.in_dll(lib, "wtp_sim_link_size").value)
+        ## Client parameters (For initializing the client again after power cycles)
+        self._params = (wisp_id, window_size, timeout, tx_buf_size, rx_buf_size, n_send, n_recv)
+        ## Checksum algorithm, framing and EPC cadence to set after power cycles
+        self._settings = (checksum_algo, framing, epc_cadence)
+        ## Session (Survives power cycles like FRAM), or None
+        self.session = WtpSession() if session else None
+        ## Checkpoint and message buffers (Survive power cycles like FRAM), or None
+        ## (Message buffers are as big as the ones made by the client)
+        self._checkpoint = (
+            ctypes.create_string_buffer(c_size_t.in_dll(lib, "wtp_sim_checkpoint_size").value),
+            ctypes.create_string_buffer(tx_buf_size//4*3),
+            ctypes.create_string_buffer(rx_buf_size//2)
+        ) if session and checkpoint else None
+        ## Connection opened handler
+        self._open_handler = None
+        ## Connection restarted handler
+        self._restart_handler = None
+        ## Message sent handlers
+        self._send_handlers = deque()
+        ## Message received handlers
+        self._recv_handlers = deque()
+        ## WIO callbacks (Kept alive while used by C code)
+        self._sent_cb = WIO_CALLBACK(self._handle_sent)
+        self._recv_cb = WIO_CALLBACK(self._handle_recv)
+        self._open_cb = WIO_CALLBACK(self._handle_open)
+        self._restart_cb = WIO_CALLBACK(self._handle_restart)
+        self._init()
+    def _init(self):
+        """!
+        @brief Initialize virtual link and client.
+        """
+        lib = self._lib
+        checksum_algo, framing, epc_cadence = self._settings
+        self._check("wtp_sim_link_init", lib.wtp_sim_link_init(self._link, *self._params))
+        self._check("wtp_on_event", lib.wtp_on_event(self._link, WTP_EVENT_OPEN, None, self._open_cb))
+        self._check("wtp_on_event", lib.wtp_on_event(self._link, WTP_EVENT_RESTART, None, self._restart_cb))
+        if checksum_algo!=None:
+            self._check("wtp_set_checksum", lib.wtp_set_checksum(self._link, checksum_algo))
+        if framing!=None:
+            self._check("wtp_set_framing", lib.wtp_set_framing(self._link, framing))
+        if epc_cadence!=None:
+            self._check("wtp_set_epc_cadence", lib.wtp_set_epc_cadence(self._link, epc_cadence))
+        if self.session:
+            self._check("wtp_set_session", lib.wtp_set_session(self._link, ctypes.byref(self.session)))
+        if self._checkpoint:
+            checkpoint, tx_msg_mem, rx_msg_mem = self._checkpoint
+            self._check("wtp_set_checkpoint", lib.wtp_set_checkpoint(
+                self._link,
+                checkpoint,
+                tx_msg_mem,
+                len(tx_msg_mem),
+                rx_msg_mem,
+                len(rx_msg_mem)
+            ))
+    def _check(self, func, status):
+        """!
+        @brief Check status returned by a simulator function.
+
+        @param func Function name.
+        @param status WIO status code.
+        @throws SimClientError If status is not WIO_OK.
+        """
+        if status!=WIO_OK:
+            raise SimClientError(func, status)
+    def _handle_sent(self, data, status, result):
+        """!
+        @brief Message sent callback.
+
+        (Send callbacks are invoked in the same order as messages are sent)
+        """
+        handler = self._send_handlers.popleft()
+        if handler:
+            handler()
+        return WIO_OK
+    def _handle_recv(self, data, status, result):
+        """!
+        @brief Message received callback.
+
+        (Receive callbacks are invoked in the same order as they are added)
+        """
+        buf = ctypes.cast(result, POINTER(WioBuf)).contents
+        msg_data = ctypes.string_at(buf.buffer, buf.size)
+        self._recv_handlers.popleft()(msg_data)
+        return WIO_OK
+    def _handle_open(self, data, status, result):
+        """!
+        @brief Connection opened callback.
+        """
+        if self._open_handler:
+            self._open_handler()
+        return WIO_OK
+    def _handle_restart(self, data, status, result):
+        """!
+        @brief Connection restarted callback.
+        """
+        if self._restart_handler:
+            self._restart_handler()
+        return WIO_OK
+    def mem_usage(self, buf_id):
+        """!
+        @brief Get memory usage of a client buffer.
+
+        @param buf_id Buffer ID (WTP_BUF_*).
+        @return Memory in use, most memory in use so far and buffer size.
+        """
+        used, used_max, size = c_uint16(), c_uint16(), c_uint16()
+        self._check("wtp_get_mem_usage", self._lib.wtp_get_mem_usage(
+            self._link,
+            buf_id,
+            ctypes.byref(used),
+            ctypes.byref(used_max),
+            ctypes.byref(size)
+        ))
+        return used.value, used_max.value, size.value
+    def close(self):
+        """!
+        @brief Finalize client and release virtual link.
+        """
+        self._lib.wtp_sim_link_fini(self._link)
+    def power_cycle(self):
+        """!
+        @brief Lose power and start again.
+
+        All client memory but the session and the checkpoint is lost; the client is not connected afterwards.
+        """
+        self._lib.wtp_sim_link_fini(self._link)
+        self._send_handlers.clear()
+        self._recv_handlers.clear()
+        self._init()
+    def on_open(self, handler):
+        """!
+        @brief Set connection opened handler.
+
+        @param handler Handler function without arguments.
+        """
+        self._open_handler = handler
+    def on_restart(self, handler):
+        """!
+        @brief Set connection restarted handler.
+
+        (Called when the server no longer knew the resumed session and opened a new connection)
+
+        @param handler Handler function without arguments.
+        """
+        self._restart_handler = handler
+    def connect(self):
+        """!
+        @brief Connect to server.
+        """
+        self._check("wtp_connect", self._lib.wtp_connect(self._link))
+    def send(self, data, handler=None):
+        """!
+        @brief Send message to server.
+
+        @param data Message data.
+        @param handler Message sent handler function without arguments.
+        @throws SimClientError If the message can't be queued.
+        """
+        data = bytes(data)
+        self._check("wtp_send", self._lib.wtp_send(self._link, data, len(data), None, self._sent_cb))
+        self._send_handlers.append(handler)
+    def recv(self, handler):
+        """!
+        @brief Receive message from server.
+
+        @param handler Message received handler function, called with message data.
+        """
+        self._check("wtp_recv", self._lib.wtp_recv(self._link, None, self._recv_cb))
+        self._recv_handlers.append(handler)
+    def before_rfid(self):
+        """!
+        @brief Run client-side work before an RFID round.
+        """
+        self._lib.wtp_sim_link_before_rfid(self._link)
+    def inventory(self):
+        """!
+        @brief Inventory the simulated tag.
+
+        @return EPC-96 of the tag.
+        """
+        epc = ctypes.create_string_buffer(WTP_SIM_EPC_SIZE)
+        self._lib.wtp_sim_link_inventory(self._link, epc)
+        return epc.raw
+    def read(self, size):
+        """!
+        @brief Carry out an RFID Read on the simulated tag.
+
+        @param size Read size.
+        @return Read data.
+        """
+        data = ctypes.create_string_buffer(size)
+        self._lib.wtp_sim_link_read(self._link, data, size)
+        return data.raw
+    def blockwrite(self, mem):
+        """!
+        @brief Carry out an RFID BlockWrite on the simulated tag.
+
+        @param mem BlockWrite memory image.
+        @return WIO status of the client BlockWrite hook.
+        """
+        mem = bytes(mem)
+        return self._lib.wtp_sim_link_blockwrite(self._link, mem, len(mem))
+    def advance(self, ms):
+        """!
+        @brief Advance simulated time of the client.
+
+        @param ms Time to advance in milliseconds.
+        """
+        self._lib.wtp_sim_link_advance(self._link, ms)
+
+class SimFGKCodec(object):
+    """!
+    @brief FGK codec of the simulated client, with the interface of "wtp.compression.FGKCodec".
+    """
+    def __init__(self, lib, n_symbols):
+        """!
+        @brief Simulated client FGK codec constructor.
+
+        @param lib WTP simulator library.
+        @param n_symbols Maximum number of symbols in tree.
+        """
+        ## WTP simulator library
+        self._lib = lib
+        ## Codec structure
+        self._codec = WtpFgk()
+        self._check("wtp_fgk_init", lib.wtp_fgk_init(ctypes.byref(self._codec), n_symbols))
+    def _check(self, func, status):
+        """!
+        @brief Raise an error for a failed library call.
+
+        @param func Name of the library function.
+        @param status WIO status code.
+        """
+        if status!=WIO_OK:
+            raise SimClientError(func, status)
+    def reset(self):
+        """!
+        @brief Reset codec and begin a new stream.
+        """
+        self._lib.wtp_fgk_reset(ctypes.byref(self._codec))
+    def encode(self, msg_data):
+        """!
+        @brief Compress a message.
+
+        @param msg_data Message data.
+        @return Compressed message data.
+        """
+        out = ctypes.create_string_buffer(len(msg_data)+1)
+        out_size = c_uint16()
+        self._check("wtp_fgk_encode", self._lib.wtp_fgk_encode(
+            ctypes.byref(self._codec), bytes(msg_data), len(msg_data), out, ctypes.byref(out_size)
+        ))
+        return out.raw[:out_size.value]
+    def decode(self, data, size_max=0xffff):
+        """!
+        @brief Decompress a message.
+
+        @param data Compressed message data.
+        @param size_max Maximum message size.
+        @return Message data.
+        """
+        out = ctypes.create_string_buffer(size_max)
+        out_size = c_uint16()
+        self._check("wtp_fgk_decode", self._lib.wtp_fgk_decode(
+            ctypes.byref(self._codec), bytes(data), len(data), out, size_max, ctypes.byref(out_size)
+        ))
+        return out.raw[:out_size.value]
+    def close(self):
+        """!
+        @brief Release tree memory.
+        """
+        self._lib.wtp_fgk_fini(ctypes.byref(self._codec))
+
+class SimTelemetryCodec(object):
+    """!
+    @brief Telemetry codec of the simulated client, with the interface of "wtp.telemetry.TelemetryCodec".
+    """
+    def __init__(self, lib, n_channels, key_interval=0):
+        """!
+        @brief Simulated client telemetry codec constructor.
+
+        @param lib WTP simulator library.
+        @param n_channels Number of channels of each sample.
+        @param key_interval Number of frames from one key frame to the next.
+        """
+        ## WTP simulator library
+        self._lib = lib
+        ## Number of channels
+        self.n_channels = n_channels
+        ## Codec structure
+        self._codec = WtpTelemetry()
+        self._check("wtp_telemetry_init", lib.wtp_telemetry_init(ctypes.byref(self._codec), n_channels, key_interval))
+    def _check(self, func, status):
+        """!
+        @brief Raise an error for a failed library call.
+
+        @param func Name of the library function.
+        @param status WIO status code.
+        """
+        if status!=WIO_OK:
+            raise SimClientError(func, status)
+    def reset(self):
+        """!
+        @brief Reset codec and begin a new stream.
+        """
+        self._lib.wtp_telemetry_reset(ctypes.byref(self._codec))
+    def encode(self, samples):
+        """!
+        @brief Encode a batch of samples into a frame.
+
+        @param samples Samples, with the channels of each sample next to each other.
+        @return Frame data.
+        """
+        n_samples = len(samples)//self.n_channels
+        values = (c_int16*len(samples))(*[(sample+0x8000)%0x10000-0x8000 for sample in samples])
+        size_max = 3+self.n_channels*(4+2*n_samples)
+        out = ctypes.create_string_buffer(size_max)
+        out_size = c_uint16()
+        self._check("wtp_telemetry_encode", self._lib.wtp_telemetry_encode(
+            ctypes.byref(self._codec), values, n_samples, out, size_max, ctypes.byref(out_size)
+        ))
+        return out.raw[:out_size.value]
+    def decode(self, data, n_samples_max=0xff):
+        """!
+        @brief Decode a frame into a batch of samples.
+
+        @param data Frame data.
+        @param n_samples_max Maximum number of samples.
+        @return Samples, with the channels of each sample next to each other.
+        """
+        values = (c_int16*(n_samples_max*self.n_channels))()
+        n_samples = c_uint8()
+        self._check("wtp_telemetry_decode", self._lib.wtp_telemetry_decode(
+            ctypes.byref(self._codec), bytes(data), len(data), values, n_samples_max, ctypes.byref(n_samples)
+        ))
+        return list(values[:n_samples.value*self.n_channels])
+    def close(self):
+        """!
+        @brief Release codec memory.
+        """
+        self._lib.wtp_telemetry_fini(ctypes.byref(self._codec))
@@ -0,0 +1,322 @@
+from __future__ import absolute_import, unicode_literals
+import logging
+from binascii import hexlify, unhexlify
+from twisted.internet.defer import Deferred
+
+import wtp.constants as consts
+from wtp.error import WTPError
+
+## Module logger
+_logger = logging.getLogger(__name__)
+# Logger level
+_logger.setLevel(logging.DEBUG)
+
+class FGKCodec(object):
+    """!
+    @brief FGK (Adaptive Huffman) codec class.
+
+    Bit-compatible with the client codec ("wtp/fgk.h"): nodes are kept in decreasing
+    order of weight with the root first, and the tree holds at most 2*n_symbols+1 nodes.
+    Symbols seen after the tree is full are sent as escaped 8-bit literals.
+    """
+    def __init__(self, n_symbols=consts.WTP_FGK_N_SYMBOLS):
+        """!
+        @brief FGK codec constructor.
+
+        @param n_symbols Maximum number of symbols in tree.
+        """
+        if n_symbols<1 or n_symbols>consts.WTP_FGK_SYMBOLS_MAX:
+            raise WTPError(consts.WTP_ERR_INVALID_PARAM)
+        ## Maximum number of tree nodes
+        self._n_nodes_max = 2*n_symbols+1
+        self.reset()
+    def reset(self):
+        """!
+        @brief Reset codec and begin a new stream.
+
+        The next encoded message is flagged with WTP_FGK_RESET. Reset the encoder
+        before every message to compress messages independently of each other.
+        """
+        self._reset_tree()
+        ## A stream of messages is in progress
+        self._in_stream = False
+        ## Index of next message in stream
+        self._msg_index = 0
+    def _reset_tree(self):
+        """!
+        @brief Reset tree to a single NYT leaf.
+        """
+        ## Node weights
+        self._weights = [0]
+        ## Leaf flags of nodes
+        self._leaf = [True]
+        ## Parent of node positions
+        self._parents = [0]
+        ## First child of internal nodes (The second child follows it), or symbol of leaves
+        self._links = [0]
+        ## Index of the NYT (Not yet transmitted) leaf
+        self._nyt = 0
+        ## Leaf index of symbols
+        self._leaves = {}
+    def _swap(self, a, b):
+        """!
+        @brief Swap the subtrees at two tree positions.
+
+        @param a First position.
+        @param b Second position.
+        """
+        weights, leaf, links = self._weights, self._leaf, self._links
+        weights[a], weights[b] = weights[b], weights[a]
+        leaf[a], leaf[b] = leaf[b], leaf[a]
+        links[a], links[b] = links[b], links[a]
+        # Children and symbols follow their parents to new positions
+        for pos in (a, b):
+            link = links[pos]
+            if leaf[pos]:
+                if pos!=self._nyt:
+                    self._leaves[link] = pos
+            else:
+                self._parents[link] = self._parents[link+1] = pos
+    def _update(self, symbol, leaf):
+        """!
+        @brief Update tree after a symbol is coded.
+
+        @param symbol Symbol.
+        @param leaf Leaf of symbol, or 0 for a new symbol.
+        """
+        weights, parents = self._weights, self._parents
+        q = leaf
+        # New symbol
+        if not q:
+            # Tree is full; the symbol stays escaped
+            if self._n_nodes_max-len(weights)<2:
+                return
+            # Split NYT leaf into a leaf of the symbol and a new NYT leaf
+            parent = self._nyt
+            q = len(weights)
+            self._leaf[parent] = False
+            self._links[parent] = q
+            weights.extend((0, 0))
+            self._leaf.extend((True, True))
+            parents.extend((parent, parent))
+            self._links.extend((symbol, 0))
+            self._leaves[symbol] = q
+            self._nyt = q+1
+        while True:
+            # Leader of the block of nodes with the same weight
+            weight = weights[q]
+            leader = q
+            while leader>0 and weights[leader-1]==weight:
+                leader -= 1
+            # Move node to the front of its block
+            if leader!=q and leader!=parents[q]:
+                self._swap(q, leader)
+                q = leader
+            weights[q] += 1
+            # Root reached
+            if not q:
+                break
+            q = parents[q]
+    def _code(self, node):
+        """!
+        @brief Get code of a tree node.
+
+        @param node Tree node index.
+        @return Code and code length.
+        """
+        parents, links = self._parents, self._links
+        code = depth = 0
+        while node:
+            parent = parents[node]
+            code |= (node-links[parent])<<depth
+            depth += 1
+            node = parent
+        return code, depth
+    def encode(self, msg_data):
+        """!
+        @brief Compress a message.
+
+        Messages are stored as is when compression doesn't make them smaller.
+
+        @param msg_data Message data.
+        @return Compressed message data.
+        """
+        msg_data = bytearray(msg_data)
+        # Begin a new stream after reset
+        header = 0
+        if not self._in_stream:
+            header |= consts.WTP_FGK_RESET
+            self._in_stream = True
+        header |= (self._msg_index&consts.WTP_FGK_HEADER_MASK)<<consts.WTP_FGK_INDEX_SHIFT
+        self._msg_index += 1
+        # Bits are accumulated in an integer
+        bits = n_bits = 0
+        for symbol in msg_data:
+            # Reset tree before weights overflow
+            if self._weights[0]>=consts.WTP_FGK_WEIGHT_MAX:
+                self._reset_tree()
+            leaf = self._leaves.get(symbol, 0)
+            # Known symbol
+            if leaf:
+                code, depth = self._code(leaf)
+            # New symbol follows NYT code as a literal
+            else:
+                code, depth = self._code(self._nyt)
+                code = (code<<8)|symbol
+                depth += 8
+            bits = (bits<<depth)|code
+            n_bits += depth
+            self._update(symbol, leaf)
+        out_size = (n_bits+7)//8
+        # Compressed message
+        if out_size<len(msg_data):
+            n_padding = out_size*8-n_bits
+            header |= consts.WTP_FGK_COMPRESSED|n_padding
+            payload = unhexlify("%0*x" % (out_size*2, bits<<n_padding))
+        # Stored message
+        else:
+            payload = bytes(msg_data)
+        return bytes(bytearray((header,)))+payload
+    def decode(self, data):
+        """!
+        @brief Decompress a message.
+
+        The stream is broken on failure, and messages are rejected until the
+        encoder begins a new stream.
+
+        @param data Compressed message data.
+        @return Message data.
+        """
+        data = bytearray(data)
+        if len(data)<consts.WTP_FGK_HEADER_SIZE:
+            raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+        header = data[0]
+        # First message of a new stream
+        if header&consts.WTP_FGK_RESET:
+            self.reset()
+            self._in_stream = True
+        # Messages missing or out of stream
+        elif not self._in_stream or \
+            ((header>>consts.WTP_FGK_INDEX_SHIFT)&consts.WTP_FGK_HEADER_MASK)!=(self._msg_index&consts.WTP_FGK_HEADER_MASK):
+            self._in_stream = False
+            raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+        self._msg_index += 1
+        try:
+            return self._decode_payload(header, data[consts.WTP_FGK_HEADER_SIZE:])
+        # Tree is out of sync with the encoder
+        except WTPError:
+            self._in_stream = False
+            raise
+    def _decode_payload(self, header, payload):
+        """!
+        @brief Decompress message payload.
+
+        @param header Message header.
+        @param payload Message payload.
+        @return Message data.
+        """
+        # Stored message (The tree is updated as if it were compressed)
+        if not header&consts.WTP_FGK_COMPRESSED:
+            for symbol in payload:
+                if self._weights[0]>=consts.WTP_FGK_WEIGHT_MAX:
+                    self._reset_tree()
+                self._update(symbol, self._leaves.get(symbol, 0))
+            return bytes(payload)
+        # Number of bits without padding
+        n_padding = header&consts.WTP_FGK_HEADER_MASK
+        if not payload:
+            raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+        size_bits = len(payload)*8
+        n_bits = size_bits-n_padding
+        bits = int(hexlify(bytes(payload)), 16)
+        pos = 0
+        msg_data = bytearray()
+        while pos<n_bits:
+            if self._weights[0]>=consts.WTP_FGK_WEIGHT_MAX:
+                self._reset_tree()
+            leaf, links = self._leaf, self._links
+            # Walk from root to leaf
+            node = 0
+            while not leaf[node]:
+                if pos>=n_bits:
+                    raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+                node = links[node]+((bits>>(size_bits-1-pos))&1)
+                pos += 1
+            # Literal of a new symbol
+            if node==self._nyt:
+                if n_bits-pos<8:
+                    raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+                symbol = (bits>>(size_bits-8-pos))&0xff
+                pos += 8
+                node = 0
+            else:
+                symbol = links[node]
+            msg_data.append(symbol)
+            self._update(symbol, node)
+        return bytes(msg_data)
+
+class FGKConnection(object):
+    """!
+    @brief Compressed message layer over a WTP connection.
+
+    Each direction is one stream of messages. The client loses its trees with
+    power, so a new downlink stream begins when the connection resumes.
+    """
+    def __init__(self, connection, n_symbols=consts.WTP_FGK_N_SYMBOLS):
+        """!
+        @brief Compressed connection constructor.
+
+        @param connection WTP connection.
+        @param n_symbols Maximum number of symbols in tree.
+        """
+        ## WTP connection
+        self.connection = connection
+        ## Downlink codec
+        self._encoder = FGKCodec(n_symbols)
+        ## Uplink codec
+        self._decoder = FGKCodec(n_symbols)
+        # Begin a new downlink stream on resume
+        connection.on("resume", lambda _: self._encoder.reset())
+    @property
+    def wisp_id(self):
+        """!
+        @brief WISP ID of the connection.
+        """
+        return self.connection.wisp_id
+    def send(self, msg_data):
+        """!
+        @brief Compress and send a message to WISP.
+
+        @param msg_data Message data
+        @return A deferred object that will be resolved when the message is fully sent.
+        """
+        d = self.connection.send(self._encoder.encode(msg_data))
+        # The client never decodes a failed message; begin a new stream
+        def on_failed(failure):
+            self._encoder.reset()
+            return failure
+        return d.addErrback(on_failed)
+    def recv(self):
+        """!
+        @brief Receive and decompress a message from WISP.
+
+        Messages that fail to decompress are dropped.
+
+        @return A deferred object that will be resolved with received message data.
+        """
+        d = Deferred()
+        def on_recv(data):
+            try:
+                msg_data = self._decoder.decode(data)
+            except WTPError as e:
+                _logger.debug("Dropped compressed message of WISP #%d: %#x", self.wisp_id, e.reason)
+                self.connection.recv().addCallback(on_recv)
+                return
+            d.callback(msg_data)
+        self.connection.recv().addCallback(on_recv)
+        return d
+    def close(self):
+        """!
+        @brief Close WTP connection with WISP.
+        """
+        self.connection.close()
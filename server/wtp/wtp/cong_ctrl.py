@@ -1,5 +1,6 @@
 from __future__ import absolute_import, unicode_literals
 import logging
+from six.moves import range
 
 from wtp.constants import WTP_OPSPEC_MIN, WTP_OPSPEC_MAX
 
@@ -8,15 +9,17 @@ _logger = logging.getLogger(__name__)
 # Logger level
 _logger.setLevel(logging.DEBUG)
 
-# TODO: More sophisticated OpSpec size control
-# TODO: Current implementation is naive and is demo only
 class OpSpecSizeControl(object):
     """!
-    @brief Demo OpSpec size control class.
+    @brief OpSpec size control base class.
+
+    The base class keeps track of pending OpSpecs and matches their sizes with
+    reported results. Subclasses decide the desired Read and BlockWrite size
+    by implementing "_update_read_size()" and "_update_write_size()".
     """
     def __init__(self, read_size, write_size):
         """!
-        @brief Demo OpSpec size control constructor.
+        @brief OpSpec size control constructor.
 
         @param read_size Initial desired Read OpSpec size.
         @param write_size Initial desired BlockWrite OpSpec size.
@@ -43,6 +46,16 @@ class OpSpecSizeControl(object):
         @param size Size of the BlockWrite OpSpec.
         """
         self._pending_writes.append(size)
+    def cancel_read(self):
+        """!
+        @brief Remove oldest pending Read OpSpec that was never carried out.
+        """
+        self._pending_reads.pop(0)
+    def cancel_write(self):
+        """!
+        @brief Remove oldest pending BlockWrite OpSpec that was never carried out.
+        """
+        self._pending_writes.pop(0)
     def report_read_result(self, succeeded, actual_size):
         """!
         @brief Report Read OpSpec result to OpSpec size control.
@@ -52,6 +65,47 @@ class OpSpecSizeControl(object):
         """
         # Pop original Read size
         read_size = self._pending_reads.pop(0)
+        self._update_read_size(read_size, succeeded, actual_size)
+    def report_write_result(self, succeeded, actual_size):
+        """!
+        @brief Report BlockWrite result to OpSpec size control.
+
+        @param succeeded Whether the BlockWrite operation succeeded or not.
+        @param actual_size Actual BlockWrite size.
+        """
+        # Pop original BlockWrite size
+        blockwrite_size = self._pending_writes.pop(0)
+        self._update_write_size(blockwrite_size, succeeded, actual_size)
+    def _update_read_size(self, size, succeeded, actual_size):
+        """!
+        @brief Update desired Read size from the result of a Read OpSpec.
+
+        @param size Requested Read size.
+        @param succeeded Whether the Read operation succeeded or not.
+        @param actual_size Actual Read size.
+        """
+        raise NotImplementedError()
+    def _update_write_size(self, size, succeeded, actual_size):
+        """!
+        @brief Update desired BlockWrite size from the result of a BlockWrite OpSpec.
+
+        @param size Requested BlockWrite size.
+        @param succeeded Whether the BlockWrite operation succeeded or not.
+        @param actual_size Actual BlockWrite size.
+        """
+        raise NotImplementedError()
+
+class NaiveOpSpecSizeControl(OpSpecSizeControl):
+    """!
+    @brief Demo OpSpec size control class.
+
+    The desired size grows by 2 after every successful OpSpec of the desired
+    size and shrinks by 2 after every failed OpSpec.
+    """
+    def _update_read_size(self, size, succeeded, actual_size):
+        """!
+        @brief Step desired Read size by 2 according to Read result.
+        """
         # Increase Read size by 2 if:
         # 1) Read succeeded
         # 2) Actual Read size is no smaller than current Read size
@@ -65,15 +119,10 @@ class OpSpecSizeControl(object):
         if not succeeded and self.read_size>WTP_OPSPEC_MIN:
             _logger.debug("Read size decreased by 2; currently %d", self.read_size)
             self.read_size -= 2
-    def report_write_result(self, succeeded, actual_size):
+    def _update_write_size(self, size, succeeded, actual_size):
         """!
-        @brief Report BlockWrite result to OpSpec size control.
-
-        @param succeeded Whether the BlockWrite operation succeeded or not.
-        @param actual_size Actual BlockWrite size.
+        @brief Step desired BlockWrite size by 2 according to BlockWrite result.
         """
-        # Pop original BlockWrite size
-        blockwrite_size = self._pending_writes.pop(0)
         # Increase BlockWrite size by 2 if:
         # 1) BlockWrite succeeded
         # 2) Actual BlockWrite size is no smaller than current BlockWrite size
@@ -87,3 +136,158 @@ class OpSpecSizeControl(object):
         if not succeeded and self.write_size>WTP_OPSPEC_MIN:
             _logger.debug("BlockWrite size decreased by 2; currently %d", self.write_size)
             self.write_size -= 2
+
+class SuccessRateCurve(object):
+    """!
+    @brief Success rate versus OpSpec size curve.
+
+    OpSpec sizes are grouped into 2-byte buckets between WTP_OPSPEC_MIN and
+    WTP_OPSPEC_MAX. Every bucket keeps exponentially decayed counts of OpSpecs
+    and successful OpSpecs of that size, and its success rate is estimated with
+    the average success rate of all sizes as prior. A bucket with few recent
+    results therefore follows its own results quickly, and a bucket not in use
+    drifts back towards the average, so that sizes given up after a burst of
+    failures are tried again later. A larger OpSpec is assumed to be no more
+    reliable than a smaller one.
+    """
+    def __init__(self, alpha=0.05, decay=0.005, prior=4.0, opspec_cost=16, overhead=6, hysteresis=0.1):
+        """!
+        @brief Success rate curve constructor.
+
+        @param alpha Weight of a new result in the average success rate of all sizes.
+        @param decay Decay of bucket counts per result.
+        @param prior Weight of the average success rate in bucket estimations, in number of results.
+        @param opspec_cost Fixed time cost of an OpSpec, in bytes transferred within the same time.
+        @param overhead Bytes of an OpSpec not carrying message data.
+        @param hysteresis Minimum relative goodput gain for changing size.
+        """
+        ## Weight of new result in average success rate
+        self.alpha = alpha
+        ## Decay of bucket counts
+        self.decay = decay
+        ## Weight of average success rate in bucket estimations
+        self.prior = prior
+        ## Fixed time cost of an OpSpec in bytes
+        self.opspec_cost = opspec_cost
+        ## Bytes of an OpSpec not carrying message data
+        self.overhead = overhead
+        ## Minimum relative goodput gain for changing size
+        self.hysteresis = hysteresis
+        ## Average success rate of all sizes
+        self.rate = 1.0
+        ## Number of buckets
+        n_buckets = (WTP_OPSPEC_MAX-WTP_OPSPEC_MIN)//2+1
+        ## Decayed number of OpSpecs of size buckets
+        self._n_results = [0.0]*n_buckets
+        ## Decayed number of successful OpSpecs of size buckets
+        self._n_successes = [0.0]*n_buckets
+    def _bucket(self, size):
+        """!
+        @brief Get bucket index of an OpSpec size.
+
+        @param size OpSpec size.
+        @return Bucket index.
+        """
+        # Round up to words and clamp to size range
+        size = min(max(size+(size&1), WTP_OPSPEC_MIN), WTP_OPSPEC_MAX)
+        return (size-WTP_OPSPEC_MIN)//2
+    def update(self, size, succeeded):
+        """!
+        @brief Update curve with the result of an OpSpec.
+
+        @param size OpSpec size.
+        @param succeeded Whether the OpSpec succeeded or not.
+        """
+        result = 1.0 if succeeded else 0.0
+        self.rate += self.alpha*(result-self.rate)
+        # Decay counts of all buckets
+        n_results = self._n_results
+        n_successes = self._n_successes
+        for i in range(len(n_results)):
+            n_results[i] *= 1-self.decay
+            n_successes[i] *= 1-self.decay
+        # Count result
+        bucket = self._bucket(size)
+        n_results[bucket] += 1
+        n_successes[bucket] += result
+    def success_rate(self, size):
+        """!
+        @brief Estimate success rate of an OpSpec size.
+
+        @param size OpSpec size.
+        @return Estimated success rate.
+        """
+        bucket = self._bucket(size)
+        return (self._n_successes[bucket]+self.prior*self.rate)/(self._n_results[bucket]+self.prior)
+    def best_size(self, current_size):
+        """!
+        @brief Get OpSpec size with highest expected goodput.
+
+        The expected goodput of a size is its success rate times message bytes
+        per byte of OpSpec time. Changing size is costly for the client, which
+        has fragmented messages and requested Reads with the current size, so
+        the current size is kept unless another size is clearly better.
+
+        @param current_size Current OpSpec size.
+        @return OpSpec size.
+        """
+        best_size = WTP_OPSPEC_MIN
+        best_goodput = -1.0
+        current_goodput = 0.0
+        current_bucket = self._bucket(current_size)
+        # Success rate no higher than that of smaller sizes
+        rate = 1.0
+        for i, size in enumerate(range(WTP_OPSPEC_MIN, WTP_OPSPEC_MAX+1, 2)):
+            rate = min(rate, self.success_rate(size))
+            goodput = rate*(size-self.overhead)/float(size+self.opspec_cost)
+            if goodput>=best_goodput:
+                best_size = size
+                best_goodput = goodput
+            if i==current_bucket:
+                current_goodput = goodput
+        # Keep current size
+        if best_goodput<=current_goodput*(1+self.hysteresis):
+            return current_size
+        return best_size
+
+class EWMAOpSpecSizeControl(OpSpecSizeControl):
+    """!
+    @brief Model-based OpSpec size control class.
+
+    Success rate curves of Read and BlockWrite are tracked separately, and the
+    desired size is the size with the highest expected goodput on the curve.
+    """
+    def __init__(self, read_size, write_size, **kwargs):
+        """!
+        @brief Model-based OpSpec size control constructor.
+
+        @param read_size Initial desired Read OpSpec size.
+        @param write_size Initial desired BlockWrite OpSpec size.
+        @param kwargs Parameters of the success rate curves.
+        """
+        # Initialize base class
+        super(EWMAOpSpecSizeControl, self).__init__(read_size, write_size)
+        ## Read success rate curve
+        self._read_curve = SuccessRateCurve(**kwargs)
+        ## BlockWrite success rate curve
+        self._write_curve = SuccessRateCurve(**kwargs)
+    def _update_read_size(self, size, succeeded, actual_size):
+        """!
+        @brief Update Read success rate curve and pick size with highest expected goodput.
+        """
+        curve = self._read_curve
+        curve.update(size, succeeded)
+        read_size = curve.best_size(self.read_size)
+        if read_size!=self.read_size:
+            _logger.debug("Read size changed to %d", read_size)
+            self.read_size = read_size
+    def _update_write_size(self, size, succeeded, actual_size):
+        """!
+        @brief Update BlockWrite success rate curve and pick size with highest expected goodput.
+        """
+        curve = self._write_curve
+        curve.update(size, succeeded)
+        write_size = curve.best_size(self.write_size)
+        if write_size!=self.write_size:
+            _logger.debug("BlockWrite size changed to %d", write_size)
+            self.write_size = write_size
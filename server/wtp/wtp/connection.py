@@ -1,13 +1,14 @@
 from __future__ import absolute_import, unicode_literals
-import functools, logging
+import functools, logging, random
 from six.moves import range
 from twisted.internet.defer import Deferred
 
 import wtp.constants as consts
-from wtp.util import EventTarget, ChecksumStream, force_print_exc
+from wtp.util import EventTarget, ChecksumStream, CHECKSUM_ALGOS, seq_resolve, seq_le, force_print_exc
 from wtp.transmission import SlidingWindowTxControl, SlidingWindowRxControl
-from wtp.cong_ctrl import OpSpecSizeControl
+from wtp.cong_ctrl import EWMAOpSpecSizeControl
 from wtp.llrp_util import read_opspec, write_opspec
+from wtp.error import WTPError
 
 ## Module logger
 _logger = logging.getLogger(__name__)
@@ -18,14 +19,24 @@ class WTPConnection(EventTarget):
     """!
     @brief WTP connection class.
     """
-    def __init__(self, server, wisp_id, checksum_func, checksum_type):
+    def __init__(self, server, wisp_id, checksum_algo=consts.WTP_CHECKSUM_XOR,
+        framing=consts.WTP_FRAMING_STANDARD, window_size=64,
+        opspec_init=consts.WTP_OPSPEC_INIT, timeout=45, n_opspecs_max=consts.LLRP_N_OPSPECS_MAX,
+        opspec_ctrl_factory=EWMAOpSpecSizeControl):
         """!
         @brief WTP connection constructor.
 
         @param server WTP server reference.
         @param wisp_id WISP ID.
-        @param checksum_func Checksum function.
-        @param checksum_type Checksum data type.
+        @param checksum_algo Checksum algorithm requested by the client
+            (XOR checksum is used if the algorithm is not supported).
+        @param framing Data packet framing requested by the client
+            (Compact framing is only used if window size allows).
+        @param window_size Sliding window size.
+        @param opspec_init Initial Read and BlockWrite size.
+        @param timeout Data fragment retransmission timeout in seconds.
+        @param n_opspecs_max Maximum number of OpSpecs in one AccessSpec.
+        @param opspec_ctrl_factory OpSpec size control class or factory function.
         """
         # Initialize base classes
         super(WTPConnection, self).__init__()
@@ -37,24 +48,41 @@ class WTPConnection(EventTarget):
         self.uplink_state = consts.WTP_STATE_CLOSED
         ## Uplink state
         self.downlink_state = consts.WTP_STATE_CLOSED
+        # Fall back to XOR checksum for unsupported algorithm
+        if checksum_algo not in CHECKSUM_ALGOS:
+            checksum_algo = consts.WTP_CHECKSUM_XOR
+        ## Checksum algorithm of downlink packets
+        self.checksum_algo = checksum_algo
+        checksum_func, checksum_type = CHECKSUM_ALGOS[checksum_algo]
+        # 8-bit sequence numbers of compact framing cannot address bigger windows
+        if framing!=consts.WTP_FRAMING_COMPACT or window_size>consts.WTP_COMPACT_WINDOW_MAX:
+            framing = consts.WTP_FRAMING_STANDARD
+        ## Data packet framing of both directions
+        self.framing = framing
+        ## Session token (Given to the client for resuming the connection after losing power)
+        self.token = random.randint(1, 0xffff)
+        ## Client opened the connection with a legacy open packet
+        ## (Answered without checksum algorithm, framing and session token)
+        self.legacy_open = False
         ## Transmit control
         self._tx_ctrl = SlidingWindowTxControl(
             reactor=self.server._reactor,
-            write_size=consts.WTP_OPSPEC_INIT,
-            window_size=64,
+            write_size=opspec_init,
+            window_size=window_size,
             checksum_func=checksum_func,
             checksum_type=checksum_type,
-            timeout=45,
-            request_access_spec=self._request_access_spec
+            timeout=timeout,
+            request_access_spec=self._request_access_spec,
+            framing=framing
         )
         ## Receive control
         self._rx_ctrl = SlidingWindowRxControl(
-            window_size=64
+            window_size=window_size
         )
         ## OpSpec congestion control
-        self._opspec_ctrl = OpSpecSizeControl(
-            read_size=consts.WTP_OPSPEC_INIT,
-            write_size=consts.WTP_OPSPEC_INIT
+        self._opspec_ctrl = opspec_ctrl_factory(
+            read_size=opspec_init,
+            write_size=opspec_init
         )
         ## Received messages
         self._recv_msgs = []
@@ -66,6 +94,12 @@ class WTPConnection(EventTarget):
         self._read_opspec_sizes = []
         ## Ongoing AccessSpec flag
         self._ongoing_access_spec = False
+        ## Maximum number of OpSpecs in one AccessSpec
+        self.n_opspecs_max = n_opspecs_max
+        ## Uplink sequence number of the latest resume packet (Identifies resume packets sent again)
+        self._resume_seq = None
+        ## Downlink sequence number given in the answer to the latest resume packet
+        self._resume_tx_seq = None
     def _build_header(self, packet_type):
         """!
         @brief Build WTP packet header for sending.
@@ -83,9 +117,16 @@ class WTPConnection(EventTarget):
 
         @return WTP acknowledgement packet data
         """
-        stream = self._build_header(consts.WTP_PKT_ACK)
+        # Data received out of order; send selective acknowledgement instead
+        sack_blocks = self._rx_ctrl.get_sack_blocks()
+        stream = self._build_header(consts.WTP_PKT_SACK if sack_blocks else consts.WTP_PKT_ACK)
         # Sequence number
         stream.write_data("H", self._rx_ctrl.seq_num)
+        # Selective acknowledgement blocks
+        if sack_blocks:
+            stream.write_data("B", len(sack_blocks))
+            for begin, size in sack_blocks:
+                stream.write_data("HB", begin, size)
         return stream.getvalue()
     def _handle_packet(self, stream, packet_type):
         """!
@@ -94,28 +135,142 @@ class WTPConnection(EventTarget):
         @param stream Data stream containing WTP packet.
         @param packet_type Packet type.
         """
+        # Compact data packet
+        if packet_type&consts.WTP_PKT_COMPACT_MSG:
+            self._handle_compact_data_packet(stream, packet_type)
+            return
         handler = self._pkt_handler.get(packet_type)
         # Drop packet with unknown packet type
         if handler:
             handler(self, stream)
-    def _handle_open(self, stream):
+    def _handle_open(self, stream, seq_num=0):
         """!
         @brief Handle WTP open packet.
 
         @param stream Data stream containing open packet.
+        @param seq_num Uplink sequence number to begin with
+            (Not 0 when the client resumes a session the server doesn't know).
         """
         # Verify checksum
         stream.validate_checksum()
         # Update connection state
         self.uplink_state = consts.WTP_STATE_OPENED
         self.downlink_state = consts.WTP_STATE_OPENING
+        self._rx_ctrl.seq_num = seq_num
+        self._send_open()
+    def _handle_open_again(self, stream):
+        """!
+        @brief Handle open or resume packet sent again by the client of this connection.
+
+        The client sends its packet again until the server answers. The open packet is sent
+        again until the client acknowledges it; after that, only the acknowledgement of the
+        client's packet was lost.
+
+        @param stream Data stream containing open or resume packet.
+        """
+        # Verify checksum
+        stream.validate_checksum()
+        if self.downlink_state==consts.WTP_STATE_OPENING:
+            self._send_open()
+        else:
+            self._send_ack()
+            self._request_access_spec()
+    def _send_open(self):
+        """!
+        @brief Answer the client with open, acknowledgement and window size packets.
+        """
+        # Send open packet with checksum algorithm, framing and session token
+        # (Sent first, so the client knows the algorithm before verifying other packets)
+        if self.legacy_open:
+            open_stream = self._build_header(consts.WTP_PKT_OPEN)
+        else:
+            open_stream = self._build_header(consts.WTP_PKT_OPEN_PARAM)
+            open_stream.write_data("BBH", self.checksum_algo, self.framing, self.token)
+        self._tx_ctrl.add_packet(open_stream.getvalue())
         # Send acknowledgement packet
         self._tx_ctrl.add_packet(self._build_ack())
-        # Send open packet
-        open_stream = self._build_header(consts.WTP_PKT_OPEN)
-        self._tx_ctrl.add_packet(open_stream.getvalue())
+        # Advertise uplink window
+        param_stream = self._build_header(consts.WTP_PKT_SET_PARAM)
+        param_stream.write_data("BH", consts.WTP_PARAM_WINDOW_SIZE, self._rx_ctrl.window_size)
+        self._tx_ctrl.add_packet(param_stream.getvalue())
         # Request sending AccessSpec
         self._request_access_spec()
+    def _handle_resume(self, stream, seq_num, ack_seq=None):
+        """!
+        @brief Handle WTP resume packet of the session of this connection.
+
+        The client lost power, and with it all data in flight: the uplink goes on from the
+        sequence number given by the client, and downlink messages not fully acknowledged fail.
+        A client restored from a checkpoint acknowledges the downlink data it kept instead;
+        uplink data received so far is kept, and downlink data in flight is sent again.
+
+        @param stream Data stream containing resume packet.
+        @param seq_num Uplink sequence number the client goes on from.
+        @param ack_seq Downlink sequence number acknowledged by a client restored from a checkpoint.
+        """
+        # Verify checksum
+        stream.validate_checksum()
+        # Resume packet sent again by the client, as the answer was lost
+        # (Handling it again would drop downlink messages sent since)
+        if ack_seq==None and seq_num==self._resume_seq:
+            self._send_resume(self._resume_tx_seq)
+            self._request_access_spec()
+            return
+        self._resume_seq = seq_num
+        # Both directions are opened again
+        self.uplink_state = consts.WTP_STATE_OPENED
+        self.downlink_state = consts.WTP_STATE_OPENED
+        # Client restored from a checkpoint
+        if ack_seq!=None:
+            self._handle_ack_seq(ack_seq)
+        # Uplink data received after the begin of the oldest message the client holds is kept;
+        # otherwise the partial uplink message is dropped
+        if ack_seq==None or not seq_le(seq_num, self._rx_ctrl.seq_num):
+            self._rx_ctrl.resume(seq_num)
+        # Downlink data in flight is sent again from the acknowledgement
+        if ack_seq!=None and self._tx_ctrl.rewind(ack_seq):
+            tx_seq_num = ack_seq
+        # Otherwise downlink messages in flight are dropped
+        else:
+            tx_seq_num, n_dropped = self._tx_ctrl.resume()
+            for _ in range(n_dropped):
+                self._send_deferreds.pop(0).errback(WTPError(consts.WTP_ERR_NOT_ACKED))
+        # Acknowledge uplink data kept, so the client skips it
+        if ack_seq!=None:
+            self._send_ack()
+        self._resume_tx_seq = tx_seq_num
+        self._send_resume(tx_seq_num)
+        # Trigger resume event
+        self.trigger("resume")
+        # Request sending AccessSpec
+        self._request_access_spec()
+    def _send_resume(self, tx_seq_num):
+        """!
+        @brief Answer the client with resume and window size packets.
+
+        @param tx_seq_num Downlink sequence number the server goes on from.
+        """
+        # Send resume packet with downlink sequence number
+        resume_stream = self._build_header(consts.WTP_PKT_RESUME)
+        resume_stream.write_data("H", tx_seq_num)
+        self._tx_ctrl.add_packet(resume_stream.getvalue())
+        # Advertise uplink window
+        param_stream = self._build_header(consts.WTP_PKT_SET_PARAM)
+        param_stream.write_data("BH", consts.WTP_PARAM_WINDOW_SIZE, self._rx_ctrl.window_size)
+        self._tx_ctrl.add_packet(param_stream.getvalue())
+    def _handle_lost(self):
+        """!
+        @brief Handle connection lost when the client opens a new one.
+        """
+        self.uplink_state = consts.WTP_STATE_CLOSED
+        self.downlink_state = consts.WTP_STATE_CLOSED
+        # Fail messages not yet sent
+        send_deferreds = self._send_deferreds
+        self._send_deferreds = []
+        for d in send_deferreds:
+            d.errback(WTPError(consts.WTP_ERR_NOT_ACKED))
+        # Trigger close event
+        self.trigger("close")
     def _handle_close(self, stream):
         """!
         @brief Handle WTP close packet.
@@ -125,11 +280,11 @@ class WTPConnection(EventTarget):
         # Verify checksum
         stream.validate_checksum()
         # Update connection information
-        self.uplink_state = WTP_STATE_CLOSED
+        self.uplink_state = consts.WTP_STATE_CLOSED
         # Trigger half close or close event
-        if self.downlink_state==WTP_STATE_OPENED:
+        if self.downlink_state==consts.WTP_STATE_OPENED:
             self.trigger("half-close")
-        elif self.downlink_state==WTP_STATE_CLOSED:
+        elif self.downlink_state==consts.WTP_STATE_CLOSED:
             self.trigger("close")
         # Send Ack message
         self._tx_ctrl.add_packet(self._build_ack())
@@ -143,6 +298,29 @@ class WTPConnection(EventTarget):
         seq_num = stream.read_data("H")
         # Verify checksum
         stream.validate_checksum()
+        self._handle_ack_seq(seq_num)
+    def _handle_sack(self, stream):
+        """!
+        @brief Handle WTP selective acknowledgement packet.
+
+        @param stream Data stream containing selective acknowledgement packet.
+        """
+        # Read acknowledged bytes and selective acknowledgement blocks
+        seq_num, n_blocks = stream.read_data("HB")
+        blocks = [stream.read_data("HB") for _ in range(n_blocks)]
+        # Verify checksum
+        stream.validate_checksum()
+        # Stop retransmission of data received out of order
+        if self.downlink_state==consts.WTP_STATE_OPENED:
+            for begin, size in blocks:
+                self._tx_ctrl.handle_sack(begin, size)
+        self._handle_ack_seq(seq_num)
+    def _handle_ack_seq(self, seq_num):
+        """!
+        @brief Handle acknowledged sequence number.
+
+        @param seq_num Acknowledged sequence number.
+        """
         # Downlink opened
         if self.downlink_state==consts.WTP_STATE_OPENING and seq_num==0:
             self.downlink_state = consts.WTP_STATE_OPENED
@@ -155,19 +333,75 @@ class WTPConnection(EventTarget):
             # Resolve send deferreds
             for _ in range(n_sent_msgs):
                 self._send_deferreds.pop(0).callback(None)
-    def _handle_data_packet(self, stream, msg_begin):
+    def _send_ack(self):
+        """!
+        @brief Acknowledge received data.
+
+        The acknowledgement is left pending in transmit control and replaces any earlier pending
+        acknowledgement. A cumulative acknowledgement is piggybacked on the next downlink data
+        packet if there is any; a selective acknowledgement packet is used instead when some
+        data is received out of order.
+        """
+        ack_packet = self._build_ack() if self._rx_ctrl.get_sack_blocks() else None
+        self._tx_ctrl.set_ack(self._rx_ctrl.seq_num, ack_packet)
+    def _handle_data_packet(self, stream, msg_begin, ack=False):
         """!
         @brief Handle WTP message data packet.
 
         @param stream Data stream containing continue message packet.
         @param msg_begin True for WTP_PKT_BEGIN_MSG and False for WTP_PKT_CONT_MSG.
+        @param ack Whether the packet carries piggybacked acknowledgement.
         """
+        # Read piggybacked acknowledgement
+        ack_seq = stream.read_data("H") if ack else None
         # Read message size
         msg_size = stream.read_data("H") if msg_begin else None
         # Read sequence number and payload size
         seq_num, payload_size = stream.read_data("HB")
+        self._handle_payload(stream, seq_num, payload_size, msg_size, ack_seq)
+    def _handle_compact_data_packet(self, stream, packet_type):
+        """!
+        @brief Handle WTP compact message data packet.
+
+        The client may send standard data packets until it learns the framing
+        from the open packet, so compact data packets are always accepted.
+
+        @param stream Data stream containing compact message data packet.
+        @param packet_type Packet type with begin and acknowledgement flags and payload size.
+        """
+        # Read piggybacked acknowledgement
+        ack_seq = None
+        if packet_type&consts.WTP_PKT_COMPACT_ACK:
+            ack_seq = stream.read_data("H")
+            if ack_seq==None:
+                return
+        # Read message size
+        msg_size = None
+        if packet_type&consts.WTP_PKT_COMPACT_BEGIN:
+            msg_size = stream.read_varint()
+            if msg_size==None:
+                return
+        # Resolve sequence number around begin of receive window
+        seq_low = stream.read_data("B")
+        if seq_low==None:
+            return
+        seq_num = seq_resolve(seq_low, self._rx_ctrl.seq_num)
+        self._handle_payload(stream, seq_num, packet_type&consts.WTP_PKT_COMPACT_SIZE_MASK, msg_size, ack_seq)
+    def _handle_payload(self, stream, seq_num, payload_size, msg_size, ack_seq=None):
+        """!
+        @brief Handle payload of WTP message data packet.
+
+        @param stream Data stream positioned at the payload.
+        @param seq_num Packet sequence number.
+        @param payload_size Payload size.
+        @param msg_size Message size for begin message data packet, or None.
+        @param ack_seq Piggybacked acknowledged sequence number, or None.
+        """
         # Read payload
         payload = stream.read(payload_size)
+        # Drop packet cut short by a Read smaller than the packet
+        if len(payload)<payload_size:
+            return
         # Verify checksum
         stream.validate_checksum()
         # Handle received data with receive control tool
@@ -180,17 +414,27 @@ class WTPConnection(EventTarget):
         if new_msgs:
             self._recv_msgs += new_msgs
         # Send acknowledgement
-        self._tx_ctrl.add_packet(self._build_ack())
-    def _handle_req_uplink(self, stream):
+        self._send_ack()
+        # Handle piggybacked acknowledgement
+        if ack_seq!=None:
+            self._handle_ack_seq(ack_seq)
+    def _handle_req_uplink(self, stream, ack=False):
         """!
         @brief Handle WTP request uplink packet.
 
         @param stream Data stream containing request uplink packet.
+        @param ack Whether the packet carries piggybacked acknowledgement.
         """
-        # Number of read operations and read OpSpec size
-        n_reads, read_size = stream.read_data("BB")
+        # Read piggybacked acknowledgement
+        ack_seq = stream.read_data("H") if ack else None
+        # Number of read operations, read OpSpec size and request ID
+        # (Request ID only makes EPC of repeated requests differ)
+        n_reads, read_size, _ = stream.read_data("BBB")
         # Verify checksum
         stream.validate_checksum()
+        # Handle piggybacked acknowledgement
+        if ack_seq!=None:
+            self._handle_ack_seq(ack_seq)
         # Add read OpSpecs
         self._read_opspec_sizes += [read_size]*n_reads
         # Request sending AccessSpec
@@ -208,8 +452,18 @@ class WTPConnection(EventTarget):
             window_size = stream.read_data("H")
             # Verify checksum
             stream.validate_checksum()
-            # Set window size
-            self._rx_ctrl.window_size = window_size
+            # Empty window (Not advertised by current clients) still allows one byte, which is sent
+            # again on retransmission timeout and probes the window until the client opens it again
+            if window_size==0:
+                _logger.debug("WISP #%d advertised empty window; probing with one byte", self.wisp_id)
+                window_size = 1
+            # Keep window within range of sequence numbers of the framing
+            window_max = consts.WTP_COMPACT_WINDOW_MAX if self.framing==consts.WTP_FRAMING_COMPACT \
+                else consts.WTP_WINDOW_MAX
+            window_size = min(window_size, window_max)
+            # Set downlink window size to receive window advertised by the client
+            _logger.debug("Set downlink window size to %d", window_size)
+            self._tx_ctrl.window_size = window_size
         # Unknown parameter
         else:
             raise WTPError(consts.WTP_ERR_UNSUPPORT_OP)
@@ -234,7 +488,7 @@ class WTPConnection(EventTarget):
                 self._opspec_ctrl.add_read(read_size)
                 # Update OpSpec ID
                 opspec_id += 1
-            if opspec_id>=consts.LLRP_N_OPSPECS_MAX:
+            if opspec_id>=self.n_opspecs_max:
                 break
             # Add a Write OpSpec
             write_data = self._tx_ctrl.get_write_data()
@@ -244,7 +498,7 @@ class WTPConnection(EventTarget):
                 self._opspec_ctrl.add_write(len(write_data))
                 # Update OpSpec ID
                 opspec_id += 1
-            if opspec_id>=consts.LLRP_N_OPSPECS_MAX:
+            if opspec_id>=self.n_opspecs_max:
                 break
             # No more OpSpec to add
             if not self._read_opspec_sizes and not write_data:
@@ -273,6 +527,7 @@ class WTPConnection(EventTarget):
                 opspec_ctrl = self._opspec_ctrl
                 # Report result to OpSpec size control
                 _logger.debug("Reporting OpSpec results")
+                read_reported = False
                 for opspec_result in opspec_results:
                     # Succeeded or not
                     succeeded = opspec_result["Result"]==0
@@ -288,14 +543,31 @@ class WTPConnection(EventTarget):
                     else:
                         # Size of data read
                         actual_size = opspec_result["ReadDataWordCount"]*2
-                        # Update OpSpec size control and Read size
+                        # Update OpSpec size control
                         opspec_ctrl.report_read_result(succeeded, actual_size)
-                        _logger.debug("Set client Read size to %d", opspec_ctrl.read_size)
-                        # Build set parameter packet
-                        pkt_stream = self._build_header(consts.WTP_PKT_SET_PARAM)
-                        pkt_stream.write_data("BB", consts.WTP_PARAM_READ_SIZE, opspec_ctrl.read_size)
-                        # Add to transmission control
-                        self._tx_ctrl.add_packet(pkt_stream.getvalue())
+                        read_reported = True
+                # The reader stops carrying out an AccessSpec when an OpSpec fails,
+                # so OpSpecs without results were never carried out
+                reported_ids = set(opspec_result["OpSpecID"] for opspec_result in opspec_results)
+                skipped_read_sizes = []
+                for opspec in opspecs:
+                    if opspec["OpSpecID"] in reported_ids:
+                        continue
+                    if "WriteData" in opspec:
+                        opspec_ctrl.cancel_write()
+                    else:
+                        opspec_ctrl.cancel_read()
+                        skipped_read_sizes.append(opspec["WordCount"]*2)
+                # Requested Reads not carried out are kept for next AccessSpec
+                self._read_opspec_sizes[:0] = skipped_read_sizes
+                # Update client Read size once for all Reads
+                if read_reported:
+                    _logger.debug("Set client Read size to %d", opspec_ctrl.read_size)
+                    # Build set parameter packet
+                    pkt_stream = self._build_header(consts.WTP_PKT_SET_PARAM)
+                    pkt_stream.write_data("BB", consts.WTP_PARAM_READ_SIZE, opspec_ctrl.read_size)
+                    # Add to transmission control
+                    self._tx_ctrl.add_packet(pkt_stream.getvalue())
                 # Next AccessSpec sending
                 self._request_access_spec()
             d.addCallback(send_access_spec_cb)
@@ -345,5 +617,9 @@ class WTPConnection(EventTarget):
         consts.WTP_PKT_BEGIN_MSG: functools.partial(_handle_data_packet, msg_begin=True),
         consts.WTP_PKT_CONT_MSG: functools.partial(_handle_data_packet, msg_begin=False),
         consts.WTP_PKT_REQ_UPLINK: _handle_req_uplink,
-        consts.WTP_PKT_SET_PARAM: _handle_set_param
+        consts.WTP_PKT_SET_PARAM: _handle_set_param,
+        consts.WTP_PKT_SACK: _handle_sack,
+        consts.WTP_PKT_BEGIN_MSG_ACK: functools.partial(_handle_data_packet, msg_begin=True, ack=True),
+        consts.WTP_PKT_CONT_MSG_ACK: functools.partial(_handle_data_packet, msg_begin=False, ack=True),
+        consts.WTP_PKT_REQ_UPLINK_ACK: functools.partial(_handle_req_uplink, ack=True)
     }
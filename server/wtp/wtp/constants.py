@@ -3,7 +3,7 @@ from __future__ import absolute_import, unicode_literals
 # === WTP packet types ===
 ## No more packets
 WTP_PKT_END = 0x00
-## Open WTP connection
+## Open WTP connection (Legacy; without checksum algorithm and framing)
 WTP_PKT_OPEN = 0x01
 ## Close WTP connection
 WTP_PKT_CLOSE = 0x02
@@ -17,6 +17,28 @@ WTP_PKT_CONT_MSG = 0x05
 WTP_PKT_REQ_UPLINK = 0x06
 ## Set parameter
 WTP_PKT_SET_PARAM = 0x07
+## Selective acknowledgement
+WTP_PKT_SACK = 0x08
+## Begin message with piggybacked acknowledgement
+WTP_PKT_BEGIN_MSG_ACK = 0x09
+## Continue message with piggybacked acknowledgement
+WTP_PKT_CONT_MSG_ACK = 0x0a
+## Request uplink transfer with piggybacked acknowledgement
+WTP_PKT_REQ_UPLINK_ACK = 0x0b
+## Resume WTP connection of a previous session
+WTP_PKT_RESUME = 0x0c
+## Resume WTP connection from a checkpoint, acknowledging downlink data kept in it
+WTP_PKT_RESUME_ACK = 0x0d
+## Open WTP connection with checksum algorithm and framing
+WTP_PKT_OPEN_PARAM = 0x0e
+## Compact message data (Flag of packet type; other bits carry begin and acknowledgement flags and payload size)
+WTP_PKT_COMPACT_MSG = 0x80
+## Compact message data begins a message
+WTP_PKT_COMPACT_BEGIN = 0x40
+## Compact message data carries piggybacked acknowledgement
+WTP_PKT_COMPACT_ACK = 0x20
+## Payload size bits of compact message data packet type
+WTP_PKT_COMPACT_SIZE_MASK = 0x1f
 
 # === WTP connection states ===
 ## WTP connection closed
@@ -45,6 +67,8 @@ WTP_ERR_UNSUPPORT_OP = 0x15
 WTP_ERR_INVALID_SIZE = 0x16
 ## Ongoing AccessSpec
 WTP_ERR_ONGOING_ACCESS_SPEC = 0x17
+## Compressed message corrupted or out of stream
+WTP_ERR_INVALID_STREAM = 0x18
 
 # === WTP parameter code ===
 ## Sliding window size
@@ -52,11 +76,61 @@ WTP_PARAM_WINDOW_SIZE = 0x00
 ## Read size
 WTP_PARAM_READ_SIZE = 0x01
 
+# === WTP checksum algorithms ===
+## XOR checksum (1 byte)
+WTP_CHECKSUM_XOR = 0x00
+## CRC-16/CCITT (2 bytes)
+WTP_CHECKSUM_CRC16 = 0x01
+
+# === WTP data packet framing ===
+## Standard framing (16-bit sequence number and message size, explicit payload size)
+WTP_FRAMING_STANDARD = 0x00
+## Compact framing (8-bit sequence number, varint message size, payload size in packet type)
+WTP_FRAMING_COMPACT = 0x01
+
+# === WTP FGK compression ===
+## Message header size
+WTP_FGK_HEADER_SIZE = 1
+## Header flag of compressed messages (Otherwise message data is stored as is)
+WTP_FGK_COMPRESSED = 0x80
+## Header flag of the first message of a stream (The receiver resets its tree)
+WTP_FGK_RESET = 0x40
+## Header shift of message index in stream (Modulo 8, checked by the receiver)
+WTP_FGK_INDEX_SHIFT = 3
+## Header mask of message index and number of padding bits
+WTP_FGK_HEADER_MASK = 0x07
+## Maximum node weight (The tree is reset when the root reaches it)
+WTP_FGK_WEIGHT_MAX = 0x7fff
+## Maximum number of symbols in tree
+WTP_FGK_SYMBOLS_MAX = 127
+## Default maximum number of symbols in tree (Same as the WISP ERT runtime)
+WTP_FGK_N_SYMBOLS = 32
+
+# === WTP telemetry framing ===
+## Frame header size (Header flags and index, number of samples)
+WTP_TELEMETRY_HEADER_SIZE = 2
+## Header flag of key frames (The first sample is sent as is, and the receiver resets its state)
+WTP_TELEMETRY_KEY = 0x80
+## Header mask of frame index in stream (Modulo 128, checked by the receiver)
+WTP_TELEMETRY_INDEX_MASK = 0x7f
+## Channel block flag of zig-zag varint deltas (Otherwise deltas are bit-packed)
+WTP_TELEMETRY_VARINT = 0x80
+## Channel block mask of bit-packed delta width
+WTP_TELEMETRY_WIDTH_MASK = 0x1f
+## Maximum number of channels
+WTP_TELEMETRY_CHANNELS_MAX = 16
+
 # === Miscellaneous ===
 ## WTP max sequence number
 WTP_SEQ_MAX = 0x10000
 ## WTP previous EPC size
 WTP_PREV_EPC_SIZE = 3
+## Maximum number of blocks in a selective acknowledgement (So that the packet fits into EPC)
+WTP_SACK_BLOCKS_MAX = 2
+## Maximum window size (Sequence numbers are resolved within half of their range)
+WTP_WINDOW_MAX = WTP_SEQ_MAX//2
+## Maximum window size for compact framing (8-bit sequence numbers are resolved within half of their range)
+WTP_COMPACT_WINDOW_MAX = 128
 
 ## WTP initial size per OpSpec
 WTP_OPSPEC_INIT = 24
@@ -65,8 +139,12 @@ WTP_OPSPEC_MIN = 8
 ## WISP maximum size per OpSpec
 WTP_OPSPEC_MAX = 30
 
-## Maximum number of OpSpecs in 1 AccessSpec
-LLRP_N_OPSPECS_MAX = 1 #4
+## Default maximum number of OpSpecs in 1 AccessSpec
+## (Should not exceed "MaxNumOpSpecsPerAccessSpec" capability of the reader)
+LLRP_N_OPSPECS_MAX = 4
+## Default maximum number of AccessSpecs on the reader
+## (Should not exceed "MaxNumAccessSpecs" capability of the reader)
+LLRP_N_ACCESS_SPECS_MAX = 8
 
 ## RFID WISP class
 RFID_WISP_CLASS = 0x51
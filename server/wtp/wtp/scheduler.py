@@ -0,0 +1,228 @@
+from __future__ import absolute_import, unicode_literals
+import logging
+from collections import deque, OrderedDict
+from twisted.internet.defer import Deferred
+
+import wtp.constants as consts
+
+## Module logger
+_logger = logging.getLogger(__name__)
+# Logger level
+_logger.setLevel(logging.DEBUG)
+
+def opspecs_cost(opspecs):
+    """!
+    @brief Get air time cost of OpSpecs in words.
+
+    @param opspecs OpSpecs.
+    @return Number of words read or written, plus one word per OpSpec.
+    """
+    cost = 0
+    for opspec in opspecs:
+        cost += 1+opspec.get("WordCount", opspec.get("WriteDataWordCount", 0))
+    return cost
+
+class AccessSpecScheduler(object):
+    """!
+    @brief AccessSpec scheduler.
+
+    The scheduler queues AccessSpecs of every tag and keeps at most one
+    AccessSpec per tag and "max_in_flight" AccessSpecs in total on the reader.
+    When a slot becomes free, tags with queued AccessSpecs are served with
+    stride scheduling: every tag has a virtual pass, which advances by the cost
+    of each AccessSpec sent in words divided by the weight of the tag, and the
+    ready tag with the smallest pass is served first. Tags thus share reader
+    air time in proportion to their weights, and a tag coming back from idle
+    starts from the current virtual time instead of using up saved credit.
+
+    When the reader rejects an AccessSpec, the in-flight limit is lowered to
+    the number of AccessSpecs it holds, and raised again by one after each
+    "max_in_flight" AccessSpecs completed, up to the configured maximum.
+    """
+    def __init__(self, send_access_spec, max_in_flight=consts.LLRP_N_ACCESS_SPECS_MAX):
+        """!
+        @brief AccessSpec scheduler constructor.
+
+        @param send_access_spec Function adding an AccessSpec to the reader,
+            called with WISP ID and OpSpecs and returning a deferred.
+        @param max_in_flight Maximum number of AccessSpecs on the reader.
+        """
+        ## AccessSpec sending function
+        self._send_access_spec = send_access_spec
+        ## Configured maximum number of AccessSpecs on the reader
+        self._max_in_flight = max_in_flight
+        ## Maximum number of AccessSpecs on the reader
+        self.max_in_flight = max_in_flight
+        ## Number of AccessSpecs completed since the in-flight limit last changed
+        self._n_completed = 0
+        ## Queued AccessSpecs of tags, in order of arrival
+        self._queues = OrderedDict()
+        ## Virtual passes of tags
+        self._passes = {}
+        ## Weights of tags
+        self._weights = {}
+        ## Deferreds of AccessSpecs on the reader, keyed by WISP ID
+        self._in_flight = {}
+        ## Deferreds of AccessSpecs on the reader whose tags were cancelled
+        self._cancelled = set()
+        ## Virtual time (Pass of the last served tag)
+        self._vtime = 0.0
+    def submit(self, wisp_id, opspecs):
+        """!
+        @brief Queue an AccessSpec.
+
+        @param wisp_id WISP ID.
+        @param opspecs OpSpecs of the AccessSpec.
+        @return A deferred object resolved with OpSpec results.
+        """
+        d = Deferred()
+        queue = self._queues.get(wisp_id)
+        if queue==None:
+            queue = self._queues[wisp_id] = deque()
+        # Idle or cancelled tag catches up with virtual time
+        if wisp_id not in self._passes or (not queue and wisp_id not in self._in_flight):
+            self._passes[wisp_id] = max(self._passes.get(wisp_id, 0.0), self._vtime)
+        queue.append((opspecs, d))
+        self._dispatch()
+        return d
+    def complete(self, wisp_id, opspec_results):
+        """!
+        @brief Report results of the AccessSpec of a tag.
+
+        @param wisp_id WISP ID.
+        @param opspec_results OpSpec results.
+        @return Whether the tag had an AccessSpec on the reader.
+        """
+        d = self._in_flight.pop(wisp_id, None)
+        if not d:
+            return False
+        # Reader keeps up; raise in-flight limit towards the configured maximum
+        self._n_completed += 1
+        if self.max_in_flight<self._max_in_flight and self._n_completed>=self.max_in_flight:
+            self.max_in_flight += 1
+            self._n_completed = 0
+        # Results of a cancelled tag are dropped
+        if d in self._cancelled:
+            self._cancelled.discard(d)
+        # Results may queue the next AccessSpec of the tag, which then takes part in scheduling
+        else:
+            d.callback(opspec_results)
+        self._dispatch()
+        return True
+    def cancel(self, wisp_id):
+        """!
+        @brief Remove queued AccessSpecs of a tag.
+
+        The AccessSpec already on the reader, if any, still occupies a slot
+        until its results are reported, and its results are then dropped.
+
+        @param wisp_id WISP ID.
+        """
+        d = self._in_flight.get(wisp_id)
+        if d:
+            self._cancelled.add(d)
+        self._queues.pop(wisp_id, None)
+        self._passes.pop(wisp_id, None)
+        self._weights.pop(wisp_id, None)
+    def set_weight(self, wisp_id, weight):
+        """!
+        @brief Set scheduling weight of a tag.
+
+        @param wisp_id WISP ID.
+        @param weight Weight of the tag (1 by default).
+        """
+        self._weights[wisp_id] = weight
+    def queue_depth(self, wisp_id):
+        """!
+        @brief Get number of queued OpSpecs of a tag.
+
+        @param wisp_id WISP ID.
+        @return Number of OpSpecs queued and not yet on the reader.
+        """
+        queue = self._queues.get(wisp_id)
+        if not queue:
+            return 0
+        return sum(len(opspecs) for opspecs, _ in queue)
+    def queue_depths(self):
+        """!
+        @brief Get number of queued OpSpecs of all tags.
+
+        @return Dictionary from WISP ID to number of queued OpSpecs.
+        """
+        return dict((wisp_id, self.queue_depth(wisp_id)) for wisp_id in self._queues)
+    def n_in_flight(self):
+        """!
+        @brief Get number of AccessSpecs on the reader.
+
+        @return Number of AccessSpecs on the reader.
+        """
+        return len(self._in_flight)
+    def _stride(self, wisp_id, opspecs):
+        """!
+        @brief Get pass increment of an AccessSpec.
+
+        @param wisp_id WISP ID.
+        @param opspecs OpSpecs of the AccessSpec.
+        @return Cost of the AccessSpec divided by weight of the tag.
+        """
+        return float(opspecs_cost(opspecs))/self._weights.get(wisp_id, 1)
+    def _dispatch(self):
+        """!
+        @brief Send queued AccessSpecs while there are free slots.
+        """
+        queues = self._queues
+        passes = self._passes
+        in_flight = self._in_flight
+        while len(in_flight)<self.max_in_flight:
+            # Tags with queued AccessSpecs and none on the reader
+            ready = [wisp_id for wisp_id, queue in queues.items() if queue and wisp_id not in in_flight]
+            if not ready:
+                break
+            # Serve tag with smallest pass (Earliest arrival among ties)
+            wisp_id = min(ready, key=lambda wisp_id: passes[wisp_id])
+            opspecs, d = queues[wisp_id].popleft()
+            self._vtime = passes[wisp_id]
+            passes[wisp_id] += self._stride(wisp_id, opspecs)
+            self._send(wisp_id, opspecs, d)
+    def _send(self, wisp_id, opspecs, d):
+        """!
+        @brief Add an AccessSpec to the reader.
+
+        If the reader rejects the AccessSpec while other AccessSpecs are on the
+        reader, the reader is taken to be full: the AccessSpec goes back to the
+        head of its queue and the in-flight limit is lowered to the number of
+        AccessSpecs the reader holds.
+
+        @param wisp_id WISP ID.
+        @param opspecs OpSpecs of the AccessSpec.
+        @param d Deferred object resolved with OpSpec results.
+        """
+        _logger.debug("Sending AccessSpec to WISP #%d (%d in flight)", wisp_id, len(self._in_flight)+1)
+        self._in_flight[wisp_id] = d
+        access_deferred = self._send_access_spec(wisp_id, opspecs)
+        # Failed to add AccessSpec; free the slot
+        def send_access_spec_eb(failure):
+            """!
+            @brief Add AccessSpec error callback.
+
+            @param failure Twisted failure object.
+            """
+            if self._in_flight.get(wisp_id) is not d:
+                return
+            del self._in_flight[wisp_id]
+            # Tag was cancelled; nothing waits for the AccessSpec
+            if d in self._cancelled:
+                self._cancelled.discard(d)
+                self._dispatch()
+                return
+            queue = self._queues.get(wisp_id)
+            # Reader is full; retry when an AccessSpec completes
+            if self._in_flight and queue!=None:
+                _logger.warning("Reader rejected AccessSpec with %d in flight; lowering limit", len(self._in_flight))
+                self.max_in_flight = len(self._in_flight)
+                self._n_completed = 0
+                queue.appendleft((opspecs, d))
+                self._passes[wisp_id] -= self._stride(wisp_id, opspecs)
+            else:
+                d.errback(failure)
+        access_deferred.addErrback(send_access_spec_eb)
@@ -1,50 +1,88 @@
 from __future__ import absolute_import, unicode_literals
-import logging
+import logging, struct
 from binascii import unhexlify
 from twisted.internet import reactor as inet_reactor
-from twisted.internet.defer import Deferred
 from sllurp.llrp import LLRPClientFactory, LLRP_PORT
 
 import wtp.constants as consts
-from wtp.util import EventTarget, ChecksumStream, xor_checksum
+from wtp.util import EventTarget, ChecksumStream, EPCHistory
 from wtp.llrp_util import read_opspec, write_opspec, wisp_target_info, access_stop_param
 from wtp.connection import WTPConnection
-from wtp.error import WTPError
+from wtp.cong_ctrl import EWMAOpSpecSizeControl
+from wtp.scheduler import AccessSpecScheduler
 
 ## Module logger
 _logger = logging.getLogger(__name__)
 # Logger level
 _logger.setLevel(logging.DEBUG)
 
+## WISP ID field at the begin of EPC
+_EPC_WISP_ID = struct.Struct("<B")
+## WISP class byte, as found at offset 1 of EPC
+_EPC_WISP_CLASS = struct.pack("<B", consts.RFID_WISP_CLASS)
+## Standard data packet types (A Read carries exactly one data packet)
+_DATA_PKT_TYPES = frozenset((
+    consts.WTP_PKT_BEGIN_MSG,
+    consts.WTP_PKT_CONT_MSG,
+    consts.WTP_PKT_BEGIN_MSG_ACK,
+    consts.WTP_PKT_CONT_MSG_ACK
+))
+
 class WTPServer(EventTarget):
     """!
     @brief WTP server class.
     """
-    def __init__(self, antennas=[1], n_tags_per_report=1, reactor=inet_reactor):
+    def __init__(self, antennas=[1], n_tags_per_report=1, reactor=inet_reactor,
+        llrp_factory=None, window_size=64, opspec_init=consts.WTP_OPSPEC_INIT, timeout=45,
+        n_opspecs_max=consts.LLRP_N_OPSPECS_MAX, opspec_ctrl_factory=EWMAOpSpecSizeControl,
+        n_access_specs_max=consts.LLRP_N_ACCESS_SPECS_MAX):
         """!
         @brief WTP server constructor.
 
         @param antennas Antennas to be enabled.
         @param n_tags_per_report Number of tags per tag report.
         @param reactor Twisted reactor.
+        @param llrp_factory LLRP client factory (Created from antennas and tag report settings if not given).
+        @param window_size Sliding window size of new connections.
+        @param opspec_init Initial Read and BlockWrite size of new connections.
+        @param timeout Data fragment retransmission timeout of new connections in seconds.
+        @param n_opspecs_max Maximum number of OpSpecs in one AccessSpec.
+        @param opspec_ctrl_factory OpSpec size control class or factory function of new connections.
+        @param n_access_specs_max Maximum number of AccessSpecs on the reader.
         """
         # Initialize base classes
         super(WTPServer, self).__init__()
+        # Create LLRP factory
+        if not llrp_factory:
+            llrp_factory = LLRPClientFactory(
+                antennas=antennas,
+                report_every_n_tags=n_tags_per_report,
+                modulation="WISP5",
+                start_inventory=True
+            )
         ## LLRP factory
-        llrp_factory = self._llrp_factory = LLRPClientFactory(
-            antennas=antennas,
-            report_every_n_tags=n_tags_per_report,
-            modulation="WISP5",
-            start_inventory=True
-        )
-        ## Previous seen EPC data
+        self._llrp_factory = llrp_factory
+        ## Sliding window size of new connections
+        self.window_size = window_size
+        ## Initial OpSpec size of new connections
+        self.opspec_init = opspec_init
+        ## Retransmission timeout of new connections
+        self.timeout = timeout
+        ## Maximum number of OpSpecs in one AccessSpec
+        self.n_opspecs_max = n_opspecs_max
+        ## OpSpec size control factory of new connections
+        self.opspec_ctrl_factory = opspec_ctrl_factory
+        ## Recently seen EPC data of WISPs
         self._prev_epcs = {}
         ## WTP connections
         self._connections = {}
         ## Twisted reactor
         self._reactor = reactor
-        ## AccessSpec deferreds
-        self._access_spec_deferreds = {}
+        ## AccessSpec scheduler
+        self.scheduler = AccessSpecScheduler(
+            send_access_spec=self._add_access_spec,
+            max_in_flight=n_access_specs_max
+        )
         ## Add tag report callback
         llrp_factory.addTagReportCallback(self._handle_tag_report)
     def start(self, server, port=LLRP_PORT):
@@ -70,26 +108,25 @@ class WTPServer(EventTarget):
         @param llrp_msg LLRP message.
         """
         reports = llrp_msg.msgdict["RO_ACCESS_REPORT"]["TagReportData"]
+        # Look up attributes once per batch of reports
+        all_prev_epcs = self._prev_epcs
         for report in reports:
-            # Get and parse EPC data
             epc_hex = report["EPC-96"]
-            epc_data = bytearray(unhexlify(epc_hex))
-            stream = ChecksumStream(epc_data)
-            wisp_id, wisp_class = stream.read_data("BB")
-            # Ignore non-WISP devices
-            if wisp_class!=consts.RFID_WISP_CLASS:
+            # Ignore non-WISP devices before decoding EPC
+            # (Only the class octet is decoded, so hexadecimal EPC of either case matches)
+            if unhexlify(epc_hex[2:4])!=_EPC_WISP_CLASS:
                 continue
+            epc_data = unhexlify(epc_hex)
+            wisp_id = _EPC_WISP_ID.unpack_from(epc_data)[0]
             # Read and handle WTP packets from EPC data only when EPC changed
-            prev_epcs = self._prev_epcs.get(wisp_id)
-            if not prev_epcs:
-                prev_epcs = [bytearray(consts.RFID_EPC_SIZE)]*consts.WTP_PREV_EPC_SIZE
-                self._prev_epcs[wisp_id] = prev_epcs
-            if epc_data not in prev_epcs:
+            prev_epcs = all_prev_epcs.get(wisp_id)
+            if prev_epcs==None:
+                prev_epcs = all_prev_epcs[wisp_id] = EPCHistory(consts.WTP_PREV_EPC_SIZE)
+            if prev_epcs.add(epc_data):
                 _logger.debug("New EPC %s for WISP #%d", epc_hex, wisp_id)
-                # Update previous EPCs
-                prev_epcs.pop(0)
-                prev_epcs.append(epc_data)
-                # Handle packets inside EPC
+                # Handle packets inside EPC (After WISP ID and class)
+                stream = ChecksumStream(epc_data)
+                stream.seek(2)
                 self._handle_packets(stream, wisp_id)
             # OpSpec results
             opspec_results = report.get("OpSpecResult")
@@ -100,9 +137,7 @@ class WTPServer(EventTarget):
             if not isinstance(opspec_results, list):
                 opspec_results = [opspec_results]
             # Resolve pending AccessSpec deferreds
-            d = self._access_spec_deferreds.pop(wisp_id, None)
-            if d:
-                d.callback(opspec_results)
+            self.scheduler.complete(wisp_id, opspec_results)
             # Handle Read
             for opspec_result in opspec_results:
                 # OpSpec result status
@@ -111,13 +146,18 @@ class WTPServer(EventTarget):
                 read_data = opspec_result.get("ReadData")
                 if op_status==0 and read_data:
                     stream = ChecksumStream(read_data)
-                    self._handle_packets(stream, wisp_id)
-    def _handle_packets(self, stream, wisp_id):
+                    self._handle_packets(stream, wisp_id, True)
+    def _handle_packets(self, stream, wisp_id, read=False):
         """!
         @brief Handle WTP packets.
 
+        A Read carries exactly one data packet. The Read may be longer than
+        the Read memory the client loaded for it, in which case the bytes
+        after the data packet are left over from previous Reads.
+
         @param stream Data stream containing WTP packets.
         @param wisp_id WISP ID.
+        @param read Whether packets come from Read data.
         """
         # Get WTP connection
         connection = self._connections.get(wisp_id)
@@ -129,57 +169,125 @@ class WTPServer(EventTarget):
             if packet_type==None or packet_type==consts.WTP_PKT_END:
                 break
             # Open connection
-            elif packet_type==consts.WTP_PKT_OPEN:
-                # Do nothing if connection already established
-                if not connection:
-                    # Create new connection
-                    connection = self._connections[wisp_id] = WTPConnection(
-                        server=self,
-                        wisp_id=wisp_id,
-                        checksum_func=xor_checksum,
-                        checksum_type="B"
+            elif packet_type==consts.WTP_PKT_OPEN or packet_type==consts.WTP_PKT_OPEN_PARAM:
+                # Checksum algorithm and framing requested by the client
+                # (Legacy clients only support XOR checksum and standard framing)
+                legacy_open = packet_type==consts.WTP_PKT_OPEN
+                if legacy_open:
+                    checksum_algo = consts.WTP_CHECKSUM_XOR
+                    framing = consts.WTP_FRAMING_STANDARD
+                else:
+                    checksum_algo = stream.read_data("B")
+                    framing = stream.read_data("B")
+                # Open packet sent again by a client that has not received the answer
+                if connection and connection.downlink_state==consts.WTP_STATE_OPENING:
+                    connection._handle_open_again(stream)
+                # Client opens a new connection
+                else:
+                    if connection:
+                        self.scheduler.cancel(wisp_id)
+                        connection._handle_lost()
+                    connection = self._open_connection(stream, wisp_id, checksum_algo, framing,
+                        legacy_open=legacy_open)
+            # Resume connection (From a checkpoint with downlink acknowledgement)
+            elif packet_type==consts.WTP_PKT_RESUME or packet_type==consts.WTP_PKT_RESUME_ACK:
+                # Downlink acknowledgement, session token and uplink sequence number
+                if packet_type==consts.WTP_PKT_RESUME_ACK:
+                    ack_seq, token, seq_num = stream.read_data("HHH")
+                else:
+                    ack_seq = None
+                    token, seq_num = stream.read_data("HH")
+                if connection and connection.token==token:
+                    connection._handle_resume(stream, seq_num, ack_seq)
+                # Resume packet of an unknown session sent again; the connection is already opened for it
+                elif connection and connection._resume_seq==seq_num:
+                    connection._handle_open_again(stream)
+                # Session unknown; open new connection with checksum algorithm and framing
+                # every client supports, and go on with uplink sequence numbers of the client
+                else:
+                    if connection:
+                        self.scheduler.cancel(wisp_id)
+                        connection._handle_lost()
+                    connection = self._open_connection(
+                        stream,
+                        wisp_id,
+                        consts.WTP_CHECKSUM_CRC16,
+                        consts.WTP_FRAMING_STANDARD,
+                        seq_num
                     )
-                    # Handle packet in connection
-                    connection._handle_packet(stream, packet_type)
-                    # Trigger connect event
-                    self.trigger("connect", connection)
+                    connection._resume_seq = seq_num
             # Do not process packets without corresponding connection
             elif connection:
                 # Handle packet in connection
                 connection._handle_packet(stream, packet_type)
+                # Only one data packet inside Read
+                if read and (packet_type in _DATA_PKT_TYPES or packet_type&consts.WTP_PKT_COMPACT_MSG):
+                    break
                 # Close connection
                 if packet_type==consts.WTP_PKT_CLOSE:
                     # Remove connection object when fully closed
                     if connection.uplink_state==consts.WTP_STATE_CLOSED and connection.downlink_state==consts.WTP_STATE_CLOSED:
                         del self._connections[wisp_id]
+                        self.scheduler.cancel(wisp_id)
+    def _open_connection(self, stream, wisp_id, checksum_algo, framing, seq_num=0, legacy_open=False):
+        """!
+        @brief Open new WTP connection.
+
+        @param stream Data stream containing open or resume packet.
+        @param wisp_id WISP ID.
+        @param checksum_algo Checksum algorithm requested by the client.
+        @param framing Data packet framing requested by the client.
+        @param seq_num Uplink sequence number to begin with.
+        @param legacy_open Whether the client opens the connection with a legacy open packet.
+        @return New WTP connection.
+        """
+        # Create new connection
+        connection = self._connections[wisp_id] = WTPConnection(
+            server=self,
+            wisp_id=wisp_id,
+            checksum_algo=checksum_algo,
+            framing=framing,
+            window_size=self.window_size,
+            opspec_init=self.opspec_init,
+            timeout=self.timeout,
+            n_opspecs_max=self.n_opspecs_max,
+            opspec_ctrl_factory=self.opspec_ctrl_factory
+        )
+        connection.legacy_open = legacy_open
+        # Handle open packet in connection
+        connection._handle_open(stream, seq_num)
+        # Trigger connect event
+        self.trigger("connect", connection)
+        return connection
     def _send_access_spec(self, wisp_id, opspecs):
         """!
         @brief Send AccessSpec to WISP.
 
+        The AccessSpec is queued by the scheduler until the reader has room for it.
+
         @param wisp_id WISP ID.
         @param opspecs OpSpecs to send.
-        @throws WTPError If there are ongoing AccessSpec for current WISP ID.
+        @return A deferred object resolved with OpSpec results.
         """
-        # Ongoing AccessSpec for current WISP ID
-        if wisp_id in self._access_spec_deferreds:
-            raise WTPError(consts.WTP_ERR_ONGOING_ACCESS_SPEC)
         # Ensure OpSpecs is a list
         if not isinstance(opspecs, list):
             opspecs = [opspecs]
+        return self.scheduler.submit(wisp_id, opspecs)
+    def _add_access_spec(self, wisp_id, opspecs):
+        """!
+        @brief Add AccessSpec to the reader.
+
+        @param wisp_id WISP ID.
+        @param opspecs OpSpecs to send.
+        @return A deferred object resolved once the AccessSpec is added.
+        """
         # Get LLRP client
         proto = self._llrp_factory.protocols[0]
         # Do next access
-        access_deferred = proto.nextAccess(
+        return proto.nextAccess(
             stopSpecPar=access_stop_param(),
             # Use WISP ID as AccessSpec ID
             accessSpecID=wisp_id,
             param=opspecs,
             target=wisp_target_info(wisp_id)
         )
-        # Return deferred object
-        d = Deferred()
-        # Chain deferreds in case of error
-        access_deferred.addErrback(d.errback)
-        # Add to deferreds mapping
-        self._access_spec_deferreds[wisp_id] = d
-        return d
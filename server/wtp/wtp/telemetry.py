@@ -0,0 +1,296 @@
+from __future__ import absolute_import, unicode_literals
+from array import array
+from binascii import hexlify, unhexlify
+from six.moves import range
+
+import wtp.constants as consts
+from wtp.error import WTPError
+
+def _zigzag(delta):
+    """!
+    @brief Zig-zag map a 16-bit delta, so that small deltas of both signs get small codes.
+
+    @param delta Delta, modulo 0x10000.
+    @return Code.
+    """
+    delta &= 0xffff
+    return ((delta<<1)^(0xffff if delta&0x8000 else 0))&0xffff
+
+def _unzigzag(code):
+    """!
+    @brief Inverse zig-zag map a code.
+
+    @param code Code.
+    @return Delta, modulo 0x10000.
+    """
+    return ((code>>1)^(0xffff if code&1 else 0))
+
+def _varint_size(value):
+    """!
+    @brief Get size of a varint.
+
+    @param value Value.
+    @return Varint size.
+    """
+    return 1 if value<0x80 else 2 if value<0x4000 else 3
+
+def _put_varint(out, value):
+    """!
+    @brief Write a varint (7 bits per byte, lowest bits first).
+
+    @param out Output byte array.
+    @param value Value.
+    """
+    while value>=0x80:
+        out.append((value&0x7f)|0x80)
+        value >>= 7
+    out.append(value)
+
+def _get_varint(data, pos):
+    """!
+    @brief Read a varint.
+
+    @param data Frame data.
+    @param pos Varint position.
+    @return Value and position after varint.
+    """
+    value = shift = 0
+    while shift<21:
+        if pos>=len(data):
+            raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+        byte = data[pos]
+        pos += 1
+        value |= (byte&0x7f)<<shift
+        if not byte&0x80:
+            if value>0xffff:
+                break
+            return value, pos
+        shift += 7
+    raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+
+class TelemetryCodec(object):
+    """!
+    @brief Telemetry framing codec class.
+
+    Compatible with the client codec ("wtp/telemetry.h"). Every channel of a frame is sent
+    as deltas against the previous sample, bit-packed at the width of the largest zig-zag
+    delta or as zig-zag varints, whichever is smaller. Decoded samples are flat arrays with
+    the channels of each sample next to each other, so they can be wrapped without copies
+    (For example, "numpy.frombuffer(samples, numpy.int16).reshape(-1, codec.n_channels)").
+    """
+    def __init__(self, n_channels=None, key_interval=0, typecode="h"):
+        """!
+        @brief Telemetry codec constructor.
+
+        @param n_channels Number of channels of each sample, or None to take it from the first key frame (Decoding only).
+        @param key_interval Number of frames from one key frame to the next (0 for key frames only at the beginning of a stream).
+        @param typecode Array type code of decoded samples ("h" for signed or "H" for unsigned 16-bit samples).
+        """
+        if n_channels!=None and (n_channels<1 or n_channels>consts.WTP_TELEMETRY_CHANNELS_MAX):
+            raise WTPError(consts.WTP_ERR_INVALID_PARAM)
+        if typecode not in ("h", "H"):
+            raise WTPError(consts.WTP_ERR_INVALID_PARAM)
+        ## Number of channels
+        self._n_channels = n_channels
+        ## Key interval
+        self._key_interval = key_interval
+        ## Array type code of decoded samples
+        self._typecode = str(typecode)
+        self.reset()
+    @property
+    def n_channels(self):
+        """!
+        @brief Number of channels of each sample.
+        """
+        return self._n_channels
+    def reset(self):
+        """!
+        @brief Reset codec and begin a new stream.
+
+        The next encoded frame is a key frame.
+        """
+        ## Last sample of previous frame (Modulo 0x10000)
+        self._prev = None
+        ## A stream of frames is in progress
+        self._in_stream = False
+        ## Index of next frame in stream
+        self._frame_index = 0
+        ## Number of frames since last key frame, including it
+        self._n_since_key = 0
+    def encode(self, samples):
+        """!
+        @brief Encode a batch of samples into a frame.
+
+        @param samples Samples, with the channels of each sample next to each other.
+        @return Frame data.
+        """
+        n_channels = self._n_channels
+        if n_channels==None:
+            raise WTPError(consts.WTP_ERR_INVALID_PARAM)
+        n_samples = len(samples)//n_channels
+        if n_samples<1 or n_samples>0xff or len(samples)!=n_samples*n_channels:
+            raise WTPError(consts.WTP_ERR_INVALID_SIZE)
+        # Begin a new stream after reset, or send a key frame every key interval
+        key = not self._in_stream or (self._key_interval and self._n_since_key>=self._key_interval)
+        out = bytearray((
+            (consts.WTP_TELEMETRY_KEY if key else 0)|(self._frame_index&consts.WTP_TELEMETRY_INDEX_MASK),
+            n_samples
+        ))
+        if key:
+            out.append(n_channels)
+        for i in range(n_channels):
+            channel = [sample&0xffff for sample in samples[i::n_channels]]
+            # Key frames carry the first sample as is
+            if key:
+                prev = channel[0]
+                _put_varint(out, _zigzag(prev))
+                channel = channel[1:]
+            else:
+                prev = self._prev[i]
+            codes = []
+            for sample in channel:
+                codes.append(_zigzag(sample-prev))
+                prev = sample
+            self._put_block(out, codes)
+        self._prev = [sample&0xffff for sample in samples[-n_channels:]]
+        self._in_stream = True
+        self._frame_index += 1
+        self._n_since_key = 1 if key else self._n_since_key+1
+        return bytes(out)
+    @staticmethod
+    def _put_block(out, codes):
+        """!
+        @brief Write zig-zag deltas of a channel as a channel block.
+
+        @param out Output byte array.
+        @param codes Zig-zag deltas.
+        """
+        width = 0
+        for code in codes:
+            width |= code
+        width = width.bit_length()
+        packed_size = (len(codes)*width+7)//8
+        varint_size = sum(_varint_size(code) for code in codes)
+        # Zig-zag varints
+        if varint_size<packed_size:
+            out.append(consts.WTP_TELEMETRY_VARINT)
+            for code in codes:
+                _put_varint(out, code)
+        # Bit-packed deltas, highest bits first
+        else:
+            out.append(width)
+            if packed_size:
+                bits = 0
+                for code in codes:
+                    bits = (bits<<width)|code
+                bits <<= packed_size*8-len(codes)*width
+                out += unhexlify("%0*x" % (packed_size*2, bits))
+    def decode(self, data):
+        """!
+        @brief Decode a frame into a batch of samples.
+
+        The stream is broken on failure, and frames are rejected until the
+        encoder sends a key frame.
+
+        @param data Frame data.
+        @return Samples as an array, with the channels of each sample next to each other.
+        """
+        data = bytearray(data)
+        if len(data)<consts.WTP_TELEMETRY_HEADER_SIZE:
+            raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+        header, n_samples = data[0], data[1]
+        pos = consts.WTP_TELEMETRY_HEADER_SIZE
+        key = header&consts.WTP_TELEMETRY_KEY
+        # First frame of a new stream
+        if key:
+            self.reset()
+            if pos>=len(data):
+                raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+            n_channels = data[pos]
+            pos += 1
+            if n_channels<1 or n_channels>consts.WTP_TELEMETRY_CHANNELS_MAX or \
+                (self._n_channels!=None and n_channels!=self._n_channels):
+                raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+            self._frame_index = header&consts.WTP_TELEMETRY_INDEX_MASK
+        # Frames missing or out of stream
+        elif not self._in_stream or \
+            (header&consts.WTP_TELEMETRY_INDEX_MASK)!=(self._frame_index&consts.WTP_TELEMETRY_INDEX_MASK):
+            self._in_stream = False
+            raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+        else:
+            n_channels = self._n_channels
+        try:
+            if n_samples<1:
+                raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+            samples = [0]*(n_samples*n_channels)
+            for i in range(n_channels):
+                # Key frames carry the first sample as is
+                if key:
+                    prev, pos = _get_varint(data, pos)
+                    prev = _unzigzag(prev)
+                    samples[i] = prev
+                    first = 1
+                else:
+                    prev = self._prev[i]
+                    first = 0
+                pos = self._get_block(data, pos, samples, i+first*n_channels, n_channels, n_samples-first, prev)
+        # Frame is corrupted; wait for next key frame
+        except WTPError:
+            self._in_stream = False
+            raise
+        self._n_channels = n_channels
+        self._prev = samples[-n_channels:]
+        self._in_stream = True
+        self._frame_index += 1
+        # Samples are kept modulo 0x10000 until here
+        if self._typecode=="h":
+            samples = [sample-0x10000 if sample&0x8000 else sample for sample in samples]
+        return array(self._typecode, samples)
+    @staticmethod
+    def _get_block(data, pos, samples, index, n_channels, n_deltas, prev):
+        """!
+        @brief Read a channel block into samples of a channel.
+
+        @param data Frame data.
+        @param pos Channel block position.
+        @param samples Samples.
+        @param index Index of first sample of channel to decode.
+        @param n_channels Number of channels.
+        @param n_deltas Number of deltas.
+        @param prev Sample before the first sample.
+        @return Position after channel block.
+        """
+        if pos>=len(data):
+            raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+        mode = data[pos]
+        pos += 1
+        indices = range(index, index+n_deltas*n_channels, n_channels)
+        # Zig-zag varints
+        if mode==consts.WTP_TELEMETRY_VARINT:
+            for i in indices:
+                code, pos = _get_varint(data, pos)
+                prev = (prev+_unzigzag(code))&0xffff
+                samples[i] = prev
+        # Bit-packed deltas
+        else:
+            width = mode
+            if width>16:
+                raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+            packed_size = (n_deltas*width+7)//8
+            if pos+packed_size>len(data):
+                raise WTPError(consts.WTP_ERR_INVALID_STREAM)
+            # A channel of constant samples takes no bits
+            if not packed_size:
+                for i in indices:
+                    samples[i] = prev
+                return pos
+            bits = int(hexlify(bytes(data[pos:pos+packed_size])), 16)
+            mask = (1<<width)-1
+            shift = packed_size*8
+            for i in indices:
+                shift -= width
+                code = (bits>>shift)&mask
+                prev = (prev+((code>>1)^(0xffff if code&1 else 0)))&0xffff
+                samples[i] = prev
+            pos += packed_size
+        return pos
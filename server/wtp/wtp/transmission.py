@@ -5,7 +5,7 @@ from recordclass import recordclass
 from twisted.internet.defer import Deferred
 
 import wtp.constants as consts
-from wtp.util import CyclicInt, CyclicRange, ChecksumStream
+from wtp.util import ChecksumStream, varint_bytes, seq_add, seq_diff, seq_offset, seq_le, seq_in_window
 
 ## Module logger
 _logger = logging.getLogger(__name__)
@@ -13,14 +13,14 @@ _logger = logging.getLogger(__name__)
 _logger.setLevel(logging.DEBUG)
 
 ## Transmit fragment type
-TxFragment = recordclass("TxFragment", ["seq_num", "msg_size", "data", "d", "need_send"])
+TxFragment = recordclass("TxFragment", ["seq_num", "msg_size", "data", "d", "need_send", "sacked"])
 
 class SlidingWindowTxControl(object):
     """!
     @brief Sliding window-based transmit control class.
     """
     def __init__(self, reactor, write_size, window_size, checksum_func,
-        checksum_type, timeout, request_access_spec):
+        checksum_type, timeout, request_access_spec, framing=consts.WTP_FRAMING_STANDARD):
         """!
         @brief Sliding windw-based transmit control constructor.
 
@@ -31,6 +31,7 @@ class SlidingWindowTxControl(object):
         @param checksum_type Checksum data type.
         @param timeout Fragment timeout.
         @param request_access_spec Request AccessSpec function.
+        @param framing Data packet framing.
         """
         ## Write OpSpec data size
         self.write_size = write_size
@@ -44,22 +45,75 @@ class SlidingWindowTxControl(object):
         self.checksum_func = checksum_func
         ## Checksum data type
         self.checksum_type = checksum_type
+        ## Data packet framing
+        self.framing = framing
         ## Twisted reactor
         self._reactor = reactor
         ## Sequence number
-        self._seq_num = CyclicInt(0, consts.WTP_SEQ_MAX)
+        self._seq_num = 0
         ## Pending packets
         self._packets = []
         ## Pending messages
         self._messages = []
         ## Begin sequence number of next message
-        self._msg_begin = CyclicInt(0, consts.WTP_SEQ_MAX)
+        self._msg_begin = 0
         ## Fragmented size of next message
         self._msg_fragmented = 0
         ## Sequence numbers of message ends
         self._msg_ends = []
         ## Sending data fragments
         self._fragments = []
+        ## Pending cumulative acknowledgement (Piggybacked on next data packet if there is any)
+        self.ack_seq = None
+        ## Pending selective acknowledgement packet
+        self._ack_packet = None
+    def _header_size(self, msg_size, ack=False):
+        """!
+        @brief Get data packet header size.
+
+        @param msg_size Message size for begin message data packet, or 0.
+        @param ack Whether the packet carries piggybacked acknowledgement.
+        @return Header size.
+        """
+        ack_size = 2 if ack else 0
+        if self.framing==consts.WTP_FRAMING_COMPACT:
+            return ack_size+(2+len(varint_bytes(msg_size)) if msg_size else 2)
+        return ack_size+(6 if msg_size else 4)
+    def _write_data_packet(self, stream, fragment, ack_seq=None):
+        """!
+        @brief Write data packet of a fragment to stream.
+
+        @param stream Stream to write to.
+        @param fragment Transmit data fragment.
+        @param ack_seq Piggybacked acknowledged sequence number, or None.
+        """
+        data = fragment.data
+        ack = ack_seq!=None
+        if self.framing==consts.WTP_FRAMING_COMPACT:
+            # Packet type carries begin and acknowledgement flags and payload size
+            packet_type = consts.WTP_PKT_COMPACT_MSG|len(data)
+            if fragment.msg_size:
+                packet_type |= consts.WTP_PKT_COMPACT_BEGIN
+            if ack:
+                packet_type |= consts.WTP_PKT_COMPACT_ACK
+            stream.write_data("B", packet_type)
+            if ack:
+                stream.write_data("H", ack_seq)
+            if fragment.msg_size:
+                stream.write_varint(fragment.msg_size)
+            # Lowest 8 bits of sequence number
+            stream.write_data("B", fragment.seq_num&0xff)
+        else:
+            if fragment.msg_size:
+                stream.write_data("B", consts.WTP_PKT_BEGIN_MSG_ACK if ack else consts.WTP_PKT_BEGIN_MSG)
+            else:
+                stream.write_data("B", consts.WTP_PKT_CONT_MSG_ACK if ack else consts.WTP_PKT_CONT_MSG)
+            if ack:
+                stream.write_data("H", ack_seq)
+            if fragment.msg_size:
+                stream.write_data("H", fragment.msg_size)
+            stream.write_data("HB", fragment.seq_num, len(data))
+        stream.write(data)
     def _make_fragment(self, avail_size):
         """!
         @brief Make new data fragment with given available size.
@@ -75,7 +129,7 @@ class SlidingWindowTxControl(object):
         # Load next message to fragment
         if self._msg_fragmented>=len(msg):
             # Update message begin and fragmented position
-            self._msg_begin += len(msg)
+            self._msg_begin = seq_add(self._msg_begin, len(msg))
             self._msg_fragmented = 0
             # Add message end
             self._msg_ends.append(self._msg_begin)
@@ -86,13 +140,16 @@ class SlidingWindowTxControl(object):
             msg = messages[0]
         # Sequence number
         msg_fragmented = self._msg_fragmented
-        seq_num = self._msg_begin+msg_fragmented
+        seq_num = seq_add(self._msg_begin, msg_fragmented)
         # Maximum packet data size using different criterion
-        max_avail = avail_size-(6 if msg_fragmented==0 else 4)
+        max_avail = avail_size-self._header_size(len(msg) if msg_fragmented==0 else 0)
         if self.checksum_type:
             max_avail -= struct.calcsize(self.checksum_type)
+        # Payload size of compact data packet is limited by bits of packet type
+        if self.framing==consts.WTP_FRAMING_COMPACT:
+            max_avail = min(max_avail, consts.WTP_PKT_COMPACT_SIZE_MASK)
         max_msg = len(msg)-msg_fragmented
-        max_window = self._seq_num+self.window_size-seq_num
+        max_window = self.window_size-seq_diff(seq_num, self._seq_num)
         # Packet data size
         packet_data_size = min(max_avail, max_msg, max_window)
         if packet_data_size<=0:
@@ -106,7 +163,8 @@ class SlidingWindowTxControl(object):
             msg_size=len(msg) if msg_fragmented==0 else 0,
             data=packet_data,
             d=None,
-            need_send=False
+            need_send=False,
+            sacked=False
         )
     def _handle_packet_timeout(self, fragment, *args):
         """!
@@ -134,6 +192,22 @@ class SlidingWindowTxControl(object):
         @param packet_data Packet data to send.
         """
         self._packets.append(packet_data)
+    def set_ack(self, seq_num, ack_packet=None):
+        """!
+        @brief Set pending acknowledgement.
+
+        At most one acknowledgement is pending, and it is replaced by every newer acknowledgement
+        until it is sent, so acknowledgements of data packets received together are coalesced.
+
+        @param seq_num Acknowledged sequence number.
+        @param ack_packet Selective acknowledgement packet data, or None for cumulative acknowledgement.
+        """
+        if ack_packet:
+            self.ack_seq = None
+            self._ack_packet = ack_packet
+        else:
+            self.ack_seq = seq_num
+            self._ack_packet = None
     def handle_ack(self, seq_num):
         """!
         @brief Handle acknowledgement.
@@ -141,63 +215,160 @@ class SlidingWindowTxControl(object):
         @param seq_num Acknowledged sequence number.
         @return Number of messages sent.
         """
-        # Acknowledged sequence number
-        seq_num = CyclicInt(seq_num, consts.WTP_SEQ_MAX)
         # Number of messages sent
         n_sent_msgs = 0
-        with self._seq_num.as_zero():
-            # Invalid sequence number; drop acknowledgement
-            if seq_num>self._msg_begin+self._msg_fragmented:
+        # Compare offsets after current sequence number
+        zero = self._seq_num
+        ack_offset = seq_offset(seq_num, zero)
+        # Invalid sequence number; drop acknowledgement
+        if ack_offset>seq_offset(seq_add(self._msg_begin, self._msg_fragmented), zero):
+            return 0
+        # Get number of acknowledged fragments
+        fragments = self._fragments
+        index = -1
+        for index, fragment in enumerate(fragments):
+            end_offset = seq_offset(fragment.seq_num, zero)+len(fragment.data)
+            # End of acknowledged range
+            if end_offset==ack_offset:
+                break
+            # No fragment to acknowledge or sequence number not at fragments border
+            elif end_offset>ack_offset:
                 return 0
-            # Get number of acknowledged fragments
-            fragments = self._fragments
-            index = -1
-            for index, fragment in enumerate(fragments):
-                fragment_end = fragment.seq_num+len(fragment.data)
-                # End of acknowledged range
-                if fragment_end==seq_num:
-                    break
-                # No fragment to acknowledge or sequence number not at fragments border
-                elif fragment_end>seq_num:
-                    return 0
-            # Remove acknowledged fragments
-            msg_ends = self._msg_ends
-            for _ in range(index+1):
-                fragment = fragments.pop(0)
-                fragment_end = fragment.seq_num+len(fragment.data)
-                # Whole message sent
-                if msg_ends and msg_ends[0]<=fragment_end:
-                    n_sent_msgs += 1
-                    msg_ends.pop(0)
-                # Resolve fragment deferreds
-                _logger.debug("Resolve seq=%d size=%d", fragment.seq_num, len(fragment.data))
+        # Remove acknowledged fragments
+        msg_ends = self._msg_ends
+        for _ in range(index+1):
+            fragment = fragments.pop(0)
+            fragment_end = seq_add(fragment.seq_num, len(fragment.data))
+            # Whole message sent
+            if msg_ends and seq_le(msg_ends[0], fragment_end):
+                n_sent_msgs += 1
+                msg_ends.pop(0)
+            # Resolve fragment deferreds
+            # (Fragments split for retransmission may not be sent yet,
+            # and timed out fragments may be acknowledged before retransmission)
+            _logger.debug("Resolve seq=%d size=%d", fragment.seq_num, len(fragment.data))
+            if fragment.d and not fragment.d.called:
                 fragment.d.callback(True)
         # Update sequence number
         self._seq_num = seq_num
         return n_sent_msgs
+    def handle_sack(self, begin, size):
+        """!
+        @brief Handle selective acknowledgement block.
+
+        Data fragments inside the block were received out of order by the client,
+        so they are no longer retransmitted.
+
+        @param begin Begin sequence number of the block.
+        @param size Size of the block.
+        """
+        # Compare offsets after current sequence number
+        zero = self._seq_num
+        begin_offset = seq_offset(begin, zero)
+        end_offset = begin_offset+size
+        for fragment in self._fragments:
+            fragment_offset = seq_offset(fragment.seq_num, zero)
+            # Fragments after the block
+            if fragment_offset>=end_offset:
+                break
+            # Fragment inside the block
+            if fragment_offset>=begin_offset and fragment_offset+len(fragment.data)<=end_offset:
+                fragment.sacked = True
+                fragment.need_send = False
+                # Cancel retransmission timeout
+                if fragment.d and not fragment.d.called:
+                    fragment.d.callback(True)
+    def resume(self):
+        """!
+        @brief Drop data in flight when the client resumes the session after losing power.
+
+        Data fragments in flight and the message being fragmented are dropped, together with
+        pending acknowledgements. Pending messages are sent from the first sequence number
+        never used, so data written before the power loss cannot be taken for new data.
+
+        @return Sequence number the downlink goes on from, and number of messages dropped.
+        """
+        n_dropped = len(self._msg_ends)
+        # Message being fragmented
+        if self._messages and self._msg_fragmented>0:
+            self._messages.pop(0)
+            n_dropped += 1
+        seq_num = seq_add(self._msg_begin, self._msg_fragmented)
+        # Cancel retransmission timeouts
+        for fragment in self._fragments:
+            if fragment.d and not fragment.d.called:
+                fragment.d.callback(False)
+        self._seq_num = self._msg_begin = seq_num
+        self._msg_fragmented = 0
+        self._msg_ends = []
+        self._fragments = []
+        self.ack_seq = None
+        self._ack_packet = None
+        return seq_num, n_dropped
+    def rewind(self, seq_num):
+        """!
+        @brief Send data in flight again when the client resumes the session from a checkpoint.
+
+        The client kept downlink data up to the sequence number it acknowledged, so data fragments
+        in flight are sent again from there. This needs all data before it to be acknowledged.
+
+        @param seq_num Downlink sequence number acknowledged by the client.
+        @return Whether data in flight is sent again (Otherwise it must be dropped with resume).
+        """
+        if seq_num!=self._seq_num:
+            return False
+        for fragment in self._fragments:
+            # Cancel retransmission timeouts
+            if fragment.d and not fragment.d.called:
+                fragment.d.callback(False)
+            fragment.need_send = True
+            fragment.sacked = False
+        self.ack_seq = None
+        self._ack_packet = None
+        return True
     def get_write_data(self):
         """!
         @brief Get Write/BlockWrite OpSpec data.
 
+        A pending cumulative acknowledgement is piggybacked on the first data packet,
+        or else written as a standalone acknowledgement packet after the data packets.
+        A pending selective acknowledgement packet is written after other pending packets.
+
         @return Write/BlockWrite data.
         """
         stream = ChecksumStream(
             checksum_func=self.checksum_func,
             checksum_type=self.checksum_type
         )
+        # Checksum size
+        checksum_size = struct.calcsize(self.checksum_type) if self.checksum_type else 0
         estimate_size = 0
         # Write packets to stream
         packets = self._packets
         while packets:
             # Calculate new estimate payload length
-            packet = packets.pop(0)
-            estimate_size += len(packet)
-            # OpSpec data will be too long
-            if estimate_size>self.write_size:
+            packet = packets[0]
+            packet_size = len(packet)+checksum_size
+            # OpSpec data will be too long; send packet next time
+            if estimate_size+packet_size>self.write_size:
                 return stream.getvalue()
+            packets.pop(0)
+            estimate_size += packet_size
             # Write packet and checksum to stream
+            stream.begin_checksum()
             stream.write(packet)
             stream.write_checksum()
+        # Write pending selective acknowledgement packet
+        ack_packet = self._ack_packet
+        if ack_packet:
+            packet_size = len(ack_packet)+checksum_size
+            if estimate_size+packet_size>self.write_size:
+                return stream.getvalue()
+            self._ack_packet = None
+            estimate_size += packet_size
+            stream.begin_checksum()
+            stream.write(ack_packet)
+            stream.write_checksum()
         # Write message data to stream
         fragments = self._fragments
         while True:
@@ -205,41 +376,64 @@ class SlidingWindowTxControl(object):
             # Try to find existing data fragment to send
             for fragment in fragments:
                 if fragment.need_send:
-                    # Fragment to retransmit
-                    _logger.debug("Retransmit seq_num=%d size=%d", fragment.seq_num, len(fragment.data))
                     send_fragment = fragment
-                    # Avoid being select multiple times
-                    send_fragment.need_send = False
                     break
+            # Piggyback pending acknowledgement
+            ack_seq = self.ack_seq
+            ack_size = 2 if ack_seq!=None else 0
+            # Fragment to retransmit
+            if send_fragment:
+                header_size = self._header_size(send_fragment.msg_size, ack_seq!=None)+checksum_size
+                packet_size = header_size+len(send_fragment.data)
+                # OpSpec data will be too long; retransmit fragment next time
+                if estimate_size+packet_size>self.write_size:
+                    # Write size has shrunk since the fragment was made; split the fragment,
+                    # or it will never fit in a BlockWrite again
+                    data_size = self.write_size-header_size
+                    if estimate_size>0 or data_size<=0:
+                        break
+                    fragments.insert(fragments.index(send_fragment)+1, TxFragment(
+                        seq_num=seq_add(send_fragment.seq_num, data_size),
+                        msg_size=0,
+                        data=send_fragment.data[data_size:],
+                        d=None,
+                        need_send=True,
+                        sacked=False
+                    ))
+                    send_fragment.data = send_fragment.data[:data_size]
+                    packet_size = header_size+data_size
+                _logger.debug("Retransmit seq_num=%d size=%d", send_fragment.seq_num, len(send_fragment.data))
+                # Avoid being select multiple times
+                send_fragment.need_send = False
             # Try to make new data fragment to send
-            if not send_fragment:
-                send_fragment = self._make_fragment(self.write_size-estimate_size)
+            else:
+                send_fragment = self._make_fragment(self.write_size-estimate_size-ack_size)
                 if send_fragment:
                     fragments.append(send_fragment)
                 # No more fragments to send
                 else:
                     break
-            # Calculate new estimate payload length
-            packet_size = 4+len(send_fragment.data)
+                packet_size = self._header_size(send_fragment.msg_size, ack_seq!=None)+ \
+                    len(send_fragment.data)+checksum_size
+            # Update estimate payload length
             estimate_size += packet_size
-            # OpSpec data will be too long
-            if estimate_size>self.write_size:
-                return stream.getvalue()
             # Write packet data
             stream.begin_checksum()
-            if send_fragment.msg_size:
-                stream.write_data("BH", consts.WTP_PKT_BEGIN_MSG, send_fragment.msg_size)
-            else:
-                stream.write_data("B", consts.WTP_PKT_CONT_MSG)
-            stream.write_data("HB", send_fragment.seq_num, len(send_fragment.data))
-            stream.write(send_fragment.data)
+            self._write_data_packet(stream, send_fragment, ack_seq)
             stream.write_checksum()
+            self.ack_seq = None
             # Set fragment timeout
             d = Deferred()
             d.addTimeout(self.timeout, self._reactor, onTimeoutCancel=functools.partial(
                 SlidingWindowTxControl._handle_packet_timeout, self, send_fragment
             ))
             send_fragment.d = d
+        # Acknowledgement not piggybacked; write standalone acknowledgement packet
+        if self.ack_seq!=None and estimate_size+3+checksum_size<=self.write_size:
+            stream.begin_checksum()
+            stream.write_data("BH", consts.WTP_PKT_ACK, self.ack_seq)
+            stream.write_checksum()
+            self.ack_seq = None
         # Return send data
         return stream.getvalue()
 
@@ -259,7 +453,7 @@ class SlidingWindowRxControl(object):
         @param window_size Sliding window size.
         """
         ## Sequence number
-        self.seq_num = CyclicInt(0, consts.WTP_SEQ_MAX)
+        self.seq_num = 0
         ## Sliding window size
         self.window_size = window_size
         ## Acknowledged next message data
@@ -268,6 +462,37 @@ class SlidingWindowRxControl(object):
         self._fragments = []
         ## Message begin sequence number and size
         self._msg_info = []
+    def resume(self, seq_num):
+        """!
+        @brief Drop partial message when the client resumes the session after losing power.
+
+        @param seq_num Sequence number the client goes on from.
+        """
+        self.seq_num = seq_num
+        self._msg_data = bytearray()
+        self._fragments = []
+        self._msg_info = []
+    def get_sack_blocks(self):
+        """!
+        @brief Get selective acknowledgement blocks for data received out of order.
+
+        Consecutive data fragments are merged into one block.
+
+        @return Begin sequence number and size of at most WTP_SACK_BLOCKS_MAX blocks.
+        """
+        blocks = []
+        for fragment in self._fragments:
+            # Extend last block (Block size is limited to 1 byte)
+            if blocks:
+                begin, size = blocks[-1]
+                if fragment.seq_num==seq_add(begin, size) and size+len(fragment.data)<=0xff:
+                    blocks[-1] = (begin, size+len(fragment.data))
+                    continue
+            # No more blocks available
+            if len(blocks)>=consts.WTP_SACK_BLOCKS_MAX:
+                break
+            blocks.append((fragment.seq_num, len(fragment.data)))
+        return blocks
     def handle_packet(self, seq_num, data, new_msg_size=None):
         """!
         @brief Handle new data packet that arrives on the connection.
@@ -277,58 +502,86 @@ class SlidingWindowRxControl(object):
         @param new_msg_size Message size for begin message data packet.
         @return Newly received messages.
         """
-        # Packet sequence number
-        seq_num = CyclicInt(seq_num, consts.WTP_SEQ_MAX)
-        # Packet data range and sliding window
-        pkt_range = CyclicRange(seq_num, size=len(data), radix=consts.WTP_SEQ_MAX)
-        sliding_window = CyclicRange(self.seq_num, size=self.window_size, radix=consts.WTP_SEQ_MAX)
+        # A fragment resent in pieces may begin before data received so far;
+        # cut the received part so that the rest is not dropped
+        received_size = seq_diff(self.seq_num, seq_num)
+        if 0<received_size<len(data):
+            seq_num = self.seq_num
+            data = data[received_size:]
+            new_msg_size = None
         # Packet data range must be within sliding window, or the packet is dropped
-        if pkt_range not in sliding_window:
+        if not seq_in_window(seq_num, len(data), self.seq_num, self.window_size):
             return []
         # Begin of message
         msg_info = self._msg_info
         if new_msg_size:
-            new_msg_size = CyclicInt(new_msg_size, radix=consts.WTP_SEQ_MAX)
-            with self.seq_num.as_zero():
-                i = 0
-                # Find position to insert new message information
-                for i in range(len(msg_info)):
-                    if seq_num<msg_info[i].begin:
-                        break
-                # Drop new message packet if it overlaps with declared messages
-                if i<len(msg_info) and seq_num+new_msg_size>msg_info[i].begin:
-                    return []
-                # Insert new message information
+            # Compare offsets after begin of message being received, before which no message begins
+            msg_base = seq_add(self.seq_num, -len(self._msg_data))
+            offset = seq_offset(seq_num, msg_base)
+            # Find position to insert new message information
+            i = len(msg_info)
+            for j, info in enumerate(msg_info):
+                if offset<seq_offset(info.begin, msg_base):
+                    i = j
+                    break
+            prev_info = msg_info[i-1] if i>0 else None
+            # Same message declared by an earlier copy of the packet
+            if prev_info and prev_info.begin==seq_num and prev_info.size==new_msg_size:
+                pass
+            # Drop new message packet if it overlaps with declared messages
+            elif (prev_info and seq_offset(prev_info.begin, msg_base)+prev_info.size>offset) or \
+                (i<len(msg_info) and offset+new_msg_size>seq_offset(msg_info[i].begin, msg_base)):
+                return []
+            # Insert new message information
+            else:
                 msg_info.insert(i, RxMsgInfo(begin=seq_num, size=new_msg_size))
         # Inserting data to data fragments
+        # (Offsets after current sequence number are compared)
         fragments = self._fragments
-        with self.seq_num.as_zero():
-            i = 0
-            # Find position to insert data fragment
-            for i in range(len(fragments)):
-                if seq_num<fragments[i].seq_num:
-                    break
-            # Drop data packet if it overlaps with other data fragments
-            if i<len(fragments) and seq_num+len(data)>fragments[i].seq_num:
-                return []
-            # Insert data fragment
-            fragments.insert(i, RxFragment(seq_num=seq_num, data=data))
+        zero = self.seq_num
+        offset = seq_offset(seq_num, zero)
+        # Find position to insert data fragment
+        i = len(fragments)
+        for j, fragment in enumerate(fragments):
+            if offset<seq_offset(fragment.seq_num, zero):
+                i = j
+                break
+        # Client may resend a fragment in pieces when its Read size shrinks,
+        # so data received before is cut from the packet instead of dropping it
+        if i>0:
+            prev_end = seq_offset(fragments[i-1].seq_num, zero)+len(fragments[i-1].data)
+            if prev_end>offset:
+                data = data[prev_end-offset:]
+                offset = prev_end
+        # Fragments covered by the packet are replaced
+        end = offset+len(data)
+        while i<len(fragments) and end>=seq_offset(fragments[i].seq_num, zero)+len(fragments[i].data):
+            del fragments[i]
+        if i<len(fragments):
+            next_offset = seq_offset(fragments[i].seq_num, zero)
+            if end>next_offset:
+                data = data[:next_offset-offset]
+        # Insert data fragment
+        if data:
+            fragments.insert(i, RxFragment(seq_num=seq_add(zero, offset), data=data))
         # Newly received messages
         new_msgs = []
+        # Number of assembled data fragments
+        n_assembled = 0
         # Try to assemble received data fragments
-        index = -1
-        for index, fragment in enumerate(fragments):
+        for fragment in fragments:
             # Append consecutive data fragments
             if fragment.seq_num==self.seq_num:
                 self._msg_data += fragment.data
-                self.seq_num += len(fragment.data)
+                self.seq_num = seq_add(self.seq_num, len(fragment.data))
+                n_assembled += 1
             else:
                 break
             # Calculate end of current message
             if not msg_info:
                 continue
             current_msg_info = msg_info[0]
-            current_msg_end = current_msg_info.begin+current_msg_info.size
+            current_msg_end = seq_add(current_msg_info.begin, current_msg_info.size)
             # End of current message reached
             if self.seq_num==current_msg_end:
                 # Update newly received messages
@@ -337,7 +590,6 @@ class SlidingWindowRxControl(object):
                 self._msg_data = bytearray()
                 # Pop message information
                 msg_info.pop(0)
-        # Remove acknowledged data fragments
-        for _ in range(index+1):
-            fragments.pop(0)
+        # Remove assembled data fragments
+        del fragments[:n_assembled]
         return new_msgs
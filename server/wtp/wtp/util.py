@@ -1,13 +1,12 @@
 from __future__ import absolute_import, unicode_literals
 import struct, logging, functools
 from io import BytesIO
-from contextlib import contextmanager
-from collections import Container
+from binascii import hexlify, crc_hqx
 from traceback import print_exc
 from six import text_type
 
 from wtp.error import WTPError
-from wtp.constants import WTP_ERR_INVALID_CHECKSUM
+from wtp.constants import WTP_ERR_INVALID_CHECKSUM, WTP_SEQ_MAX, WTP_CHECKSUM_XOR, WTP_CHECKSUM_CRC16
 
 class EventTarget(object):
     """!
@@ -100,10 +99,46 @@ class DataStreamMixin(object):
         endian = kwargs.pop("endian", "<")
         # Write data
         self.write(struct.pack(endian+fmt, *args))
+    def read_varint(self):
+        """!
+        @brief Read an unsigned variable-length integer from stream.
+
+        The integer is stored in groups of 7 bits, least significant group
+        first; the highest bit of every byte but the last one is set.
+
+        @return Integer read, or None if the stream ends before the integer.
+        """
+        value = 0
+        shift = 0
+        while True:
+            byte = self.read(1)
+            if not byte:
+                return None
+            byte = ord(byte)
+            value |= (byte&0x7f)<<shift
+            if not byte&0x80:
+                return value
+            shift += 7
+    def write_varint(self, value):
+        """!
+        @brief Write an unsigned variable-length integer to stream.
+
+        @param value Integer to write.
+        """
+        self.write(varint_bytes(value))
+
+## Unbound BytesIO methods
+_bytes_io_write = BytesIO.write
+_bytes_io_read = BytesIO.read
 
 class ChecksumStream(BytesIO, DataStreamMixin):
     """!
     @brief Byte data stream with checksum functionality.
+
+    The checksum is accumulated over data written to or read from the stream
+    since "begin_checksum()". Checksum functions therefore take the running
+    checksum as an optional second argument, and return the checksum of no
+    data when called with an empty buffer alone.
     """
     def __init__(self, *args, **kwargs):
         """!
@@ -113,28 +148,50 @@ class ChecksumStream(BytesIO, DataStreamMixin):
         self._checksum_func = kwargs.pop("checksum_func", None)
         ## Checksum data type
         self._checksum_type = kwargs.pop("checksum_type", "<B")
-        ## Begin checksum position
-        self._begin_pos = 0
+        ## Running checksum (None when not calculating checksum)
+        self._checksum = None
         # Initialize base class
         super(ChecksumStream, self).__init__(*args, **kwargs)
+    def write(self, data):
+        """!
+        @brief Write data to stream and update running checksum.
+
+        @param data Data to write.
+        @return Number of bytes written.
+        """
+        checksum = self._checksum
+        if checksum is not None:
+            self._checksum = self._checksum_func(data, checksum)
+        return _bytes_io_write(self, data)
+    def read(self, size=-1):
+        """!
+        @brief Read data from stream and update running checksum.
+
+        @param size Number of bytes to read (All remaining data by default).
+        @return Data read.
+        """
+        data = _bytes_io_read(self, size)
+        checksum = self._checksum
+        if checksum is not None:
+            self._checksum = self._checksum_func(data, checksum)
+        return data
     def begin_checksum(self):
         """!
         @brief Begin checksum calculation.
         """
-        self._begin_pos = self.tell()
+        if self._checksum_func:
+            self._checksum = self._checksum_func(b"")
     def validate_checksum(self):
         """!
         @brief Validate checksum.
 
         @throws WTPError if checksum validation failed.
         """
-        end_pos = self.tell()
-        # Calculate checksum
-        calc_checksum = 0
         if not self._checksum_func:
             return
-        buffer_slice = self.getvalue()[self._begin_pos:end_pos]
-        calc_checksum = self._checksum_func(buffer_slice)
+        # Stop calculating checksum before reading it
+        calc_checksum = self._checksum
+        self._checksum = None
         # Read checksum
         read_checksum = self.read_data(self._checksum_type)
         # Throw checksum error if validation failed
@@ -144,268 +201,219 @@ class ChecksumStream(BytesIO, DataStreamMixin):
         """!
         @brief Write checksum to stream.
         """
-        end_pos = self.tell()
-        # Calculate checksum
         if not self._checksum_func:
             return
-        buffer_slice = self.getvalue()[self._begin_pos:end_pos]
-        checksum = self._checksum_func(buffer_slice)
+        # Stop calculating checksum before writing it
+        checksum = self._checksum
+        self._checksum = None
         # Write checksum to stream
         self.write(struct.pack(self._checksum_type, checksum))
 
-def xor_checksum(buf):
+## Minimum buffer size for folding XOR checksum over a big integer
+_XOR_FOLD_MIN = 64
+
+if hasattr(int, "from_bytes"):
+    def _bytes_to_int(buf):
+        """!
+        @brief Convert bytes to a non-negative integer.
+
+        @param buf Buffer.
+        @return Little-endian integer value of the buffer.
+        """
+        return int.from_bytes(buf, "little")
+else:
+    def _bytes_to_int(buf):
+        """!
+        @brief Convert bytes to a non-negative integer.
+
+        @param buf Buffer.
+        @return Big-endian integer value of the buffer.
+        """
+        return int(hexlify(buf), 16)
+
+def xor_checksum(buf, checksum=0):
     """!
     @brief Xor checksum function.
 
+    Buffers of at least _XOR_FOLD_MIN bytes are converted to one integer,
+    which is folded in half until one byte is left, so that the XOR is done
+    by a few big integer operations instead of a loop over bytes.
+
     @param buf Buffer to calculate checksum.
+    @param checksum Checksum of preceding data.
+    @return Checksum of preceding data and buffer.
     """
-    # Convert buffer to byte array
-    buf = bytearray(buf)
-    # Calculate checksum
-    checksum = 0
-    for byte in buf:
-        checksum ^= byte
-    return checksum
-
-def _check_radix(x, y):
+    n_bytes = len(buf)
+    # Small buffer; XOR bytes one by one
+    if n_bytes<_XOR_FOLD_MIN:
+        for byte in bytearray(buf):
+            checksum ^= byte
+        return checksum
+    # Fold integer, with width rounded up to a power of two, in half down to one byte
+    value = _bytes_to_int(buf)
+    width = 1<<(n_bytes*8-1).bit_length()
+    while width>8:
+        width >>= 1
+        value = (value>>width)^(value&((1<<width)-1))
+    return checksum^value
+
+def crc16_ccitt(buf, checksum=0):
     """!
-    @brief Check the radix of two cyclic integers or ranges.
+    @brief CRC-16/CCITT checksum function.
+
+    Same as "crc16_ccitt()" of the WISP firmware with no preload, which is
+    the CRC-16 of EPC Gen2 (Polynomial 0x1021, initial value 0xffff and
+    complemented result). The CRC is calculated by the table-driven
+    "binascii.crc_hqx()", which leaves out the complement.
 
-    @param x Cyclic integer or range.
-    @param y Cyclic integer or range.
-    @throws ValueError if radix of x and y mismatch.
+    @param buf Buffer to calculate checksum.
+    @param checksum Checksum of preceding data.
+    @return Checksum of preceding data and buffer.
     """
-    if x._radix!=y._radix:
-        raise ValueError("Radix mismatch.")
+    return crc_hqx(buf, checksum^0xffff)^0xffff
+
+## Checksum functions and data types of WTP checksum algorithms
+CHECKSUM_ALGOS = {
+    WTP_CHECKSUM_XOR: (xor_checksum, "<B"),
+    WTP_CHECKSUM_CRC16: (crc16_ccitt, "<H")
+}
 
-@functools.total_ordering
-class CyclicInt(object):
+class EPCHistory(object):
     """!
-    @brief Cyclic integer type.
+    @brief Recently seen EPCs of a WISP.
+
+    EPCs are kept in a fixed-size ring in order of arrival, together with a
+    set of the same EPCs, so looking up an EPC takes constant time.
     """
-    def __init__(self, value, radix):
+    __slots__ = ("_ring", "_pos", "_epcs")
+    def __init__(self, size):
         """!
-        @brief Cyclic integer type constructor.
+        @brief EPC history constructor.
 
-        @param value Value of the cyclic integer.
-        @param radix Radix of the cyclic integer.
+        @param size Number of EPCs kept.
         """
-        ## Value
-        self._value = value%radix
-        ## Radix
-        self._radix = radix
-    def __eq__(self, other):
+        ## Ring of recent EPCs
+        self._ring = [None]*size
+        ## Position of oldest EPC in ring
+        self._pos = 0
+        ## Recent EPCs
+        self._epcs = set()
+    def add(self, epc_data):
         """!
-        @brief Compare equality of cyclic integer with another value.
+        @brief Add an EPC unless it is seen recently.
 
-        @param other Other value.
-        @return Whether two cyclic integer is equal or not.
+        @param epc_data EPC data (Hashable).
+        @return Whether the EPC is new.
         """
-        # Cyclic integer
-        if isinstance(other, CyclicInt):
-            _check_radix(self, other)
-            return self._value==other._value
-        # Other types
-        else:
-            return self._value==int(other)
-    def __lt__(self, other):
-        """!
-        @brief Compare if a cyclic integer is smaller than another value.
+        epcs = self._epcs
+        if epc_data in epcs:
+            return False
+        # Replace oldest EPC
+        ring = self._ring
+        pos = self._pos
+        epcs.discard(ring[pos])
+        ring[pos] = epc_data
+        epcs.add(epc_data)
+        self._pos = (pos+1)%len(ring)
+        return True
+
+## Sequence number mask
+_SEQ_MASK = WTP_SEQ_MAX-1
+## Half of sequence number space
+_SEQ_HALF = WTP_SEQ_MAX//2
+
+def seq_add(x, n):
+    """!
+    @brief Add an offset to a sequence number.
 
-        You should enter a zero context before comparing two cyclic integers.
+    @param x Sequence number.
+    @param n Offset (May be negative).
+    @return Sequence number n bytes after x.
+    """
+    return (x+n)&_SEQ_MASK
 
-        @param other Other value.
-        @return Whether this cyclic integer is smaller than the other value.
-        """
-        # Cyclic integer
-        if isinstance(other, CyclicInt):
-            _check_radix(self, other)
-            # Get zero point context
-            zero = self._zero_ctx()
-            _check_radix(self, zero)
-            # Do comparison
-            rel_self = (self._value-zero._value)%self._radix
-            rel_other = (other._value-zero._value)%self._radix
-            return rel_self<rel_other
-        # Other types
-        else:
-            return self._value<int(other)
-    def __gt__(self, other):
-        """!
-        @brief Compare if a cyclic integer is bigger than another value.
+def seq_diff(x, y):
+    """!
+    @brief Get signed distance between two sequence numbers.
 
-        You should enter a zero context before comparing two cyclic integers.
+    (Serial number arithmetic as in RFC 1982)
 
-        @param other Other value.
-        @return Whether this cyclic integer is bigger than the other value.
-        """
-        # Cyclic integer
-        if isinstance(other, CyclicInt):
-            _check_radix(self, other)
-            # Get zero point context
-            zero = self._zero_ctx()
-            _check_radix(self, zero)
-            # Do comparison
-            rel_self = (self._value-zero._value)%self._radix
-            rel_other = (other._value-zero._value)%self._radix
-            return rel_self>rel_other
-        # Other types
-        else:
-            return self._value>int(other)
-    def __add__(self, other):
-        """!
-        @brief Add cyclic integer with another value.
+    @param x Sequence number.
+    @param y Sequence number.
+    @return Distance from y to x, between -WTP_SEQ_MAX/2 and WTP_SEQ_MAX/2-1.
+    """
+    return ((x-y+_SEQ_HALF)&_SEQ_MASK)-_SEQ_HALF
 
-        @param other Other value.
-        @return A cyclic sum of the two values.
-        """
-        # For cyclic integer, check its radix
-        if isinstance(other, CyclicInt):
-            _check_radix(self, other)
-        # Return new cyclic integer
-        return CyclicInt(self._value+int(other), self._radix)
-    def __radd__(self, other):
-        """!
-        @brief Add cyclic integer with another value.
+def seq_offset(x, zero):
+    """!
+    @brief Get offset of a sequence number after a zero point.
 
-        (Proxied to self.__add__)
+    @param x Sequence number.
+    @param zero Zero point sequence number.
+    @return Offset of x, between 0 and WTP_SEQ_MAX-1.
+    """
+    return (x-zero)&_SEQ_MASK
 
-        @param other Other value.
-        @return A cyclic sum of the two values.
-        """
-        return self.__add__(other)
-    def __sub__(self, other):
-        """!
-        @brief Subtract a value from self.
+def seq_lt(x, y):
+    """!
+    @brief Check if a sequence number is before another.
 
-        @param other Other value
-        @return A cyclic difference of the two values.
-        """
-        # For cyclic integer, check its radix
-        if isinstance(other, CyclicInt):
-            _check_radix(self, other)
-        # Return new cyclic integer
-        return CyclicInt(self._value-int(other), self._radix)
-    def __neg__(self):
-        """!
-        @brief Get supplementary cyclic integer.
+    (Serial number arithmetic as in RFC 1982)
 
-        @return Supplementary cyclic integer.
-        """
-        return CyclicInt(-self._value, self._radix)
-    def __int__(self):
-        """!
-        @brief Convert a cyclic integer to built-in integer.
+    @param x Sequence number.
+    @param y Sequence number.
+    @return Whether x is before y.
+    """
+    return 0<((y-x)&_SEQ_MASK)<_SEQ_HALF
 
-        @return Corresponding Python integer.
-        """
-        return self._value
-    def __index__(self):
-        """!
-        @brief Convert cyclic integer to collection index.
+def seq_le(x, y):
+    """!
+    @brief Check if a sequence number is before or equal to another.
 
-        (Proxied to self.__int__)
+    (Serial number arithmetic as in RFC 1982)
 
-        @return Corresponding Python integer.
-        """
-        return self.__int__()
-    def __repr__(self):
-        """!
-        @brief Representation of cyclic integer.
+    @param x Sequence number.
+    @param y Sequence number.
+    @return Whether x is before or equal to y.
+    """
+    return ((y-x)&_SEQ_MASK)<_SEQ_HALF
 
-        @return A readable representation of the cyclic integer.
-        """
-        return "CyclicInt(%d, %d)" % (self._value, self._radix)
-    @classmethod
-    def _zero_ctx(cls):
-        """!
-        @brief Get current zero point context.
+def seq_in_window(begin, size, window_begin, window_size):
+    """!
+    @brief Check if a sequence number range is within a window.
 
-        @return Current zero point context.
-        @throws Exception if not in a zero point context.
-        """
-        if cls._zero_ctx_stack:
-            return cls._zero_ctx_stack[-1]
-        # Not in zero point context
-        else:
-            raise Exception("Not in a zero point context.")
-    @contextmanager
-    def as_zero(self):
-        """!
-        @brief Enter a context with this cyclic integer as zero point.
+    @param begin Begin of the range.
+    @param size Size of the range.
+    @param window_begin Begin of the window.
+    @param window_size Size of the window.
+    @return Whether the range is within the window.
+    """
+    return ((begin-window_begin)&_SEQ_MASK)+size<=window_size
 
-        (The old zero context will be saved in a zero context stack)
-        """
-        # Add to contexts stack
-        self._zero_ctx_stack.append(self)
-        # Enter context
-        yield
-        # Remove from stack
-        self._zero_ctx_stack.pop()
-    ## Zero point contexts stack
-    _zero_ctx_stack = []
-
-class CyclicRange(object):
+def seq_resolve(low, base):
     """!
-    @brief Cyclic range type.
-    """
-    def __init__(self, x, radix, y=None, size=None):
-        """!
-        @brief Cyclic range type constructor.
+    @brief Resolve a sequence number from its lowest 8 bits.
 
-        @param x Begin of the range.
-        @param radix Radix of the cyclic range.
-        @param y End of the range.
-        @param size Size of the range.
-        """
-        # Range end
-        if y==None and size==None:
-            raise ValueError("Either y or size must be given to construct cyclic range.")
-        y = y if y else x+size
-        # Range bounds
-        self._x = int(x)%radix
-        self._y = int(y)%radix
-        # Radix
-        self._radix = radix
-    def __eq__(self, other):
-        """!
-        @brief Check if other value equals with this cyclic range.
+    @param low Lowest 8 bits of the sequence number.
+    @param base Base sequence number (The resolved sequence number is between
+        128 bytes before and 127 bytes after it).
+    @return Resolved sequence number.
+    """
+    return (base+((low-base+0x80)&0xff)-0x80)&_SEQ_MASK
 
-        @param other Other value.
-        @return Whether two values equal or not.
-        """
-        if isinstance(other, CyclicRange):
-            _check_radix(self, other)
-            return self._x==other._x and self._y==other._y
-        else:
-            return False
-    def __contains__(self, other):
-        """!
-        @brief Check if given value, cyclic integer or cyclic range is within this cyclic range.
+def varint_bytes(value):
+    """!
+    @brief Encode an unsigned variable-length integer.
 
-        @param other Other value.
-        @return Whether the other value is in this cyclic range.
-        """
-        # Cyclic range and cyclic integer
-        if isinstance(other, (CyclicRange, CyclicInt)):
-            # Check radix
-            _check_radix(self, other)
-        # Radix
-        radix = self._radix
-        # Range boundaries
-        self_x = CyclicInt(self._x, radix)
-        self_y = CyclicInt(self._y, radix)
-        # Cyclic range
-        if isinstance(other, CyclicRange):
-            # Range boundaries
-            other_x = CyclicInt(other._x, radix)
-            other_y = CyclicInt(other._y, radix)
-            # Do comparison
-            with self_x.as_zero():
-                return other_y>=other_x and self_y>=other_y
-        # TODO: Cyclic integer or other values
-        else:
-            pass
+    @param value Integer to encode.
+    @return Encoded integer.
+    """
+    data = bytearray()
+    while value>=0x80:
+        data.append((value&0x7f)|0x80)
+        value >>= 7
+    data.append(value)
+    return bytes(data)
 
 def force_print_exc(func):
     """!